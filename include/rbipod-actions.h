@@ -7,17 +7,27 @@
 // DELAYED ACTION MANAGEMENT
 // =============================================================================
 
-// Delayed action operations
-void rb_ipod_add_delayed_action(RbIpodDb *db, RbIpodDelayedActionType type, gpointer data);
-void rb_ipod_remove_delayed_action(RbIpodDb *db, RbIpodDelayedActionType type, gpointer data);
-void rb_ipod_set_name_delayed_action(RbIpodDb *db, const gchar *name);
-void rb_ipod_add_track_delayed_action(RbIpodDb *db, Itdb_Track *track);
-void rb_ipod_remove_track_delayed_action(RbIpodDb *db, Itdb_Track *track);
+// Queueing: safe from any thread (db->mutex), never touches db->itdb.
+// Each returns the number of actions now waiting.
+guint rb_ipod_add_delayed_action(RbIpodDb *db, RbIpodDelayedAction *action);
+guint rb_ipod_set_name_delayed_action(RbIpodDb *db, const gchar *name);
+guint rb_ipod_add_track_delayed_action(RbIpodDb *db, Itdb_Track *track, GList *playlists);
+guint rb_ipod_remove_track_delayed_action(RbIpodDb *db, Itdb_Track *track);
+guint rb_ipod_update_track_delayed_action(RbIpodDb *db, Itdb_Track *track, const RbIpodTrackUpdate *update);
 
-// Action processing
+// Drops the queued actions of this type on data (a track or a name; NULL
+// matches any). The track of a dropped ADD_TRACK is freed and leaves the
+// content index, along with any later action queued on it. Owner thread.
+// Returns the number dropped.
+guint rb_ipod_remove_delayed_action(RbIpodDb *db, RbIpodDelayedActionType type, gpointer data);
+
+// Action processing (owner thread, no save running): takes the whole log
+// under one lock, coalesces it, then applies it as a batch
 gboolean rb_ipod_db_process_delayed_actions(RbIpodDb *db);
 
 // Action cleanup
 void free_delayed_action(RbIpodDelayedAction *action);
+RbIpodTrackUpdate* rb_ipod_track_update_new(void);
+void rb_ipod_track_update_free(RbIpodTrackUpdate *update);
 
-#endif // RBIPOD_ACTIONS_H
\ No newline at end of file
+#endif // RBIPOD_ACTIONS_H
@@ -0,0 +1,21 @@
+#ifndef RBIPOD_ALLOCATOR_H
+#define RBIPOD_ALLOCATOR_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// IPOD FILENAME ALLOCATOR
+// =============================================================================
+
+// Allocator creation and cleanup (scans iPod_Control/Music/Fxx once)
+RbIpodFileAllocator* rb_ipod_file_allocator_new(const char *mount_point);
+void rb_ipod_file_allocator_free(RbIpodFileAllocator *allocator);
+
+// Name allocation (thread-safe)
+char* rb_ipod_file_allocator_next(RbIpodFileAllocator *allocator, const char *original_filename);
+void rb_ipod_file_allocator_release(RbIpodFileAllocator *allocator, const char *ipod_path);
+
+// Statistics
+guint rb_ipod_file_allocator_get_file_count(RbIpodFileAllocator *allocator);
+
+#endif // RBIPOD_ALLOCATOR_H
@@ -0,0 +1,46 @@
+#ifndef RBIPOD_ARTCACHE_H
+#define RBIPOD_ARTCACHE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// ARTWORK DEDUPLICATION CACHE
+// =============================================================================
+
+// Cache creation and cleanup (one per RbIpodDb session). Covers are scaled
+// to the largest cover art format of device (NULL: kept at full size).
+RbIpodArtworkCache* rb_ipod_artwork_cache_new(const Itdb_Device *device);
+void rb_ipod_artwork_cache_free(RbIpodArtworkCache *cache);
+
+// Largest cover art format of device, from its generation. FALSE (and 0x0)
+// for models without artwork or when the model is unknown.
+gboolean rb_ipod_artwork_target_size(const Itdb_Device *device, int *width, int *height);
+
+// Gives track the cover in meta->artwork_data. Identical images (same content
+// hash) are decoded into a GdkPixbuf once and handed to libgpod as pixels;
+// later tracks receive a duplicate of that artwork. Thread-safe: concurrent
+// workers asking for an image being decoded wait for that single decode.
+gboolean rb_ipod_artwork_cache_apply(RbIpodArtworkCache *cache, Itdb_Track *track,
+                                     const AudioMetadata *meta);
+
+// Decodes an image already reduced to fit max_width x max_height (JPEG via
+// DCT scaling, other formats via one bilinear pass). <= 0 keeps full size.
+GdkPixbuf* rb_ipod_artwork_decode_scaled(const guchar *data, gsize size, int max_width, int max_height);
+
+// Decoded images are kept in LRU order within ARTWORK_CACHE_MAX_BYTES
+void rb_ipod_artwork_cache_set_max_bytes(RbIpodArtworkCache *cache, gsize max_bytes);
+
+// Tracks keep their cover pixels until the database is written. Once the
+// images handed out exceed ARTWORK_MEMORY_BUDGET, new covers are written to a
+// temporary content-addressed PNG store and given to libgpod as files, which
+// it only loads during itdb_write(). The store is removed by cache_free.
+void rb_ipod_artwork_cache_set_memory_budget(RbIpodArtworkCache *cache, gsize budget);
+
+// Statistics
+guint rb_ipod_artwork_cache_get_image_count(RbIpodArtworkCache *cache);
+gsize rb_ipod_artwork_cache_get_pixel_bytes(RbIpodArtworkCache *cache);
+gsize rb_ipod_artwork_cache_get_retained_bytes(RbIpodArtworkCache *cache);
+
+#endif // RBIPOD_ARTCACHE_H
@@ -14,13 +14,17 @@ int command_auto_mount(void);
 
 // Sync commands
 int command_sync_directory(const char *mount_point, const char *sync_dir);
-int command_sync_file(const char *mount_point, const char *file_path);
+int command_sync_files(const char *mount_point, const char *const *file_paths, int num_files);
 int command_sync_folder_filtered(const char *mount_point, const char *folder_path, const char *mediatype_str);
 
 // Info commands
 int command_list_tracks(const char *mount_point);
 int command_show_info(const char *mount_point);
 
+// Trigram search over title/artist/album/podcast fields (mediatype 0 = any,
+// limit 0 = no limit)
+int command_search(const char *mount_point, const char *query, guint32 mediatype, guint limit);
+
 // Reset commands
 int command_reset_media_type(const char *mount_point, const char *media_type_str);
 int command_reset_all(const char *mount_point);
@@ -17,5 +17,56 @@
 // iPod filesystem limits (based on Rhythmbox's constants)
 #define IPOD_MAX_PATH_LEN 56
 #define MAX_TRIES 5
+#define IPOD_MUSIC_DIR_COUNT 50
+
+// Source tree walker
+#define WALKER_MAX_THREADS 16
+
+// Sync pipeline
+#define PIPELINE_MAX_JOBS 32
+#define PIPELINE_WRITE_QUEUE_DEPTH 8
+#define PIPELINE_CHECKPOINT_TRACKS 500   // Tracks committed between background saves
+#define PIPELINE_CHECKPOINT_SECONDS 300  // ...or seconds, whichever comes first
+#define PIPELINE_CHECKPOINT_MAX_OVERHEAD 0.05 // Max share of sync time spent in itdb_write
+
+// Queued database actions applied by the owner in one batch
+#define ACTION_BATCH_SIZE 256
+
+// Bulk removal (reset): file deletions issued concurrently
+#define UNLINK_MAX_THREADS 8
+
+// Device copies
+#define COPY_BUFFER_SIZE (1024 * 1024)
+#define COPY_WINDOW_SIZE (8 * 1024 * 1024)
+
+// Native container probing
+#define PROBE_SYNC_SEARCH_LIMIT (64 * 1024)   // Bytes scanned for the first MPEG/ADTS frame
+#define PROBE_ADTS_SAMPLE_FRAMES 64           // ADTS frames averaged for the duration estimate
+#define PROBE_MAX_PICTURE_SIZE (16 * 1024 * 1024)
+#define MP3_DECODER_DELAY 529                 // Samples added by the MP3 decoder itself
+#define RB_IPOD_MEDIATYPE_AUTO 0              // Media type taken from the file when not forced
+
+// Folder cover images (cover.jpg, folder.jpg, ...) held in memory at once
+#define FOLDER_COVER_LOADED_MAX 32
+
+// Decoded artwork kept for reuse across tracks of the same album (LRU)
+#define ARTWORK_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+// Decoded cover pixels that tracks may hold until itdb_write(); beyond this,
+// prepared covers are spilled to temporary files libgpod reads at write time
+#define ARTWORK_MEMORY_BUDGET (128 * 1024 * 1024)
+
+// Prepared covers kept across runs (~/.cache/PROGRAM_NAME), per device format
+#define THUMBNAIL_CACHE_DIRNAME "thumbnails"
+#define THUMBNAIL_CACHE_MAX_BYTES (512LL * 1024 * 1024)
+
+// Host metadata cache (~/.cache/PROGRAM_NAME)
+#define METADATA_CACHE_FILENAME "metadata-cache.bin"
+#define METADATA_CACHE_VERSION 2
+
+// Device search index (~/.cache/PROGRAM_NAME, one file per mount point)
+#define SEARCH_INDEX_PREFIX "search-index"
+#define SEARCH_INDEX_VERSION 2
+#define SEARCH_DEFAULT_LIMIT 50
 
 #endif // RBIPOD_CONFIG_H
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef RBIPOD_COPY_H
+#define RBIPOD_COPY_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// FILE COPY ENGINE
+// =============================================================================
+
+// Copies source_path to dest_path (created/truncated). RB_IPOD_COPY_AUTO
+// tries copy_file_range, then sendfile, then buffered I/O; the strategy
+// that actually moved the data is returned in used_strategy.
+gboolean rb_ipod_copy_file(const char *source_path, const char *dest_path,
+                           RbIpodCopyStrategy strategy, RbIpodCopyStrategy *used_strategy);
+
+const char* rb_ipod_copy_strategy_name(RbIpodCopyStrategy strategy);
+
+#endif // RBIPOD_COPY_H
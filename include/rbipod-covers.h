@@ -0,0 +1,31 @@
+#ifndef RBIPOD_COVERS_H
+#define RBIPOD_COVERS_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// FOLDER COVER DISCOVERY
+// =============================================================================
+
+// Cover image of each source directory (cover.jpg, folder.jpg, front.png...),
+// resolved once per directory and shared by all its files. All calls are
+// thread-safe (walker threads record, probe workers apply).
+RbIpodFolderCovers* rb_ipod_folder_covers_new(void);
+void rb_ipod_folder_covers_free(RbIpodFolderCovers *covers);
+
+// Priority of a file name as a folder cover, 0 if it is not one (lower wins)
+int rb_ipod_folder_cover_rank(const char *filename);
+
+// Walker side: best candidate found while listing dir_path (NULL if none),
+// so applying it later needs no extra directory listing
+void rb_ipod_folder_covers_record(RbIpodFolderCovers *covers, const char *dir_path,
+                                  const char *cover_name);
+
+// TRUE if the directory of file_path has a cover image
+gboolean rb_ipod_folder_covers_has(RbIpodFolderCovers *covers, const char *file_path);
+
+// Copies the directory cover into meta->artwork_data if meta has none
+gboolean rb_ipod_folder_covers_apply(RbIpodFolderCovers *covers, const char *file_path,
+                                     AudioMetadata *meta);
+
+#endif // RBIPOD_COVERS_H
@@ -15,6 +15,29 @@ void rb_ipod_db_free(RbIpodDb *db);
 gboolean rb_ipod_db_save_sync(RbIpodDb *db);
 gboolean rb_ipod_db_save_async(RbIpodDb *db);
 
+// Background save completion (owner thread). poll returns at once while the
+// save runs; both apply the queued actions once it has finished and return
+// FALSE only if that save failed. wait also applies them when no save runs.
+gboolean rb_ipod_db_poll_save(RbIpodDb *db);
+gboolean rb_ipod_db_wait_for_save(RbIpodDb *db);
+
+// Mutations (owner thread). Queued in the action log and applied in
+// batches of ACTION_BATCH_SIZE, before a save, or by wait_for_save.
+// Adds go to the master playlist (and Podcasts) plus the given playlists;
+// removal leaves the file alone; set_name renames the iPod.
+void rb_ipod_db_add_track(RbIpodDb *db, Itdb_Track *track);
+void rb_ipod_db_add_track_with_playlists(RbIpodDb *db, Itdb_Track *track, GList *playlists);
+void rb_ipod_db_remove_track(RbIpodDb *db, Itdb_Track *track);
+void rb_ipod_db_update_track(RbIpodDb *db, Itdb_Track *track, const RbIpodTrackUpdate *update);
+void rb_ipod_db_set_name(RbIpodDb *db, const gchar *name);
+
+// Bulk removal (set of Itdb_Track*): each playlist and the track list are
+// rebuilt in a single pass. Returns the number of tracks removed.
+guint rb_ipod_db_remove_tracks(RbIpodDb *db, GHashTable *tracks);
+
+// Replaces the database with an empty one (master playlist only)
+gboolean rb_ipod_db_reset(RbIpodDb *db);
+
 // Database backup and recovery
 gboolean create_database_backup(RbIpodDb *db);
 gboolean restore_database_backup(RbIpodDb *db);
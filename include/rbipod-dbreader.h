@@ -0,0 +1,50 @@
+#ifndef RBIPOD_DBREADER_H
+#define RBIPOD_DBREADER_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// READ-ONLY ITUNESDB READER
+// =============================================================================
+
+// Maps iPod_Control/iTunes/iTunesDB read-only and walks the mhbd/mhsd/mhlt/
+// mhit/mhlp/mhyp/mhod records in place: no Itdb_Track, no ArtworkDB, no
+// allocation per record. For commands that only report on the device.
+// Returns NULL when the file is missing, compressed (iTunesCDB) or does not
+// parse: callers fall back to rb_ipod_db_new().
+RbIpodDbReader* rb_ipod_dbreader_open(const char *mount_point);
+void rb_ipod_dbreader_close(RbIpodDbReader *reader);
+
+// Counts from the list headers
+guint rb_ipod_dbreader_track_count(const RbIpodDbReader *reader);
+guint rb_ipod_dbreader_playlist_count(const RbIpodDbReader *reader);
+
+// Streams the records in database order. A record points into the mapping:
+// a copy stays usable until rb_ipod_dbreader_close(). Returning FALSE stops
+// the walk.
+typedef gboolean (*RbIpodDbTrackFunc)(const RbIpodDbTrackRecord *record, gpointer user_data);
+typedef gboolean (*RbIpodDbPlaylistFunc)(const RbIpodDbPlaylistRecord *record, gpointer user_data);
+void rb_ipod_dbreader_foreach_track(const RbIpodDbReader *reader, RbIpodDbTrackFunc func, gpointer user_data);
+void rb_ipod_dbreader_foreach_playlist(const RbIpodDbReader *reader, RbIpodDbPlaylistFunc func,
+                                       gpointer user_data);
+
+// String mhod types
+#define RB_IPOD_MHOD_TITLE 1
+#define RB_IPOD_MHOD_PATH 2
+#define RB_IPOD_MHOD_ALBUM 3
+#define RB_IPOD_MHOD_ARTIST 4
+#define RB_IPOD_MHOD_GENRE 5
+#define RB_IPOD_MHOD_FILETYPE 6
+#define RB_IPOD_MHOD_SUBTITLE 18
+#define RB_IPOD_MHOD_ALBUMARTIST 22
+
+// String mhods of a record (RB_IPOD_MHOD_*). The copy is UTF-8 and must be
+// freed; NULL when absent.
+char* rb_ipod_dbreader_track_string(const RbIpodDbTrackRecord *record, guint32 mhod_type);
+char* rb_ipod_dbreader_playlist_name(const RbIpodDbPlaylistRecord *record);
+
+// Case-insensitive ASCII comparison done in the mapping, without a copy
+gboolean rb_ipod_dbreader_track_string_is(const RbIpodDbTrackRecord *record, guint32 mhod_type,
+                                          const char *ascii);
+
+#endif // RBIPOD_DBREADER_H
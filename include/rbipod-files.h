@@ -10,8 +10,6 @@
 // iPod file naming
 char* build_ipod_dir_name(const char *mount_point);
 char* utf8_to_ascii(const char *utf8_string);
-char* generate_ipod_filename(const char *mount_point, const char *original_filename);
-void initialize_ipod_file_counter(const char *mount_point);
 
 // File operations
 gboolean ensure_ipod_directory_structure(const char *mount_point);
@@ -21,6 +19,16 @@ gboolean is_supported_audio_file(const char *filename);
 // Track creation and management
 Itdb_Track* create_ipod_track_from_metadata(const AudioMetadata *meta, const char *ipod_path, const char *media_type);
 gboolean add_file_to_ipod(RbIpodDb *db, const char *file_path);
+gboolean add_source_file_to_ipod(RbIpodDb *db, const char *file_path,
+                                 gint64 file_size, gint64 source_mtime);
+
+// Stages shared by add_source_file_to_ipod and the sync pipeline
+AudioMetadata* probe_source_file(const char *file_path, gint64 file_size, guint32 mediatype);
+void commit_track_to_ipod(RbIpodDb *db, Itdb_Track *track, gint32 pos);
+void remove_track_from_ipod(RbIpodDb *db, Itdb_Track *track);
+void update_track_on_ipod(RbIpodDb *db, Itdb_Track *track, const RbIpodTrackUpdate *update);
+Itdb_Playlist* ensure_podcasts_playlist(RbIpodDb *db);
+guint remove_tracks_from_ipod(RbIpodDb *db, GHashTable *tracks);
 
 // Audio metadata extraction
 gboolean extract_audio_duration(const char *file_path, int *duration, int *bitrate);
@@ -32,10 +40,11 @@ gboolean extract_artwork_ffmpeg(const char *file_path, AudioMetadata *meta);
 gboolean extract_podcast_specific_metadata(const char *file_path, AudioMetadata *meta);
 gboolean probe_audio_file(const char *file_path, AudioMetadata *meta);
 
-// TagLib native artwork extraction (C++ functions)
+// TagLib native extraction (C++ functions)
 #ifdef __cplusplus
 extern "C" {
 #endif
+gboolean extract_audio_metadata_unified(const char *file_path, AudioMetadata *meta);
 gboolean extract_artwork_taglib_native(const char *file_path, AudioMetadata *meta);
 gboolean extract_artwork_mp3_id3v2(const char *file_path, AudioMetadata *meta);
 gboolean extract_artwork_flac(const char *file_path, AudioMetadata *meta);
@@ -23,4 +23,10 @@ gboolean is_ipod_mounted(const char *mount_point);
 // Device detection
 char* find_ipod_device(void);
 
+// Bulk removal. Unlinks paths from num_threads workers (0 = default) and
+// returns the number removed; clear_music_dirs empties and removes every
+// iPod_Control/Music/Fxx directory.
+guint rb_ipod_unlink_files(GPtrArray *paths, guint num_threads);
+guint rb_ipod_clear_music_dirs(const char *mount_point, guint num_threads);
+
 #endif // RBIPOD_FILESYSTEM_H
\ No newline at end of file
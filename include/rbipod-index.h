@@ -0,0 +1,35 @@
+#ifndef RBIPOD_INDEX_H
+#define RBIPOD_INDEX_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// ON-DEVICE CONTENT INDEX (INCREMENTAL SYNC)
+// =============================================================================
+
+// Index creation and cleanup
+RbIpodContentIndex* rb_ipod_content_index_new(Itdb_iTunesDB *itdb, const char *mount_point);
+void rb_ipod_content_index_free(RbIpodContentIndex *index);
+
+// Lookups performed before any probing or copying
+Itdb_Track* rb_ipod_content_index_lookup_source(RbIpodContentIndex *index, const char *source_path,
+                                                gint64 size, gint64 mtime);
+Itdb_Track* rb_ipod_content_index_lookup_identity(RbIpodContentIndex *index, const char *title,
+                                                  const char *artist, gint64 size, guint32 mediatype);
+
+// Index maintenance
+void rb_ipod_content_index_add_track(RbIpodContentIndex *index, Itdb_Track *track);
+void rb_ipod_content_index_remove_track(RbIpodContentIndex *index, Itdb_Track *track);
+void rb_ipod_content_index_record_source(RbIpodContentIndex *index, const char *source_path,
+                                         gint64 size, gint64 mtime, Itdb_Track *track);
+
+// Sidecar persistence (host side)
+gboolean rb_ipod_content_index_save(RbIpodContentIndex *index, Itdb_iTunesDB *itdb);
+
+// iPod path helpers
+char* rb_ipod_normalize_ipod_path(const char *ipod_path);
+
+// Host file (~/.cache/PROGRAM_NAME/<prefix>-<device key>.tsv) kept per device
+char* rb_ipod_device_cache_path(Itdb_iTunesDB *itdb, const char *mount_point, const char *prefix);
+
+#endif // RBIPOD_INDEX_H
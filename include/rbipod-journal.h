@@ -0,0 +1,32 @@
+#ifndef RBIPOD_JOURNAL_H
+#define RBIPOD_JOURNAL_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// SYNC JOURNAL (CRASH RECOVERY)
+// =============================================================================
+
+// Host-side list of device files handed to the copy stage whose track is not
+// yet in a written iTunesDB. Survives a cable pull or a killed process, so
+// the next sync can adopt complete copies and delete partial ones. Owner
+// thread only.
+RbIpodSyncJournal* rb_ipod_sync_journal_open(Itdb_iTunesDB *itdb, const char *mount_point);
+void rb_ipod_sync_journal_free(RbIpodSyncJournal *journal);
+
+// Before the copy of source_path to ipod_path (absolute) starts; flushed at once
+void rb_ipod_sync_journal_record(RbIpodSyncJournal *journal, const char *ipod_path,
+                                 const char *source_path, gint64 size, gint64 mtime,
+                                 guint32 mediatype);
+
+// The copy failed and its file was removed
+void rb_ipod_sync_journal_forget(RbIpodSyncJournal *journal, const char *ipod_path);
+
+// After a successful itdb_write: drops the files that database references
+void rb_ipod_sync_journal_commit(RbIpodSyncJournal *journal, Itdb_iTunesDB *itdb);
+
+// Adopts the complete files left by an interrupted run (probed again, added
+// without copying) and deletes the rest. Returns the number adopted.
+guint rb_ipod_sync_journal_recover(RbIpodDb *db);
+
+#endif // RBIPOD_JOURNAL_H
@@ -0,0 +1,35 @@
+#ifndef RBIPOD_METACACHE_H
+#define RBIPOD_METACACHE_H
+
+#include <sys/stat.h>
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// HOST METADATA CACHE
+// =============================================================================
+
+// Probe results of previous runs, keyed by source path and validated by
+// (dev, inode, size, mtime_ns) plus the requested media type and whether
+// external tools were allowed (g_sync_ctx.allow_external_tools). The cache file
+// is mapped read-only at open; artwork is stored once per content hash.
+// path NULL selects ~/.cache/PROGRAM_NAME/METADATA_CACHE_FILENAME.
+RbIpodMetadataCache* rb_ipod_metadata_cache_open(const char *path);
+void rb_ipod_metadata_cache_free(RbIpodMetadataCache *cache);
+
+// Lookups and stores are thread-safe (called from the probe workers).
+// lookup fills an empty meta and returns FALSE on any mismatch.
+gboolean rb_ipod_metadata_cache_lookup(RbIpodMetadataCache *cache, const char *source_path,
+                                       const struct stat *source_stat, guint32 mediatype,
+                                       AudioMetadata *meta);
+void rb_ipod_metadata_cache_store(RbIpodMetadataCache *cache, const char *source_path,
+                                  const struct stat *source_stat, guint32 mediatype,
+                                  const AudioMetadata *meta);
+
+// Rewrites the cache file (temp file + rename) if anything was stored,
+// dropping entries whose source file is gone and unreferenced artwork
+gboolean rb_ipod_metadata_cache_save(RbIpodMetadataCache *cache);
+
+guint rb_ipod_metadata_cache_size(RbIpodMetadataCache *cache);
+
+#endif // RBIPOD_METACACHE_H
@@ -15,6 +15,9 @@ void free_metadata(AudioMetadata *meta);
 guint32 parse_media_type_string(const char *media_type_str);
 const char* get_media_type_name(guint32 mediatype);
 void parse_mediatype_arg(int argc, char *argv[], int start_index, char **mediatype_str);
+void parse_jobs_arg(int argc, char *argv[], int start_index, guint *num_jobs);
+void parse_uint_arg(int argc, char *argv[], int start_index, const char *option, guint *value);
+gboolean parse_flag_arg(int argc, char *argv[], int start_index, const char *flag);
 
 // Podcast-specific metadata utilities
 void set_podcast_metadata(AudioMetadata *meta, const char *podcast_name, int season, int episode, 
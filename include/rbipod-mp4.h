@@ -0,0 +1,25 @@
+#ifndef RBIPOD_MP4_H
+#define RBIPOD_MP4_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// NATIVE MP4 / M4A ATOM PARSER
+// =============================================================================
+
+// Maps the file read-only and walks moov (mvhd, trak/mdia/mdhd+hdlr,
+// udta/chpl, udta/meta/ilst). mdat is skipped by size and never touched.
+// All slices in the result point into the mapping: they are valid until
+// rb_ipod_mp4_close().
+RbIpodMp4File* rb_ipod_mp4_open(const char *file_path);
+void rb_ipod_mp4_close(RbIpodMp4File *mp4);
+
+// Copies the parsed fields into meta (empty fields only). The cover is the
+// only payload copied, straight from the mapping.
+gboolean rb_ipod_mp4_fill_metadata(const RbIpodMp4File *mp4, AudioMetadata *meta);
+
+// iTunes media kind ("stik"), podcast flag and video track -> ITDB_MEDIATYPE_*
+// (0 when the file does not say)
+guint32 rb_ipod_mp4_mediatype(const RbIpodMp4File *mp4);
+
+#endif // RBIPOD_MP4_H
@@ -0,0 +1,16 @@
+#ifndef RBIPOD_PIPELINE_H
+#define RBIPOD_PIPELINE_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// SYNC PIPELINE (PROBE -> COPY -> DATABASE COMMIT)
+// =============================================================================
+
+// Runs a manifest through the staged pipeline. num_jobs probe workers
+// (0 = one per CPU) feed a single device writer; the calling thread owns
+// the database and applies every itdb change.
+gboolean rb_ipod_sync_pipeline_run(RbIpodDb *db, const RbIpodManifest *manifest,
+                                   guint32 mediatype, guint num_jobs);
+
+#endif // RBIPOD_PIPELINE_H
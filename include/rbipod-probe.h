@@ -0,0 +1,24 @@
+#ifndef RBIPOD_PROBE_H
+#define RBIPOD_PROBE_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// NATIVE CONTAINER PROBING
+// =============================================================================
+
+// Duration (seconds) and bitrate (kbps) read from container headers:
+// RIFF/WAVE, AIFF/AIFC, MPEG audio (Xing/Info/VBRI or CBR), ADTS AAC and
+// MP4 (mvhd). No external process is spawned.
+gboolean rb_ipod_probe_audio_properties(const char *file_path, int *duration, int *bitrate);
+
+// MP3 scan over a read-only mapping: Xing/Info/VBRI header when present,
+// otherwise a walk over every frame header (no decoding). Also returns the
+// LAME encoder delay/padding used for gapless playback.
+gboolean rb_ipod_probe_mp3(const char *file_path, RbIpodMp3Info *info);
+
+// First picture of a leading ID3v2 tag (MP3 and ADTS AAC files TagLib does
+// not open). Fills artwork_data/artwork_size/artwork_format.
+gboolean rb_ipod_probe_embedded_picture(const char *file_path, AudioMetadata *meta);
+
+#endif // RBIPOD_PROBE_H
@@ -0,0 +1,31 @@
+#ifndef RBIPOD_SEARCH_H
+#define RBIPOD_SEARCH_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// DEVICE SEARCH INDEX
+// =============================================================================
+
+// Trigram index over the title, artist, album, album artist and podcast
+// subtitle of every track on the device. Built from the mapped iTunesDB
+// (libgpod for a compressed iTunesCDB) and cached in ~/.cache/PROGRAM_NAME,
+// keyed on the database file's size and mtime; a cached index is mapped and
+// queried in place. cache_path NULL selects the default file for the mount
+// point. Read-only: never loads the database for writing.
+RbIpodSearchIndex* rb_ipod_search_index_open(const char *mount_point, const char *cache_path);
+void rb_ipod_search_index_free(RbIpodSearchIndex *index);
+
+// TRUE when the index was mapped from the cache instead of rebuilt
+gboolean rb_ipod_search_index_from_cache(const RbIpodSearchIndex *index);
+guint rb_ipod_search_index_size(const RbIpodSearchIndex *index);
+
+// Every whitespace-separated term must occur in one of the indexed fields
+// (case- and accent-insensitive). mediatype 0 matches any, limit 0 means no
+// limit. Appends the matching entry ids (guint32, database order) to hits
+// and returns how many were appended.
+guint rb_ipod_search_index_query(const RbIpodSearchIndex *index, const char *query,
+                                 guint32 mediatype, guint limit, GArray *hits);
+gboolean rb_ipod_search_index_entry(const RbIpodSearchIndex *index, guint32 id, RbIpodSearchEntry *entry);
+
+#endif // RBIPOD_SEARCH_H
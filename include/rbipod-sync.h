@@ -7,13 +7,10 @@
 // SYNCHRONIZATION OPERATIONS
 // =============================================================================
 
-// Directory scanning
-int count_audio_files_recursive(const char *dir_path);
-
-// Synchronization functions
-gboolean sync_directory_recursive(RbIpodDb *db, const char *dir_path, int *current_file, int total_files);
+// Synchronization functions (manifests come from rb_ipod_walk_directory)
+gboolean sync_manifest(RbIpodDb *db, const RbIpodManifest *manifest);
 gboolean sync_single_file(RbIpodDb *db, const char *file_path);
-gboolean sync_folder_filtered(RbIpodDb *db, const char *dir_path, guint32 filter_mediatype, int *current_file, int total_files);
+gboolean sync_folder_filtered(RbIpodDb *db, const RbIpodManifest *manifest, guint32 filter_mediatype);
 
 // Signal handling
 void setup_signal_handlers(void);
@@ -0,0 +1,29 @@
+#ifndef RBIPOD_THUMBCACHE_H
+#define RBIPOD_THUMBCACHE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// HOST THUMBNAIL CACHE
+// =============================================================================
+
+// Prepared (decoded and scaled) covers stored as raw pixels under
+// base_dir/format_key, one file per source image content hash. format_key
+// names the device generation and target size so devices of the same model
+// share entries. base_dir NULL selects ~/.cache/PROGRAM_NAME/THUMBNAIL_CACHE_DIRNAME.
+RbIpodThumbnailCache* rb_ipod_thumbnail_cache_open(const char *base_dir, const char *format_key);
+
+// Evicts least recently used files beyond the size limit, then frees
+void rb_ipod_thumbnail_cache_free(RbIpodThumbnailCache *cache);
+
+// Thread-safe. lookup returns a new reference or NULL; no image decoding.
+GdkPixbuf* rb_ipod_thumbnail_cache_lookup(RbIpodThumbnailCache *cache, guint64 hash, gsize source_size);
+void rb_ipod_thumbnail_cache_store(RbIpodThumbnailCache *cache, guint64 hash, gsize source_size,
+                                   GdkPixbuf *pixbuf);
+
+// Size limit applied at free (default THUMBNAIL_CACHE_MAX_BYTES)
+void rb_ipod_thumbnail_cache_set_max_bytes(RbIpodThumbnailCache *cache, gint64 max_bytes);
+
+#endif // RBIPOD_THUMBCACHE_H
@@ -0,0 +1,39 @@
+#ifndef RBIPOD_TRACKINDEX_H
+#define RBIPOD_TRACKINDEX_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// IN-MEMORY TRACK INDICES (LOADED ITUNESDB)
+// =============================================================================
+
+// Hash indices over db->itdb built once at open, so lookups and removals do
+// not walk the track and playlist lists. Kept in sync by
+// commit_track_to_ipod() and remove_track_from_ipod(); owner thread only.
+RbIpodTrackIndex* rb_ipod_track_index_new(Itdb_iTunesDB *itdb);
+void rb_ipod_track_index_free(RbIpodTrackIndex *index);
+
+// Index maintenance (after itdb_track_add / before itdb_track_remove)
+void rb_ipod_track_index_add_track(RbIpodTrackIndex *index, Itdb_Track *track);
+void rb_ipod_track_index_remove_track(RbIpodTrackIndex *index, Itdb_Track *track);
+void rb_ipod_track_index_add_member(RbIpodTrackIndex *index, Itdb_Playlist *playlist, Itdb_Track *track);
+void rb_ipod_track_index_remove_playlist(RbIpodTrackIndex *index, Itdb_Playlist *playlist);
+
+// After a successful itdb_write: indexes the dbids libgpod just assigned
+void rb_ipod_track_index_commit(RbIpodTrackIndex *index);
+
+// Lookups
+Itdb_Track* rb_ipod_track_index_lookup_path(RbIpodTrackIndex *index, const char *ipod_path);
+Itdb_Track* rb_ipod_track_index_lookup_dbid(RbIpodTrackIndex *index, guint64 dbid);
+Itdb_Track* rb_ipod_track_index_lookup_tags(RbIpodTrackIndex *index, const char *artist,
+                                            const char *album, const char *title, gint track_nr);
+Itdb_Track* rb_ipod_track_index_lookup_episode(RbIpodTrackIndex *index, const char *episode_id);
+
+// Playlists holding track (owned by the index, do not free)
+GList* rb_ipod_track_index_playlists(RbIpodTrackIndex *index, Itdb_Track *track);
+
+// Counts kept without walking itdb->tracks
+guint rb_ipod_track_index_count(RbIpodTrackIndex *index);
+guint rb_ipod_track_index_count_mediatype(RbIpodTrackIndex *index, guint32 mediatype);
+
+#endif // RBIPOD_TRACKINDEX_H
@@ -16,31 +16,79 @@
 typedef enum {
     RB_IPOD_ACTION_SET_NAME,
     RB_IPOD_ACTION_ADD_TRACK,
-    RB_IPOD_ACTION_REMOVE_TRACK
+    RB_IPOD_ACTION_REMOVE_TRACK,
+    RB_IPOD_ACTION_UPDATE_TRACK
 } RbIpodDelayedActionType;
 
+// Field changes carried by an UPDATE_TRACK action (NULL or -1 = unchanged)
+typedef struct {
+    gchar *title;
+    gchar *artist;
+    gchar *album;
+    gchar *albumartist;
+    gchar *genre;
+    gint32 track_nr;
+    gint32 rating;
+} RbIpodTrackUpdate;
+
 typedef struct {
     RbIpodDelayedActionType type;
     union {
         gchar *name;
         Itdb_Track *track;
     };
+    GList *playlists;           // ADD_TRACK: playlists beyond master/podcasts
+    RbIpodTrackUpdate *update;  // UPDATE_TRACK
 } RbIpodDelayedAction;
 
+typedef struct _RbIpodContentIndex RbIpodContentIndex;
+typedef struct _RbIpodFileAllocator RbIpodFileAllocator;
+typedef struct _RbIpodMetadataCache RbIpodMetadataCache;
+typedef struct _RbIpodArtworkCache RbIpodArtworkCache;
+typedef struct _RbIpodThumbnailCache RbIpodThumbnailCache;
+typedef struct _RbIpodFolderCovers RbIpodFolderCovers;
+typedef struct _RbIpodSyncJournal RbIpodSyncJournal;
+typedef struct _RbIpodTrackIndex RbIpodTrackIndex;
+typedef struct _RbIpodDbReader RbIpodDbReader;
+typedef struct _RbIpodSearchIndex RbIpodSearchIndex;
+
 typedef struct {
     Itdb_iTunesDB *itdb;
     gchar *mount_point;
-    GMutex *mutex;
+    GMutex *mutex;              // Guards delayed_actions (queued from any thread)
     gboolean is_read_only;
     gboolean is_saving;
     GQueue *delayed_actions;
-    gboolean has_delayed_actions;
     gboolean shutdown_requested;
     
+    // Background itdb_write() started by rb_ipod_db_save_async(); while
+    // is_saving, new tracks wait in delayed_actions
+    GThread *save_thread;
+    gint save_finished;         // Set by the save thread (atomic)
+    gboolean save_result;
+    gint64 last_save_us;        // Duration of the last itdb_write()
+    
+    // Identity index over on-device tracks for incremental sync
+    RbIpodContentIndex *content_index;
+    
+    // Path, dbid, tag, episode and playlist-membership lookups over itdb
+    RbIpodTrackIndex *track_index;
+    
+    // iPod_Control/Music filename allocator (scanned once at open)
+    RbIpodFileAllocator *file_allocator;
+    
+    // Converted covers shared by tracks with identical artwork bytes
+    RbIpodArtworkCache *artwork_cache;
+    
+    // Host record of copied files not yet in a written iTunesDB
+    RbIpodSyncJournal *journal;
+    
     // Database backup fields
+    char database_path[MAX_PATH_LEN];   // iPod_Control/iTunes/iTunesDB
     char backup_path[MAX_PATH_LEN];
     char working_path[MAX_PATH_LEN];
     gboolean backup_created;
+    gboolean keep_backup;               // Restore failed: the backup is the last good database
 } RbIpodDb;
 
 typedef struct {
@@ -87,8 +135,146 @@ typedef struct {
     guchar *artwork_data;
     gsize artwork_size;
     char *artwork_format;  // "jpeg", "png", etc.
+    
+    // Exact timing and gapless playback (MP3 frame scan)
+    guint32 duration_ms;   // Preferred over duration when set
+    guint32 pregap;        // Samples of encoder + decoder delay
+    guint32 postgap;       // Samples of encoder padding
+    guint64 samplecount;   // Samples of actual audio
+    guint32 gapless_data;  // Bytes from the first frame to the 8th before last
+    gboolean has_gapless;
+    
+    // Video and container-level fields (native MP4 parser)
+    guint32 detected_mediatype; // From stik/pcst/video track, 0 if unknown
+    gboolean has_video;
+    char *tvshow;
+    char *tvepisode;
+    char *tvnetwork;
+    GPtrArray *chapters;        // RbIpodChapter*, ordered by start time
 } AudioMetadata;
 
+typedef struct {
+    guint32 start_ms;
+    char *title;
+} RbIpodChapter;
+
+// Byte range inside a file mapping (not NUL-terminated)
+typedef struct {
+    const guchar *data;
+    gsize length;
+} RbIpodMp4Slice;
+
+typedef struct {
+    guint64 start;             // 100 ns units, as stored in Nero "chpl"
+    RbIpodMp4Slice title;
+} RbIpodMp4Chapter;
+
+typedef struct {
+    const guchar *map;         // Read-only mapping of the whole file
+    gsize map_size;
+    guint32 duration_ms;       // moov/mvhd
+    int sample_rate;           // mdhd timescale of the sound track
+    gboolean has_audio;
+    gboolean has_video;
+    gint64 mdat_bytes;
+    
+    // moov/udta/meta/ilst items, pointing into the mapping
+    RbIpodMp4Slice title, artist, album, album_artist, genre, composer, year;
+    RbIpodMp4Slice grouping, category, description, long_description;
+    RbIpodMp4Slice tvshow, tvepisode, tvnetwork, podcast_url;
+    RbIpodMp4Slice sort_title, sort_artist, sort_album, sort_album_artist;
+    RbIpodMp4Slice cover;
+    int cover_type;            // "data" type: 13 = JPEG, 14 = PNG
+    int genre_id;              // "gnre": ID3v1 genre index + 1
+    int track_number, track_total;
+    int disc_number, disc_total;
+    int season, episode;
+    int stik;                  // iTunes media kind, -1 if absent
+    gboolean podcast;
+    GArray *chapters;          // RbIpodMp4Chapter
+} RbIpodMp4File;
+
+// iTunesDB records streamed by the read-only reader. Only the fixed fields
+// are decoded; strings stay in the mapping until asked for.
+typedef struct {
+    const guchar *mhit;        // Record inside the mapping, mhods included
+    gsize length;
+    guint32 mediatype;         // ITDB_MEDIATYPE_*, 0 in databases too old to say
+    guint32 size;
+    guint32 tracklen;          // ms
+} RbIpodDbTrackRecord;
+
+typedef struct {
+    const guchar *mhyp;
+    gsize length;
+    guint32 items;
+    gboolean master;
+    gboolean podcasts;
+} RbIpodDbPlaylistRecord;
+
+// One search result; the strings point into the index
+typedef struct {
+    guint32 mediatype;
+    const char *title;
+    const char *artist;
+    const char *album;
+    const char *ipod_path;
+} RbIpodSearchEntry;
+
+typedef struct {
+    guint32 duration_ms;
+    int bitrate;               // Average kbps over the audio frames
+    int sample_rate;
+    guint32 frame_count;       // Audio frames (Xing/Info frame excluded)
+    guint64 sample_count;      // Decoded samples minus encoder delay/padding
+    guint32 encoder_delay;     // LAME tag, in samples
+    guint32 encoder_padding;
+    guint32 gapless_data;
+    gboolean vbr;
+    gboolean has_gapless;      // LAME tag with delay/padding was found
+} RbIpodMp3Info;
+
+typedef enum {
+    RB_IPOD_EXT_UNSUPPORTED,
+    RB_IPOD_EXT_MP3,
+    RB_IPOD_EXT_M4A,
+    RB_IPOD_EXT_AAC,
+    RB_IPOD_EXT_WAV,
+    RB_IPOD_EXT_AIFF,
+    RB_IPOD_EXT_M4P,
+    RB_IPOD_EXT_MP4
+} RbIpodExtClass;
+
+typedef enum {
+    RB_IPOD_WALK_OK,
+    RB_IPOD_WALK_NOT_A_DIRECTORY,
+    RB_IPOD_WALK_CANCELLED
+} RbIpodWalkStatus;
+
+typedef struct {
+    char *path;
+    gint64 size;
+    gint64 mtime;
+    guint64 inode;
+    guint64 device;
+    RbIpodExtClass ext_class;
+} RbIpodManifestEntry;
+
+typedef struct {
+    GPtrArray *entries;        // RbIpodManifestEntry*, sorted by path
+    guint directories_scanned;
+    guint errors;
+    gint64 total_bytes;
+} RbIpodManifest;
+
+// Sync phases measured for peak memory
+typedef enum {
+    RB_IPOD_PHASE_SCAN,         // Source tree walk
+    RB_IPOD_PHASE_TRANSFER,     // Probe, artwork and copy pipeline
+    RB_IPOD_PHASE_WRITE,        // itdb_write() (artwork materialized here)
+    RB_IPOD_PHASE_COUNT
+} RbIpodPhase;
+
 typedef struct {
     int files_added;
     int files_skipped;
@@ -100,6 +286,21 @@ typedef struct {
     time_t operation_start;
     time_t operation_end;
     double average_speed;
+    gint external_spawns;       // mediainfo/ffprobe/ffmpeg processes started
+    gint metadata_cache_hits;   // Probes answered by the host metadata cache
+    gint metadata_cache_misses;
+    gint artwork_cache_hits;    // Tracks reusing an already converted cover
+    gint artwork_cache_misses;
+    gint64 artwork_bytes_saved; // Cover bytes not decoded/converted again
+    gint thumbnail_cache_hits;  // Covers loaded prepared from the host cache
+    gint thumbnail_cache_misses;
+    gint folder_covers_used;    // Tracks given their directory's cover image
+    gint artwork_spilled;       // Distinct covers kept on disk instead of in memory
+    gint db_checkpoints;        // Background database saves during the transfer
+    gint64 checkpoint_write_us; // Time those saves spent in itdb_write()
+    gint files_adopted;         // Files copied by an interrupted run, added to the DB
+    gint orphans_removed;       // Partial or stale files of an interrupted run deleted
+    gint64 peak_rss_kb[RB_IPOD_PHASE_COUNT]; // VmHWM per phase, 0 if not measured
 } OperationStats;
 
 typedef struct {
@@ -110,8 +311,21 @@ typedef struct {
     pthread_mutex_t log_mutex;
     guint32 force_mediatype;
     gboolean use_force_mediatype;
+    guint num_jobs;             // Probe workers for the sync pipeline (0 = auto)
+    gboolean allow_external_tools; // Fall back to mediainfo/ffprobe/ffmpeg
+    RbIpodMetadataCache *metadata_cache; // NULL with --no-metadata-cache
+    RbIpodFolderCovers *folder_covers;   // Directory covers seen by the walker
+    guint checkpoint_tracks;    // Background save every N committed tracks (0 = off)
+    guint checkpoint_seconds;   // ... or every M seconds (0 = off)
 } SyncContext;
 
+typedef enum {
+    RB_IPOD_COPY_AUTO,
+    RB_IPOD_COPY_FILE_RANGE,    // copy_file_range(): in-kernel, may offload
+    RB_IPOD_COPY_SENDFILE,      // sendfile(): in-kernel, no userspace buffer
+    RB_IPOD_COPY_BUFFERED       // read()/write() through an aligned buffer
+} RbIpodCopyStrategy;
+
 typedef enum {
     FILESYSTEM_FAT32,
     FILESYSTEM_HFS_PLUS,
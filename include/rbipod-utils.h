@@ -15,6 +15,15 @@ void cleanup_application(void);
 void print_usage(const char *program_name);
 void print_version(void);
 
+// 64-bit content hash (artwork identity in the host caches)
+guint64 rb_ipod_hash_bytes(const void *data, gsize length);
+
+// Peak resident set size per sync phase: phase_end() records the peak since
+// the previous phase_begin()/phase_end() into g_sync_ctx.stats.peak_rss_kb
+gint64 rb_ipod_get_peak_rss_kb(void);
+void rb_ipod_phase_begin(void);
+void rb_ipod_phase_end(RbIpodPhase phase);
+
 // Global sync context access
 extern SyncContext g_sync_ctx;
 
@@ -0,0 +1,20 @@
+#ifndef RBIPOD_WALKER_H
+#define RBIPOD_WALKER_H
+
+#include "rbipod-types.h"
+
+// =============================================================================
+// SOURCE TREE WALKER
+// =============================================================================
+
+// Single parallel traversal producing the list of syncable files. Returns
+// NULL when root_path is not a directory or the walk was cancelled; status
+// (may be NULL) tells which.
+RbIpodManifest* rb_ipod_walk_directory(const char *root_path, guint num_threads, RbIpodWalkStatus *status);
+RbIpodManifest* rb_ipod_manifest_new_from_files(const char *const *file_paths, guint num_files);
+void rb_ipod_manifest_free(RbIpodManifest *manifest);
+
+// Extension classification (no filesystem access)
+RbIpodExtClass rb_ipod_classify_extension(const char *filename);
+
+#endif // RBIPOD_WALKER_H
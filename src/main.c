@@ -34,6 +34,9 @@
  * 
  * 4. Sync folder with specific media type:
  *    ./rhythmbox-ipod-sync sync-folder-filtered /media/ipod ~/Audiobooks audiobook
+ * 
+ * 5. Find tracks on the device:
+ *    ./rhythmbox-ipod-sync search /media/ipod daft punk --mediatype audio --limit 20
  */
 
 #include <stdio.h>
@@ -47,6 +50,8 @@
 #include "../include/rbipod-commands.h"
 #include "../include/rbipod-metadata.h"
 #include "../include/rbipod-logging.h"
+#include "../include/rbipod-metacache.h"
+#include "../include/rbipod-covers.h"
 
 // =============================================================================
 // MAIN FUNCTION
@@ -149,6 +154,19 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    // Parse worker count for pipelined sync commands
+    if (strcmp(command, "sync") == 0 || strcmp(command, "sync-file") == 0 ||
+        strcmp(command, "sync-folder-filtered") == 0) {
+        parse_jobs_arg(argc, argv, 4, &g_sync_ctx.num_jobs);
+        parse_uint_arg(argc, argv, 4, "--checkpoint-tracks", &g_sync_ctx.checkpoint_tracks);
+        parse_uint_arg(argc, argv, 4, "--checkpoint-seconds", &g_sync_ctx.checkpoint_seconds);
+        g_sync_ctx.allow_external_tools = parse_flag_arg(argc, argv, 3, "--external-tools");
+        if (!parse_flag_arg(argc, argv, 3, "--no-metadata-cache")) {
+            g_sync_ctx.metadata_cache = rb_ipod_metadata_cache_open(NULL);
+        }
+        g_sync_ctx.folder_covers = rb_ipod_folder_covers_new();
+    }
+    
     int result = 1;
     
     // Dispatch commands
@@ -164,13 +182,62 @@ int main(int argc, char *argv[]) {
         result = command_list_tracks(mount_point);
     } else if (strcmp(command, "info") == 0) {
         result = command_show_info(mount_point);
+    } else if (strcmp(command, "search") == 0) {
+        guint limit = SEARCH_DEFAULT_LIMIT;
+        guint32 search_mediatype = 0;
+        parse_uint_arg(argc, argv, 3, "--limit", &limit);
+        parse_mediatype_arg(argc, argv, 3, &mediatype_str);
+        if (mediatype_str) {
+            search_mediatype = parse_media_type_string(mediatype_str);
+            if (search_mediatype == ITDB_MEDIATYPE_AUDIO && strcmp(mediatype_str, "audio") != 0) {
+                fprintf(stderr, "Error: Invalid media type '%s'\n", mediatype_str);
+                cleanup_application();
+                return 1;
+            }
+        }
+        
+        // Every non-option argument is part of the query
+        GString *query = g_string_new(NULL);
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--mediatype") == 0 || strcmp(argv[i], "--limit") == 0) {
+                i++; // Skip option value
+                continue;
+            }
+            if (query->len > 0) g_string_append_c(query, ' ');
+            g_string_append(query, argv[i]);
+        }
+        if (query->len == 0 && search_mediatype == 0) {
+            fprintf(stderr, "Error: search command requires a query or --mediatype\n");
+            fprintf(stderr, "Usage: %s search <mount_point> <query...> [--mediatype type] [--limit N]\n", argv[0]);
+            result = 1;
+        } else {
+            result = command_search(mount_point, query->str, search_mediatype, limit);
+        }
+        g_string_free(query, TRUE);
     } else if (strcmp(command, "sync-file") == 0) {
         if (argc < 4) {
             fprintf(stderr, "Error: sync-file command requires file path\n");
-            fprintf(stderr, "Usage: %s sync-file <mount_point> <file_path> [--mediatype type]\n", argv[0]);
+            fprintf(stderr, "Usage: %s sync-file <mount_point> <file_path> [file_path...] [--mediatype type] [--jobs N] [--external-tools] [--no-metadata-cache]\n", argv[0]);
             result = 1;
         } else {
-            result = command_sync_file(mount_point, argv[3]);
+            // Every non-option argument is a file to sync
+            const char **file_paths = g_new0(const char*, argc);
+            int num_files = 0;
+            for (int i = 3; i < argc; i++) {
+                if (strcmp(argv[i], "--mediatype") == 0 || strcmp(argv[i], "--jobs") == 0 ||
+                    strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--checkpoint-tracks") == 0 ||
+                    strcmp(argv[i], "--checkpoint-seconds") == 0) {
+                    i++; // Skip option value
+                    continue;
+                }
+                if (strcmp(argv[i], "--external-tools") == 0 ||
+                    strcmp(argv[i], "--no-metadata-cache") == 0) {
+                    continue;
+                }
+                file_paths[num_files++] = argv[i];
+            }
+            result = command_sync_files(mount_point, file_paths, num_files);
+            g_free(file_paths);
         }
     } else if (strcmp(command, "sync-folder-filtered") == 0) {
         if (argc < 4) {
@@ -201,6 +268,15 @@ int main(int argc, char *argv[]) {
         result = 1;
     }
     
+    // Keep this run's probe results for the next sync
+    if (g_sync_ctx.metadata_cache) {
+        rb_ipod_metadata_cache_save(g_sync_ctx.metadata_cache);
+        rb_ipod_metadata_cache_free(g_sync_ctx.metadata_cache);
+        g_sync_ctx.metadata_cache = NULL;
+    }
+    rb_ipod_folder_covers_free(g_sync_ctx.folder_covers);
+    g_sync_ctx.folder_covers = NULL;
+    
     // Cleanup and exit
     cleanup_application();
     return result;
@@ -1,100 +1,303 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <glib.h>
 
 #include "../include/rbipod-actions.h"
+#include "../include/rbipod-files.h"
+#include "../include/rbipod-index.h"
+#include "../include/rbipod-trackindex.h"
 #include "../include/rbipod-logging.h"
 
 // =============================================================================
-// DELAYED ACTION MANAGEMENT (STUB IMPLEMENTATION)
+// DELAYED ACTION MANAGEMENT
 // =============================================================================
 
-void rb_ipod_add_delayed_action(RbIpodDb *db, RbIpodDelayedActionType type, gpointer data) {
-    if (!db) return;
+// Every change to db->itdb from a sync path is queued here. Producers only
+// take db->mutex to append; the owner takes the whole log in one locked
+// swap and applies it without holding the lock.
+
+guint rb_ipod_add_delayed_action(RbIpodDb *db, RbIpodDelayedAction *action) {
+    if (!db || !action) return 0;
+    
+    g_mutex_lock(db->mutex);
+    g_queue_push_tail(db->delayed_actions, action);
+    guint pending = g_queue_get_length(db->delayed_actions);
+    g_mutex_unlock(db->mutex);
     
+    log_message(LOG_DEBUG, "Added delayed action type %d (%u pending)", action->type, pending);
+    return pending;
+}
+
+static RbIpodDelayedAction* new_action(RbIpodDelayedActionType type) {
     RbIpodDelayedAction *action = g_malloc0(sizeof(RbIpodDelayedAction));
     action->type = type;
+    return action;
+}
+
+guint rb_ipod_set_name_delayed_action(RbIpodDb *db, const gchar *name) {
+    if (!name) return 0;
     
-    switch (type) {
-        case RB_IPOD_ACTION_SET_NAME:
-            action->name = g_strdup((const gchar*)data);
-            break;
-        case RB_IPOD_ACTION_ADD_TRACK:
-        case RB_IPOD_ACTION_REMOVE_TRACK:
-            action->track = (Itdb_Track*)data;
-            break;
-    }
+    RbIpodDelayedAction *action = new_action(RB_IPOD_ACTION_SET_NAME);
+    action->name = g_strdup(name);
+    return rb_ipod_add_delayed_action(db, action);
+}
+
+guint rb_ipod_add_track_delayed_action(RbIpodDb *db, Itdb_Track *track, GList *playlists) {
+    if (!track) return 0;
     
-    g_queue_push_tail(db->delayed_actions, action);
-    db->has_delayed_actions = TRUE;
+    RbIpodDelayedAction *action = new_action(RB_IPOD_ACTION_ADD_TRACK);
+    action->track = track;
+    action->playlists = g_list_copy(playlists);
+    return rb_ipod_add_delayed_action(db, action);
+}
+
+guint rb_ipod_remove_track_delayed_action(RbIpodDb *db, Itdb_Track *track) {
+    if (!track) return 0;
     
-    log_message(LOG_DEBUG, "Added delayed action type %d", type);
+    RbIpodDelayedAction *action = new_action(RB_IPOD_ACTION_REMOVE_TRACK);
+    action->track = track;
+    return rb_ipod_add_delayed_action(db, action);
 }
 
-void rb_ipod_remove_delayed_action(RbIpodDb *db, RbIpodDelayedActionType type, gpointer data) {
-    if (!db || !db->delayed_actions) return;
+guint rb_ipod_update_track_delayed_action(RbIpodDb *db, Itdb_Track *track, const RbIpodTrackUpdate *update) {
+    if (!track || !update) return 0;
     
-    // TODO: Implement removal of specific delayed actions
-    log_message(LOG_DEBUG, "Removing delayed action type %d", type);
-    (void)data; // Suppress unused parameter warning
+    RbIpodDelayedAction *action = new_action(RB_IPOD_ACTION_UPDATE_TRACK);
+    action->track = track;
+    action->update = rb_ipod_track_update_new();
+    action->update->title = g_strdup(update->title);
+    action->update->artist = g_strdup(update->artist);
+    action->update->album = g_strdup(update->album);
+    action->update->albumartist = g_strdup(update->albumartist);
+    action->update->genre = g_strdup(update->genre);
+    action->update->track_nr = update->track_nr;
+    action->update->rating = update->rating;
+    return rb_ipod_add_delayed_action(db, action);
 }
 
-void rb_ipod_set_name_delayed_action(RbIpodDb *db, const gchar *name) {
-    rb_ipod_add_delayed_action(db, RB_IPOD_ACTION_SET_NAME, (gpointer)name);
+static gboolean action_matches(const RbIpodDelayedAction *action, RbIpodDelayedActionType type, gpointer data) {
+    if (action->type != type) return FALSE;
+    if (!data) return TRUE;
+    
+    if (type == RB_IPOD_ACTION_SET_NAME) {
+        return g_strcmp0(action->name, data) == 0;
+    }
+    return action->track == data;
 }
 
-void rb_ipod_add_track_delayed_action(RbIpodDb *db, Itdb_Track *track) {
-    rb_ipod_add_delayed_action(db, RB_IPOD_ACTION_ADD_TRACK, track);
+guint rb_ipod_remove_delayed_action(RbIpodDb *db, RbIpodDelayedActionType type, gpointer data) {
+    if (!db || !db->delayed_actions) return 0;
+    
+    guint dropped = 0;
+    GHashTable *cancelled = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_mutex_lock(db->mutex);
+    GList *link = db->delayed_actions->head;
+    while (link) {
+        GList *next = link->next;
+        RbIpodDelayedAction *action = link->data;
+        if (action_matches(action, type, data)) {
+            if (action->type == RB_IPOD_ACTION_ADD_TRACK) {
+                g_hash_table_add(cancelled, action->track);
+            }
+            g_queue_delete_link(db->delayed_actions, link);
+            free_delayed_action(action);
+            dropped++;
+        }
+        link = next;
+    }
+    
+    // Later actions on a track that will never be added go with it
+    link = g_hash_table_size(cancelled) > 0 ? db->delayed_actions->head : NULL;
+    while (link) {
+        GList *next = link->next;
+        RbIpodDelayedAction *action = link->data;
+        if (action->track && g_hash_table_contains(cancelled, action->track)) {
+            g_queue_delete_link(db->delayed_actions, link);
+            free_delayed_action(action);
+            dropped++;
+        }
+        link = next;
+    }
+    g_mutex_unlock(db->mutex);
+    
+    // Never owned by the itdb, same as a coalesced add/remove pair
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, cancelled);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        rb_ipod_content_index_remove_track(db->content_index, (Itdb_Track*)key);
+        itdb_track_free((Itdb_Track*)key);
+    }
+    g_hash_table_destroy(cancelled);
+    
+    log_message(LOG_DEBUG, "Removed %u delayed actions of type %d", dropped, type);
+    return dropped;
 }
 
-void rb_ipod_remove_track_delayed_action(RbIpodDb *db, Itdb_Track *track) {
-    rb_ipod_add_delayed_action(db, RB_IPOD_ACTION_REMOVE_TRACK, track);
+// Adds to the extra playlists the track is not already in
+static void add_to_playlists(RbIpodDb *db, Itdb_Track *track, GList *playlists) {
+    for (GList *item = playlists; item; item = item->next) {
+        Itdb_Playlist *playlist = (Itdb_Playlist*)item->data;
+        if (g_list_find(rb_ipod_track_index_playlists(db->track_index, track), playlist)) continue;
+        
+        itdb_playlist_add_track(playlist, track, -1);
+        rb_ipod_track_index_add_member(db->track_index, playlist, track);
+    }
 }
 
 gboolean rb_ipod_db_process_delayed_actions(RbIpodDb *db) {
-    if (!db || !db->has_delayed_actions) return TRUE;
+    if (!db || !db->itdb) return TRUE;
+    
+    // itdb_write() on the save thread is reading the lists
+    if (db->is_saving) return TRUE;
     
-    log_message(LOG_INFO, "Processing delayed actions");
+    g_mutex_lock(db->mutex);
+    GQueue batch = *db->delayed_actions;
+    g_queue_init(db->delayed_actions);
+    g_mutex_unlock(db->mutex);
+    if (batch.length == 0) return TRUE;
     
-    while (!g_queue_is_empty(db->delayed_actions)) {
-        RbIpodDelayedAction *action = g_queue_pop_head(db->delayed_actions);
+    // Coalescing: a track added and removed within the batch never reaches
+    // the itdb, updates to removed tracks are dropped, the last name wins
+    GHashTable *added = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTable *removed = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTable *discarded = g_hash_table_new(g_direct_hash, g_direct_equal);
+    RbIpodDelayedAction *last_name = NULL;
+    gboolean adds_podcasts = FALSE;
+    
+    for (GList *link = batch.head; link; link = link->next) {
+        RbIpodDelayedAction *action = link->data;
+        switch (action->type) {
+            case RB_IPOD_ACTION_SET_NAME:
+                last_name = action;
+                break;
+            case RB_IPOD_ACTION_ADD_TRACK:
+                g_hash_table_add(added, action->track);
+                if (action->track->mediatype == ITDB_MEDIATYPE_PODCAST) adds_podcasts = TRUE;
+                break;
+            case RB_IPOD_ACTION_REMOVE_TRACK:
+                g_hash_table_add(removed, action->track);
+                if (g_hash_table_contains(added, action->track)) {
+                    g_hash_table_add(discarded, action->track);
+                }
+                break;
+            case RB_IPOD_ACTION_UPDATE_TRACK:
+                break;
+        }
+    }
+    
+    // itdb_track_add() and itdb_playlist_add_track() append by walking the
+    // list: reverse the lists once so each add is a prepend, then restore
+    GList *reversed = NULL;
+    if (g_hash_table_size(added) > g_hash_table_size(discarded)) {
+        db->itdb->tracks = g_list_reverse(db->itdb->tracks);
+        Itdb_Playlist *master_pl = itdb_playlist_mpl(db->itdb);
+        if (master_pl) reversed = g_list_prepend(reversed, master_pl);
+        if (adds_podcasts) reversed = g_list_prepend(reversed, ensure_podcasts_playlist(db));
+        for (GList *item = reversed; item; item = item->next) {
+            Itdb_Playlist *playlist = (Itdb_Playlist*)item->data;
+            playlist->members = g_list_reverse(playlist->members);
+        }
+    }
+    
+    guint applied = 0;
+    for (GList *link = batch.head; link; link = link->next) {
+        RbIpodDelayedAction *action = link->data;
         
         switch (action->type) {
             case RB_IPOD_ACTION_SET_NAME:
-                if (db->itdb && action->name) {
-                    // Set iPod name
-                    log_message(LOG_DEBUG, "Setting iPod name to: %s", action->name);
+                if (action == last_name) {
+                    // The iPod's name is the master playlist's
+                    Itdb_Playlist *master_pl = itdb_playlist_mpl(db->itdb);
+                    if (master_pl) {
+                        g_free(master_pl->name);
+                        master_pl->name = g_strdup(action->name);
+                        log_message(LOG_DEBUG, "Setting iPod name to: %s", action->name);
+                        applied++;
+                    }
                 }
                 break;
                 
             case RB_IPOD_ACTION_ADD_TRACK:
-                if (db->itdb && action->track) {
-                    itdb_track_add(db->itdb, action->track, -1);
-                    log_message(LOG_DEBUG, "Added track to database");
+                if (!g_hash_table_contains(discarded, action->track)) {
+                    // Same path as an immediate add: master and podcast playlists
+                    commit_track_to_ipod(db, action->track, 0);
+                    add_to_playlists(db, action->track, action->playlists);
+                    applied++;
                 }
                 break;
                 
             case RB_IPOD_ACTION_REMOVE_TRACK:
-                if (db->itdb && action->track) {
-                    itdb_track_remove(action->track);
-                    log_message(LOG_DEBUG, "Removed track from database");
+                if (!g_hash_table_contains(discarded, action->track)) {
+                    remove_track_from_ipod(db, action->track);
+                    applied++;
+                }
+                break;
+                
+            case RB_IPOD_ACTION_UPDATE_TRACK:
+                if (!g_hash_table_contains(removed, action->track)) {
+                    update_track_on_ipod(db, action->track, action->update);
+                    applied++;
                 }
                 break;
         }
-        
-        free_delayed_action(action);
     }
     
-    db->has_delayed_actions = FALSE;
+    if (reversed) {
+        db->itdb->tracks = g_list_reverse(db->itdb->tracks);
+        for (GList *item = reversed; item; item = item->next) {
+            Itdb_Playlist *playlist = (Itdb_Playlist*)item->data;
+            playlist->members = g_list_reverse(playlist->members);
+        }
+        g_list_free(reversed);
+    }
+    
+    // Never added, so never owned by the itdb
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, discarded);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        rb_ipod_content_index_remove_track(db->content_index, (Itdb_Track*)key);
+        itdb_track_free((Itdb_Track*)key);
+    }
+    
+    log_message(LOG_INFO, "Applied %u of %u delayed actions (%u add/remove pairs coalesced)",
+               applied, batch.length, g_hash_table_size(discarded));
+    
+    g_hash_table_destroy(added);
+    g_hash_table_destroy(removed);
+    g_hash_table_destroy(discarded);
+    g_list_free_full(batch.head, (GDestroyNotify)free_delayed_action);
     return TRUE;
 }
 
+RbIpodTrackUpdate* rb_ipod_track_update_new(void) {
+    RbIpodTrackUpdate *update = g_malloc0(sizeof(RbIpodTrackUpdate));
+    update->track_nr = -1;
+    update->rating = -1;
+    return update;
+}
+
+void rb_ipod_track_update_free(RbIpodTrackUpdate *update) {
+    if (!update) return;
+    
+    g_free(update->title);
+    g_free(update->artist);
+    g_free(update->album);
+    g_free(update->albumartist);
+    g_free(update->genre);
+    g_free(update);
+}
+
 void free_delayed_action(RbIpodDelayedAction *action) {
     if (!action) return;
     
     if (action->type == RB_IPOD_ACTION_SET_NAME && action->name) {
         g_free(action->name);
     }
+    g_list_free(action->playlists);
+    rb_ipod_track_update_free(action->update);
     
     g_free(action);
-}
\ No newline at end of file
+}
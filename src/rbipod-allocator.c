@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "../include/rbipod-allocator.h"
+#include "../include/rbipod-logging.h"
+
+// =============================================================================
+// IPOD FILENAME ALLOCATOR
+// =============================================================================
+
+// Names are 4 uppercase letters in the style of Apple/gtkpod: [A-Z]{4}
+#define IPOD_NAME_SPACE (26 * 26 * 26 * 26)
+
+struct _RbIpodFileAllocator {
+    GMutex mutex;
+    char *mount_point;
+    GHashTable *used;                           // dir/name key -> present
+    guint files_per_dir[IPOD_MUSIC_DIR_COUNT];
+    gboolean dir_exists[IPOD_MUSIC_DIR_COUNT];
+    guint next_dir;                             // round-robin start for ties
+    guint32 cursor;                             // next candidate name value
+    guint total_files;
+};
+
+static inline gpointer name_key(guint dir_num, guint32 name_value) {
+    // +1 keeps the key non-NULL for the direct hash table
+    return GUINT_TO_POINTER(dir_num * IPOD_NAME_SPACE + name_value + 1);
+}
+
+static gboolean parse_ipod_name(const char *filename, guint32 *name_value) {
+    guint32 value = 0;
+
+    for (int i = 0; i < 4; i++) {
+        char c = g_ascii_toupper(filename[i]);
+        if (c < 'A' || c > 'Z') return FALSE;
+        value = value * 26 + (guint32)(c - 'A');
+    }
+    if (filename[4] != '.' && filename[4] != '\0') return FALSE;
+
+    *name_value = value;
+    return TRUE;
+}
+
+static void format_ipod_name(guint32 name_value, char name[5]) {
+    name[0] = 'A' + (name_value / (26 * 26 * 26)) % 26;
+    name[1] = 'A' + (name_value / (26 * 26)) % 26;
+    name[2] = 'A' + (name_value / 26) % 26;
+    name[3] = 'A' + name_value % 26;
+    name[4] = '\0';
+}
+
+RbIpodFileAllocator* rb_ipod_file_allocator_new(const char *mount_point) {
+    if (!mount_point) return NULL;
+
+    RbIpodFileAllocator *allocator = g_malloc0(sizeof(RbIpodFileAllocator));
+    g_mutex_init(&allocator->mutex);
+    allocator->mount_point = g_strdup(mount_point);
+    allocator->used = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    guint32 max_value = 0;
+    gboolean any_named = FALSE;
+
+    // Single pass over F00-F49; everything afterwards is served from memory
+    for (guint dir_num = 0; dir_num < IPOD_MUSIC_DIR_COUNT; dir_num++) {
+        char f_dir[MAX_PATH_LEN];
+        snprintf(f_dir, sizeof(f_dir), "%s/iPod_Control/Music/F%02u", mount_point, dir_num);
+
+        GDir *dir = g_dir_open(f_dir, 0, NULL);
+        if (!dir) continue;
+        allocator->dir_exists[dir_num] = TRUE;
+
+        const char *filename;
+        while ((filename = g_dir_read_name(dir)) != NULL) {
+            allocator->files_per_dir[dir_num]++;
+            allocator->total_files++;
+
+            guint32 name_value;
+            if (parse_ipod_name(filename, &name_value)) {
+                g_hash_table_add(allocator->used, name_key(dir_num, name_value));
+                if (!any_named || name_value > max_value) {
+                    max_value = name_value;
+                    any_named = TRUE;
+                }
+            }
+        }
+        g_dir_close(dir);
+    }
+
+    // Continue after the highest existing name so new files sort after old ones
+    allocator->cursor = any_named ? (max_value + 1) % IPOD_NAME_SPACE : 0;
+
+    log_message(LOG_DEBUG, "File allocator scanned %u existing files (next name index %u)",
+               allocator->total_files, allocator->cursor);
+    return allocator;
+}
+
+void rb_ipod_file_allocator_free(RbIpodFileAllocator *allocator) {
+    if (!allocator) return;
+
+    g_hash_table_destroy(allocator->used);
+    g_mutex_clear(&allocator->mutex);
+    g_free(allocator->mount_point);
+    g_free(allocator);
+}
+
+char* rb_ipod_file_allocator_next(RbIpodFileAllocator *allocator, const char *original_filename) {
+    if (!allocator || !original_filename) return NULL;
+
+    // Get file extension from original filename
+    const char *ext = strrchr(original_filename, '.');
+    if (!ext || strchr(ext, '/')) ext = ".mp3"; // Default extension
+
+    g_mutex_lock(&allocator->mutex);
+
+    // Least-loaded directory keeps Fxx evenly filled (constant 50-entry scan)
+    guint dir_num = allocator->next_dir;
+    for (guint i = 1; i < IPOD_MUSIC_DIR_COUNT; i++) {
+        guint candidate = (allocator->next_dir + i) % IPOD_MUSIC_DIR_COUNT;
+        if (allocator->files_per_dir[candidate] < allocator->files_per_dir[dir_num]) {
+            dir_num = candidate;
+        }
+    }
+    allocator->next_dir = (dir_num + 1) % IPOD_MUSIC_DIR_COUNT;
+
+    // Advance the cursor past names already taken in that directory
+    guint32 name_value = 0;
+    gboolean found = FALSE;
+    for (guint32 attempts = 0; attempts < IPOD_NAME_SPACE; attempts++) {
+        name_value = allocator->cursor;
+        allocator->cursor = (allocator->cursor + 1) % IPOD_NAME_SPACE;
+        if (!g_hash_table_contains(allocator->used, name_key(dir_num, name_value))) {
+            found = TRUE;
+            break;
+        }
+    }
+
+    if (!found) {
+        g_mutex_unlock(&allocator->mutex);
+        log_message(LOG_ERROR, "No free iPod filename left in F%02u", dir_num);
+        return NULL;
+    }
+
+    g_hash_table_add(allocator->used, name_key(dir_num, name_value));
+    allocator->files_per_dir[dir_num]++;
+    allocator->total_files++;
+
+    // Create the directory the first time it is handed out
+    if (!allocator->dir_exists[dir_num]) {
+        char f_dir[MAX_PATH_LEN];
+        snprintf(f_dir, sizeof(f_dir), "%s/iPod_Control/Music/F%02u", allocator->mount_point, dir_num);
+        if (g_mkdir_with_parents(f_dir, 0755) != 0) {
+            log_message(LOG_WARNING, "Failed to create directory F%02u: %s", dir_num, strerror(errno));
+        } else {
+            allocator->dir_exists[dir_num] = TRUE;
+        }
+    }
+
+    g_mutex_unlock(&allocator->mutex);
+
+    char ipod_name[5];
+    format_ipod_name(name_value, ipod_name);
+
+    char *result = g_strdup_printf("%s/iPod_Control/Music/F%02u/%s%s",
+                                   allocator->mount_point, dir_num, ipod_name, ext);
+
+    log_message(LOG_DEBUG, "Generated iPod filename: %s", result);
+    return result;
+}
+
+void rb_ipod_file_allocator_release(RbIpodFileAllocator *allocator, const char *ipod_path) {
+    if (!allocator || !ipod_path) return;
+
+    // Expect .../F<nn>/<NAME>.<ext>
+    const char *name = strrchr(ipod_path, '/');
+    if (!name || name - ipod_path < 4) return;
+    const char *dir_part = name - 4;
+    if (dir_part[0] != '/' || (dir_part[1] != 'F' && dir_part[1] != 'f') ||
+        !g_ascii_isdigit(dir_part[2]) || !g_ascii_isdigit(dir_part[3])) {
+        return;
+    }
+
+    guint dir_num = (guint)((dir_part[2] - '0') * 10 + (dir_part[3] - '0'));
+    guint32 name_value;
+    if (dir_num >= IPOD_MUSIC_DIR_COUNT || !parse_ipod_name(name + 1, &name_value)) return;
+
+    g_mutex_lock(&allocator->mutex);
+    if (g_hash_table_remove(allocator->used, name_key(dir_num, name_value))) {
+        allocator->files_per_dir[dir_num]--;
+        allocator->total_files--;
+    }
+    g_mutex_unlock(&allocator->mutex);
+}
+
+guint rb_ipod_file_allocator_get_file_count(RbIpodFileAllocator *allocator) {
+    if (!allocator) return 0;
+
+    g_mutex_lock(&allocator->mutex);
+    guint count = allocator->total_files;
+    g_mutex_unlock(&allocator->mutex);
+    return count;
+}
@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gpod/itdb.h>
+
+#include "../include/rbipod-artcache.h"
+#include "../include/rbipod-thumbcache.h"
+#include "../include/rbipod-logging.h"
+#include "../include/rbipod-utils.h"
+
+// =============================================================================
+// ARTWORK DEDUPLICATION CACHE
+// =============================================================================
+
+typedef struct {
+    guint64 hash;              // rb_ipod_hash_bytes() of the raw cover bytes
+    gsize source_size;
+    Itdb_Artwork *artwork;     // Template duplicated into each track, NULL if unusable
+    gsize pixel_bytes;         // Decoded size of the prepared cover
+    gboolean spilled;          // Template refers to a file in spill_dir, holds no pixels
+    guint uses;
+    gboolean ready;            // FALSE while a worker is still decoding it
+    guint waiters;             // Workers blocked on ready (never evicted meanwhile)
+    GList *lru_link;           // Node in cache->lru, NULL when kept out of the table
+} ArtworkEntry;
+
+struct _RbIpodArtworkCache {
+    GMutex mutex;
+    GCond ready_cond;
+    GHashTable *entries;       // &entry->hash -> ArtworkEntry*
+    GQueue lru;                // Most recently used first
+    gsize pixel_bytes;         // Sum over cached entries
+    gsize max_pixel_bytes;
+    int max_width;             // Largest cover art format of the device, 0 if unknown
+    int max_height;
+    guint evictions;
+    RbIpodThumbnailCache *thumbnails; // Host cache of prepared covers, NULL if unused
+    gsize retained_bytes;      // In-memory cover pixels handed out to tracks
+    gsize memory_budget;
+    char *spill_dir;           // Temporary PNG store, created on first spill
+};
+
+// Pixels an entry keeps alive in this process
+#define ENTRY_MEMORY(entry) ((entry)->spilled ? 0 : (entry)->pixel_bytes)
+
+static void free_entry(gpointer data) {
+    ArtworkEntry *entry = data;
+    if (entry->artwork) itdb_artwork_free(entry->artwork);
+    g_free(entry);
+}
+
+// Largest cover art format per generation (the cover art tables of libgpod's
+// itdb_device.c, which it does not export); 0 for models without artwork
+static int cover_art_size(Itdb_IpodGeneration generation) {
+    switch (generation) {
+    case ITDB_IPOD_GENERATION_NANO_3:
+    case ITDB_IPOD_GENERATION_CLASSIC_1:
+    case ITDB_IPOD_GENERATION_CLASSIC_2:
+    case ITDB_IPOD_GENERATION_CLASSIC_3:
+        return 320;
+    case ITDB_IPOD_GENERATION_TOUCH_1:
+    case ITDB_IPOD_GENERATION_TOUCH_2:
+    case ITDB_IPOD_GENERATION_TOUCH_3:
+    case ITDB_IPOD_GENERATION_TOUCH_4:
+    case ITDB_IPOD_GENERATION_IPHONE_1:
+    case ITDB_IPOD_GENERATION_IPHONE_2:
+    case ITDB_IPOD_GENERATION_IPHONE_3:
+    case ITDB_IPOD_GENERATION_IPHONE_4:
+    case ITDB_IPOD_GENERATION_IPAD_1:
+        return 256;
+    case ITDB_IPOD_GENERATION_NANO_4:
+    case ITDB_IPOD_GENERATION_NANO_5:
+    case ITDB_IPOD_GENERATION_NANO_6:
+        return 240;
+    case ITDB_IPOD_GENERATION_VIDEO_1:
+    case ITDB_IPOD_GENERATION_VIDEO_2:
+        return 200;
+    case ITDB_IPOD_GENERATION_PHOTO:
+        return 140;
+    case ITDB_IPOD_GENERATION_NANO_1:
+    case ITDB_IPOD_GENERATION_NANO_2:
+        return 100;
+    default:
+        return 0;
+    }
+}
+
+gboolean rb_ipod_artwork_target_size(const Itdb_Device *device, int *width, int *height) {
+    const Itdb_IpodInfo *info = device && itdb_device_supports_artwork(device) ?
+                                itdb_device_get_ipod_info(device) : NULL;
+    int size = info ? cover_art_size(info->ipod_generation) : 0;
+    if (width) *width = size;
+    if (height) *height = size;
+    return size > 0;
+}
+
+RbIpodArtworkCache* rb_ipod_artwork_cache_new(const Itdb_Device *device) {
+    RbIpodArtworkCache *cache = g_malloc0(sizeof(RbIpodArtworkCache));
+    g_mutex_init(&cache->mutex);
+    g_cond_init(&cache->ready_cond);
+    cache->entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, free_entry);
+    g_queue_init(&cache->lru);
+    cache->max_pixel_bytes = ARTWORK_CACHE_MAX_BYTES;
+    cache->memory_budget = ARTWORK_MEMORY_BUDGET;
+
+    // Decoded covers are scaled once to the largest thumbnail the device
+    // stores; libgpod derives the smaller formats from that pixbuf
+    rb_ipod_artwork_target_size(device, &cache->max_width, &cache->max_height);
+
+    if (cache->max_width > 0) {
+        log_message(LOG_DEBUG, "Artwork cache: covers scaled to at most %dx%d",
+                   cache->max_width, cache->max_height);
+
+        // Prepared covers only depend on the source bytes and the device format
+        const Itdb_IpodInfo *info = itdb_device_get_ipod_info(device);
+        char *format_key = g_strdup_printf("gen%d-%dx%d", info ? (int)info->ipod_generation : 0,
+                                           cache->max_width, cache->max_height);
+        cache->thumbnails = rb_ipod_thumbnail_cache_open(NULL, format_key);
+        g_free(format_key);
+    }
+    return cache;
+}
+
+// Spilled covers are only needed until the last itdb_write()
+static void remove_spill_dir(const char *spill_dir) {
+    GDir *dir = g_dir_open(spill_dir, 0, NULL);
+    if (dir) {
+        const char *name;
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            char *path = g_build_filename(spill_dir, name, NULL);
+            g_unlink(path);
+            g_free(path);
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(spill_dir);
+}
+
+void rb_ipod_artwork_cache_free(RbIpodArtworkCache *cache) {
+    if (!cache) return;
+
+    guint images = g_hash_table_size(cache->entries);
+    if (images > 0 || cache->evictions > 0) {
+        log_message(LOG_DEBUG, "Artwork cache: %u distinct images, %u evicted, %.1f MB held by tracks",
+                   images, cache->evictions, cache->retained_bytes / (1024.0 * 1024.0));
+    }
+    if (cache->spill_dir) {
+        remove_spill_dir(cache->spill_dir);
+        g_free(cache->spill_dir);
+    }
+
+    rb_ipod_thumbnail_cache_free(cache->thumbnails);
+    g_queue_clear(&cache->lru);
+    g_hash_table_destroy(cache->entries);
+    g_cond_clear(&cache->ready_cond);
+    g_mutex_clear(&cache->mutex);
+    g_free(cache);
+}
+
+typedef struct {
+    int max_width;
+    int max_height;
+} ScaleTarget;
+
+// Asks the loader for the final size before decoding starts. The JPEG loader
+// turns this into libjpeg DCT scaling (1/2, 1/4, 1/8), so a 3000x3000 cover
+// is never decoded at full resolution; other formats are decoded and then
+// reduced once with a bilinear filter.
+static void on_size_prepared(GdkPixbufLoader *loader, gint width, gint height, gpointer data) {
+    const ScaleTarget *target = data;
+    if (target->max_width <= 0 || target->max_height <= 0 ||
+        (width <= target->max_width && height <= target->max_height)) {
+        return;
+    }
+
+    double scale = MIN((double)target->max_width / width, (double)target->max_height / height);
+    gdk_pixbuf_loader_set_size(loader, MAX(1, (int)(width * scale + 0.5)), MAX(1, (int)(height * scale + 0.5)));
+}
+
+GdkPixbuf* rb_ipod_artwork_decode_scaled(const guchar *data, gsize size, int max_width, int max_height) {
+    if (!data || size == 0) return NULL;
+
+    ScaleTarget target = {max_width, max_height};
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+    g_signal_connect(loader, "size-prepared", G_CALLBACK(on_size_prepared), &target);
+
+    GError *error = NULL;
+    gboolean ok = gdk_pixbuf_loader_write(loader, data, size, &error);
+    // close() must run even after a failed write
+    ok = gdk_pixbuf_loader_close(loader, ok ? &error : NULL) && ok;
+
+    GdkPixbuf *pixbuf = ok ? gdk_pixbuf_loader_get_pixbuf(loader) : NULL;
+    if (pixbuf) {
+        g_object_ref(pixbuf);
+    } else {
+        log_message(LOG_WARNING, "Failed to decode artwork: %s", error ? error->message : "unknown error");
+    }
+    if (error) g_error_free(error);
+    g_object_unref(loader);
+    return pixbuf;
+}
+
+// Reserves pixel_bytes of the memory budget (returns NULL), or returns the
+// spill file for this image once the budget is used up
+static char* claim_memory_or_spill(RbIpodArtworkCache *cache, const ArtworkEntry *entry, gsize pixel_bytes) {
+    char *spill_path = NULL;
+
+    g_mutex_lock(&cache->mutex);
+    if (cache->retained_bytes + pixel_bytes > cache->memory_budget) {
+        if (!cache->spill_dir) {
+            cache->spill_dir = g_dir_make_tmp("rbipod-artwork-spill-XXXXXX", NULL);
+            if (cache->spill_dir) {
+                log_message(LOG_INFO, "Artwork memory budget reached (%.1f MB), spilling covers to %s",
+                           cache->memory_budget / (1024.0 * 1024.0), cache->spill_dir);
+            }
+        }
+        if (cache->spill_dir) {
+            // Named by content, like the host caches
+            spill_path = g_strdup_printf("%s/%016" G_GINT64_MODIFIER "x-%" G_GSIZE_MODIFIER "x.png",
+                                         cache->spill_dir, entry->hash, entry->source_size);
+        }
+    }
+    if (!spill_path) {
+        cache->retained_bytes += pixel_bytes;
+    }
+    g_mutex_unlock(&cache->mutex);
+    return spill_path;
+}
+
+// Hands the prepared cover to libgpod as a file it loads at write time
+static gboolean spill_artwork(Itdb_Artwork *artwork, GdkPixbuf *pixbuf, const char *spill_path) {
+    GError *error = NULL;
+    // Low compression: the file lives until the database is written
+    gboolean ok = gdk_pixbuf_save(pixbuf, spill_path, "png", &error, "compression", "1", NULL) &&
+                  itdb_artwork_set_thumbnail(artwork, spill_path, 0, &error);
+    if (!ok) {
+        log_message(LOG_WARNING, "Failed to spill artwork to %s: %s", spill_path,
+                   error ? error->message : "libgpod error");
+        g_clear_error(&error);
+        g_unlink(spill_path);
+    }
+    return ok;
+}
+
+// Builds the template artwork for one distinct image (called without the lock)
+static void prepare_entry(RbIpodArtworkCache *cache, ArtworkEntry *entry, const AudioMetadata *meta) {
+    GdkPixbuf *pixbuf = rb_ipod_thumbnail_cache_lookup(cache->thumbnails, entry->hash, entry->source_size);
+    if (pixbuf) {
+        g_atomic_int_inc(&g_sync_ctx.stats.thumbnail_cache_hits);
+    } else {
+        pixbuf = rb_ipod_artwork_decode_scaled(meta->artwork_data, meta->artwork_size,
+                                               cache->max_width, cache->max_height);
+        if (!pixbuf) return;
+        if (cache->thumbnails) {
+            g_atomic_int_inc(&g_sync_ctx.stats.thumbnail_cache_misses);
+            rb_ipod_thumbnail_cache_store(cache->thumbnails, entry->hash, entry->source_size, pixbuf);
+        }
+    }
+
+    gsize pixel_bytes = (gsize)gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+    Itdb_Artwork *artwork = itdb_artwork_new();
+    char *spill_path = claim_memory_or_spill(cache, entry, pixel_bytes);
+    if (spill_path) {
+        entry->spilled = spill_artwork(artwork, pixbuf, spill_path);
+        if (!entry->spilled) {
+            // Keep the pixels in memory after all
+            g_mutex_lock(&cache->mutex);
+            cache->retained_bytes += pixel_bytes;
+            g_mutex_unlock(&cache->mutex);
+        }
+        g_free(spill_path);
+    }
+
+    GError *error = NULL;
+    if (entry->spilled || itdb_artwork_set_thumbnail_from_pixbuf(artwork, pixbuf, 0, &error)) {
+        entry->artwork = artwork;
+        entry->pixel_bytes = pixel_bytes;
+        if (entry->spilled) g_atomic_int_inc(&g_sync_ctx.stats.artwork_spilled);
+    } else {
+        log_message(LOG_WARNING, "Failed to add artwork from pixbuf: %s", error ? error->message : "libgpod error");
+        g_clear_error(&error);
+        itdb_artwork_free(artwork);
+    }
+
+    // The template artwork holds its own reference
+    g_object_unref(pixbuf);
+}
+
+// Drops least recently used images until the decoded pixels fit the budget.
+// Tracks that already received an image keep their own reference to it.
+static void evict_locked(RbIpodArtworkCache *cache, ArtworkEntry *keep) {
+    GList *link = cache->lru.tail;
+    while (link && cache->pixel_bytes > cache->max_pixel_bytes) {
+        ArtworkEntry *victim = link->data;
+        link = link->prev;
+        if (victim == keep || victim->waiters > 0) continue;
+
+        g_queue_delete_link(&cache->lru, victim->lru_link);
+        cache->pixel_bytes -= ENTRY_MEMORY(victim);
+        cache->evictions++;
+        g_hash_table_remove(cache->entries, &victim->hash);
+    }
+}
+
+gboolean rb_ipod_artwork_cache_apply(RbIpodArtworkCache *cache, Itdb_Track *track,
+                                     const AudioMetadata *meta) {
+    if (!cache || !track || !meta || !meta->artwork_data || meta->artwork_size == 0) return FALSE;
+
+    guint64 hash = rb_ipod_hash_bytes(meta->artwork_data, meta->artwork_size);
+
+    g_mutex_lock(&cache->mutex);
+    ArtworkEntry *entry = g_hash_table_lookup(cache->entries, &hash);
+    gboolean hit = entry && entry->source_size == meta->artwork_size;
+    ArtworkEntry *private_entry = NULL;
+
+    if (hit) {
+        // Tracks of one album reach the probe workers together: the first
+        // one decodes, the others wait for its result
+        entry->waiters++;
+        while (!entry->ready) {
+            g_cond_wait(&cache->ready_cond, &cache->mutex);
+        }
+        entry->waiters--;
+        g_atomic_int_inc(&g_sync_ctx.stats.artwork_cache_hits);
+        g_sync_ctx.stats.artwork_bytes_saved += meta->artwork_size;
+    } else {
+        ArtworkEntry *created = g_malloc0(sizeof(ArtworkEntry));
+        created->hash = hash;
+        created->source_size = meta->artwork_size;
+        if (entry) {
+            private_entry = created;   // 64-bit hash collision: keep it out of the table
+        } else {
+            g_hash_table_insert(cache->entries, &created->hash, created);
+        }
+        entry = created;
+        g_mutex_unlock(&cache->mutex);
+
+        prepare_entry(cache, created, meta);
+        g_atomic_int_inc(&g_sync_ctx.stats.artwork_cache_misses);
+
+        g_mutex_lock(&cache->mutex);
+        created->ready = TRUE;
+        if (!private_entry) {
+            g_queue_push_head(&cache->lru, created);
+            created->lru_link = cache->lru.head;
+            cache->pixel_bytes += ENTRY_MEMORY(created);
+            evict_locked(cache, created);
+            g_cond_broadcast(&cache->ready_cond);
+        }
+    }
+
+    if (entry->lru_link && entry->lru_link != cache->lru.head) {
+        g_queue_unlink(&cache->lru, entry->lru_link);
+        g_queue_push_head_link(&cache->lru, entry->lru_link);
+    }
+
+    gboolean applied = entry->artwork != NULL;
+    if (applied) {
+        // Pixbuf thumbnails are duplicated by reference, not by pixels
+        itdb_artwork_free(track->artwork);
+        track->artwork = itdb_artwork_duplicate(entry->artwork);
+        track->artwork_count = 1;
+        track->artwork_size = entry->pixel_bytes;
+        track->has_artwork = 0x01;
+    }
+    guint uses = ++entry->uses;
+    g_mutex_unlock(&cache->mutex);
+
+    if (private_entry) free_entry(private_entry);
+
+    if (applied) {
+        log_message(LOG_DEBUG, "%s artwork for track: %s (used by %u tracks)",
+                   hit ? "Shared" : "Added", track->title, uses);
+    } else {
+        log_message(LOG_WARNING, "Failed to add artwork to track: %s", track->title);
+    }
+    return applied;
+}
+
+guint rb_ipod_artwork_cache_get_image_count(RbIpodArtworkCache *cache) {
+    if (!cache) return 0;
+
+    g_mutex_lock(&cache->mutex);
+    guint count = g_hash_table_size(cache->entries);
+    g_mutex_unlock(&cache->mutex);
+    return count;
+}
+
+gsize rb_ipod_artwork_cache_get_pixel_bytes(RbIpodArtworkCache *cache) {
+    if (!cache) return 0;
+
+    g_mutex_lock(&cache->mutex);
+    gsize bytes = cache->pixel_bytes;
+    g_mutex_unlock(&cache->mutex);
+    return bytes;
+}
+
+gsize rb_ipod_artwork_cache_get_retained_bytes(RbIpodArtworkCache *cache) {
+    if (!cache) return 0;
+
+    g_mutex_lock(&cache->mutex);
+    gsize bytes = cache->retained_bytes;
+    g_mutex_unlock(&cache->mutex);
+    return bytes;
+}
+
+void rb_ipod_artwork_cache_set_memory_budget(RbIpodArtworkCache *cache, gsize budget) {
+    if (!cache) return;
+
+    g_mutex_lock(&cache->mutex);
+    cache->memory_budget = budget;
+    g_mutex_unlock(&cache->mutex);
+}
+
+void rb_ipod_artwork_cache_set_max_bytes(RbIpodArtworkCache *cache, gsize max_bytes) {
+    if (!cache) return;
+
+    g_mutex_lock(&cache->mutex);
+    cache->max_pixel_bytes = max_bytes;
+    evict_locked(cache, NULL);
+    g_mutex_unlock(&cache->mutex);
+}
@@ -17,55 +17,119 @@
 #include <taglib/mp4file.h>
 #include <taglib/mp4tag.h>
 #include <taglib/mp4coverart.h>
+#include <taglib/wavfile.h>
+#include <taglib/aifffile.h>
 
 extern "C" {
 #include "../include/rbipod-types.h"
 #include "../include/rbipod-logging.h"
 }
 
+// Copy picture bytes into the metadata structure with a normalized format name
+static void store_artwork(AudioMetadata *meta, const TagLib::ByteVector &imageData, const char *format) {
+    meta->artwork_size = imageData.size();
+    meta->artwork_data = static_cast<guchar*>(g_malloc(meta->artwork_size));
+    memcpy(meta->artwork_data, imageData.data(), meta->artwork_size);
+    meta->artwork_format = g_strdup(format);
+}
+
+static const char* format_from_mime(const TagLib::String &mimeType) {
+    std::string mimeStr = mimeType.toCString();
+    if (mimeStr.find("jpeg") != std::string::npos || mimeStr.find("jpg") != std::string::npos) {
+        return "jpeg";
+    } else if (mimeStr.find("png") != std::string::npos) {
+        return "png";
+    }
+    return "unknown";
+}
+
+// Cover from ID3v2 APIC frames (tag already parsed by the caller)
+static gboolean read_id3v2_artwork(TagLib::ID3v2::Tag *id3v2tag, AudioMetadata *meta) {
+    if (!id3v2tag) return FALSE;
+    
+    TagLib::ID3v2::FrameList frames = id3v2tag->frameList("APIC");
+    if (frames.isEmpty()) return FALSE;
+    
+    // Get the first cover art frame (usually front cover)
+    TagLib::ID3v2::AttachedPictureFrame *frame = 
+        static_cast<TagLib::ID3v2::AttachedPictureFrame *>(frames.front());
+    
+    if (!frame) return FALSE;
+    
+    TagLib::ByteVector imageData = frame->picture();
+    if (imageData.isEmpty()) return FALSE;
+    
+    store_artwork(meta, imageData, format_from_mime(frame->mimeType()));
+    
+    log_message(LOG_DEBUG, "Extracted ID3v2 artwork: %zu bytes, MIME: %s", 
+               meta->artwork_size, frame->mimeType().toCString());
+    return TRUE;
+}
+
+// Cover from FLAC picture metadata blocks
+static gboolean read_flac_artwork(TagLib::FLAC::File *flacFile, AudioMetadata *meta) {
+    if (!flacFile) return FALSE;
+    
+    TagLib::List<TagLib::FLAC::Picture*> pictures = flacFile->pictureList();
+    if (pictures.isEmpty()) return FALSE;
+    
+    // Get the first picture (usually front cover)
+    TagLib::FLAC::Picture *picture = pictures.front();
+    if (!picture) return FALSE;
+    
+    TagLib::ByteVector imageData = picture->data();
+    if (imageData.isEmpty()) return FALSE;
+    
+    store_artwork(meta, imageData, format_from_mime(picture->mimeType()));
+    
+    log_message(LOG_DEBUG, "Extracted FLAC artwork: %zu bytes, MIME: %s", 
+               meta->artwork_size, picture->mimeType().toCString());
+    return TRUE;
+}
+
+// Cover from the MP4 "covr" item
+static gboolean read_mp4_artwork(TagLib::MP4::Tag *tag, AudioMetadata *meta) {
+    if (!tag) return FALSE;
+    
+    TagLib::MP4::ItemMap itemMap = tag->itemMap();
+    if (!itemMap.contains("covr")) return FALSE;
+    
+    TagLib::MP4::Item coverItem = itemMap["covr"];
+    TagLib::MP4::CoverArtList coverList = coverItem.toCoverArtList();
+    if (coverList.isEmpty()) return FALSE;
+    
+    // Get the first cover art
+    TagLib::MP4::CoverArt coverArt = coverList.front();
+    TagLib::ByteVector imageData = coverArt.data();
+    if (imageData.isEmpty()) return FALSE;
+    
+    // Determine format from TagLib format
+    switch (coverArt.format()) {
+        case TagLib::MP4::CoverArt::JPEG:
+            store_artwork(meta, imageData, "jpeg");
+            break;
+        case TagLib::MP4::CoverArt::PNG:
+            store_artwork(meta, imageData, "png");
+            break;
+        default:
+            store_artwork(meta, imageData, "unknown");
+            break;
+    }
+    
+    log_message(LOG_DEBUG, "Extracted MP4 artwork: %zu bytes, format: %s", 
+               meta->artwork_size, meta->artwork_format);
+    return TRUE;
+}
+
 // Extract artwork from MP3 files using ID3v2 APIC frames
 extern "C" gboolean extract_artwork_mp3_id3v2(const char *file_path, AudioMetadata *meta) {
     if (!file_path || !meta) return FALSE;
     
     try {
-        TagLib::MPEG::File mpegFile(file_path);
+        TagLib::MPEG::File mpegFile(file_path, false);
         if (!mpegFile.isValid()) return FALSE;
         
-        TagLib::ID3v2::Tag *id3v2tag = mpegFile.ID3v2Tag();
-        if (!id3v2tag) return FALSE;
-        
-        TagLib::ID3v2::FrameList frames = id3v2tag->frameList("APIC");
-        if (frames.isEmpty()) return FALSE;
-        
-        // Get the first cover art frame (usually front cover)
-        TagLib::ID3v2::AttachedPictureFrame *frame = 
-            static_cast<TagLib::ID3v2::AttachedPictureFrame *>(frames.front());
-        
-        if (!frame) return FALSE;
-        
-        TagLib::ByteVector imageData = frame->picture();
-        if (imageData.isEmpty()) return FALSE;
-        
-        // Copy artwork data to metadata structure
-        meta->artwork_size = imageData.size();
-        meta->artwork_data = static_cast<guchar*>(g_malloc(meta->artwork_size));
-        memcpy(meta->artwork_data, imageData.data(), meta->artwork_size);
-        
-        // Determine format from MIME type
-        TagLib::String mimeType = frame->mimeType();
-        std::string mimeStr = mimeType.toCString();
-        if (mimeStr.find("jpeg") != std::string::npos || mimeStr.find("jpg") != std::string::npos) {
-            meta->artwork_format = g_strdup("jpeg");
-        } else if (mimeStr.find("png") != std::string::npos) {
-            meta->artwork_format = g_strdup("png");
-        } else {
-            meta->artwork_format = g_strdup("unknown");
-        }
-        
-        log_message(LOG_DEBUG, "Extracted MP3 artwork: %zu bytes, MIME: %s", 
-                   meta->artwork_size, mimeType.toCString());
-        
-        return TRUE;
+        return read_id3v2_artwork(mpegFile.ID3v2Tag(), meta);
         
     } catch (const std::exception& e) {
         log_message(LOG_WARNING, "TagLib exception during MP3 artwork extraction: %s", e.what());
@@ -78,39 +142,10 @@ extern "C" gboolean extract_artwork_flac(const char *file_path, AudioMetadata *m
     if (!file_path || !meta) return FALSE;
     
     try {
-        TagLib::FLAC::File flacFile(file_path);
+        TagLib::FLAC::File flacFile(file_path, false);
         if (!flacFile.isValid()) return FALSE;
         
-        TagLib::List<TagLib::FLAC::Picture*> pictures = flacFile.pictureList();
-        if (pictures.isEmpty()) return FALSE;
-        
-        // Get the first picture (usually front cover)
-        TagLib::FLAC::Picture *picture = pictures.front();
-        if (!picture) return FALSE;
-        
-        TagLib::ByteVector imageData = picture->data();
-        if (imageData.isEmpty()) return FALSE;
-        
-        // Copy artwork data to metadata structure
-        meta->artwork_size = imageData.size();
-        meta->artwork_data = static_cast<guchar*>(g_malloc(meta->artwork_size));
-        memcpy(meta->artwork_data, imageData.data(), meta->artwork_size);
-        
-        // Determine format from MIME type
-        TagLib::String mimeType = picture->mimeType();
-        std::string mimeStr = mimeType.toCString();
-        if (mimeStr.find("jpeg") != std::string::npos || mimeStr.find("jpg") != std::string::npos) {
-            meta->artwork_format = g_strdup("jpeg");
-        } else if (mimeStr.find("png") != std::string::npos) {
-            meta->artwork_format = g_strdup("png");
-        } else {
-            meta->artwork_format = g_strdup("unknown");
-        }
-        
-        log_message(LOG_DEBUG, "Extracted FLAC artwork: %zu bytes, MIME: %s", 
-                   meta->artwork_size, mimeType.toCString());
-        
-        return TRUE;
+        return read_flac_artwork(&flacFile, meta);
         
     } catch (const std::exception& e) {
         log_message(LOG_WARNING, "TagLib exception during FLAC artwork extraction: %s", e.what());
@@ -123,47 +158,10 @@ extern "C" gboolean extract_artwork_mp4(const char *file_path, AudioMetadata *me
     if (!file_path || !meta) return FALSE;
     
     try {
-        TagLib::MP4::File mp4File(file_path);
+        TagLib::MP4::File mp4File(file_path, false);
         if (!mp4File.isValid()) return FALSE;
         
-        TagLib::MP4::Tag *tag = mp4File.tag();
-        if (!tag) return FALSE;
-        
-        TagLib::MP4::ItemMap itemMap = tag->itemMap();
-        if (!itemMap.contains("covr")) return FALSE;
-        
-        TagLib::MP4::Item coverItem = itemMap["covr"];
-        TagLib::MP4::CoverArtList coverList = coverItem.toCoverArtList();
-        if (coverList.isEmpty()) return FALSE;
-        
-        // Get the first cover art
-        TagLib::MP4::CoverArt coverArt = coverList.front();
-        TagLib::ByteVector imageData = coverArt.data();
-        if (imageData.isEmpty()) return FALSE;
-        
-        // Copy artwork data to metadata structure
-        meta->artwork_size = imageData.size();
-        meta->artwork_data = static_cast<guchar*>(g_malloc(meta->artwork_size));
-        memcpy(meta->artwork_data, imageData.data(), meta->artwork_size);
-        
-        // Determine format from TagLib format
-        TagLib::MP4::CoverArt::Format format = coverArt.format();
-        switch (format) {
-            case TagLib::MP4::CoverArt::JPEG:
-                meta->artwork_format = g_strdup("jpeg");
-                break;
-            case TagLib::MP4::CoverArt::PNG:
-                meta->artwork_format = g_strdup("png");
-                break;
-            default:
-                meta->artwork_format = g_strdup("unknown");
-                break;
-        }
-        
-        log_message(LOG_DEBUG, "Extracted MP4 artwork: %zu bytes, format: %s", 
-                   meta->artwork_size, meta->artwork_format);
-        
-        return TRUE;
+        return read_mp4_artwork(mp4File.tag(), meta);
         
     } catch (const std::exception& e) {
         log_message(LOG_WARNING, "TagLib exception during MP4 artwork extraction: %s", e.what());
@@ -171,165 +169,170 @@ extern "C" gboolean extract_artwork_mp4(const char *file_path, AudioMetadata *me
     }
 }
 
-// Main TagLib artwork extraction function
-extern "C" gboolean extract_extended_podcast_metadata(const char *file_path, AudioMetadata *meta) {
-    if (!file_path || !meta) return FALSE;
+// Podcast frames (DATE, GROUPING, SUBTITLE, TXXX...) from an ID3v2 tag
+static gboolean read_id3v2_podcast_frames(TagLib::ID3v2::Tag *id3v2, AudioMetadata *meta) {
+    if (!id3v2) return FALSE;
     
-    try {
-        TagLib::FileRef fileRef(file_path);
-        if (fileRef.isNull() || !fileRef.tag()) {
-            return FALSE;
-        }
-        
-        gboolean found_any = FALSE;
-        
-        // For MP3 files, check ID3v2 tags for extended metadata
-        TagLib::MPEG::File *mpegFile = dynamic_cast<TagLib::MPEG::File*>(fileRef.file());
-        if (mpegFile && mpegFile->ID3v2Tag()) {
-            TagLib::ID3v2::Tag *id3v2 = mpegFile->ID3v2Tag();
-            
-            // Extract DATE field (TDRC, TDAT, DATE)
-            TagLib::ID3v2::FrameList date_frames = id3v2->frameList("TDRC");
-            if (date_frames.isEmpty()) date_frames = id3v2->frameList("TDAT");
-            if (date_frames.isEmpty()) date_frames = id3v2->frameList("DATE");
-            if (!date_frames.isEmpty()) {
-                TagLib::String date_str = date_frames.front()->toString();
-                if (!date_str.isEmpty()) {
-                    std::string date_std = date_str.to8Bit(true);
-                    struct tm tm_date;
-                    memset(&tm_date, 0, sizeof(tm_date));
-                    
-                    if (strptime(date_std.c_str(), "%Y-%m-%d", &tm_date) ||
-                        strptime(date_std.c_str(), "%Y/%m/%d", &tm_date) ||
-                        strptime(date_std.c_str(), "%Y-%m", &tm_date) ||
-                        strptime(date_std.c_str(), "%Y", &tm_date)) {
-                        meta->time_released = mktime(&tm_date);
-                        found_any = TRUE;
-                        g_print("[DEBUG] Extracted DATE: '%s' -> %ld\n", date_std.c_str(), meta->time_released);
-                    }
-                }
-            }
+    gboolean found_any = FALSE;
+    
+    // Extract DATE field (TDRC, TDAT, DATE)
+    TagLib::ID3v2::FrameList date_frames = id3v2->frameList("TDRC");
+    if (date_frames.isEmpty()) date_frames = id3v2->frameList("TDAT");
+    if (date_frames.isEmpty()) date_frames = id3v2->frameList("DATE");
+    if (!date_frames.isEmpty()) {
+        TagLib::String date_str = date_frames.front()->toString();
+        if (!date_str.isEmpty()) {
+            std::string date_std = date_str.to8Bit(true);
+            struct tm tm_date;
+            memset(&tm_date, 0, sizeof(tm_date));
             
-            // Extract GROUPING (TIT1)
-            TagLib::ID3v2::FrameList grouping_frames = id3v2->frameList("TIT1");
-            if (!grouping_frames.isEmpty()) {
-                TagLib::String grouping_str = grouping_frames.front()->toString();
-                if (!grouping_str.isEmpty()) {
-                    std::string grouping_std = grouping_str.to8Bit(true);
-                    if (meta->episode_id) g_free(meta->episode_id);
-                    meta->episode_id = g_strdup(grouping_std.c_str());
-                    found_any = TRUE;
-                    g_print("[DEBUG] Extracted GROUPING: '%s'\n", meta->episode_id);
-                }
+            if (strptime(date_std.c_str(), "%Y-%m-%d", &tm_date) ||
+                strptime(date_std.c_str(), "%Y/%m/%d", &tm_date) ||
+                strptime(date_std.c_str(), "%Y-%m", &tm_date) ||
+                strptime(date_std.c_str(), "%Y", &tm_date)) {
+                meta->time_released = mktime(&tm_date);
+                found_any = TRUE;
+                g_print("[DEBUG] Extracted DATE: '%s' -> %ld\n", date_std.c_str(), meta->time_released);
             }
-            
-            // Extract SUBTITLE (TIT3)
-            TagLib::ID3v2::FrameList subtitle_frames = id3v2->frameList("TIT3");
-            if (!subtitle_frames.isEmpty()) {
-                TagLib::String subtitle_str = subtitle_frames.front()->toString();
-                if (!subtitle_str.isEmpty()) {
-                    std::string subtitle_std = subtitle_str.to8Bit(true);
-                    if (meta->subtitle) g_free(meta->subtitle);
-                    meta->subtitle = g_strdup(subtitle_std.c_str());
+        }
+    }
+    
+    // Extract GROUPING (TIT1)
+    TagLib::ID3v2::FrameList grouping_frames = id3v2->frameList("TIT1");
+    if (!grouping_frames.isEmpty()) {
+        TagLib::String grouping_str = grouping_frames.front()->toString();
+        if (!grouping_str.isEmpty()) {
+            std::string grouping_std = grouping_str.to8Bit(true);
+            if (meta->episode_id) g_free(meta->episode_id);
+            meta->episode_id = g_strdup(grouping_std.c_str());
+            found_any = TRUE;
+            g_print("[DEBUG] Extracted GROUPING: '%s'\n", meta->episode_id);
+        }
+    }
+    
+    // Extract SUBTITLE (TIT3)
+    TagLib::ID3v2::FrameList subtitle_frames = id3v2->frameList("TIT3");
+    if (!subtitle_frames.isEmpty()) {
+        TagLib::String subtitle_str = subtitle_frames.front()->toString();
+        if (!subtitle_str.isEmpty()) {
+            std::string subtitle_std = subtitle_str.to8Bit(true);
+            if (meta->subtitle) g_free(meta->subtitle);
+            meta->subtitle = g_strdup(subtitle_std.c_str());
+            found_any = TRUE;
+            g_print("[DEBUG] Extracted SUBTITLE: '%s'\n", meta->subtitle);
+        }
+    }
+    
+    // Extract CATEGORY (TCAT - custom frame)
+    TagLib::ID3v2::FrameList category_frames = id3v2->frameList("TCAT");
+    if (category_frames.isEmpty()) {
+        // Try TXXX frame with description "CATEGORY"
+        TagLib::ID3v2::FrameList txxx_frames = id3v2->frameList("TXXX");
+        for (auto it = txxx_frames.begin(); it != txxx_frames.end(); ++it) {
+            TagLib::ID3v2::UserTextIdentificationFrame *txxx = 
+                dynamic_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(*it);
+            if (txxx && txxx->description().upper() == "CATEGORY") {
+                if (!txxx->fieldList().isEmpty()) {
+                    std::string category_std = txxx->fieldList().back().to8Bit(true);
+                    if (meta->category) g_free(meta->category);
+                    meta->category = g_strdup(category_std.c_str());
                     found_any = TRUE;
-                    g_print("[DEBUG] Extracted SUBTITLE: '%s'\n", meta->subtitle);
+                    g_print("[DEBUG] Extracted CATEGORY: '%s'\n", meta->category);
+                    break;
                 }
             }
-            
-            // Extract CATEGORY (TCAT - custom frame)
-            TagLib::ID3v2::FrameList category_frames = id3v2->frameList("TCAT");
-            if (category_frames.isEmpty()) {
-                // Try TXXX frame with description "CATEGORY"
-                TagLib::ID3v2::FrameList txxx_frames = id3v2->frameList("TXXX");
-                for (auto it = txxx_frames.begin(); it != txxx_frames.end(); ++it) {
-                    TagLib::ID3v2::UserTextIdentificationFrame *txxx = 
-                        dynamic_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(*it);
-                    if (txxx && txxx->description().upper() == "CATEGORY") {
-                        if (!txxx->fieldList().isEmpty()) {
-                            std::string category_std = txxx->fieldList().back().to8Bit(true);
-                            if (meta->category) g_free(meta->category);
-                            meta->category = g_strdup(category_std.c_str());
-                            found_any = TRUE;
-                            g_print("[DEBUG] Extracted CATEGORY: '%s'\n", meta->category);
-                            break;
-                        }
-                    }
-                }
-            }
-            
-            // Extract PODCAST (show name from TALB if different from TXXX PODCAST)
-            TagLib::ID3v2::FrameList podcast_frames = id3v2->frameList("TXXX");
-            for (auto it = podcast_frames.begin(); it != podcast_frames.end(); ++it) {
-                TagLib::ID3v2::UserTextIdentificationFrame *txxx = 
-                    dynamic_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(*it);
-                if (txxx && (txxx->description().upper() == "PODCAST" || 
-                            txxx->description().upper() == "PODCASTNAME")) {
-                    if (!txxx->fieldList().isEmpty()) {
-                        std::string podcast_std = txxx->fieldList().back().to8Bit(true);
-                        if (meta->podcast_name) g_free(meta->podcast_name);
-                        meta->podcast_name = g_strdup(podcast_std.c_str());
-                        found_any = TRUE;
-                        g_print("[DEBUG] Extracted PODCAST: '%s'\n", meta->podcast_name);
-                        break;
-                    }
-                }
+        }
+    }
+    
+    // Extract PODCAST (show name from TALB if different from TXXX PODCAST)
+    TagLib::ID3v2::FrameList podcast_frames = id3v2->frameList("TXXX");
+    for (auto it = podcast_frames.begin(); it != podcast_frames.end(); ++it) {
+        TagLib::ID3v2::UserTextIdentificationFrame *txxx = 
+            dynamic_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(*it);
+        if (txxx && (txxx->description().upper() == "PODCAST" || 
+                    txxx->description().upper() == "PODCASTNAME")) {
+            if (!txxx->fieldList().isEmpty()) {
+                std::string podcast_std = txxx->fieldList().back().to8Bit(true);
+                if (meta->podcast_name) g_free(meta->podcast_name);
+                meta->podcast_name = g_strdup(podcast_std.c_str());
+                found_any = TRUE;
+                g_print("[DEBUG] Extracted PODCAST: '%s'\n", meta->podcast_name);
+                break;
             }
-            
-            // Extract PODCASTURL
-            TagLib::ID3v2::FrameList url_frames = id3v2->frameList("WOAS");
-            if (url_frames.isEmpty()) {
-                // Try TXXX frame with PODCASTURL
-                for (auto it = podcast_frames.begin(); it != podcast_frames.end(); ++it) {
-                    TagLib::ID3v2::UserTextIdentificationFrame *txxx = 
-                        dynamic_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(*it);
-                    if (txxx && txxx->description().upper() == "PODCASTURL") {
-                        if (!txxx->fieldList().isEmpty()) {
-                            std::string podcasturl_std = txxx->fieldList().back().to8Bit(true);
-                            if (meta->podcasturl) g_free(meta->podcasturl);
-                            meta->podcasturl = g_strdup(podcasturl_std.c_str());
-                            found_any = TRUE;
-                            g_print("[DEBUG] Extracted PODCASTURL: '%s'\n", meta->podcasturl);
-                            break;
-                        }
-                    }
+        }
+    }
+    
+    // Extract PODCASTURL
+    TagLib::ID3v2::FrameList url_frames = id3v2->frameList("WOAS");
+    if (url_frames.isEmpty()) {
+        // Try TXXX frame with PODCASTURL
+        for (auto it = podcast_frames.begin(); it != podcast_frames.end(); ++it) {
+            TagLib::ID3v2::UserTextIdentificationFrame *txxx = 
+                dynamic_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(*it);
+            if (txxx && txxx->description().upper() == "PODCASTURL") {
+                if (!txxx->fieldList().isEmpty()) {
+                    std::string podcasturl_std = txxx->fieldList().back().to8Bit(true);
+                    if (meta->podcasturl) g_free(meta->podcasturl);
+                    meta->podcasturl = g_strdup(podcasturl_std.c_str());
+                    found_any = TRUE;
+                    g_print("[DEBUG] Extracted PODCASTURL: '%s'\n", meta->podcasturl);
+                    break;
                 }
             }
-            
-            // Extract PODCASTRSS
-            for (auto it = podcast_frames.begin(); it != podcast_frames.end(); ++it) {
-                TagLib::ID3v2::UserTextIdentificationFrame *txxx = 
-                    dynamic_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(*it);
-                if (txxx && txxx->description().upper() == "PODCASTRSS") {
-                    if (!txxx->fieldList().isEmpty()) {
-                        std::string podcastrss_std = txxx->fieldList().back().to8Bit(true);
-                        if (meta->podcastrss) g_free(meta->podcastrss);
-                        meta->podcastrss = g_strdup(podcastrss_std.c_str());
-                        found_any = TRUE;
-                        g_print("[DEBUG] Extracted PODCASTRSS: '%s'\n", meta->podcastrss);
-                        break;
-                    }
-                }
+        }
+    }
+    
+    // Extract PODCASTRSS
+    for (auto it = podcast_frames.begin(); it != podcast_frames.end(); ++it) {
+        TagLib::ID3v2::UserTextIdentificationFrame *txxx = 
+            dynamic_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(*it);
+        if (txxx && txxx->description().upper() == "PODCASTRSS") {
+            if (!txxx->fieldList().isEmpty()) {
+                std::string podcastrss_std = txxx->fieldList().back().to8Bit(true);
+                if (meta->podcastrss) g_free(meta->podcastrss);
+                meta->podcastrss = g_strdup(podcastrss_std.c_str());
+                found_any = TRUE;
+                g_print("[DEBUG] Extracted PODCASTRSS: '%s'\n", meta->podcastrss);
+                break;
             }
-            
-            // Extract DESCRIPTION (longer description)
-            for (auto it = podcast_frames.begin(); it != podcast_frames.end(); ++it) {
-                TagLib::ID3v2::UserTextIdentificationFrame *txxx = 
-                    dynamic_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(*it);
-                if (txxx && (txxx->description().upper() == "DESCRIPTION" ||
-                            txxx->description().upper() == "EPISODESUMMARY")) {
-                    if (!txxx->fieldList().isEmpty()) {
-                        std::string episode_summary_std = txxx->fieldList().back().to8Bit(true);
-                        if (meta->episode_summary) g_free(meta->episode_summary);
-                        meta->episode_summary = g_strdup(episode_summary_std.c_str());
-                        found_any = TRUE;
-                        g_print("[DEBUG] Extracted DESCRIPTION: '%s'\n", meta->episode_summary);
-                        break;
-                    }
-                }
+        }
+    }
+    
+    // Extract DESCRIPTION (longer description)
+    for (auto it = podcast_frames.begin(); it != podcast_frames.end(); ++it) {
+        TagLib::ID3v2::UserTextIdentificationFrame *txxx = 
+            dynamic_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(*it);
+        if (txxx && (txxx->description().upper() == "DESCRIPTION" ||
+                    txxx->description().upper() == "EPISODESUMMARY")) {
+            if (!txxx->fieldList().isEmpty()) {
+                std::string episode_summary_std = txxx->fieldList().back().to8Bit(true);
+                if (meta->episode_summary) g_free(meta->episode_summary);
+                meta->episode_summary = g_strdup(episode_summary_std.c_str());
+                found_any = TRUE;
+                g_print("[DEBUG] Extracted DESCRIPTION: '%s'\n", meta->episode_summary);
+                break;
             }
         }
+    }
+    
+    return found_any;
+}
+
+// Main TagLib artwork extraction function
+extern "C" gboolean extract_extended_podcast_metadata(const char *file_path, AudioMetadata *meta) {
+    if (!file_path || !meta) return FALSE;
+    
+    try {
+        TagLib::FileRef fileRef(file_path, false);
+        if (fileRef.isNull()) {
+            return FALSE;
+        }
         
-        return found_any;
+        // For MP3 files, check ID3v2 tags for extended metadata
+        TagLib::MPEG::File *mpegFile = dynamic_cast<TagLib::MPEG::File*>(fileRef.file());
+        if (mpegFile) {
+            return read_id3v2_podcast_frames(mpegFile->ID3v2Tag(), meta);
+        }
         
     } catch (const std::exception& e) {
         g_print("[WARNING] Exception in date extraction: %s\n", e.what());
@@ -369,4 +372,110 @@ extern "C" gboolean extract_artwork_taglib_native(const char *file_path, AudioMe
     }
     
     return success;
-}
\ No newline at end of file
+}
+// =============================================================================
+// UNIFIED TAG READER
+// =============================================================================
+
+// Copy a tag string into a metadata field, ignoring empty values
+static gboolean store_tag_string(gchar **field, const TagLib::String &value) {
+    if (value.isEmpty()) return FALSE;
+    
+    std::string value_std = value.to8Bit(true);
+    if (value_std.empty()) return FALSE;
+    
+    g_free(*field);
+    *field = g_strdup(value_std.c_str());
+    return TRUE;
+}
+
+// ID3v2 tag of the formats that carry one (MP3, and WAV/AIFF "ID3 " chunks)
+static TagLib::ID3v2::Tag* id3v2_tag_of(TagLib::File *file) {
+    if (TagLib::MPEG::File *mpegFile = dynamic_cast<TagLib::MPEG::File*>(file)) {
+        return mpegFile->ID3v2Tag();
+    }
+    if (TagLib::RIFF::WAV::File *wavFile = dynamic_cast<TagLib::RIFF::WAV::File*>(file)) {
+        return wavFile->hasID3v2Tag() ? wavFile->ID3v2Tag() : NULL;
+    }
+    if (TagLib::RIFF::AIFF::File *aiffFile = dynamic_cast<TagLib::RIFF::AIFF::File*>(file)) {
+        return aiffFile->hasID3v2Tag() ? aiffFile->tag() : NULL;
+    }
+    return NULL;
+}
+
+// Reads tags, audio properties, podcast frames and cover art from a single
+// TagLib open. The concrete file type is recovered with dynamic_cast so the
+// format-specific readers work on the already parsed file instead of
+// reopening it. Returns TRUE if any tag or property was found; artwork is
+// only looked up in that case (artwork_data stays NULL when there is none).
+extern "C" gboolean extract_audio_metadata_unified(const char *file_path, AudioMetadata *meta) {
+    if (!file_path || !meta) return FALSE;
+    
+    try {
+        TagLib::FileRef fileRef(file_path, true, TagLib::AudioProperties::Average);
+        if (fileRef.isNull() || !fileRef.tag()) {
+            return FALSE;
+        }
+        
+        TagLib::Tag *tag = fileRef.tag();
+        gboolean any_success = FALSE;
+        
+        // Basic tags (comment is not stored in AudioMetadata)
+        any_success |= store_tag_string(&meta->title, tag->title());
+        any_success |= store_tag_string(&meta->artist, tag->artist());
+        any_success |= store_tag_string(&meta->album, tag->album());
+        any_success |= store_tag_string(&meta->genre, tag->genre());
+        
+        if (tag->year() > 0) {
+            meta->year = tag->year();
+            any_success = TRUE;
+        }
+        if (tag->track() > 0) {
+            meta->track_number = tag->track();
+            any_success = TRUE;
+        }
+        
+        TagLib::File *file = fileRef.file();
+        TagLib::ID3v2::Tag *id3v2 = id3v2_tag_of(file);
+        
+        // Extended podcast frames live in ID3v2 only
+        if (meta->mediatype == ITDB_MEDIATYPE_PODCAST && id3v2) {
+            read_id3v2_podcast_frames(id3v2, meta);
+        }
+        
+        TagLib::AudioProperties *props = fileRef.audioProperties();
+        if (props) {
+            if (props->length() > 0) {
+                meta->duration = props->length();
+                any_success = TRUE;
+            }
+            if (props->bitrate() > 0) {
+                meta->bitrate = props->bitrate();
+                any_success = TRUE;
+            }
+        }
+        
+        if (any_success && !meta->artwork_data) {
+            gboolean artwork_found = FALSE;
+            
+            if (id3v2) {
+                artwork_found = read_id3v2_artwork(id3v2, meta);
+            } else if (TagLib::FLAC::File *flacFile = dynamic_cast<TagLib::FLAC::File*>(file)) {
+                artwork_found = read_flac_artwork(flacFile, meta);
+            } else if (TagLib::MP4::File *mp4File = dynamic_cast<TagLib::MP4::File*>(file)) {
+                artwork_found = read_mp4_artwork(mp4File->tag(), meta);
+            }
+            
+            if (artwork_found) {
+                log_message(LOG_DEBUG, "TagLib native artwork extraction successful: %s (%zu bytes)", 
+                           file_path, meta->artwork_size);
+            }
+        }
+        
+        return any_success;
+        
+    } catch (const std::exception& e) {
+        log_message(LOG_WARNING, "TagLib exception while reading %s: %s", file_path, e.what());
+        return FALSE;
+    }
+}
@@ -9,8 +9,14 @@
 
 #include "../include/rbipod-commands.h"
 #include "../include/rbipod-database.h"
+#include "../include/rbipod-index.h"
+#include "../include/rbipod-journal.h"
+#include "../include/rbipod-trackindex.h"
+#include "../include/rbipod-dbreader.h"
+#include "../include/rbipod-search.h"
 #include "../include/rbipod-filesystem.h"
 #include "../include/rbipod-sync.h"
+#include "../include/rbipod-walker.h"
 #include "../include/rbipod-metadata.h"
 #include "../include/rbipod-logging.h"
 #include "../include/rbipod-utils.h"
@@ -60,6 +66,54 @@ int command_auto_mount(void) {
     }
 }
 
+// Host metadata cache and artwork deduplication counters for sync summaries
+static void print_cache_summary(void) {
+    printf("Metadata cache: %d hits, %d misses\n", g_sync_ctx.stats.metadata_cache_hits,
+           g_sync_ctx.stats.metadata_cache_misses);
+    
+    int artwork_lookups = g_sync_ctx.stats.artwork_cache_hits + g_sync_ctx.stats.artwork_cache_misses;
+    if (artwork_lookups > 0) {
+        printf("Artwork cache: %d hits, %d misses (%.1f%% hit rate, %.1f MB not reconverted)\n",
+               g_sync_ctx.stats.artwork_cache_hits, g_sync_ctx.stats.artwork_cache_misses,
+               100.0 * g_sync_ctx.stats.artwork_cache_hits / artwork_lookups,
+               g_sync_ctx.stats.artwork_bytes_saved / (1024.0 * 1024.0));
+    }
+    if (g_sync_ctx.stats.thumbnail_cache_hits + g_sync_ctx.stats.thumbnail_cache_misses > 0) {
+        printf("Thumbnail cache: %d hits, %d misses\n", g_sync_ctx.stats.thumbnail_cache_hits,
+               g_sync_ctx.stats.thumbnail_cache_misses);
+    }
+    if (g_sync_ctx.stats.folder_covers_used > 0) {
+        printf("Folder covers: %d tracks\n", g_sync_ctx.stats.folder_covers_used);
+    }
+    if (g_sync_ctx.stats.artwork_spilled > 0) {
+        printf("Artwork spilled to disk: %d images (memory budget reached)\n", g_sync_ctx.stats.artwork_spilled);
+    }
+    if (g_sync_ctx.stats.db_checkpoints > 0) {
+        printf("Database checkpoints: %d (%.1f s writing in background)\n", g_sync_ctx.stats.db_checkpoints,
+               g_sync_ctx.stats.checkpoint_write_us / (double)G_USEC_PER_SEC);
+    }
+    if (g_sync_ctx.stats.files_adopted + g_sync_ctx.stats.orphans_removed > 0) {
+        printf("Interrupted sync recovered: %d files adopted, %d partial files removed\n",
+               g_sync_ctx.stats.files_adopted, g_sync_ctx.stats.orphans_removed);
+    }
+}
+
+static void print_memory_summary(void) {
+    static const char *const phase_names[RB_IPOD_PHASE_COUNT] = {"scan", "transfer", "write"};
+    
+    GString *line = g_string_new(NULL);
+    for (int phase = 0; phase < RB_IPOD_PHASE_COUNT; phase++) {
+        gint64 peak_kb = g_sync_ctx.stats.peak_rss_kb[phase];
+        if (peak_kb <= 0) continue;
+        g_string_append_printf(line, "%s%s %.1f MB", line->len > 0 ? ", " : "",
+                               phase_names[phase], peak_kb / 1024.0);
+    }
+    if (line->len > 0) {
+        printf("Peak memory: %s\n", line->str);
+    }
+    g_string_free(line, TRUE);
+}
+
 int command_sync_directory(const char *mount_point, const char *sync_dir) {
     log_message(LOG_INFO, "Starting directory sync from %s to %s", sync_dir, mount_point);
     
@@ -77,30 +131,49 @@ int command_sync_directory(const char *mount_point, const char *sync_dir) {
         return 1;
     }
     
+    // Snapshot of the database before this command changes anything
+    create_database_backup(g_sync_ctx.ipod_db);
+    
     // Reset statistics
     memset(&g_sync_ctx.stats, 0, sizeof(g_sync_ctx.stats));
+    rb_ipod_phase_begin();
     
     time_t start_time = time(NULL);
     int tracks_before = itdb_tracks_number(g_sync_ctx.ipod_db->itdb);
     
-    // Count files for progress tracking
-    printf("Counting files in %s...\n", sync_dir);
-    int total_files = count_audio_files_recursive(sync_dir);
+    // Files copied by a sync that never reached its database save
+    rb_ipod_sync_journal_recover(g_sync_ctx.ipod_db);
+    
+    // Walk the source tree once; the manifest drives progress and the sync
+    printf("Scanning %s...\n", sync_dir);
+    RbIpodWalkStatus walk_status;
+    RbIpodManifest *manifest = rb_ipod_walk_directory(sync_dir, 0, &walk_status);
+    rb_ipod_phase_end(RB_IPOD_PHASE_SCAN);
     
-    if (total_files == 0) {
+    if (walk_status == RB_IPOD_WALK_CANCELLED) {
+        printf("Scan cancelled by user\n");
+        rb_ipod_db_free(g_sync_ctx.ipod_db);
+        g_sync_ctx.ipod_db = NULL;
+        return 1;
+    }
+    if (!manifest || manifest->entries->len == 0) {
         printf("No audio files found in %s\n", sync_dir);
+        rb_ipod_manifest_free(manifest);
         rb_ipod_db_free(g_sync_ctx.ipod_db);
         g_sync_ctx.ipod_db = NULL;
         return 0;
     }
     
-    printf("Found %d audio files to sync\n", total_files);
+    printf("Found %u audio files to sync\n", manifest->entries->len);
     
     // Perform sync
-    int current_file = 0;
-    gboolean success = sync_directory_recursive(g_sync_ctx.ipod_db, sync_dir, &current_file, total_files);
+    gboolean success = sync_manifest(g_sync_ctx.ipod_db, manifest);
+    rb_ipod_manifest_free(manifest);
+    
+    rb_ipod_phase_end(RB_IPOD_PHASE_TRANSFER);
     
     time_t end_time = time(NULL);
+    rb_ipod_db_wait_for_save(g_sync_ctx.ipod_db);    // Queued commits join the itdb
     int tracks_after = itdb_tracks_number(g_sync_ctx.ipod_db->itdb);
     
     // Save database
@@ -110,6 +183,7 @@ int command_sync_directory(const char *mount_point, const char *sync_dir) {
         g_sync_ctx.ipod_db = NULL;
         return 1;
     }
+    rb_ipod_phase_end(RB_IPOD_PHASE_WRITE);
     
     // Report results
     printf("\n=== Sync Complete ===\n");
@@ -117,6 +191,9 @@ int command_sync_directory(const char *mount_point, const char *sync_dir) {
     printf("Files added: %d\n", g_sync_ctx.stats.files_added);
     printf("Files skipped: %d\n", g_sync_ctx.stats.files_skipped);
     printf("Files failed: %d\n", g_sync_ctx.stats.files_failed);
+    printf("External tool spawns: %d\n", g_sync_ctx.stats.external_spawns);
+    print_cache_summary();
+    print_memory_summary();
     printf("Tracks before: %d\n", tracks_before);
     printf("Tracks after: %d\n", tracks_after);
     printf("Duration: %ld seconds\n", end_time - start_time);
@@ -126,30 +203,56 @@ int command_sync_directory(const char *mount_point, const char *sync_dir) {
     return success ? 0 : 1;
 }
 
-int command_sync_file(const char *mount_point, const char *file_path) {
-    log_message(LOG_INFO, "Starting single file sync from %s to %s", file_path, mount_point);
+int command_sync_files(const char *mount_point, const char *const *file_paths, int num_files) {
+    log_message(LOG_INFO, "Starting file sync of %d file(s) to %s", num_files, mount_point);
     
-    if (!file_path || access(file_path, F_OK) != 0) {
-        fprintf(stderr, "Error: File does not exist: %s\n", file_path);
+    if (!file_paths || num_files <= 0) {
+        fprintf(stderr, "Error: No file to synchronize\n");
         return 1;
     }
     
+    for (int i = 0; i < num_files; i++) {
+        if (access(file_paths[i], F_OK) != 0) {
+            fprintf(stderr, "Error: File does not exist: %s\n", file_paths[i]);
+            return 1;
+        }
+    }
+    
     g_sync_ctx.ipod_db = rb_ipod_db_new(mount_point);
     if (!g_sync_ctx.ipod_db) {
         fprintf(stderr, "Error: Failed to initialize iPod database\n");
         return 1;
     }
     
+    // Snapshot of the database before this command changes anything
+    create_database_backup(g_sync_ctx.ipod_db);
+    
     memset(&g_sync_ctx.stats, 0, sizeof(g_sync_ctx.stats));
+    rb_ipod_phase_begin();
     
     time_t start_time = time(NULL);
     int tracks_before = itdb_tracks_number(g_sync_ctx.ipod_db->itdb);
     
-    printf("Synchronizing file: %s\n", file_path);
+    // Files copied by a sync that never reached its database save
+    rb_ipod_sync_journal_recover(g_sync_ctx.ipod_db);
+    
+    gboolean success;
+    if (num_files == 1) {
+        printf("Synchronizing file: %s\n", file_paths[0]);
+        success = sync_single_file(g_sync_ctx.ipod_db, file_paths[0]);
+    } else {
+        // Batches go through the same pipeline as directory syncs
+        RbIpodManifest *manifest = rb_ipod_manifest_new_from_files(file_paths, (guint)num_files);
+        printf("Synchronizing %u files\n", manifest->entries->len);
+        success = sync_manifest(g_sync_ctx.ipod_db, manifest) && manifest->errors == 0;
+        g_sync_ctx.stats.files_failed += manifest->errors;
+        rb_ipod_manifest_free(manifest);
+    }
     
-    gboolean success = sync_single_file(g_sync_ctx.ipod_db, file_path);
+    rb_ipod_phase_end(RB_IPOD_PHASE_TRANSFER);
     
     time_t end_time = time(NULL);
+    rb_ipod_db_wait_for_save(g_sync_ctx.ipod_db);    // Queued commits join the itdb
     int tracks_after = itdb_tracks_number(g_sync_ctx.ipod_db->itdb);
     
     if (!rb_ipod_db_save_sync(g_sync_ctx.ipod_db)) {
@@ -158,12 +261,16 @@ int command_sync_file(const char *mount_point, const char *file_path) {
         g_sync_ctx.ipod_db = NULL;
         return 1;
     }
+    rb_ipod_phase_end(RB_IPOD_PHASE_WRITE);
     
     printf("\n=== Sync Complete ===\n");
     printf("Result: %s\n", success ? "SUCCESS" : "FAILED");
     printf("Files added: %d\n", g_sync_ctx.stats.files_added);
     printf("Files skipped: %d\n", g_sync_ctx.stats.files_skipped);
     printf("Files failed: %d\n", g_sync_ctx.stats.files_failed);
+    printf("External tool spawns: %d\n", g_sync_ctx.stats.external_spawns);
+    print_cache_summary();
+    print_memory_summary();
     printf("Tracks before: %d\n", tracks_before);
     printf("Tracks after: %d\n", tracks_after);
     printf("Duration: %ld seconds\n", end_time - start_time);
@@ -204,27 +311,46 @@ int command_sync_folder_filtered(const char *mount_point, const char *folder_pat
         return 1;
     }
     
+    // Snapshot of the database before this command changes anything
+    create_database_backup(g_sync_ctx.ipod_db);
+    
     memset(&g_sync_ctx.stats, 0, sizeof(g_sync_ctx.stats));
+    rb_ipod_phase_begin();
     
     time_t start_time = time(NULL);
     int tracks_before = itdb_tracks_number(g_sync_ctx.ipod_db->itdb);
     
-    printf("Counting files in %s...\n", folder_path);
-    int total_files = count_audio_files_recursive(folder_path);
+    // Files copied by a sync that never reached its database save
+    rb_ipod_sync_journal_recover(g_sync_ctx.ipod_db);
     
-    if (total_files == 0) {
+    printf("Scanning %s...\n", folder_path);
+    RbIpodWalkStatus walk_status;
+    RbIpodManifest *manifest = rb_ipod_walk_directory(folder_path, 0, &walk_status);
+    rb_ipod_phase_end(RB_IPOD_PHASE_SCAN);
+    
+    if (walk_status == RB_IPOD_WALK_CANCELLED) {
+        printf("Scan cancelled by user\n");
+        rb_ipod_db_free(g_sync_ctx.ipod_db);
+        g_sync_ctx.ipod_db = NULL;
+        return 1;
+    }
+    if (!manifest || manifest->entries->len == 0) {
         printf("No audio files found in %s\n", folder_path);
+        rb_ipod_manifest_free(manifest);
         rb_ipod_db_free(g_sync_ctx.ipod_db);
         g_sync_ctx.ipod_db = NULL;
         return 0;
     }
     
-    printf("Found %d audio files to sync with media type: %s\n", total_files, get_media_type_name(filter_mediatype));
+    printf("Found %u audio files to sync with media type: %s\n", manifest->entries->len, get_media_type_name(filter_mediatype));
     
-    int current_file = 0;
-    gboolean success = sync_folder_filtered(g_sync_ctx.ipod_db, folder_path, filter_mediatype, &current_file, total_files);
+    gboolean success = sync_folder_filtered(g_sync_ctx.ipod_db, manifest, filter_mediatype);
+    rb_ipod_manifest_free(manifest);
+    
+    rb_ipod_phase_end(RB_IPOD_PHASE_TRANSFER);
     
     time_t end_time = time(NULL);
+    rb_ipod_db_wait_for_save(g_sync_ctx.ipod_db);    // Queued commits join the itdb
     int tracks_after = itdb_tracks_number(g_sync_ctx.ipod_db->itdb);
     
     if (!rb_ipod_db_save_sync(g_sync_ctx.ipod_db)) {
@@ -233,6 +359,7 @@ int command_sync_folder_filtered(const char *mount_point, const char *folder_pat
         g_sync_ctx.ipod_db = NULL;
         return 1;
     }
+    rb_ipod_phase_end(RB_IPOD_PHASE_WRITE);
     
     printf("\n=== Sync Complete ===\n");
     printf("Result: %s\n", success ? "SUCCESS" : "FAILED");
@@ -240,6 +367,9 @@ int command_sync_folder_filtered(const char *mount_point, const char *folder_pat
     printf("Files added: %d\n", g_sync_ctx.stats.files_added);
     printf("Files skipped: %d\n", g_sync_ctx.stats.files_skipped);
     printf("Files failed: %d\n", g_sync_ctx.stats.files_failed);
+    printf("External tool spawns: %d\n", g_sync_ctx.stats.external_spawns);
+    print_cache_summary();
+    print_memory_summary();
     printf("Tracks before: %d\n", tracks_before);
     printf("Tracks after: %d\n", tracks_after);
     printf("Duration: %ld seconds\n", end_time - start_time);
@@ -249,14 +379,135 @@ int command_sync_folder_filtered(const char *mount_point, const char *folder_pat
     return success ? 0 : 1;
 }
 
+// =============================================================================
+// READ-ONLY REPORTS
+// =============================================================================
+
+// list and info stream the mapped iTunesDB (rbipod-dbreader) and only load
+// it through libgpod when it cannot be read directly
+
+#define RECENT_TRACKS_SHOWN 10
+
+typedef struct {
+    guint audio, podcast, audiobook, video;
+    gint64 total_size, total_duration;
+    int mp3_count, m4a_count, other_format_count;
+    RbIpodDbTrackRecord recent[RECENT_TRACKS_SHOWN];   // Ring of the last records
+    guint seen;
+} DeviceSummary;
+
+static const char* media_type_label(guint32 mediatype) {
+    switch (mediatype) {
+        case ITDB_MEDIATYPE_PODCAST: return "Podcast";
+        case ITDB_MEDIATYPE_AUDIOBOOK: return "Audiobook";
+        case ITDB_MEDIATYPE_MOVIE: return "Movie";
+        case ITDB_MEDIATYPE_MUSICVIDEO: return "Music Video";
+        case ITDB_MEDIATYPE_TVSHOW: return "TV Show";
+        default: return "Audio";
+    }
+}
+
+static gboolean summarize_track(const RbIpodDbTrackRecord *record, gpointer user_data) {
+    DeviceSummary *summary = user_data;
+    
+    switch (record->mediatype) {
+        case ITDB_MEDIATYPE_AUDIO: summary->audio++; break;
+        case ITDB_MEDIATYPE_PODCAST: summary->podcast++; break;
+        case ITDB_MEDIATYPE_AUDIOBOOK: summary->audiobook++; break;
+        case ITDB_MEDIATYPE_MOVIE:
+        case ITDB_MEDIATYPE_MUSICVIDEO:
+        case ITDB_MEDIATYPE_TVSHOW: summary->video++; break;
+    }
+    summary->total_size += record->size;
+    summary->total_duration += record->tracklen;
+    summary->recent[summary->seen % RECENT_TRACKS_SHOWN] = *record;
+    summary->seen++;
+    return TRUE;
+}
+
+static gboolean count_file_format(const RbIpodDbTrackRecord *record, gpointer user_data) {
+    DeviceSummary *summary = user_data;
+    
+    if (rb_ipod_dbreader_track_string_is(record, RB_IPOD_MHOD_FILETYPE, "mp3")) {
+        summary->mp3_count++;
+    } else if (rb_ipod_dbreader_track_string_is(record, RB_IPOD_MHOD_FILETYPE, "m4a")) {
+        summary->m4a_count++;
+    } else {
+        summary->other_format_count++;
+    }
+    return TRUE;
+}
+
+static gboolean print_playlist_record(const RbIpodDbPlaylistRecord *record, gpointer user_data) {
+    (void)user_data;
+    char *name = rb_ipod_dbreader_playlist_name(record);
+    const char *playlist_type = record->master ? " (Master)" : record->podcasts ? " (Podcasts)" : "";
+    
+    printf("  %-20s: %u tracks%s\n", name ? name : "(Unnamed)", record->items, playlist_type);
+    g_free(name);
+    return TRUE;
+}
+
+static void print_media_type_counts(int audio, int podcast, int audiobook, int video, int other) {
+    printf("\nTRACKS BY MEDIA TYPE:\n");
+    printf("  Audio/Music:     %d\n", audio);
+    printf("  Podcasts:        %d\n", podcast);
+    printf("  Audiobooks:      %d\n", audiobook);
+    printf("  Videos:          %d\n", video);
+    printf("  Other:           %d\n", other);
+}
+
+static void list_tracks_from_reader(RbIpodDbReader *reader) {
+    guint total = rb_ipod_dbreader_track_count(reader);
+    
+    printf("=== IPOD TRACK LISTING ===\n");
+    printf("Total tracks: %u\n", total);
+    printf("Total playlists: %u\n\n", rb_ipod_dbreader_playlist_count(reader));
+    
+    printf("PLAYLISTS:\n");
+    rb_ipod_dbreader_foreach_playlist(reader, print_playlist_record, NULL);
+    
+    DeviceSummary summary = {0};
+    rb_ipod_dbreader_foreach_track(reader, summarize_track, &summary);
+    print_media_type_counts(summary.audio, summary.podcast, summary.audiobook, summary.video,
+                            (int)(summary.seen - summary.audio - summary.podcast -
+                                  summary.audiobook - summary.video));
+    
+    // Only the ten records shown are decoded
+    printf("\nRECENT TRACKS (last %d):\n", RECENT_TRACKS_SHOWN);
+    guint shown = MIN(summary.seen, RECENT_TRACKS_SHOWN);
+    for (guint i = 1; i <= shown; i++) {
+        const RbIpodDbTrackRecord *record = &summary.recent[(summary.seen - i) % RECENT_TRACKS_SHOWN];
+        char *artist = rb_ipod_dbreader_track_string(record, RB_IPOD_MHOD_ARTIST);
+        char *title = rb_ipod_dbreader_track_string(record, RB_IPOD_MHOD_TITLE);
+        
+        printf("  [%s] %s - %s\n",
+               media_type_label(record->mediatype),
+               artist ? artist : "Unknown Artist",
+               title ? title : "Unknown Title");
+        g_free(artist);
+        g_free(title);
+    }
+    if (summary.seen != total) {
+        log_message(LOG_WARNING, "Track list holds %u records, header says %u", summary.seen, total);
+    }
+}
+
 int command_list_tracks(const char *mount_point) {
     log_message(LOG_INFO, "Listing iPod tracks");
     
+    RbIpodDbReader *reader = rb_ipod_dbreader_open(mount_point);
+    if (reader) {
+        list_tracks_from_reader(reader);
+        rb_ipod_dbreader_close(reader);
+        return 0;
+    }
+    
     RbIpodDb *db = rb_ipod_db_new(mount_point);
     if (!db) return 1;
     
     printf("=== IPOD TRACK LISTING ===\n");
-    printf("Total tracks: %d\n", g_list_length(db->itdb->tracks));
+    printf("Total tracks: %u\n", rb_ipod_track_index_count(db->track_index));
     printf("Total playlists: %d\n\n", g_list_length(db->itdb->playlists));
     
     // Show playlists and their track counts
@@ -280,56 +531,26 @@ int command_list_tracks(const char *mount_point) {
     }
     
     // Show tracks by media type
-    printf("\nTRACKS BY MEDIA TYPE:\n");
-    int audio_count = 0, podcast_count = 0, audiobook_count = 0, video_count = 0, other_count = 0;
-    
-    for (GList *item = db->itdb->tracks; item; item = item->next) {
-        Itdb_Track *track = (Itdb_Track*)item->data;
-        
-        switch (track->mediatype) {
-            case ITDB_MEDIATYPE_AUDIO:
-                audio_count++;
-                break;
-            case ITDB_MEDIATYPE_PODCAST:
-                podcast_count++;
-                break;
-            case ITDB_MEDIATYPE_AUDIOBOOK:
-                audiobook_count++;
-                break;
-            case ITDB_MEDIATYPE_MOVIE:
-            case ITDB_MEDIATYPE_MUSICVIDEO:
-            case ITDB_MEDIATYPE_TVSHOW:
-                video_count++;
-                break;
-            default:
-                other_count++;
-                break;
-        }
-    }
-    
-    printf("  Audio/Music:     %d\n", audio_count);
-    printf("  Podcasts:        %d\n", podcast_count);
-    printf("  Audiobooks:      %d\n", audiobook_count);
-    printf("  Videos:          %d\n", video_count);
-    printf("  Other:           %d\n", other_count);
+    RbIpodTrackIndex *index = db->track_index;
+    int audio_count = rb_ipod_track_index_count_mediatype(index, ITDB_MEDIATYPE_AUDIO);
+    int podcast_count = rb_ipod_track_index_count_mediatype(index, ITDB_MEDIATYPE_PODCAST);
+    int audiobook_count = rb_ipod_track_index_count_mediatype(index, ITDB_MEDIATYPE_AUDIOBOOK);
+    int video_count = rb_ipod_track_index_count_mediatype(index, ITDB_MEDIATYPE_MOVIE) +
+                      rb_ipod_track_index_count_mediatype(index, ITDB_MEDIATYPE_MUSICVIDEO) +
+                      rb_ipod_track_index_count_mediatype(index, ITDB_MEDIATYPE_TVSHOW);
+    int other_count = (int)rb_ipod_track_index_count(index) - audio_count - podcast_count -
+                      audiobook_count - video_count;
+    
+    print_media_type_counts(audio_count, podcast_count, audiobook_count, video_count, other_count);
     
     // Show some recent tracks
-    printf("\nRECENT TRACKS (last 10):\n");
+    printf("\nRECENT TRACKS (last %d):\n", RECENT_TRACKS_SHOWN);
     int count = 0;
-    for (GList *item = g_list_last(db->itdb->tracks); item && count < 10; item = item->prev, count++) {
+    for (GList *item = g_list_last(db->itdb->tracks); item && count < RECENT_TRACKS_SHOWN; item = item->prev, count++) {
         Itdb_Track *track = (Itdb_Track*)item->data;
-        const char *media_type_name = "Audio";
-        
-        switch (track->mediatype) {
-            case ITDB_MEDIATYPE_PODCAST: media_type_name = "Podcast"; break;
-            case ITDB_MEDIATYPE_AUDIOBOOK: media_type_name = "Audiobook"; break;
-            case ITDB_MEDIATYPE_MOVIE: media_type_name = "Movie"; break;
-            case ITDB_MEDIATYPE_MUSICVIDEO: media_type_name = "Music Video"; break;
-            case ITDB_MEDIATYPE_TVSHOW: media_type_name = "TV Show"; break;
-        }
         
         printf("  [%s] %s - %s\n", 
-               media_type_name,
+               media_type_label(track->mediatype),
                track->artist ? track->artist : "Unknown Artist",
                track->title ? track->title : "Unknown Title");
     }
@@ -338,41 +559,8 @@ int command_list_tracks(const char *mount_point) {
     return 0;
 }
 
-int command_show_info(const char *mount_point) {
-    log_message(LOG_INFO, "Showing iPod information");
-    
-    RbIpodDb *db = rb_ipod_db_new(mount_point);
-    if (!db) return 1;
-    
-    printf("=== IPOD INFORMATION ===\n");
-    printf("Mount point:      %s\n", mount_point);
-    printf("Total tracks:     %d\n", g_list_length(db->itdb->tracks));
-    printf("Total playlists:  %d\n", g_list_length(db->itdb->playlists));
-    
-    // Calculate statistics
-    gint64 total_size = 0;
-    gint64 total_duration = 0;
-    int mp3_count = 0, m4a_count = 0, other_count = 0;
-    
-    for (GList *item = db->itdb->tracks; item; item = item->next) {
-        Itdb_Track *track = (Itdb_Track*)item->data;
-        
-        total_size += track->size;
-        total_duration += track->tracklen;
-        
-        if (track->filetype) {
-            if (g_ascii_strcasecmp(track->filetype, "mp3") == 0) {
-                mp3_count++;
-            } else if (g_ascii_strcasecmp(track->filetype, "m4a") == 0) {
-                m4a_count++;
-            } else {
-                other_count++;
-            }
-        } else {
-            other_count++;
-        }
-    }
-    
+static void print_totals(gint64 total_size, gint64 total_duration,
+                         int mp3_count, int m4a_count, int other_count) {
     if (total_duration > 0) {
         int hours = total_duration / (1000 * 3600);
         int minutes = (total_duration % (1000 * 3600)) / (1000 * 60);
@@ -387,10 +575,12 @@ int command_show_info(const char *mount_point) {
     printf("  MP3:            %d\n", mp3_count);
     printf("  M4A/AAC:        %d\n", m4a_count);
     printf("  Other:          %d\n", other_count);
-    
-    if (db->itdb->device) {
+}
+
+static void print_device_info(const Itdb_Device *device, const char *mount_point) {
+    if (device) {
         printf("\nDevice detected:  Yes\n");
-        const Itdb_IpodInfo *info = itdb_device_get_ipod_info(db->itdb->device);
+        const Itdb_IpodInfo *info = itdb_device_get_ipod_info(device);
         if (info) {
             printf("Model:            %s\n", 
                    itdb_info_get_ipod_model_name_string(info->ipod_model));
@@ -422,11 +612,117 @@ int command_show_info(const char *mount_point) {
         printf("Model:            N/A (directory mode)\n");
         printf("Generation:       N/A (directory mode)\n");
     }
+}
+
+static gboolean summarize_track_format(const RbIpodDbTrackRecord *record, gpointer user_data) {
+    summarize_track(record, user_data);
+    return count_file_format(record, user_data);
+}
+
+static void show_info_from_reader(RbIpodDbReader *reader, const char *mount_point) {
+    printf("=== IPOD INFORMATION ===\n");
+    printf("Mount point:      %s\n", mount_point);
+    printf("Total tracks:     %u\n", rb_ipod_dbreader_track_count(reader));
+    printf("Total playlists:  %u\n", rb_ipod_dbreader_playlist_count(reader));
+    
+    DeviceSummary summary = {0};
+    rb_ipod_dbreader_foreach_track(reader, summarize_track_format, &summary);
+    print_totals(summary.total_size, summary.total_duration,
+                 summary.mp3_count, summary.m4a_count, summary.other_format_count);
+    
+    // SysInfo only, the database is not parsed again
+    Itdb_Device *device = itdb_device_new();
+    itdb_device_set_mountpoint(device, mount_point);
+    print_device_info(device, mount_point);
+    itdb_device_free(device);
+}
+
+int command_show_info(const char *mount_point) {
+    log_message(LOG_INFO, "Showing iPod information");
+    
+    RbIpodDbReader *reader = rb_ipod_dbreader_open(mount_point);
+    if (reader) {
+        show_info_from_reader(reader, mount_point);
+        rb_ipod_dbreader_close(reader);
+        return 0;
+    }
+    
+    RbIpodDb *db = rb_ipod_db_new(mount_point);
+    if (!db) return 1;
+    
+    printf("=== IPOD INFORMATION ===\n");
+    printf("Mount point:      %s\n", mount_point);
+    printf("Total tracks:     %u\n", rb_ipod_track_index_count(db->track_index));
+    printf("Total playlists:  %d\n", g_list_length(db->itdb->playlists));
+    
+    // Calculate statistics
+    gint64 total_size = 0;
+    gint64 total_duration = 0;
+    int mp3_count = 0, m4a_count = 0, other_count = 0;
+    
+    for (GList *item = db->itdb->tracks; item; item = item->next) {
+        Itdb_Track *track = (Itdb_Track*)item->data;
+        
+        total_size += track->size;
+        total_duration += track->tracklen;
+        
+        if (track->filetype) {
+            if (g_ascii_strcasecmp(track->filetype, "mp3") == 0) {
+                mp3_count++;
+            } else if (g_ascii_strcasecmp(track->filetype, "m4a") == 0) {
+                m4a_count++;
+            } else {
+                other_count++;
+            }
+        } else {
+            other_count++;
+        }
+    }
+    
+    print_totals(total_size, total_duration, mp3_count, m4a_count, other_count);
+    print_device_info(db->itdb->device, mount_point);
     
     rb_ipod_db_free(db);
     return 0;
 }
 
+int command_search(const char *mount_point, const char *query, guint32 mediatype, guint limit) {
+    log_message(LOG_INFO, "Searching iPod for: %s", query ? query : "");
+    
+    gint64 start = g_get_monotonic_time();
+    RbIpodSearchIndex *index = rb_ipod_search_index_open(mount_point, NULL);
+    if (!index) return 1;
+    
+    GArray *hits = g_array_new(FALSE, FALSE, sizeof(guint32));
+    guint found = rb_ipod_search_index_query(index, query, mediatype, limit, hits);
+    gint64 elapsed_us = g_get_monotonic_time() - start;
+    
+    printf("=== IPOD SEARCH: %s ===\n", query && *query ? query : "(all)");
+    if (mediatype != 0) {
+        printf("Media type: %s\n", get_media_type_name(mediatype));
+    }
+    printf("\n");
+    
+    for (guint i = 0; i < hits->len; i++) {
+        RbIpodSearchEntry entry;
+        if (!rb_ipod_search_index_entry(index, g_array_index(hits, guint32, i), &entry)) continue;
+        
+        printf("  [%s] %s - %s", media_type_label(entry.mediatype),
+               *entry.artist ? entry.artist : "Unknown Artist",
+               *entry.title ? entry.title : "Unknown Title");
+        if (*entry.album) printf(" (%s)", entry.album);
+        printf("\n      %s\n", entry.ipod_path);
+    }
+    
+    printf("\n%u result%s%s in %.1f ms (%u tracks, %s index)\n", found, found == 1 ? "" : "s",
+           limit > 0 && found == limit ? ", limit reached" : "", elapsed_us / 1000.0,
+           rb_ipod_search_index_size(index), rb_ipod_search_index_from_cache(index) ? "cached" : "new");
+    
+    g_array_free(hits, TRUE);
+    rb_ipod_search_index_free(index);
+    return 0;
+}
+
 int command_reset_media_type(const char *mount_point, const char *media_type_str) {
     log_message(LOG_INFO, "Starting reset of media type: %s", media_type_str);
     
@@ -462,68 +758,41 @@ int command_reset_media_type(const char *mount_point, const char *media_type_str
         return 0;
     }
     
-    int removed_tracks = 0;
-    int removed_files = 0;
+    create_database_backup(db);
     
-    // Create a list of tracks to remove (to avoid modifying list while iterating)
-    GList *tracks_to_remove = NULL;
+    // Partition once: the tracks to drop and their files on the device
+    GHashTable *tracks_to_remove = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GPtrArray *files_to_delete = g_ptr_array_new_with_free_func(g_free);
     
     for (GList *item = db->itdb->tracks; item; item = item->next) {
         Itdb_Track *track = (Itdb_Track*)item->data;
-        if (track->mediatype == target_mediatype) {
-            tracks_to_remove = g_list_prepend(tracks_to_remove, track);
+        if (track->mediatype != target_mediatype) continue;
+        
+        g_hash_table_add(tracks_to_remove, track);
+        if (track->ipod_path) {
+            char *relative = rb_ipod_normalize_ipod_path(track->ipod_path);
+            g_ptr_array_add(files_to_delete, g_build_filename(mount_point, relative, NULL));
+            g_free(relative);
         }
+        printf("Removing: %s - %s\n",
+               track->artist ? track->artist : "Unknown Artist",
+               track->title ? track->title : "Unknown Title");
     }
     
-    printf("Found %d tracks of type '%s' to remove\n", g_list_length(tracks_to_remove), media_type_str);
+    printf("Found %u tracks of type '%s' to remove\n", g_hash_table_size(tracks_to_remove), media_type_str);
     
-    // Remove tracks from playlists and database
-    for (GList *item = tracks_to_remove; item; item = item->next) {
-        Itdb_Track *track = (Itdb_Track*)item->data;
-        
-        // Store track info before removal (since track memory will be freed)
-        char *artist_copy = track->artist ? g_strdup(track->artist) : g_strdup("Unknown Artist");
-        char *title_copy = track->title ? g_strdup(track->title) : g_strdup("Unknown Title");
-        char *ipod_path_copy = track->ipod_path ? g_strdup(track->ipod_path) : NULL;
-        
-        // Remove file from iPod if path exists
-        if (ipod_path_copy) {
-            char full_path[1024];
-            snprintf(full_path, sizeof(full_path), "%s%s", mount_point, ipod_path_copy);
-            
-            if (unlink(full_path) == 0) {
-                removed_files++;
-                log_message(LOG_DEBUG, "Deleted file: %s", ipod_path_copy);
-            } else {
-                log_message(LOG_WARNING, "Could not delete file: %s", ipod_path_copy);
-            }
-        }
-        
-        // Remove from all playlists
-        for (GList *pl_item = db->itdb->playlists; pl_item; pl_item = pl_item->next) {
-            Itdb_Playlist *playlist = (Itdb_Playlist*)pl_item->data;
-            itdb_playlist_remove_track(playlist, track);
-        }
-        
-        // Remove from main database
-        itdb_track_remove(track);
-        removed_tracks++;
-        
-        printf("Removed: %s - %s\n", artist_copy, title_copy);
-        
-        // Free our copies
-        g_free(artist_copy);
-        g_free(title_copy);
-        if (ipod_path_copy) g_free(ipod_path_copy);
-    }
+    int removed_files = rb_ipod_unlink_files(files_to_delete, 0);
+    int removed_tracks = rb_ipod_db_remove_tracks(db, tracks_to_remove);
     
-    g_list_free(tracks_to_remove);
+    g_ptr_array_free(files_to_delete, TRUE);
+    g_hash_table_destroy(tracks_to_remove);
     
     // Clean up empty playlists if needed
     if (target_mediatype == ITDB_MEDIATYPE_PODCAST) {
         // Remove empty podcasts playlist
         Itdb_Playlist *podcasts_pl = itdb_playlist_podcasts(db->itdb);
-        if (podcasts_pl && g_list_length(podcasts_pl->members) == 0) {
+        if (podcasts_pl && podcasts_pl->members == NULL) {
+            rb_ipod_track_index_remove_playlist(db->track_index, podcasts_pl);
             itdb_playlist_remove(podcasts_pl);
             log_message(LOG_INFO, "Removed empty Podcasts playlist");
         }
@@ -570,101 +839,20 @@ int command_reset_all(const char *mount_point) {
         return 0;
     }
     
-    int total_tracks = g_list_length(db->itdb->tracks);
-    int total_playlists = g_list_length(db->itdb->playlists);
-    int removed_tracks = 0;
-    int removed_files = 0;
-    int removed_playlists = 0;
+    create_database_backup(db);
     
-    printf("Found %d tracks and %d playlists to remove\n", total_tracks, total_playlists);
+    int removed_tracks = rb_ipod_track_index_count(db->track_index);
+    int removed_playlists = g_list_length(db->itdb->playlists) - 1;    // The master playlist stays
     
-    // Create a list of tracks to remove (to avoid modifying list while iterating)
-    GList *tracks_to_remove = NULL;
-    for (GList *item = db->itdb->tracks; item; item = item->next) {
-        tracks_to_remove = g_list_prepend(tracks_to_remove, item->data);
-    }
+    printf("Found %d tracks and %d playlists to remove\n", removed_tracks, removed_playlists);
     
-    // Remove all tracks and their files
-    for (GList *item = tracks_to_remove; item; item = item->next) {
-        Itdb_Track *track = (Itdb_Track*)item->data;
-        
-        // Store track info before removal
-        char *artist_copy = track->artist ? g_strdup(track->artist) : g_strdup("Unknown Artist");
-        char *title_copy = track->title ? g_strdup(track->title) : g_strdup("Unknown Title");
-        char *ipod_path_copy = track->ipod_path ? g_strdup(track->ipod_path) : NULL;
-        
-        // Remove file from iPod if path exists
-        if (ipod_path_copy) {
-            char full_path[1024];
-            snprintf(full_path, sizeof(full_path), "%s%s", mount_point, ipod_path_copy);
-            
-            if (unlink(full_path) == 0) {
-                removed_files++;
-                log_message(LOG_DEBUG, "Deleted file: %s", ipod_path_copy);
-            } else {
-                log_message(LOG_DEBUG, "Could not delete file: %s (may not exist)", ipod_path_copy);
-            }
-        }
-        
-        // Remove from all playlists
-        for (GList *pl_item = db->itdb->playlists; pl_item; pl_item = pl_item->next) {
-            Itdb_Playlist *playlist = (Itdb_Playlist*)pl_item->data;
-            itdb_playlist_remove_track(playlist, track);
-        }
-        
-        // Remove from main database
-        itdb_track_remove(track);
-        removed_tracks++;
-        
-        if (removed_tracks % 10 == 0 || removed_tracks == total_tracks) {
-            printf("Progress: %d/%d tracks removed\n", removed_tracks, total_tracks);
-        }
-        
-        // Free our copies
-        g_free(artist_copy);
-        g_free(title_copy);
-        if (ipod_path_copy) g_free(ipod_path_copy);
-    }
-    
-    g_list_free(tracks_to_remove);
-    
-    // Remove all non-master playlists
-    GList *playlists_to_remove = NULL;
-    for (GList *pl_item = db->itdb->playlists; pl_item; pl_item = pl_item->next) {
-        Itdb_Playlist *playlist = (Itdb_Playlist*)pl_item->data;
-        // Keep only the master playlist
-        if (!itdb_playlist_is_mpl(playlist)) {
-            playlists_to_remove = g_list_prepend(playlists_to_remove, playlist);
-        }
-    }
-    
-    for (GList *item = playlists_to_remove; item; item = item->next) {
-        Itdb_Playlist *playlist = (Itdb_Playlist*)item->data;
-        log_message(LOG_DEBUG, "Removing playlist: %s", playlist->name ? playlist->name : "(Unnamed)");
-        itdb_playlist_remove(playlist);
-        removed_playlists++;
-    }
-    
-    g_list_free(playlists_to_remove);
-    
-    // Clean up empty music directories
-    char music_dir[1024];
-    snprintf(music_dir, sizeof(music_dir), "%s/iPod_Control/Music", mount_point);
-    
-    // Try to remove all F** directories
-    for (int i = 0; i < 100; i++) {
-        char subdir[1024];
-        snprintf(subdir, sizeof(subdir), "%s/F%02d", music_dir, i);
-        
-        // Remove all files in the directory first
-        char command[2048];
-        snprintf(command, sizeof(command), "rm -f \"%s\"/* 2>/dev/null", subdir);
-        system(command);
-        
-        // Try to remove the directory (will only work if empty)
-        if (rmdir(subdir) == 0) {
-            log_message(LOG_DEBUG, "Removed empty directory: %s", subdir);
-        }
+    // Every file under Music/Fxx goes, tracked or not, and the database
+    // restarts empty instead of losing its tracks one at a time
+    int removed_files = rb_ipod_clear_music_dirs(mount_point, 0);
+    if (!rb_ipod_db_reset(db)) {
+        fprintf(stderr, "Error: Failed to reset iPod database\n");
+        rb_ipod_db_free(db);
+        return 1;
     }
     
     // Save the cleaned database
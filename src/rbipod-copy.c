@@ -0,0 +1,239 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <glib.h>
+
+#include "../include/rbipod-copy.h"
+#include "../include/rbipod-logging.h"
+
+// =============================================================================
+// FILE COPY ENGINE
+// =============================================================================
+
+// Data is moved in COPY_WINDOW_SIZE windows. After each window the kernel
+// is asked to start writeback, and the previous window (already on its way
+// to the device) is dropped from the page cache on both sides, so a large
+// sync keeps a bounded amount of dirty and cached data.
+
+typedef enum {
+    COPY_STEP_OK,
+    COPY_STEP_UNSUPPORTED,  // Strategy not usable for this pair of files
+    COPY_STEP_ERROR
+} CopyStepResult;
+
+const char* rb_ipod_copy_strategy_name(RbIpodCopyStrategy strategy) {
+    switch (strategy) {
+        case RB_IPOD_COPY_AUTO: return "auto";
+        case RB_IPOD_COPY_FILE_RANGE: return "copy_file_range";
+        case RB_IPOD_COPY_SENDFILE: return "sendfile";
+        case RB_IPOD_COPY_BUFFERED: return "buffered";
+        default: return "unknown";
+    }
+}
+
+static gboolean is_unsupported_errno(int err) {
+    return err == ENOSYS || err == EXDEV || err == EINVAL ||
+           err == EOPNOTSUPP || err == EBADF || err == ETXTBSY;
+}
+
+static CopyStepResult copy_window_file_range(int src_fd, int dest_fd, off_t offset, size_t length,
+                                             gboolean first_window) {
+    loff_t src_off = offset;
+    loff_t dest_off = offset;
+
+    while (length > 0) {
+        ssize_t copied = copy_file_range(src_fd, &src_off, dest_fd, &dest_off, length, 0);
+        if (copied < 0) {
+            if (errno == EINTR) continue;
+            // Nothing written yet: let the caller pick another strategy
+            if (first_window && src_off == offset && is_unsupported_errno(errno)) {
+                return COPY_STEP_UNSUPPORTED;
+            }
+            return COPY_STEP_ERROR;
+        }
+        if (copied == 0) return COPY_STEP_ERROR; // Source shrank under us
+        length -= copied;
+    }
+    return COPY_STEP_OK;
+}
+
+static CopyStepResult copy_window_sendfile(int src_fd, int dest_fd, off_t offset, size_t length,
+                                           gboolean first_window) {
+    off_t src_off = offset;
+
+    if (lseek(dest_fd, offset, SEEK_SET) < 0) return COPY_STEP_ERROR;
+
+    while (length > 0) {
+        ssize_t copied = sendfile(dest_fd, src_fd, &src_off, length);
+        if (copied < 0) {
+            if (errno == EINTR) continue;
+            if (first_window && src_off == offset && is_unsupported_errno(errno)) {
+                return COPY_STEP_UNSUPPORTED;
+            }
+            return COPY_STEP_ERROR;
+        }
+        if (copied == 0) return COPY_STEP_ERROR;
+        length -= copied;
+    }
+    return COPY_STEP_OK;
+}
+
+static CopyStepResult copy_window_buffered(int src_fd, int dest_fd, off_t offset, size_t length,
+                                           guchar *buffer) {
+    while (length > 0) {
+        size_t chunk = MIN(length, (size_t)COPY_BUFFER_SIZE);
+        ssize_t bytes_read = pread(src_fd, buffer, chunk, offset);
+        if (bytes_read < 0) {
+            if (errno == EINTR) continue;
+            return COPY_STEP_ERROR;
+        }
+        if (bytes_read == 0) return COPY_STEP_ERROR;
+
+        ssize_t done = 0;
+        while (done < bytes_read) {
+            ssize_t written = pwrite(dest_fd, buffer + done, bytes_read - done, offset + done);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return COPY_STEP_ERROR;
+            }
+            done += written;
+        }
+
+        offset += bytes_read;
+        length -= bytes_read;
+    }
+    return COPY_STEP_OK;
+}
+
+static void preallocate_destination(int dest_fd, off_t size) {
+    if (size <= 0) return;
+
+    // KEEP_SIZE reserves clusters up front (contiguous on FAT32) without the
+    // zero-fill vfat performs when a file is extended. Plain ftruncate is
+    // deliberately not used as a fallback for that reason.
+    if (fallocate(dest_fd, FALLOC_FL_KEEP_SIZE, 0, size) != 0 && errno != EOPNOTSUPP) {
+        log_message(LOG_DEBUG, "fallocate failed, continuing without preallocation: %s", strerror(errno));
+    }
+}
+
+static void release_window(int src_fd, int dest_fd, off_t offset, off_t length) {
+    if (length <= 0) return;
+
+    // Wait for the window's writeback, then both sides can leave the cache
+    sync_file_range(dest_fd, offset, length,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(dest_fd, offset, length, POSIX_FADV_DONTNEED);
+    posix_fadvise(src_fd, offset, length, POSIX_FADV_DONTNEED);
+}
+
+gboolean rb_ipod_copy_file(const char *source_path, const char *dest_path,
+                           RbIpodCopyStrategy strategy, RbIpodCopyStrategy *used_strategy) {
+    if (!source_path || !dest_path) return FALSE;
+
+    int src_fd = open(source_path, O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) {
+        log_message(LOG_ERROR, "Cannot open source file %s: %s", source_path, strerror(errno));
+        return FALSE;
+    }
+
+    struct stat source_stat;
+    if (fstat(src_fd, &source_stat) != 0) {
+        log_message(LOG_ERROR, "Cannot stat source file %s: %s", source_path, strerror(errno));
+        close(src_fd);
+        return FALSE;
+    }
+
+    int dest_fd = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (dest_fd < 0) {
+        log_message(LOG_ERROR, "Cannot create destination file %s: %s", dest_path, strerror(errno));
+        close(src_fd);
+        return FALSE;
+    }
+
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    preallocate_destination(dest_fd, source_stat.st_size);
+
+    RbIpodCopyStrategy current = (strategy == RB_IPOD_COPY_AUTO) ? RB_IPOD_COPY_FILE_RANGE : strategy;
+    guchar *buffer = NULL;
+    gboolean success = TRUE;
+    off_t total = source_stat.st_size;
+    off_t offset = 0;
+    off_t previous_offset = 0;
+    off_t previous_length = 0;
+
+    while (offset < total) {
+        size_t length = (size_t)MIN(total - offset, (off_t)COPY_WINDOW_SIZE);
+        gboolean first_window = (offset == 0);
+        CopyStepResult result;
+
+        switch (current) {
+            case RB_IPOD_COPY_FILE_RANGE:
+                result = copy_window_file_range(src_fd, dest_fd, offset, length, first_window);
+                break;
+            case RB_IPOD_COPY_SENDFILE:
+                result = copy_window_sendfile(src_fd, dest_fd, offset, length, first_window);
+                break;
+            default:
+                if (!buffer) {
+                    // Page-aligned buffer keeps the path O_DIRECT-compatible
+                    if (posix_memalign((void**)&buffer, 4096, COPY_BUFFER_SIZE) != 0) {
+                        buffer = NULL;
+                        result = COPY_STEP_ERROR;
+                        break;
+                    }
+                }
+                result = copy_window_buffered(src_fd, dest_fd, offset, length, buffer);
+                break;
+        }
+
+        if (result == COPY_STEP_UNSUPPORTED && strategy == RB_IPOD_COPY_AUTO) {
+            // Fall through the strategy list without losing any data
+            log_message(LOG_DEBUG, "%s not usable for %s, falling back",
+                       rb_ipod_copy_strategy_name(current), dest_path);
+            current = (current == RB_IPOD_COPY_FILE_RANGE) ? RB_IPOD_COPY_SENDFILE : RB_IPOD_COPY_BUFFERED;
+            continue;
+        }
+        if (result != COPY_STEP_OK) {
+            log_message(LOG_ERROR, "Error copying %s to %s (%s): %s", source_path, dest_path,
+                       rb_ipod_copy_strategy_name(current), strerror(errno));
+            success = FALSE;
+            break;
+        }
+
+        // Start writeback of this window, retire the previous one
+        sync_file_range(dest_fd, offset, length, SYNC_FILE_RANGE_WRITE);
+        release_window(src_fd, dest_fd, previous_offset, previous_length);
+        previous_offset = offset;
+        previous_length = length;
+        offset += length;
+    }
+
+    if (success) {
+        release_window(src_fd, dest_fd, previous_offset, previous_length);
+    }
+
+    free(buffer);
+    close(src_fd);
+    if (close(dest_fd) != 0) {
+        log_message(LOG_ERROR, "Error closing destination file %s: %s", dest_path, strerror(errno));
+        success = FALSE;
+    }
+
+    if (!success) {
+        // Clean up failed copy
+        unlink(dest_path);
+        return FALSE;
+    }
+
+    if (used_strategy) *used_strategy = current;
+    log_message(LOG_DEBUG, "File copied with %s: %s -> %s (%" G_GINT64_FORMAT " bytes)",
+               rb_ipod_copy_strategy_name(current), source_path, dest_path, (gint64)total);
+    return TRUE;
+}
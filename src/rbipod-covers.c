@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "../include/rbipod-covers.h"
+#include "../include/rbipod-logging.h"
+#include "../include/rbipod-utils.h"
+
+// =============================================================================
+// FOLDER COVER DISCOVERY
+// =============================================================================
+
+// Base names in order of preference; each accepts .jpg, .jpeg and .png
+static const char *const cover_basenames[] = {
+    "cover", "folder", "front", "album", "albumart", "albumartsmall",
+};
+
+typedef struct {
+    char *path;                // NULL: the directory has no cover image
+    GBytes *data;              // Loaded image, NULL until used or once unloaded
+    gboolean unreadable;       // Read failed or size out of range: never retried
+    GList *loaded_link;        // Node in covers->loaded while data is held
+} FolderCover;
+
+struct _RbIpodFolderCovers {
+    GMutex mutex;
+    GHashTable *dirs;          // Directory path -> FolderCover*
+    GQueue loaded;             // FolderCover* holding data, most recent first
+};
+
+static void free_folder_cover(gpointer data) {
+    FolderCover *cover = data;
+    if (cover->data) g_bytes_unref(cover->data);
+    g_free(cover->path);
+    g_free(cover);
+}
+
+RbIpodFolderCovers* rb_ipod_folder_covers_new(void) {
+    RbIpodFolderCovers *covers = g_malloc0(sizeof(RbIpodFolderCovers));
+    g_mutex_init(&covers->mutex);
+    covers->dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_folder_cover);
+    g_queue_init(&covers->loaded);
+    return covers;
+}
+
+void rb_ipod_folder_covers_free(RbIpodFolderCovers *covers) {
+    if (!covers) return;
+
+    g_queue_clear(&covers->loaded);
+    g_hash_table_destroy(covers->dirs);
+    g_mutex_clear(&covers->mutex);
+    g_free(covers);
+}
+
+int rb_ipod_folder_cover_rank(const char *filename) {
+    if (!filename) return 0;
+
+    const char *ext = strrchr(filename, '.');
+    if (!ext || ext == filename) return 0;
+
+    gboolean png = g_ascii_strcasecmp(ext + 1, "png") == 0;
+    if (!png && g_ascii_strcasecmp(ext + 1, "jpg") != 0 && g_ascii_strcasecmp(ext + 1, "jpeg") != 0) {
+        return 0;
+    }
+
+    gsize base_len = ext - filename;
+    for (guint i = 0; i < G_N_ELEMENTS(cover_basenames); i++) {
+        if (strlen(cover_basenames[i]) == base_len &&
+            g_ascii_strncasecmp(filename, cover_basenames[i], base_len) == 0) {
+            // JPEG before PNG for the same name: no alpha, smaller to decode
+            return 1 + i * 2 + (png ? 1 : 0);
+        }
+    }
+    return 0;
+}
+
+// Directory keys without trailing separators, so walker paths and
+// g_path_get_dirname() of their files agree
+static char* directory_key(const char *dir_path) {
+    char *key = g_strdup(dir_path);
+    gsize len = strlen(key);
+    while (len > 1 && key[len - 1] == G_DIR_SEPARATOR) {
+        key[--len] = '\0';
+    }
+    return key;
+}
+
+// Keeps the first result for a directory (walker threads never list one twice)
+static FolderCover* insert_locked(RbIpodFolderCovers *covers, char *key, const char *cover_path) {
+    FolderCover *cover = g_hash_table_lookup(covers->dirs, key);
+    if (cover) {
+        g_free(key);
+        return cover;
+    }
+
+    cover = g_malloc0(sizeof(FolderCover));
+    cover->path = g_strdup(cover_path);
+    g_hash_table_insert(covers->dirs, key, cover);
+    return cover;
+}
+
+void rb_ipod_folder_covers_record(RbIpodFolderCovers *covers, const char *dir_path,
+                                  const char *cover_name) {
+    if (!covers || !dir_path) return;
+
+    char *cover_path = cover_name ? g_build_filename(dir_path, cover_name, NULL) : NULL;
+    g_mutex_lock(&covers->mutex);
+    insert_locked(covers, directory_key(dir_path), cover_path);
+    g_mutex_unlock(&covers->mutex);
+    g_free(cover_path);
+}
+
+// Directories the walker did not list (sync-file) are listed here, once
+static char* scan_directory(const char *dir_path) {
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    if (!dir) return NULL;
+
+    char *best = NULL;
+    int best_rank = 0;
+    const char *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        int rank = rb_ipod_folder_cover_rank(name);
+        if (rank > 0 && (best_rank == 0 || rank < best_rank)) {
+            g_free(best);
+            best = g_strdup(name);
+            best_rank = rank;
+        }
+    }
+    g_dir_close(dir);
+
+    char *cover_path = best ? g_build_filename(dir_path, best, NULL) : NULL;
+    g_free(best);
+    return cover_path;
+}
+
+// Returns with the mutex held
+static FolderCover* resolve_and_lock(RbIpodFolderCovers *covers, const char *file_path) {
+    char *key = g_path_get_dirname(file_path);
+
+    g_mutex_lock(&covers->mutex);
+    FolderCover *cover = g_hash_table_lookup(covers->dirs, key);
+    if (cover) {
+        g_free(key);
+        return cover;
+    }
+    g_mutex_unlock(&covers->mutex);
+
+    char *cover_path = scan_directory(key);
+    g_mutex_lock(&covers->mutex);
+    cover = insert_locked(covers, key, cover_path);
+    g_free(cover_path);
+    return cover;
+}
+
+gboolean rb_ipod_folder_covers_has(RbIpodFolderCovers *covers, const char *file_path) {
+    if (!covers || !file_path) return FALSE;
+
+    FolderCover *cover = resolve_and_lock(covers, file_path);
+    gboolean has = cover->path != NULL && !cover->unreadable;
+    g_mutex_unlock(&covers->mutex);
+    return has;
+}
+
+// Images of directories already done are dropped; their path stays known
+static void unload_oldest_locked(RbIpodFolderCovers *covers) {
+    while (covers->loaded.length > FOLDER_COVER_LOADED_MAX) {
+        FolderCover *oldest = g_queue_pop_tail(&covers->loaded);
+        g_bytes_unref(oldest->data);
+        oldest->data = NULL;
+        oldest->loaded_link = NULL;
+    }
+}
+
+gboolean rb_ipod_folder_covers_apply(RbIpodFolderCovers *covers, const char *file_path,
+                                     AudioMetadata *meta) {
+    if (!covers || !file_path || !meta || meta->artwork_data) return FALSE;
+
+    FolderCover *cover = resolve_and_lock(covers, file_path);
+    if (!cover->path || cover->unreadable) {
+        g_mutex_unlock(&covers->mutex);
+        return FALSE;
+    }
+
+    if (!cover->data) {
+        // Read outside the lock; entries are never removed, only unloaded
+        char *cover_path = g_strdup(cover->path);
+        g_mutex_unlock(&covers->mutex);
+
+        gchar *contents = NULL;
+        gsize length = 0;
+        gboolean ok = g_file_get_contents(cover_path, &contents, &length, NULL) &&
+                      length > 0 && length <= PROBE_MAX_PICTURE_SIZE;
+        if (!ok) {
+            log_message(LOG_WARNING, "Ignoring unreadable folder cover: %s", cover_path);
+            g_free(contents);
+        }
+        g_free(cover_path);
+
+        g_mutex_lock(&covers->mutex);
+        if (!ok) {
+            cover->unreadable = TRUE;
+            g_mutex_unlock(&covers->mutex);
+            return FALSE;
+        }
+        if (cover->data) {
+            g_free(contents);     // Another worker loaded it meanwhile
+        } else {
+            cover->data = g_bytes_new_take(contents, length);
+            g_queue_push_head(&covers->loaded, cover);
+            cover->loaded_link = covers->loaded.head;
+            log_message(LOG_DEBUG, "Folder cover loaded: %s (%zu bytes)", cover->path, length);
+        }
+    }
+
+    if (cover->loaded_link != covers->loaded.head) {
+        g_queue_unlink(&covers->loaded, cover->loaded_link);
+        g_queue_push_head_link(&covers->loaded, cover->loaded_link);
+    }
+    GBytes *data = g_bytes_ref(cover->data);
+    const char *ext = strrchr(cover->path, '.');
+    gboolean png = ext && g_ascii_strcasecmp(ext, ".png") == 0;
+    unload_oldest_locked(covers);
+    g_mutex_unlock(&covers->mutex);
+
+    // Each track owns its copy; the artwork cache deduplicates by content
+    gsize size = 0;
+    gconstpointer bytes = g_bytes_get_data(data, &size);
+    meta->artwork_data = g_malloc(size);
+    memcpy(meta->artwork_data, bytes, size);
+    meta->artwork_size = size;
+    g_free(meta->artwork_format);
+    meta->artwork_format = g_strdup(png ? "png" : "jpeg");
+    g_bytes_unref(data);
+
+    g_atomic_int_inc(&g_sync_ctx.stats.folder_covers_used);
+    return TRUE;
+}
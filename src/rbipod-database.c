@@ -1,16 +1,44 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
 #include <glib.h>
 #include <gpod/itdb.h>
 
 #include "../include/rbipod-database.h"
+#include "../include/rbipod-actions.h"
+#include "../include/rbipod-files.h"
+#include "../include/rbipod-index.h"
+#include "../include/rbipod-trackindex.h"
+#include "../include/rbipod-journal.h"
+#include "../include/rbipod-allocator.h"
+#include "../include/rbipod-artcache.h"
+#include "../include/rbipod-copy.h"
 #include "../include/rbipod-logging.h"
 
 // =============================================================================
-// DATABASE MANAGEMENT (STUB IMPLEMENTATION)
+// DATABASE MANAGEMENT
 // =============================================================================
 
+static gboolean write_database(RbIpodDb *db, GError **error);
+
+static void init_database_paths(RbIpodDb *db, const char *mount_point) {
+    gchar *itunes_dir = itdb_get_itunes_dir(mount_point);
+    gchar *path = itunes_dir ? g_build_filename(itunes_dir, "iTunesDB", NULL)
+                             : g_build_filename(mount_point, "iPod_Control", "iTunes", "iTunesDB", NULL);
+    snprintf(db->database_path, sizeof(db->database_path), "%s", path);
+    snprintf(db->backup_path, sizeof(db->backup_path), "%s" BACKUP_EXTENSION, path);
+    snprintf(db->working_path, sizeof(db->working_path), "%s" WORKING_EXTENSION, path);
+    g_free(path);
+    g_free(itunes_dir);
+}
+
 RbIpodDb* rb_ipod_db_new(const char *mount_point) {
     if (!mount_point) {
         log_message(LOG_ERROR, "rb_ipod_db_new: mount_point is NULL");
@@ -24,7 +52,16 @@ RbIpodDb* rb_ipod_db_new(const char *mount_point) {
     }
     
     // Initialize the iTunes database
+    init_database_paths(db, mount_point);
     db->itdb = itdb_parse(mount_point, NULL);
+    if (!db->itdb && g_file_test(db->backup_path, G_FILE_TEST_EXISTS)) {
+        // Left behind by a command that died while saving
+        log_message(LOG_WARNING, "iTunes database unreadable, restoring backup %s", db->backup_path);
+        if (restore_database_backup(db)) {
+            db->itdb = itdb_parse(mount_point, NULL);
+            db->backup_created = TRUE;
+        }
+    }
     if (!db->itdb) {
         log_message(LOG_ERROR, "Failed to parse iTunes database at %s", mount_point);
         g_free(db);
@@ -35,6 +72,11 @@ RbIpodDb* rb_ipod_db_new(const char *mount_point) {
     db->mutex = g_malloc(sizeof(GMutex));
     g_mutex_init(db->mutex);
     db->delayed_actions = g_queue_new();
+    db->content_index = rb_ipod_content_index_new(db->itdb, mount_point);
+    db->track_index = rb_ipod_track_index_new(db->itdb);
+    db->file_allocator = rb_ipod_file_allocator_new(mount_point);
+    db->artwork_cache = rb_ipod_artwork_cache_new(db->itdb->device);
+    db->journal = rb_ipod_sync_journal_open(db->itdb, mount_point);
     
     log_message(LOG_INFO, "Successfully initialized iPod database at %s", mount_point);
     return db;
@@ -45,6 +87,32 @@ void rb_ipod_db_free(RbIpodDb *db) {
     
     log_message(LOG_INFO, "Freeing iPod database");
     
+    // A background save still owns the itdb
+    rb_ipod_db_wait_for_save(db);
+    
+    // Every save was validated (or rolled back): the snapshot has done its job
+    cleanup_backup_files(db);
+    
+    if (db->content_index) {
+        rb_ipod_content_index_free(db->content_index);
+    }
+    
+    if (db->track_index) {
+        rb_ipod_track_index_free(db->track_index);
+    }
+    
+    if (db->file_allocator) {
+        rb_ipod_file_allocator_free(db->file_allocator);
+    }
+    
+    if (db->artwork_cache) {
+        rb_ipod_artwork_cache_free(db->artwork_cache);
+    }
+    
+    if (db->journal) {
+        rb_ipod_sync_journal_free(db->journal);
+    }
+    
     if (db->itdb) {
         itdb_free(db->itdb);
     }
@@ -55,7 +123,7 @@ void rb_ipod_db_free(RbIpodDb *db) {
     }
     
     if (db->delayed_actions) {
-        g_queue_free(db->delayed_actions);
+        g_queue_free_full(db->delayed_actions, (GDestroyNotify)free_delayed_action);
     }
     
     g_free(db->mount_point);
@@ -68,10 +136,13 @@ gboolean rb_ipod_db_save_sync(RbIpodDb *db) {
         return FALSE;
     }
     
+    // Let a checkpoint in progress finish and apply what queued behind it
+    rb_ipod_db_wait_for_save(db);
+    
     log_message(LOG_INFO, "Saving iPod database synchronously");
     
     GError *error = NULL;
-    gboolean result = itdb_write(db->itdb, &error);
+    gboolean result = write_database(db, &error);
     
     if (!result) {
         log_message(LOG_ERROR, "Failed to save database: %s", 
@@ -81,36 +152,370 @@ gboolean rb_ipod_db_save_sync(RbIpodDb *db) {
     }
     
     log_message(LOG_INFO, "Database saved successfully");
+    rb_ipod_track_index_commit(db->track_index);
+    
+    // Persist the source -> track mapping only once the tracks are on disk
+    if (db->content_index) {
+        rb_ipod_content_index_save(db->content_index, db->itdb);
+    }
+    rb_ipod_sync_journal_commit(db->journal, db->itdb);
+    
     return TRUE;
 }
 
+// Runs on the save thread. The owner leaves db->itdb alone until the
+// thread is joined: commits are queued, never applied, while is_saving.
+static gpointer save_thread_func(gpointer data) {
+    RbIpodDb *db = data;
+    GError *error = NULL;
+    
+    db->save_result = write_database(db, &error);
+    if (!db->save_result) {
+        log_message(LOG_ERROR, "Failed to save database in background: %s",
+                   error ? error->message : "Unknown error");
+        if (error) g_error_free(error);
+    }
+    
+    g_atomic_int_set(&db->save_finished, TRUE);
+    return NULL;
+}
+
 gboolean rb_ipod_db_save_async(RbIpodDb *db) {
-    // For now, just call sync version
-    // TODO: Implement proper async saving with threading
-    return rb_ipod_db_save_sync(db);
+    if (!db || !db->itdb) {
+        log_message(LOG_ERROR, "rb_ipod_db_save_async: Invalid database");
+        return FALSE;
+    }
+    
+    if (db->is_saving) {
+        log_message(LOG_DEBUG, "Background save already in progress");
+        return TRUE;
+    }
+    
+    // The track list as of now, queued actions included, is the snapshot written
+    rb_ipod_db_process_delayed_actions(db);
+    log_message(LOG_INFO, "Saving iPod database in background (%u tracks)",
+               itdb_tracks_number(db->itdb));
+    db->is_saving = TRUE;
+    db->save_result = FALSE;
+    g_atomic_int_set(&db->save_finished, FALSE);
+    db->save_thread = g_thread_new("rbipod-save", save_thread_func, db);
+    return TRUE;
+}
+
+// Owner side: joins the save thread, then applies the queued actions
+static gboolean finish_save(RbIpodDb *db) {
+    g_thread_join(db->save_thread);
+    db->save_thread = NULL;
+    db->is_saving = FALSE;
+    
+    if (db->save_result) {
+        log_message(LOG_INFO, "Background save completed (%u actions queued meanwhile)",
+                   g_queue_get_length(db->delayed_actions));
+        rb_ipod_track_index_commit(db->track_index);
+        // Before the queued tracks join the itdb: the sidecar must only map
+        // sources to tracks the written iTunesDB knows about
+        if (db->content_index) {
+            rb_ipod_content_index_save(db->content_index, db->itdb);
+        }
+        rb_ipod_sync_journal_commit(db->journal, db->itdb);
+    }
+    
+    rb_ipod_db_process_delayed_actions(db);
+    return db->save_result;
+}
+
+gboolean rb_ipod_db_poll_save(RbIpodDb *db) {
+    if (!db || !db->is_saving) return TRUE;
+    if (!g_atomic_int_get(&db->save_finished)) return TRUE;
+    
+    return finish_save(db);
+}
+
+gboolean rb_ipod_db_wait_for_save(RbIpodDb *db) {
+    if (!db) return TRUE;
+    
+    if (!db->is_saving) {
+        rb_ipod_db_process_delayed_actions(db);
+        return TRUE;
+    }
+    return finish_save(db);
+}
+
+// Owner side of the queueing calls: a full batch is applied at once unless
+// a save is running, the rest waits for the next save or wait_for_save
+static void apply_if_batch_full(RbIpodDb *db, guint pending) {
+    if (pending >= ACTION_BATCH_SIZE) {
+        rb_ipod_db_process_delayed_actions(db);
+    }
+}
+
+void rb_ipod_db_add_track(RbIpodDb *db, Itdb_Track *track) {
+    rb_ipod_db_add_track_with_playlists(db, track, NULL);
+}
+
+void rb_ipod_db_add_track_with_playlists(RbIpodDb *db, Itdb_Track *track, GList *playlists) {
+    if (!db || !track) return;
+    
+    apply_if_batch_full(db, rb_ipod_add_track_delayed_action(db, track, playlists));
+}
+
+void rb_ipod_db_remove_track(RbIpodDb *db, Itdb_Track *track) {
+    if (!db || !track) return;
+    
+    apply_if_batch_full(db, rb_ipod_remove_track_delayed_action(db, track));
+}
+
+void rb_ipod_db_update_track(RbIpodDb *db, Itdb_Track *track, const RbIpodTrackUpdate *update) {
+    if (!db || !track || !update) return;
+    
+    apply_if_batch_full(db, rb_ipod_update_track_delayed_action(db, track, update));
+}
+
+void rb_ipod_db_set_name(RbIpodDb *db, const gchar *name) {
+    if (!db || !name) return;
+    
+    apply_if_batch_full(db, rb_ipod_set_name_delayed_action(db, name));
+}
+
+guint rb_ipod_db_remove_tracks(RbIpodDb *db, GHashTable *tracks) {
+    if (!db || !db->itdb) return 0;
+    
+    // Bulk removal rewrites the lists a background save is reading
+    rb_ipod_db_wait_for_save(db);
+    return remove_tracks_from_ipod(db, tracks);
+}
+
+gboolean rb_ipod_db_reset(RbIpodDb *db) {
+    if (!db || !db->itdb) return FALSE;
+    
+    rb_ipod_db_wait_for_save(db);
+    
+    // An empty database with only the master playlist, for the same device
+    Itdb_iTunesDB *fresh = itdb_new();
+    itdb_set_mountpoint(fresh, db->mount_point);
+    fresh->id = db->itdb->id;
+    fresh->version = db->itdb->version;
+    
+    Itdb_Playlist *old_master = itdb_playlist_mpl(db->itdb);
+    Itdb_Playlist *master = itdb_playlist_new(old_master && old_master->name ? old_master->name : "iPod", FALSE);
+    itdb_playlist_set_mpl(master);
+    itdb_playlist_add(fresh, master, -1);
+    
+    log_message(LOG_INFO, "Replacing database (%u tracks, %u playlists) with an empty one",
+               itdb_tracks_number(db->itdb), g_list_length(db->itdb->playlists));
+    
+    // Everything holding tracks or the device of the old itdb goes with it
+    rb_ipod_content_index_free(db->content_index);
+    rb_ipod_track_index_free(db->track_index);
+    rb_ipod_artwork_cache_free(db->artwork_cache);
+    rb_ipod_file_allocator_free(db->file_allocator);
+    itdb_free(db->itdb);
+    
+    db->itdb = fresh;
+    db->content_index = rb_ipod_content_index_new(db->itdb, db->mount_point);
+    db->track_index = rb_ipod_track_index_new(db->itdb);
+    db->artwork_cache = rb_ipod_artwork_cache_new(db->itdb->device);
+    db->file_allocator = rb_ipod_file_allocator_new(db->mount_point);
+    return TRUE;
+}
+
+// =============================================================================
+// DATABASE BACKUP AND ATOMIC SAVE
+// =============================================================================
+
+// A backup is a snapshot of iTunesDB as last written, taken before a command
+// changes anything and refreshed after each validated save. The cheapest
+// method the filesystem offers is used: a reflink shares blocks (btrfs, XFS),
+// a hardlink shares the inode (libgpod replaces iTunesDB by rename, never in
+// place), a copy is the FAT32 fallback.
+
+static gboolean clone_file(const char *source, const char *dest) {
+    int src_fd = open(source, O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) return FALSE;
+
+    int dest_fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (dest_fd < 0) {
+        close(src_fd);
+        return FALSE;
+    }
+
+    gboolean cloned = ioctl(dest_fd, FICLONE, src_fd) == 0;
+    close(src_fd);
+    if (close(dest_fd) != 0) cloned = FALSE;
+    if (!cloned) unlink(dest);
+    return cloned;
+}
+
+static gboolean sync_path(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return FALSE;
+    gboolean synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+
+// Puts a snapshot of source at dest through the working file, so dest is
+// either the old file or the complete new one. Returns the method used.
+static const char* snapshot_file(RbIpodDb *db, const char *source, const char *dest) {
+    unlink(db->working_path);
+
+    const char *method = NULL;
+    if (clone_file(source, db->working_path)) {
+        method = "reflink";
+    } else if (link(source, db->working_path) == 0) {
+        method = "hardlink";
+    } else if (rb_ipod_copy_file(source, db->working_path, RB_IPOD_COPY_AUTO, NULL) &&
+               sync_path(db->working_path)) {
+        method = "copy";
+    }
+
+    if (!method || rename(db->working_path, dest) != 0) {
+        int saved_errno = errno;
+        unlink(db->working_path);
+        errno = saved_errno;
+        return NULL;
+    }
+    // rename() between two links to one inode leaves the source name behind
+    unlink(db->working_path);
+    return method;
 }
 
 gboolean create_database_backup(RbIpodDb *db) {
     if (!db) return FALSE;
     
-    log_message(LOG_INFO, "Creating database backup");
-    // TODO: Implement backup functionality
+    // Nothing written yet (freshly initialized iPod): nothing to protect
+    if (!g_file_test(db->database_path, G_FILE_TEST_EXISTS)) {
+        return TRUE;
+    }
+    
+    gint64 start = g_get_monotonic_time();
+    const char *method = snapshot_file(db, db->database_path, db->backup_path);
+    if (!method) {
+        log_message(LOG_WARNING, "Cannot back up %s: %s", db->database_path, strerror(errno));
+        return FALSE;
+    }
+    
+    db->backup_created = TRUE;
+    log_message(LOG_INFO, "Database backup (%s, %.1f ms): %s", method,
+               (g_get_monotonic_time() - start) / 1000.0, db->backup_path);
     return TRUE;
 }
 
 gboolean restore_database_backup(RbIpodDb *db) {
     if (!db) return FALSE;
     
-    log_message(LOG_INFO, "Restoring database backup");
-    // TODO: Implement restore functionality
+    if (!g_file_test(db->backup_path, G_FILE_TEST_EXISTS)) {
+        log_message(LOG_ERROR, "No database backup to restore at %s", db->backup_path);
+        return FALSE;
+    }
+    
+    const char *method = snapshot_file(db, db->backup_path, db->database_path);
+    if (!method) {
+        log_message(LOG_ERROR, "Failed to restore database backup %s: %s", db->backup_path, strerror(errno));
+        db->keep_backup = TRUE;
+        return FALSE;
+    }
+    
+    log_message(LOG_INFO, "Database restored from backup (%s)", method);
     return TRUE;
 }
 
 void cleanup_backup_files(RbIpodDb *db) {
-    if (!db) return;
+    if (!db || !db->backup_created) return;
+    
+    unlink(db->working_path);
+    if (db->keep_backup) {
+        log_message(LOG_WARNING, "Keeping database backup for manual recovery: %s", db->backup_path);
+        return;
+    }
+    
+    unlink(db->backup_path);
+    db->backup_created = FALSE;
+    log_message(LOG_DEBUG, "Database backup removed: %s", db->backup_path);
+}
+
+static guint32 read_le32(const gchar *data) {
+    guint32 value;
+    memcpy(&value, data, sizeof(value));
+    return GUINT32_FROM_LE(value);
+}
+
+// Structural check of a written iTunesDB: sizes add up and the track list
+// holds expected_tracks entries
+static gboolean validate_database_file(const char *path, guint expected_tracks) {
+    gchar *contents = NULL;
+    gsize length = 0;
+    if (!g_file_get_contents(path, &contents, &length, NULL)) {
+        return FALSE;
+    }
+    
+    gboolean valid = length >= 24 && memcmp(contents, "mhbd", 4) == 0 &&
+                     read_le32(contents + 8) == length;
+    gboolean found_tracks = FALSE;
+    
+    if (valid) {
+        guint32 children = read_le32(contents + 20);
+        gsize offset = read_le32(contents + 4);
+        for (guint32 i = 0; i < children && valid; i++) {
+            if (offset + 16 > length || memcmp(contents + offset, "mhsd", 4) != 0) {
+                valid = FALSE;
+                break;
+            }
+            guint32 header_len = read_le32(contents + offset + 4);
+            guint32 total_len = read_le32(contents + offset + 8);
+            if (total_len < header_len || total_len > length - offset) {
+                valid = FALSE;
+                break;
+            }
+            
+            gsize child = offset + header_len;
+            if (read_le32(contents + offset + 12) == 1 && child + 12 <= length &&
+                memcmp(contents + child, "mhlt", 4) == 0) {
+                found_tracks = TRUE;
+                valid = read_le32(contents + child + 8) == expected_tracks;
+            }
+            offset += total_len;
+        }
+    }
     
-    log_message(LOG_INFO, "Cleaning up backup files");
-    // TODO: Implement backup cleanup
+    g_free(contents);
+    return valid && found_tracks;
+}
+
+// itdb_write() plus the safety net: the previous database stays on disk
+// until the new one has been checked
+static gboolean write_database(RbIpodDb *db, GError **error) {
+    guint expected_tracks = itdb_tracks_number(db->itdb);
+    
+    // Normally taken when the command started
+    if (!db->backup_created) {
+        create_database_backup(db);
+    }
+    
+    gint64 start = g_get_monotonic_time();
+    gboolean ok = itdb_write(db->itdb, error);
+    db->last_save_us = g_get_monotonic_time() - start;
+    
+    // Compressed databases (iTunesCDB) cannot be checked this way
+    if (ok && !itdb_device_supports_compressed_itunesdb(db->itdb->device) &&
+        !validate_database_file(db->database_path, expected_tracks)) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                    "written iTunesDB failed validation (%u tracks expected)", expected_tracks);
+        ok = FALSE;
+    }
+    
+    if (!ok) {
+        if (db->backup_created && restore_database_backup(db)) {
+            log_message(LOG_WARNING, "Database save failed, previous database restored");
+        }
+        return FALSE;
+    }
+    
+    // The next save rolls back to this one at worst
+    if (db->backup_created) {
+        create_database_backup(db);
+    }
+    return TRUE;
 }
 
 gboolean validate_ipod_database(RbIpodDb *db) {
@@ -118,6 +523,8 @@ gboolean validate_ipod_database(RbIpodDb *db) {
         return FALSE;
     }
     
-    // Basic validation - check if we can access the track list
-    return TRUE;
-}
\ No newline at end of file
+    if (itdb_device_supports_compressed_itunesdb(db->itdb->device)) {
+        return TRUE;
+    }
+    return validate_database_file(db->database_path, itdb_tracks_number(db->itdb));
+}
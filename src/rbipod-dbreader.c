@@ -0,0 +1,318 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <glib.h>
+#include <gpod/itdb.h>
+
+#include "../include/rbipod-dbreader.h"
+#include "../include/rbipod-logging.h"
+
+// =============================================================================
+// READ-ONLY ITUNESDB READER
+// =============================================================================
+
+// Every record starts with a 4-byte tag, its header length and (except the
+// list headers) its total length, all little-endian. Only the offsets below
+// are read; anything else in the file is skipped by length.
+
+#define MHSD_TYPE_TRACKS 1
+#define MHSD_TYPE_PLAYLISTS 2
+#define MHSD_TYPE_PODCASTS 3
+
+#define MHIT_SIZE 0x24
+#define MHIT_TRACKLEN 0x28
+#define MHIT_MEDIATYPE 0xD0
+
+#define MHYP_ITEMS 16
+#define MHYP_TYPE 20
+#define MHYP_PODCASTFLAG 42
+
+#define MHOD_TYPE 12
+#define MHOD_STRING_ENCODING 24
+#define MHOD_STRING_LENGTH 28
+#define MHOD_STRING_DATA 40
+#define MHOD_ENCODING_UTF8 2
+
+struct _RbIpodDbReader {
+    const guchar *map;
+    gsize map_size;
+    const guchar *tracks;          // First mhit
+    const guchar *tracks_end;
+    guint track_count;
+    const guchar *playlists;       // First mhyp
+    const guchar *playlists_end;
+    guint playlist_count;
+};
+
+typedef struct {
+    const guchar *start;
+    gsize header_length;
+    gsize total_length;
+} DbRecord;
+
+static guint16 read_le16(const guchar *p) {
+    return (guint16)p[0] | ((guint16)p[1] << 8);
+}
+
+static guint32 read_le32(const guchar *p) {
+    return (guint32)p[0] | ((guint32)p[1] << 8) | ((guint32)p[2] << 16) | ((guint32)p[3] << 24);
+}
+
+// Reads the record at p (bounded by end). List headers (mhlt, mhlp) carry
+// a count instead of a total length: their span is the header alone.
+static gboolean read_record(const guchar *p, const guchar *end, const char *tag,
+                            gboolean list_header, DbRecord *record) {
+    if (p > end || end - p < 12 || memcmp(p, tag, 4) != 0) return FALSE;
+
+    record->start = p;
+    record->header_length = read_le32(p + 4);
+    record->total_length = list_header ? record->header_length : read_le32(p + 8);
+    return record->header_length >= 12 &&
+           record->header_length <= record->total_length &&
+           record->total_length <= (gsize)(end - p);
+}
+
+static gboolean locate_list(RbIpodDbReader *reader, const DbRecord *mhsd, guint32 type) {
+    const guchar *end = mhsd->start + mhsd->total_length;
+    const guchar *list = mhsd->start + mhsd->header_length;
+    DbRecord header;
+
+    if (type == MHSD_TYPE_TRACKS) {
+        if (!read_record(list, end, "mhlt", TRUE, &header)) return FALSE;
+        reader->tracks = list + header.header_length;
+        reader->tracks_end = end;
+        reader->track_count = read_le32(list + 8);
+    } else {
+        if (!read_record(list, end, "mhlp", TRUE, &header)) return FALSE;
+        reader->playlists = list + header.header_length;
+        reader->playlists_end = end;
+        reader->playlist_count = read_le32(list + 8);
+    }
+    return TRUE;
+}
+
+static gboolean parse_database(RbIpodDbReader *reader) {
+    const guchar *end = reader->map + reader->map_size;
+    DbRecord mhbd;
+    if (!read_record(reader->map, end, "mhbd", FALSE, &mhbd) || mhbd.header_length < 24) return FALSE;
+
+    guint32 children = read_le32(reader->map + 20);
+    const guchar *cursor = reader->map + mhbd.header_length;
+    gboolean have_playlists = FALSE;
+
+    for (guint32 i = 0; i < children; i++) {
+        DbRecord mhsd;
+        if (!read_record(cursor, end, "mhsd", FALSE, &mhsd) || mhsd.header_length < 16) return FALSE;
+
+        // Type 3 only regroups the podcasts by show: the flat type 2 list is
+        // preferred, type 3 used when it is the only one
+        guint32 type = read_le32(cursor + 12);
+        if (type == MHSD_TYPE_TRACKS) {
+            if (!locate_list(reader, &mhsd, type)) return FALSE;
+        } else if (type == MHSD_TYPE_PLAYLISTS || (type == MHSD_TYPE_PODCASTS && !have_playlists)) {
+            if (!locate_list(reader, &mhsd, type)) return FALSE;
+            have_playlists = (type == MHSD_TYPE_PLAYLISTS);
+        }
+        cursor += mhsd.total_length;
+    }
+    return reader->tracks != NULL;
+}
+
+RbIpodDbReader* rb_ipod_dbreader_open(const char *mount_point) {
+    if (!mount_point) return NULL;
+
+    // Compressed databases are left to libgpod
+    gchar *itunes_dir = itdb_get_itunes_dir(mount_point);
+    gchar *cdb_path = itunes_dir ? itdb_get_path(itunes_dir, "iTunesCDB") : NULL;
+    g_free(itunes_dir);
+    if (cdb_path) {
+        g_free(cdb_path);
+        log_message(LOG_DEBUG, "Compressed iTunesCDB found, not reading it directly");
+        return NULL;
+    }
+
+    gchar *db_path = itdb_get_itunesdb_path(mount_point);
+    if (!db_path) return NULL;
+
+    int fd = open(db_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_message(LOG_DEBUG, "Cannot open %s: %s", db_path, strerror(errno));
+        g_free(db_path);
+        return NULL;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < 24) {
+        close(fd);
+        g_free(db_path);
+        return NULL;
+    }
+
+    gsize size = (gsize)file_stat.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_message(LOG_DEBUG, "Cannot map %s: %s", db_path, strerror(errno));
+        g_free(db_path);
+        return NULL;
+    }
+    // Records are read front to back
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    RbIpodDbReader *reader = g_new0(RbIpodDbReader, 1);
+    reader->map = map;
+    reader->map_size = size;
+
+    if (!parse_database(reader)) {
+        log_message(LOG_WARNING, "Cannot read %s directly, falling back to libgpod", db_path);
+        rb_ipod_dbreader_close(reader);
+        reader = NULL;
+    }
+    g_free(db_path);
+    return reader;
+}
+
+void rb_ipod_dbreader_close(RbIpodDbReader *reader) {
+    if (!reader) return;
+    munmap((void*)reader->map, reader->map_size);
+    g_free(reader);
+}
+
+guint rb_ipod_dbreader_track_count(const RbIpodDbReader *reader) {
+    return reader ? reader->track_count : 0;
+}
+
+guint rb_ipod_dbreader_playlist_count(const RbIpodDbReader *reader) {
+    return reader ? reader->playlist_count : 0;
+}
+
+void rb_ipod_dbreader_foreach_track(const RbIpodDbReader *reader, RbIpodDbTrackFunc func, gpointer user_data) {
+    if (!reader || !func) return;
+
+    const guchar *cursor = reader->tracks;
+    DbRecord mhit;
+    for (guint i = 0; i < reader->track_count; i++) {
+        if (!read_record(cursor, reader->tracks_end, "mhit", FALSE, &mhit) ||
+            mhit.header_length < MHIT_TRACKLEN + 4) {
+            log_message(LOG_WARNING, "iTunesDB track list truncated after %u tracks", i);
+            return;
+        }
+
+        RbIpodDbTrackRecord record = {
+            .mhit = cursor,
+            .length = mhit.total_length,
+            .mediatype = mhit.header_length >= MHIT_MEDIATYPE + 4 ? read_le32(cursor + MHIT_MEDIATYPE) : 0,
+            .size = read_le32(cursor + MHIT_SIZE),
+            .tracklen = read_le32(cursor + MHIT_TRACKLEN),
+        };
+        if (!func(&record, user_data)) return;
+        cursor += mhit.total_length;
+    }
+}
+
+void rb_ipod_dbreader_foreach_playlist(const RbIpodDbReader *reader, RbIpodDbPlaylistFunc func,
+                                       gpointer user_data) {
+    if (!reader || !func || !reader->playlists) return;
+
+    const guchar *cursor = reader->playlists;
+    DbRecord mhyp;
+    for (guint i = 0; i < reader->playlist_count; i++) {
+        if (!read_record(cursor, reader->playlists_end, "mhyp", FALSE, &mhyp) ||
+            mhyp.header_length < MHYP_PODCASTFLAG + 2) {
+            log_message(LOG_WARNING, "iTunesDB playlist list truncated after %u playlists", i);
+            return;
+        }
+
+        RbIpodDbPlaylistRecord record = {
+            .mhyp = cursor,
+            .length = mhyp.total_length,
+            .items = read_le32(cursor + MHYP_ITEMS),
+            .master = cursor[MHYP_TYPE] == 1,
+            .podcasts = read_le16(cursor + MHYP_PODCASTFLAG) == 1,
+        };
+        if (!func(&record, user_data)) return;
+        cursor += mhyp.total_length;
+    }
+}
+
+// Finds the string mhod of this type among the mhods that follow the
+// record header; the playlist items (mhip) after them end the search
+static gboolean find_string(const guchar *record, gsize length, guint32 type,
+                            const guchar **data, gsize *data_length, gboolean *utf8) {
+    const guchar *end = record + length;
+    const guchar *cursor = record + read_le32(record + 4);
+    DbRecord mhod;
+
+    while (read_record(cursor, end, "mhod", FALSE, &mhod)) {
+        if (read_le32(cursor + MHOD_TYPE) == type) {
+            if (mhod.total_length < MHOD_STRING_DATA) return FALSE;
+            gsize string_length = read_le32(cursor + MHOD_STRING_LENGTH);
+            if (string_length > mhod.total_length - MHOD_STRING_DATA) return FALSE;
+
+            *data = cursor + MHOD_STRING_DATA;
+            *data_length = string_length;
+            *utf8 = read_le32(cursor + MHOD_STRING_ENCODING) == MHOD_ENCODING_UTF8;
+            return TRUE;
+        }
+        cursor += mhod.total_length;
+    }
+    return FALSE;
+}
+
+static char* decode_string(const guchar *record, gsize length, guint32 type) {
+    const guchar *data;
+    gsize data_length;
+    gboolean utf8;
+    if (!find_string(record, length, type, &data, &data_length, &utf8)) return NULL;
+
+    if (utf8) {
+        return g_utf8_make_valid((const gchar*)data, (gssize)data_length);
+    }
+
+    // UTF-16LE, possibly unaligned in the mapping
+    glong units = (glong)(data_length / 2);
+    gunichar2 *utf16 = g_new(gunichar2, units + 1);
+    for (glong i = 0; i < units; i++) {
+        utf16[i] = read_le16(data + i * 2);
+    }
+    char *result = g_utf16_to_utf8(utf16, units, NULL, NULL, NULL);
+    g_free(utf16);
+    return result;
+}
+
+char* rb_ipod_dbreader_track_string(const RbIpodDbTrackRecord *record, guint32 mhod_type) {
+    if (!record) return NULL;
+    return decode_string(record->mhit, record->length, mhod_type);
+}
+
+char* rb_ipod_dbreader_playlist_name(const RbIpodDbPlaylistRecord *record) {
+    if (!record) return NULL;
+    return decode_string(record->mhyp, record->length, RB_IPOD_MHOD_TITLE);
+}
+
+gboolean rb_ipod_dbreader_track_string_is(const RbIpodDbTrackRecord *record, guint32 mhod_type,
+                                          const char *ascii) {
+    if (!record || !ascii) return FALSE;
+
+    const guchar *data;
+    gsize data_length;
+    gboolean utf8;
+    if (!find_string(record->mhit, record->length, mhod_type, &data, &data_length, &utf8)) return FALSE;
+
+    gsize width = utf8 ? 1 : 2;
+    gsize chars = strlen(ascii);
+    if (data_length != chars * width) return FALSE;
+
+    for (gsize i = 0; i < chars; i++) {
+        guint32 unit = utf8 ? data[i] : read_le16(data + i * 2);
+        if (unit > 0x7f || g_ascii_tolower((gchar)unit) != g_ascii_tolower(ascii[i])) return FALSE;
+    }
+    return TRUE;
+}
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,15 +8,23 @@
 #include <unistd.h>
 #include <time.h>
 #include <glib.h>
-#include <gio/gio.h>
-#include <gdk-pixbuf/gdk-pixbuf.h>
 #include <gpod/itdb.h>
-#include <tag_c.h>
 
 #include "../include/rbipod-files.h"
 #include "../include/rbipod-logging.h"
 #include "../include/rbipod-metadata.h"
 #include "../include/rbipod-database.h"
+#include "../include/rbipod-index.h"
+#include "../include/rbipod-trackindex.h"
+#include "../include/rbipod-allocator.h"
+#include "../include/rbipod-walker.h"
+#include "../include/rbipod-copy.h"
+#include "../include/rbipod-probe.h"
+#include "../include/rbipod-mp4.h"
+#include "../include/rbipod-metacache.h"
+#include "../include/rbipod-artcache.h"
+#include "../include/rbipod-covers.h"
+#include "../include/rbipod-journal.h"
 #include "../include/rbipod-utils.h"
 
 // =============================================================================
@@ -36,90 +46,6 @@ char* utf8_to_ascii(const char *utf8_string) {
     return g_strdup(utf8_string);
 }
 
-// Global counter for iPod filename generation
-static guint32 g_ipod_file_counter = 0;
-
-// Initialize the iPod file counter based on existing files
-void initialize_ipod_file_counter(const char *mount_point) {
-    if (!mount_point) return;
-    
-    guint32 max_counter = 0;
-    
-    // Scan all F00-F49 directories for existing files
-    for (int dir_num = 0; dir_num < 50; dir_num++) {
-        char f_dir[1024];
-        snprintf(f_dir, sizeof(f_dir), "%s/iPod_Control/Music/F%02d", mount_point, dir_num);
-        
-        GDir *dir = g_dir_open(f_dir, 0, NULL);
-        if (!dir) continue;
-        
-        const char *filename;
-        while ((filename = g_dir_read_name(dir)) != NULL) {
-            // Check if filename matches iPod pattern (4 uppercase letters + extension)
-            if (strlen(filename) >= 5) {
-                char name_part[5];
-                strncpy(name_part, filename, 4);
-                name_part[4] = '\0';
-                
-                // Convert 4-letter name back to counter value
-                if (name_part[0] >= 'A' && name_part[0] <= 'Z' &&
-                    name_part[1] >= 'A' && name_part[1] <= 'Z' &&
-                    name_part[2] >= 'A' && name_part[2] <= 'Z' &&
-                    name_part[3] >= 'A' && name_part[3] <= 'Z') {
-                    
-                    guint32 name_value = 
-                        (name_part[0] - 'A') * (26 * 26 * 26) +
-                        (name_part[1] - 'A') * (26 * 26) +
-                        (name_part[2] - 'A') * 26 +
-                        (name_part[3] - 'A');
-                    
-                    guint32 estimated_counter = dir_num * 100 + name_value;
-                    if (estimated_counter > max_counter) {
-                        max_counter = estimated_counter;
-                    }
-                }
-            }
-        }
-        g_dir_close(dir);
-    }
-    
-    // Start counter after the highest existing file
-    g_ipod_file_counter = max_counter + 1;
-    
-    log_message(LOG_DEBUG, "Initialized iPod file counter to %u", g_ipod_file_counter);
-}
-
-char* generate_ipod_filename(const char *mount_point, const char *original_filename) {
-    if (!mount_point || !original_filename) return NULL;
-    
-    // Get file extension from original filename
-    const char *ext = strrchr(original_filename, '.');
-    if (!ext) ext = ".mp3"; // Default extension
-    
-    // Calculate which F directory to use (0-49, distributed evenly)
-    int dir_num = (g_ipod_file_counter / 100) % 50;
-    
-    // Generate 4-character filename in the style of Apple/gtkpod
-    // Format: [A-Z][A-Z][A-Z][A-Z] (uppercase letters)
-    char ipod_name[5];
-    guint32 name_id = g_ipod_file_counter % (26 * 26 * 26 * 26); // 456976 combinations
-    
-    ipod_name[0] = 'A' + (name_id / (26 * 26 * 26)) % 26;
-    ipod_name[1] = 'A' + (name_id / (26 * 26)) % 26;
-    ipod_name[2] = 'A' + (name_id / 26) % 26;
-    ipod_name[3] = 'A' + name_id % 26;
-    ipod_name[4] = '\0';
-    
-    // Increment counter for next file
-    g_ipod_file_counter++;
-    
-    char *result = g_strdup_printf("%s/iPod_Control/Music/F%02d/%s%s", 
-                                   mount_point, dir_num, ipod_name, ext);
-    
-    log_message(LOG_DEBUG, "Generated iPod filename: %s (counter: %u)", result, g_ipod_file_counter - 1);
-    return result;
-}
-
 gboolean ensure_ipod_directory_structure(const char *mount_point) {
     if (!mount_point) return FALSE;
     
@@ -175,48 +101,13 @@ gboolean copy_file_to_ipod(const char *source_path, const char *dest_path) {
     }
     g_free(dest_dir);
     
-    // Open source file
-    FILE *source = fopen(source_path, "rb");
-    if (!source) {
-        log_message(LOG_ERROR, "Cannot open source file: %s", source_path);
-        return FALSE;
-    }
-    
-    // Open destination file
-    FILE *dest = fopen(dest_path, "wb");
-    if (!dest) {
-        log_message(LOG_ERROR, "Cannot create destination file: %s", dest_path);
-        fclose(source);
-        return FALSE;
-    }
-    
-    // Copy file in chunks
-    char buffer[8192];
-    size_t bytes_read;
-    gboolean success = TRUE;
-    
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), source)) > 0) {
-        if (fwrite(buffer, 1, bytes_read, dest) != bytes_read) {
-            log_message(LOG_ERROR, "Error writing to destination file: %s", dest_path);
-            success = FALSE;
-            break;
-        }
-    }
-    
-    // Check for read errors
-    if (ferror(source)) {
-        log_message(LOG_ERROR, "Error reading from source file: %s", source_path);
-        success = FALSE;
-    }
-    
-    fclose(source);
-    fclose(dest);
+    // Kernel-side copy where possible, with preallocation and page cache hints
+    RbIpodCopyStrategy used_strategy = RB_IPOD_COPY_AUTO;
+    gboolean success = rb_ipod_copy_file(source_path, dest_path, RB_IPOD_COPY_AUTO, &used_strategy);
     
     if (success) {
-        log_message(LOG_DEBUG, "File copied successfully: %s -> %s", source_path, dest_path);
-    } else {
-        // Clean up failed copy
-        unlink(dest_path);
+        log_message(LOG_DEBUG, "File copied successfully (%s): %s -> %s",
+                   rb_ipod_copy_strategy_name(used_strategy), source_path, dest_path);
     }
     
     return success;
@@ -225,18 +116,28 @@ gboolean copy_file_to_ipod(const char *source_path, const char *dest_path) {
 gboolean is_supported_audio_file(const char *filename) {
     if (!filename) return FALSE;
     
-    const char *ext = strrchr(filename, '.');
-    if (!ext) return FALSE;
-    
-    ext++; // Skip the dot
-    
-    return (g_ascii_strcasecmp(ext, "mp3") == 0 ||
-            g_ascii_strcasecmp(ext, "m4a") == 0 ||
-            g_ascii_strcasecmp(ext, "aac") == 0 ||
-            g_ascii_strcasecmp(ext, "wav") == 0 ||
-            g_ascii_strcasecmp(ext, "aiff") == 0 ||
-            g_ascii_strcasecmp(ext, "m4p") == 0 ||
-            g_ascii_strcasecmp(ext, "mp4") == 0);
+    return rb_ipod_classify_extension(filename) != RB_IPOD_EXT_UNSUPPORTED;
+}
+
+// External tools are an opt-in last resort (--external-tools): a spawn
+// costs more than parsing the container headers natively
+static gboolean external_tools_allowed(const char *tool, const char *file_path) {
+    if (!g_sync_ctx.allow_external_tools) {
+        log_message(LOG_DEBUG, "Not running %s on %s (external tools disabled)", tool, file_path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Every spawn is counted for the sync summary (probe workers run concurrently)
+static FILE* open_external_tool(const char *command) {
+    g_atomic_int_inc(&g_sync_ctx.stats.external_spawns);
+    return popen(command, "r");
+}
+
+static int run_external_tool(const char *command) {
+    g_atomic_int_inc(&g_sync_ctx.stats.external_spawns);
+    return system(command);
 }
 
 gboolean extract_audio_duration_mediainfo(const char *file_path, int *duration, int *bitrate) {
@@ -245,13 +146,15 @@ gboolean extract_audio_duration_mediainfo(const char *file_path, int *duration,
     *duration = 0;
     *bitrate = 0;
     
+    if (!external_tools_allowed("mediainfo", file_path)) return FALSE;
+    
     // Use mediainfo to extract precise metadata
     char command[2048];
     snprintf(command, sizeof(command), 
              "mediainfo --Output='Duration=%%Duration%%;Bitrate=%%BitRate%%' \"%s\" 2>/dev/null", 
              file_path);
     
-    FILE *pipe = popen(command, "r");
+    FILE *pipe = open_external_tool(command);
     if (!pipe) {
         log_message(LOG_WARNING, "Failed to run mediainfo command");
         return FALSE;
@@ -286,19 +189,17 @@ gboolean extract_audio_duration_mediainfo(const char *file_path, int *duration,
                  "ffprobe -v quiet -show_entries format=duration,bit_rate -of csv=p=0 \"%s\" 2>/dev/null", 
                  file_path);
         
-        pipe = popen(command, "r");
+        pipe = open_external_tool(command);
         if (pipe) {
             if (fgets(output, sizeof(output), pipe)) {
                 // Parse ffprobe CSV output: duration,bit_rate
-                char *token = strtok(output, ",");
-                if (token) {
-                    double duration_float = strtod(token, NULL);
-                    *duration = (int)duration_float;
-                    
-                    token = strtok(NULL, ",");
-                    if (token) {
-                        *bitrate = strtol(token, NULL, 10) / 1000; // Convert bps to kbps
-                    }
+                // (no strtok: this runs concurrently in the sync pipeline)
+                char *separator = strchr(output, ',');
+                double duration_float = strtod(output, NULL);
+                *duration = (int)duration_float;
+                
+                if (separator) {
+                    *bitrate = strtol(separator + 1, NULL, 10) / 1000; // Convert bps to kbps
                 }
                 
                 log_message(LOG_DEBUG, "FFprobe extracted: %s -> duration: %d sec, bitrate: %d kbps", 
@@ -308,6 +209,21 @@ gboolean extract_audio_duration_mediainfo(const char *file_path, int *duration,
         }
     }
     
+    return (*duration > 0);
+}
+
+gboolean extract_audio_duration(const char *file_path, int *duration, int *bitrate) {
+    if (!file_path || !duration || !bitrate) return FALSE;
+    
+    // Container headers first: no process spawn
+    if (rb_ipod_probe_audio_properties(file_path, duration, bitrate)) {
+        return TRUE;
+    }
+    
+    if (extract_audio_duration_mediainfo(file_path, duration, bitrate)) {
+        return TRUE;
+    }
+    
     // Set reasonable defaults if extraction failed
     if (*duration == 0) {
         // Try to estimate from file size as last resort
@@ -328,18 +244,14 @@ gboolean extract_audio_duration_mediainfo(const char *file_path, int *duration,
     return (*duration > 0);
 }
 
-gboolean extract_audio_duration(const char *file_path, int *duration, int *bitrate) {
-    // Use the new robust extraction method
-    return extract_audio_duration_mediainfo(file_path, duration, bitrate);
-}
-
 gboolean extract_metadata_field(const char *file_path, const char *field_name, char **result) {
     if (!file_path || !field_name || !result) return FALSE;
+    if (!external_tools_allowed("mediainfo", file_path)) return FALSE;
     
     char command[1024];
     snprintf(command, sizeof(command), "mediainfo --Inform=\"General;%%%s%%\" \"%s\" 2>/dev/null", field_name, file_path);
     
-    FILE *pipe = popen(command, "r");
+    FILE *pipe = open_external_tool(command);
     if (!pipe) return FALSE;
     
     char output[512];
@@ -363,10 +275,17 @@ gboolean extract_metadata_field(const char *file_path, const char *field_name, c
 
 gboolean extract_artwork_ffmpeg(const char *file_path, AudioMetadata *meta) {
     if (!file_path || !meta) return FALSE;
+    if (!external_tools_allowed("ffmpeg", file_path)) return FALSE;
     
-    // Create temporary file for artwork extraction
-    char temp_artwork[256];
-    snprintf(temp_artwork, sizeof(temp_artwork), "/tmp/artwork_%d", getpid());
+    // Private temporary directory: several pipeline workers may run ffmpeg
+    // at once, so a per-process name is not unique enough
+    char *temp_dir = g_dir_make_tmp("rbipod-artwork-XXXXXX", NULL);
+    if (!temp_dir) {
+        log_message(LOG_WARNING, "Cannot create temporary directory for artwork extraction");
+        return FALSE;
+    }
+    char temp_artwork[MAX_PATH_LEN];
+    snprintf(temp_artwork, sizeof(temp_artwork), "%s/artwork", temp_dir);
     
     // Try multiple extraction methods to get artwork
     char command[2048];
@@ -377,8 +296,8 @@ gboolean extract_artwork_ffmpeg(const char *file_path, AudioMetadata *meta) {
              "ffmpeg -i \"%s\" -map 0:v:0 -c:v mjpeg -q:v 2 \"%s.jpg\" -y 2>/dev/null", 
              file_path, temp_artwork);
     
-    if (system(command) == 0) {
-        char jpg_file[512];
+    if (run_external_tool(command) == 0) {
+        char jpg_file[MAX_PATH_LEN + 8];
         snprintf(jpg_file, sizeof(jpg_file), "%s.jpg", temp_artwork);
         
         FILE *artwork_file = fopen(jpg_file, "rb");
@@ -405,8 +324,8 @@ gboolean extract_artwork_ffmpeg(const char *file_path, AudioMetadata *meta) {
                  "ffmpeg -i \"%s\" -map 0:v:0 -c:v png \"%s.png\" -y 2>/dev/null", 
                  file_path, temp_artwork);
         
-        if (system(command) == 0) {
-            char png_file[512];
+        if (run_external_tool(command) == 0) {
+            char png_file[MAX_PATH_LEN + 8];
             snprintf(png_file, sizeof(png_file), "%s.png", temp_artwork);
             
             FILE *artwork_file = fopen(png_file, "rb");
@@ -434,7 +353,7 @@ gboolean extract_artwork_ffmpeg(const char *file_path, AudioMetadata *meta) {
                  "ffprobe -v quiet -select_streams v:0 -show_entries stream=codec_name -of csv=p=0 \"%s\" 2>/dev/null", 
                  file_path);
         
-        FILE *probe = popen(command, "r");
+        FILE *probe = open_external_tool(command);
         if (probe) {
             char codec[64] = {0};
             if (fgets(codec, sizeof(codec), probe)) {
@@ -452,9 +371,19 @@ gboolean extract_artwork_ffmpeg(const char *file_path, AudioMetadata *meta) {
         }
     }
     
+    rmdir(temp_dir);
+    g_free(temp_dir);
     return success;
 }
 
+// Last resort for a file without embedded artwork. A cover image in its
+// directory is applied by probe_audio_file() (it is not part of the cached
+// probe result), so ffmpeg only runs for directories without one.
+static void extract_missing_artwork(const char *file_path, AudioMetadata *meta) {
+    if (rb_ipod_folder_covers_has(g_sync_ctx.folder_covers, file_path)) return;
+    extract_artwork_ffmpeg(file_path, meta);
+}
+
 gboolean extract_podcast_specific_metadata(const char *file_path, AudioMetadata *meta) {
     if (!file_path || !meta) return FALSE;
     
@@ -510,99 +439,14 @@ gboolean extract_podcast_specific_metadata(const char *file_path, AudioMetadata
 gboolean extract_audio_metadata_taglib(const char *file_path, AudioMetadata *meta) {
     if (!file_path || !meta) return FALSE;
     
-    // Open file with TagLib
-    TagLib_File *file = taglib_file_new(file_path);
-    if (!file || !taglib_file_is_valid(file)) {
-        if (file) taglib_file_free(file);
-        return FALSE;
-    }
-    
-    // Get tag information
-    TagLib_Tag *tag = taglib_file_tag(file);
-    if (!tag) {
-        taglib_file_free(file);
-        return FALSE;
-    }
-    
-    gboolean any_success = FALSE;
-    
-    // Extract metadata
-    char *title = taglib_tag_title(tag);
-    char *artist = taglib_tag_artist(tag);
-    char *album = taglib_tag_album(tag);
-    char *genre = taglib_tag_genre(tag);
-    char *comment = taglib_tag_comment(tag);
-    
-    // Safely copy to metadata structure
-    if (title && strlen(title) > 0) {
-        g_free(meta->title);
-        meta->title = g_strdup(title);
-        any_success = TRUE;
-    }
-    if (artist && strlen(artist) > 0) {
-        g_free(meta->artist);
-        meta->artist = g_strdup(artist);
-        any_success = TRUE;
-    }
-    if (album && strlen(album) > 0) {
-        g_free(meta->album);
-        meta->album = g_strdup(album);
-        any_success = TRUE;
-    }
-    if (genre && strlen(genre) > 0) {
-        g_free(meta->genre);
-        meta->genre = g_strdup(genre);
-        any_success = TRUE;
-    }
-    // Note: comment field not available in AudioMetadata structure
-    // if (comment && strlen(comment) > 0) {
-    //     meta->comment = g_strdup(comment);
-    //     any_success = TRUE;
-    // }
-    
-    // Extract numeric metadata
-    unsigned int year = taglib_tag_year(tag);
-    unsigned int track = taglib_tag_track(tag);
-    
-    if (year > 0) {
-        meta->year = year;
-        any_success = TRUE;
-    }
-    if (track > 0) {
-        meta->track_number = track;
-        any_success = TRUE;
-    }
-    
-    // Extract podcast release date from tags using C++ module
-    if (meta->mediatype == ITDB_MEDIATYPE_PODCAST) {
-        extract_extended_podcast_metadata(file_path, meta);
-    }
-    
-    // Get audio properties
-    const TagLib_AudioProperties *props = taglib_file_audioproperties(file);
-    if (props) {
-        int duration = taglib_audioproperties_length(props);
-        int bitrate = taglib_audioproperties_bitrate(props);
-        
-        if (duration > 0) {
-            meta->duration = duration;
-            any_success = TRUE;
-        }
-        if (bitrate > 0) {
-            meta->bitrate = bitrate;
-            any_success = TRUE;
-        }
-    }
-    
-    // Clean up
-    taglib_file_free(file);
+    // One TagLib open covers tags, audio properties, podcast frames and artwork
+    gboolean any_success = extract_audio_metadata_unified(file_path, meta);
     
-    // Extract artwork if TagLib extraction was successful
-    if (any_success) {
-        // Try TagLib native artwork extraction first
-        if (!extract_artwork_taglib_native(file_path, meta)) {
-            // Fallback to ffmpeg if TagLib fails
-            extract_artwork_ffmpeg(file_path, meta);
+    // TagLib found tags but no artwork: read a leading ID3v2 picture
+    // natively, and only then fall back to ffmpeg (if enabled)
+    if (any_success && !meta->artwork_data) {
+        if (!rb_ipod_probe_embedded_picture(file_path, meta)) {
+            extract_missing_artwork(file_path, meta);
         }
     }
     
@@ -621,6 +465,31 @@ gboolean extract_audio_metadata_taglib(const char *file_path, AudioMetadata *met
 gboolean extract_audio_metadata_full(const char *file_path, AudioMetadata *meta) {
     if (!file_path || !meta) return FALSE;
     
+    // MP4 family: native atom walk (no mdat reads, cover copied once),
+    // TagLib only when the container cannot be parsed
+    switch (rb_ipod_classify_extension(file_path)) {
+        case RB_IPOD_EXT_M4A:
+        case RB_IPOD_EXT_M4P:
+        case RB_IPOD_EXT_MP4:
+        case RB_IPOD_EXT_AAC: {
+            RbIpodMp4File *mp4 = rb_ipod_mp4_open(file_path);
+            gboolean mp4_success = mp4 && rb_ipod_mp4_fill_metadata(mp4, meta);
+            rb_ipod_mp4_close(mp4);
+            if (mp4_success) {
+                if (!meta->artwork_data) {
+                    extract_missing_artwork(file_path, meta);
+                }
+                log_message(LOG_DEBUG, "MP4 atoms parsed for %s: %u ms, %zu bytes of artwork, %u chapters",
+                           file_path, meta->duration_ms, meta->artwork_size,
+                           meta->chapters ? meta->chapters->len : 0);
+                return TRUE;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    
     // Try TagLib first (most reliable)
     gboolean taglib_success = extract_audio_metadata_taglib(file_path, meta);
     if (taglib_success) {
@@ -632,13 +501,28 @@ gboolean extract_audio_metadata_full(const char *file_path, AudioMetadata *meta)
     
     gboolean any_success = FALSE;
     
-    // Fallback: simple ffprobe for duration/bitrate only
+    // Fallback: duration/bitrate from container headers, picture from ID3v2
+    int duration = 0, bitrate = 0;
+    if (rb_ipod_probe_audio_properties(file_path, &duration, &bitrate)) {
+        meta->duration = duration;
+        meta->bitrate = bitrate;
+        any_success = TRUE;
+    }
+    if (!meta->artwork_data) {
+        rb_ipod_probe_embedded_picture(file_path, meta);
+    }
+    
+    if (any_success || !external_tools_allowed("ffprobe", file_path)) {
+        return any_success;
+    }
+    
+    // Last resort: simple ffprobe for duration/bitrate only
     char command[2048];
     snprintf(command, sizeof(command), 
              "ffprobe -v quiet -show_format -of default=noprint_wrappers=1:nokey=1 -select_streams a:0 \"%s\" 2>/dev/null", 
              file_path);
     
-    FILE *pipe = popen(command, "r");
+    FILE *pipe = open_external_tool(command);
     if (pipe) {
         char line[256];
         while (fgets(line, sizeof(line), pipe)) {
@@ -667,6 +551,18 @@ gboolean extract_audio_metadata_full(const char *file_path, AudioMetadata *meta)
 gboolean probe_audio_file(const char *file_path, AudioMetadata *meta) {
     if (!file_path || !meta) return FALSE;
     
+    // Unchanged host file: reuse the previous run's result without opening it
+    RbIpodMetadataCache *cache = g_sync_ctx.metadata_cache;
+    guint32 requested_mediatype = meta->mediatype;
+    struct stat source_stat;
+    gboolean cacheable = cache && stat(file_path, &source_stat) == 0;
+    if (cacheable && rb_ipod_metadata_cache_lookup(cache, file_path, &source_stat, requested_mediatype, meta)) {
+        g_atomic_int_inc(&g_sync_ctx.stats.metadata_cache_hits);
+        log_message(LOG_DEBUG, "Metadata cache hit: %s", file_path);
+        rb_ipod_folder_covers_apply(g_sync_ctx.folder_covers, file_path, meta);
+        return TRUE;
+    }
+    
     // First, try comprehensive metadata extraction from the audio file
     gboolean metadata_success = extract_audio_metadata_full(file_path, meta);
     
@@ -747,6 +643,25 @@ gboolean probe_audio_file(const char *file_path, AudioMetadata *meta) {
         }
     }
     
+    // MP3: frame headers give the exact VBR length and the gapless fields,
+    // which TagLib's average-based length does not
+    if (rb_ipod_classify_extension(file_path) == RB_IPOD_EXT_MP3) {
+        RbIpodMp3Info mp3;
+        if (rb_ipod_probe_mp3(file_path, &mp3)) {
+            meta->duration_ms = mp3.duration_ms;
+            meta->duration = (mp3.duration_ms + 500) / 1000;
+            meta->bitrate = mp3.bitrate;
+            if (mp3.has_gapless) {
+                meta->pregap = mp3.encoder_delay + MP3_DECODER_DELAY;
+                meta->postgap = mp3.encoder_padding > MP3_DECODER_DELAY ?
+                                mp3.encoder_padding - MP3_DECODER_DELAY : 0;
+                meta->samplecount = mp3.sample_count;
+                meta->gapless_data = mp3.gapless_data;
+                meta->has_gapless = TRUE;
+            }
+        }
+    }
+    
     // Always try to get duration/bitrate if not already set
     if (meta->duration == 0) {
         int duration = 0, bitrate = 0;
@@ -770,6 +685,17 @@ gboolean probe_audio_file(const char *file_path, AudioMetadata *meta) {
                meta->artist ? meta->artist : "N/A", 
                meta->album ? meta->album : "N/A");
     
+    if (cacheable) {
+        g_atomic_int_inc(&g_sync_ctx.stats.metadata_cache_misses);
+        rb_ipod_metadata_cache_store(cache, file_path, &source_stat, requested_mediatype, meta);
+    }
+    
+    // Untagged rips: the directory's cover.jpg/folder.jpg, shared through
+    // the artwork cache like an embedded picture
+    if (rb_ipod_folder_covers_apply(g_sync_ctx.folder_covers, file_path, meta)) {
+        log_message(LOG_DEBUG, "Using folder cover for: %s", file_path);
+    }
+    
     return TRUE;
 }
 
@@ -799,13 +725,35 @@ Itdb_Track* create_ipod_track_from_metadata(const AudioMetadata *meta, const cha
     track->cd_nr = meta->disc_number > 0 ? meta->disc_number : 1;
     
     // Essential timing and quality information
-    track->tracklen = meta->duration * 1000; // Convert to milliseconds (CRITICAL for playback)
+    track->tracklen = meta->duration_ms > 0 ? (gint32)meta->duration_ms
+                                            : meta->duration * 1000; // Milliseconds (CRITICAL for playback)
     track->bitrate = meta->bitrate > 0 ? meta->bitrate : 128; // Default bitrate if not available
     
-    // Get file size from the actual file
+    // Gapless playback (pregap/postgap in samples, as iTunes stores them)
+    if (meta->has_gapless) {
+        track->pregap = meta->pregap;
+        track->postgap = meta->postgap;
+        track->samplecount = meta->samplecount;
+        track->gapless_data = meta->gapless_data;
+        track->gapless_track_flag = 1;
+    }
+    
+    // Chapter markers (audiobooks, podcasts, films)
+    if (meta->chapters && meta->chapters->len > 0) {
+        track->chapterdata = itdb_chapterdata_new();
+        for (guint i = 0; i < meta->chapters->len; i++) {
+            const RbIpodChapter *chapter = g_ptr_array_index(meta->chapters, i);
+            itdb_chapterdata_add_chapter(track->chapterdata, chapter->start_ms, chapter->title);
+        }
+    }
+    
+    // Get file size from the actual file (the source size while the copy
+    // is still queued in the sync pipeline - copies are byte-identical)
     struct stat file_stat;
     if (stat(ipod_path, &file_stat) == 0) {
         track->size = file_stat.st_size;
+    } else {
+        track->size = meta->file_size;
     }
     
     // Set iPod path - must be relative to mount point
@@ -829,6 +777,11 @@ Itdb_Track* create_ipod_track_from_metadata(const AudioMetadata *meta, const cha
         } else if (g_ascii_strcasecmp(file_ext, "m4a") == 0 || 
                    g_ascii_strcasecmp(file_ext, "aac") == 0) {
             track->filetype = g_strdup("m4a");
+        } else if (g_ascii_strcasecmp(file_ext, "m4p") == 0) {
+            track->filetype = g_strdup("m4p");
+        } else if (g_ascii_strcasecmp(file_ext, "mp4") == 0 ||
+                   g_ascii_strcasecmp(file_ext, "m4v") == 0) {
+            track->filetype = g_strdup(meta->has_video ? "m4v" : "m4a");
         } else {
             track->filetype = g_strdup("mp3"); // Safe default
         }
@@ -840,79 +793,9 @@ Itdb_Track* create_ipod_track_from_metadata(const AudioMetadata *meta, const cha
     track->time_added = time(NULL);
     track->time_modified = track->time_added;
     
-    // Add artwork using libgpod memory-based API if available
-    if (meta->artwork_data && meta->artwork_size > 0) {
-        guchar *final_artwork_data = meta->artwork_data;
-        gsize final_artwork_size = meta->artwork_size;
-        gboolean need_to_free_converted = FALSE;
-        
-        // Convert to JPEG if format is not already JPEG
-        if (meta->artwork_format && strcmp(meta->artwork_format, "jpeg") != 0 && strcmp(meta->artwork_format, "jpg") != 0) {
-            log_message(LOG_DEBUG, "Converting artwork from %s to JPEG for better iPod compatibility", meta->artwork_format);
-            
-            // Load image from memory using GdkPixbuf
-            GInputStream *stream = g_memory_input_stream_new_from_data(meta->artwork_data, meta->artwork_size, NULL);
-            GError *error = NULL;
-            GdkPixbuf *pixbuf = gdk_pixbuf_new_from_stream(stream, NULL, &error);
-            g_object_unref(stream);
-            
-            if (pixbuf) {
-                // Convert to JPEG
-                gchar *jpeg_data = NULL;
-                gsize jpeg_size = 0;
-                
-                if (gdk_pixbuf_save_to_buffer(pixbuf, &jpeg_data, &jpeg_size, "jpeg", &error, "quality", "90", NULL)) {
-                    final_artwork_data = (guchar*)jpeg_data;
-                    final_artwork_size = jpeg_size;
-                    need_to_free_converted = TRUE;
-                    log_message(LOG_DEBUG, "Successfully converted artwork to JPEG: %zu -> %zu bytes", 
-                               meta->artwork_size, jpeg_size);
-                } else {
-                    log_message(LOG_WARNING, "Failed to convert artwork to JPEG: %s", error ? error->message : "unknown error");
-                    if (error) g_error_free(error);
-                }
-                g_object_unref(pixbuf);
-            } else {
-                log_message(LOG_WARNING, "Failed to load artwork for conversion: %s", error ? error->message : "unknown error");
-                if (error) g_error_free(error);
-            }
-        }
-        
-        // Use itdb_track_set_thumbnails_from_data for direct memory-based artwork handling
-        gboolean artwork_added = itdb_track_set_thumbnails_from_data(track, final_artwork_data, final_artwork_size);
-        
-        if (artwork_added) {
-            const char *format_desc = need_to_free_converted ? "jpeg (converted)" : 
-                                    (meta->artwork_format && strcmp(meta->artwork_format, "png") == 0) ? "png" : "jpeg";
-            log_message(LOG_DEBUG, "Successfully added artwork to track: %s (%zu bytes, format: %s)", 
-                       track->title, final_artwork_size, format_desc);
-        } else {
-            log_message(LOG_WARNING, "Failed to add artwork to track: %s (libgpod memory-based error)", track->title);
-            
-            // Fallback: Use traditional file-based method if memory-based fails
-            char temp_artwork[256];
-            snprintf(temp_artwork, sizeof(temp_artwork), "/tmp/track_artwork_%d.jpg", getpid());
-            
-            FILE *temp_file = fopen(temp_artwork, "wb");
-            if (temp_file) {
-                size_t written = fwrite(final_artwork_data, 1, final_artwork_size, temp_file);
-                fclose(temp_file);
-                
-                if (written == final_artwork_size) {
-                    if (itdb_track_set_thumbnails(track, temp_artwork)) {
-                        log_message(LOG_DEBUG, "Successfully added artwork using file-based fallback: %s", track->title);
-                    } else {
-                        log_message(LOG_WARNING, "Both memory-based and file-based artwork methods failed for: %s", track->title);
-                    }
-                }
-                unlink(temp_artwork); // Clean up temporary file
-            }
-        }
-        
-        // Clean up converted data if needed
-        if (need_to_free_converted) {
-            g_free(final_artwork_data);
-        }
+    // Add artwork, converting and building thumbnails once per distinct image
+    if (meta->artwork_data && meta->artwork_size > 0 && g_sync_ctx.ipod_db) {
+        rb_ipod_artwork_cache_apply(g_sync_ctx.ipod_db->artwork_cache, track, meta);
     }
     
     // Set media-type specific attributes
@@ -972,6 +855,30 @@ Itdb_Track* create_ipod_track_from_metadata(const AudioMetadata *meta, const cha
         log_message(LOG_DEBUG, "Set podcast attributes for track: %s (Episode: %d, Season: %d, Released: %ld, Show: %s)", 
                    track->title, track->track_nr, track->cd_nr, track->time_released, 
                    meta->podcast_name ? meta->podcast_name : "N/A");
+    } else if (track->mediatype == ITDB_MEDIATYPE_TVSHOW ||
+               track->mediatype == ITDB_MEDIATYPE_MOVIE ||
+               track->mediatype == ITDB_MEDIATYPE_MUSICVIDEO) {
+        track->movie_flag = meta->has_video ? 0x01 : 0x00;
+        track->remember_playback_position = (track->mediatype != ITDB_MEDIATYPE_MUSICVIDEO);
+        
+        if (meta->tvshow && strlen(meta->tvshow) > 0) {
+            track->tvshow = g_strdup(meta->tvshow);
+        }
+        if (meta->tvepisode && strlen(meta->tvepisode) > 0) {
+            track->tvepisode = g_strdup(meta->tvepisode);
+        }
+        if (meta->tvnetwork && strlen(meta->tvnetwork) > 0) {
+            track->tvnetwork = g_strdup(meta->tvnetwork);
+        }
+        if (meta->description && strlen(meta->description) > 0) {
+            track->description = g_strdup(meta->description);
+        }
+        track->season_nr = meta->season_number;
+        track->episode_nr = meta->episode_number;
+        
+        log_message(LOG_DEBUG, "Set video attributes for track: %s (show: %s, season: %d, episode: %d)", 
+                   track->title, meta->tvshow ? meta->tvshow : "N/A",
+                   track->season_nr, track->episode_nr);
     } else if (track->mediatype == ITDB_MEDIATYPE_AUDIO) {
         // CRITICAL: Ensure music tracks have proper attributes for iPod menu access
         track->flag4 = 0x00;  // No special flags for music
@@ -992,57 +899,230 @@ Itdb_Track* create_ipod_track_from_metadata(const AudioMetadata *meta, const cha
 gboolean add_file_to_ipod(RbIpodDb *db, const char *file_path) {
     if (!db || !file_path) return FALSE;
     
-    log_message(LOG_INFO, "Adding file to iPod: %s", file_path);
+    struct stat file_stat;
+    gint64 file_size = 0;
+    gint64 source_mtime = 0;
+    if (stat(file_path, &file_stat) == 0) {
+        file_size = file_stat.st_size;
+        source_mtime = file_stat.st_mtime;
+    }
+    
+    return add_source_file_to_ipod(db, file_path, file_size, source_mtime);
+}
+
+AudioMetadata* probe_source_file(const char *file_path, gint64 file_size, guint32 mediatype) {
+    if (!file_path) return NULL;
     
     // Initialize metadata structure
     AudioMetadata *meta = g_malloc0(sizeof(AudioMetadata));
     if (!meta) {
         log_message(LOG_ERROR, "Failed to allocate metadata structure");
-        return FALSE;
+        return NULL;
     }
     
-    // Set media type if forced
-    if (g_sync_ctx.use_force_mediatype) {
-        meta->mediatype = g_sync_ctx.force_mediatype;
-    } else {
-        meta->mediatype = ITDB_MEDIATYPE_AUDIO; // Default
-    }
-    
-    // Set basic file info
-    struct stat file_stat;
-    if (stat(file_path, &file_stat) == 0) {
-        meta->file_size = file_stat.st_size;
-    }
+    // Media type is decided by the caller, never read from shared state here;
+    // RB_IPOD_MEDIATYPE_AUTO lets the file itself say (MP4 "stik", video track)
+    meta->mediatype = mediatype != RB_IPOD_MEDIATYPE_AUTO ? mediatype : ITDB_MEDIATYPE_AUDIO;
+    meta->file_size = file_size;
     meta->time_added = time(NULL);
     
     // Probe audio file for all metadata (will fallback to filename if needed)
     if (!probe_audio_file(file_path, meta)) {
         log_message(LOG_ERROR, "Failed to extract any metadata from %s", file_path);
         free_metadata(meta);
-        return FALSE;
+        return NULL;
     }
     
-    // Ensure iPod directory structure exists
-    if (!ensure_ipod_directory_structure(db->mount_point)) {
-        log_message(LOG_ERROR, "Failed to create iPod directory structure");
-        free_metadata(meta);
+    if (mediatype == RB_IPOD_MEDIATYPE_AUTO && meta->detected_mediatype != 0) {
+        meta->mediatype = meta->detected_mediatype;
+    }
+    
+    return meta;
+}
+
+Itdb_Playlist* ensure_podcasts_playlist(RbIpodDb *db) {
+    Itdb_Playlist *podcasts_pl = itdb_playlist_podcasts(db->itdb);
+    if (!podcasts_pl) {
+        podcasts_pl = itdb_playlist_new("Podcasts", FALSE);
+        itdb_playlist_set_podcasts(podcasts_pl);
+        itdb_playlist_add(db->itdb, podcasts_pl, -1);
+        log_message(LOG_INFO, "Created essential Podcasts playlist");
+    }
+    return podcasts_pl;
+}
+
+void commit_track_to_ipod(RbIpodDb *db, Itdb_Track *track, gint32 pos) {
+    if (!db || !track) return;
+    
+    // Add track to database
+    itdb_track_add(db->itdb, track, pos);
+    rb_ipod_track_index_add_track(db->track_index, track);
+    
+    // CRITICAL: Add ALL tracks to Master Playlist for iPod menu visibility
+    Itdb_Playlist *master_pl = itdb_playlist_mpl(db->itdb);
+    if (master_pl) {
+        itdb_playlist_add_track(master_pl, track, pos);
+        rb_ipod_track_index_add_member(db->track_index, master_pl, track);
+        log_message(LOG_DEBUG, "Added track to Master Playlist: %s", track->title);
+    } else {
+        log_message(LOG_ERROR, "Master Playlist not found - track may not be visible in iPod menu!");
+    }
+    
+    // Add to media-type specific playlists 
+    if (track->mediatype == ITDB_MEDIATYPE_PODCAST) {
+        // Podcast-specific playlist
+        Itdb_Playlist *podcasts_pl = ensure_podcasts_playlist(db);
+        itdb_playlist_add_track(podcasts_pl, track, pos);
+        rb_ipod_track_index_add_member(db->track_index, podcasts_pl, track);
+        log_message(LOG_DEBUG, "Added podcast track to Podcasts playlist: %s", track->title);
+    } else if (track->mediatype == ITDB_MEDIATYPE_AUDIO) {
+        // Music tracks are accessible through Master Playlist - no special playlist needed
+        log_message(LOG_DEBUG, "Music track added to Master Playlist: %s", track->title);
+    } else {
+        log_message(LOG_DEBUG, "Added %s track to Master Playlist: %s", 
+                   get_media_type_name(track->mediatype), track->title);
+    }
+}
+
+static void replace_string(gchar **field, const gchar *value) {
+    if (!value) return;
+    g_free(*field);
+    *field = g_strdup(value);
+}
+
+void update_track_on_ipod(RbIpodDb *db, Itdb_Track *track, const RbIpodTrackUpdate *update) {
+    if (!db || !track || !update) return;
+    
+    // Tag and identity keys change with the fields: re-index around the edit,
+    // keeping the playlists the track belongs to
+    GList *playlists = g_list_copy(rb_ipod_track_index_playlists(db->track_index, track));
+    rb_ipod_content_index_remove_track(db->content_index, track);
+    rb_ipod_track_index_remove_track(db->track_index, track);
+    
+    replace_string(&track->title, update->title);
+    replace_string(&track->artist, update->artist);
+    replace_string(&track->album, update->album);
+    replace_string(&track->albumartist, update->albumartist);
+    replace_string(&track->genre, update->genre);
+    if (update->track_nr >= 0) track->track_nr = update->track_nr;
+    if (update->rating >= 0) track->rating = (guint32)update->rating;
+    track->time_modified = time(NULL);
+    
+    rb_ipod_track_index_add_track(db->track_index, track);
+    for (GList *item = g_list_last(playlists); item; item = item->prev) {
+        rb_ipod_track_index_add_member(db->track_index, (Itdb_Playlist*)item->data, track);
+    }
+    rb_ipod_content_index_add_track(db->content_index, track);
+    g_list_free(playlists);
+}
+
+void remove_track_from_ipod(RbIpodDb *db, Itdb_Track *track) {
+    if (!db || !track) return;
+    
+    // Only the playlists holding the track, not every playlist on the device
+    for (GList *pl_item = rb_ipod_track_index_playlists(db->track_index, track); pl_item; pl_item = pl_item->next) {
+        itdb_playlist_remove_track((Itdb_Playlist*)pl_item->data, track);
+    }
+    
+    rb_ipod_content_index_remove_track(db->content_index, track);
+    rb_ipod_track_index_remove_track(db->track_index, track);
+    itdb_track_remove(track);
+}
+
+// Drops the links whose track is in the set, in one walk of the list
+static GList* drop_listed_tracks(GList *list, GHashTable *tracks) {
+    GList *item = list;
+    while (item) {
+        GList *next = item->next;
+        if (g_hash_table_contains(tracks, item->data)) {
+            list = g_list_delete_link(list, item);
+        }
+        item = next;
+    }
+    return list;
+}
+
+guint remove_tracks_from_ipod(RbIpodDb *db, GHashTable *tracks) {
+    if (!db || !tracks || g_hash_table_size(tracks) == 0) return 0;
+    
+    // One pass per playlist and one over the track list, instead of a
+    // g_list_remove() per track and playlist
+    for (GList *pl_item = db->itdb->playlists; pl_item; pl_item = pl_item->next) {
+        Itdb_Playlist *playlist = (Itdb_Playlist*)pl_item->data;
+        playlist->members = drop_listed_tracks(playlist->members, tracks);
+    }
+    db->itdb->tracks = drop_listed_tracks(db->itdb->tracks, tracks);
+    
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, tracks);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        Itdb_Track *track = key;
+        rb_ipod_content_index_remove_track(db->content_index, track);
+        rb_ipod_track_index_remove_track(db->track_index, track);
+        track->itdb = NULL;
+        itdb_track_free(track);
+    }
+    
+    log_message(LOG_INFO, "Removed %u tracks from the database", g_hash_table_size(tracks));
+    return g_hash_table_size(tracks);
+}
+
+gboolean add_source_file_to_ipod(RbIpodDb *db, const char *file_path,
+                                 gint64 file_size, gint64 source_mtime) {
+    if (!db || !file_path) return FALSE;
+    
+    log_message(LOG_INFO, "Adding file to iPod: %s", file_path);
+    
+    // Skip files already synced from this exact source (no probe, no copy)
+    Itdb_Track *existing = rb_ipod_content_index_lookup_source(db->content_index, file_path,
+                                                               file_size, source_mtime);
+    if (existing) {
+        log_message(LOG_DEBUG, "Unchanged since last sync, skipping: %s", file_path);
+        g_sync_ctx.stats.files_skipped++;
+        return TRUE;
+    }
+    
+    // Set media type if forced
+    guint32 mediatype = g_sync_ctx.use_force_mediatype ? g_sync_ctx.force_mediatype
+                                                       : RB_IPOD_MEDIATYPE_AUTO;
+    
+    AudioMetadata *meta = probe_source_file(file_path, file_size, mediatype);
+    if (!meta) {
+        g_sync_ctx.stats.files_failed++;
         return FALSE;
     }
     
-    // Initialize the iPod file counter based on existing files
-    initialize_ipod_file_counter(db->mount_point);
+    // Same track already on the device (e.g. synced from another path or
+    // before the sidecar existed): remember the mapping and skip the copy
+    existing = rb_ipod_content_index_lookup_identity(db->content_index, meta->title,
+                                                     meta->artist, meta->file_size, meta->mediatype);
+    if (existing) {
+        log_message(LOG_DEBUG, "Track already on iPod (%s), skipping: %s", existing->ipod_path, file_path);
+        rb_ipod_content_index_record_source(db->content_index, file_path, meta->file_size,
+                                            source_mtime, existing);
+        g_sync_ctx.stats.files_skipped++;
+        free_metadata(meta);
+        return TRUE;
+    }
     
-    // Generate iPod filename using Apple/gtkpod naming convention
-    char *ipod_path = generate_ipod_filename(db->mount_point, file_path);
+    // Allocate an iPod filename using Apple/gtkpod naming convention
+    // (the allocator creates missing Fxx directories on demand)
+    char *ipod_path = rb_ipod_file_allocator_next(db->file_allocator, file_path);
     if (!ipod_path) {
         log_message(LOG_ERROR, "Failed to generate iPod path for %s", file_path);
+        g_sync_ctx.stats.files_failed++;
         free_metadata(meta);
         return FALSE;
     }
     
     // Copy file to iPod
+    rb_ipod_sync_journal_record(db->journal, ipod_path, file_path, meta->file_size, source_mtime, mediatype);
     if (!copy_file_to_ipod(file_path, ipod_path)) {
         log_message(LOG_ERROR, "Failed to copy file to iPod");
+        g_sync_ctx.stats.files_failed++;
+        rb_ipod_sync_journal_forget(db->journal, ipod_path);
+        rb_ipod_file_allocator_release(db->file_allocator, ipod_path);
         g_free(ipod_path);
         free_metadata(meta);
         return FALSE;
@@ -1052,49 +1132,30 @@ gboolean add_file_to_ipod(RbIpodDb *db, const char *file_path) {
     Itdb_Track *track = create_ipod_track_from_metadata(meta, ipod_path, strrchr(file_path, '.'));
     if (!track) {
         log_message(LOG_ERROR, "Failed to create track from metadata");
+        g_sync_ctx.stats.files_failed++;
+        // No track owns the copy: drop it before journal recovery finds it
+        unlink(ipod_path);
+        rb_ipod_sync_journal_forget(db->journal, ipod_path);
+        rb_ipod_file_allocator_release(db->file_allocator, ipod_path);
         g_free(ipod_path);
         free_metadata(meta);
         return FALSE;
     }
     
-    // Add track to database
-    itdb_track_add(db->itdb, track, -1);
-    
-    // CRITICAL: Add ALL tracks to Master Playlist for iPod menu visibility
-    Itdb_Playlist *master_pl = itdb_playlist_mpl(db->itdb);
-    if (master_pl) {
-        itdb_playlist_add_track(master_pl, track, -1);
-        log_message(LOG_DEBUG, "Added track to Master Playlist: %s", track->title);
-    } else {
-        log_message(LOG_ERROR, "Master Playlist not found - track may not be visible in iPod menu!");
-    }
+    rb_ipod_db_add_track(db, track);
     
-    // Add to media-type specific playlists 
-    if (track->mediatype == ITDB_MEDIATYPE_PODCAST) {
-        // Podcast-specific playlist
-        Itdb_Playlist *podcasts_pl = itdb_playlist_podcasts(db->itdb);
-        if (!podcasts_pl) {
-            podcasts_pl = itdb_playlist_new("Podcasts", FALSE);
-            itdb_playlist_set_podcasts(podcasts_pl);
-            itdb_playlist_add(db->itdb, podcasts_pl, -1);
-            log_message(LOG_INFO, "Created essential Podcasts playlist");
-        }
-        itdb_playlist_add_track(podcasts_pl, track, -1);
-        log_message(LOG_DEBUG, "Added podcast track to Podcasts playlist: %s", track->title);
-    } else if (track->mediatype == ITDB_MEDIATYPE_AUDIO) {
-        // Music tracks are accessible through Master Playlist - no special playlist needed
-        log_message(LOG_DEBUG, "Music track added to Master Playlist: %s", track->title);
-    } else {
-        log_message(LOG_DEBUG, "Added %s track to Master Playlist: %s", 
-                   get_media_type_name(track->mediatype), track->title);
-    }
+    // Register the new track so later files (and the next run) see it
+    rb_ipod_content_index_add_track(db->content_index, track);
+    rb_ipod_content_index_record_source(db->content_index, file_path, meta->file_size,
+                                        source_mtime, track);
     
     // Update statistics
     g_sync_ctx.stats.files_added++;
+    g_sync_ctx.stats.bytes_transferred += meta->file_size;
     
     g_free(ipod_path);
     free_metadata(meta);
     
     log_message(LOG_DEBUG, "Successfully added file to iPod database");
     return TRUE;
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <glib.h>
@@ -105,4 +106,102 @@ char* find_ipod_device(void) {
     // TODO: Implement device detection
     // Check common mount points and device paths
     return NULL;
-}
\ No newline at end of file
+}
+
+// =============================================================================
+// PARALLEL FILE REMOVAL
+// =============================================================================
+
+typedef struct {
+    GPtrArray *paths;
+    gint next;          // Index of the next path to claim (atomic)
+    gint removed;       // Atomic
+} UnlinkState;
+
+static gpointer unlink_worker(gpointer data) {
+    UnlinkState *state = data;
+    gint index;
+
+    // Each unlink is a metadata round trip to the device: several in
+    // flight keep the FAT updates queued instead of serialized
+    while ((index = g_atomic_int_add(&state->next, 1)) < (gint)state->paths->len) {
+        const char *path = g_ptr_array_index(state->paths, index);
+        if (unlink(path) == 0) {
+            g_atomic_int_inc(&state->removed);
+        } else if (errno != ENOENT) {
+            log_message(LOG_WARNING, "Could not delete file: %s (%s)", path, strerror(errno));
+        }
+    }
+    return NULL;
+}
+
+guint rb_ipod_unlink_files(GPtrArray *paths, guint num_threads) {
+    if (!paths || paths->len == 0) return 0;
+
+    if (num_threads == 0) {
+        num_threads = MIN(g_get_num_processors() * 2, UNLINK_MAX_THREADS);
+    }
+    num_threads = CLAMP(num_threads, 1, MIN(UNLINK_MAX_THREADS, paths->len));
+
+    UnlinkState state = { paths, 0, 0 };
+    GThread **threads = g_new0(GThread*, num_threads);
+    for (guint i = 0; i < num_threads; i++) {
+        threads[i] = g_thread_new("rbipod-unlink", unlink_worker, &state);
+    }
+    for (guint i = 0; i < num_threads; i++) {
+        g_thread_join(threads[i]);
+    }
+    g_free(threads);
+
+    log_message(LOG_INFO, "Deleted %d of %u files with %u threads", state.removed, paths->len, num_threads);
+    return (guint)state.removed;
+}
+
+static gboolean is_music_subdir(const char *name) {
+    return name[0] == 'F' && g_ascii_isdigit(name[1]) && g_ascii_isdigit(name[2]) && name[3] == '\0';
+}
+
+guint rb_ipod_clear_music_dirs(const char *mount_point, guint num_threads) {
+    if (!mount_point) return 0;
+
+    char *music_dir = g_build_filename(mount_point, "iPod_Control", "Music", NULL);
+    GDir *dir = g_dir_open(music_dir, 0, NULL);
+    if (!dir) {
+        g_free(music_dir);
+        return 0;
+    }
+
+    GPtrArray *subdirs = g_ptr_array_new_with_free_func(g_free);
+    GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+    const char *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (!is_music_subdir(name)) continue;
+
+        char *subdir = g_build_filename(music_dir, name, NULL);
+        GDir *fdir = g_dir_open(subdir, 0, NULL);
+        if (fdir) {
+            const char *file;
+            while ((file = g_dir_read_name(fdir)) != NULL) {
+                g_ptr_array_add(files, g_build_filename(subdir, file, NULL));
+            }
+            g_dir_close(fdir);
+        }
+        g_ptr_array_add(subdirs, subdir);
+    }
+    g_dir_close(dir);
+
+    guint removed = rb_ipod_unlink_files(files, num_threads);
+
+    // Only succeeds once empty: anything that could not be deleted stays put
+    for (guint i = 0; i < subdirs->len; i++) {
+        const char *subdir = g_ptr_array_index(subdirs, i);
+        if (rmdir(subdir) == 0) {
+            log_message(LOG_DEBUG, "Removed empty directory: %s", subdir);
+        }
+    }
+
+    g_ptr_array_free(files, TRUE);
+    g_ptr_array_free(subdirs, TRUE);
+    g_free(music_dir);
+    return removed;
+}
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <gpod/itdb.h>
+
+#include "../include/rbipod-index.h"
+#include "../include/rbipod-logging.h"
+
+// =============================================================================
+// ON-DEVICE CONTENT INDEX (INCREMENTAL SYNC)
+// =============================================================================
+
+#define CONTENT_INDEX_HEADER "# rbipod-content-index 1"
+
+typedef struct {
+    gint64 size;
+    gint64 mtime;
+    guint64 dbid;
+    char *ipod_path;    // Normalized ('/' separated, relative to mount point)
+} RbIpodSourceRecord;
+
+struct _RbIpodContentIndex {
+    GHashTable *tracks_by_path;      // normalized ipod_path -> Itdb_Track*
+    GHashTable *tracks_by_identity;  // size/mediatype/title/artist key -> Itdb_Track*
+    GHashTable *sources;             // host source path -> RbIpodSourceRecord*
+    char *sidecar_path;
+};
+
+static void free_source_record(gpointer data) {
+    RbIpodSourceRecord *record = data;
+    if (!record) return;
+    g_free(record->ipod_path);
+    g_free(record);
+}
+
+char* rb_ipod_normalize_ipod_path(const char *ipod_path) {
+    if (!ipod_path) return NULL;
+
+    // libgpod stores locations with ':' separators, tracks created by this
+    // tool use '/' - index both under the same key
+    char *normalized = g_strdup(ipod_path);
+    for (char *p = normalized; *p; p++) {
+        if (*p == ':') *p = '/';
+    }
+    return normalized;
+}
+
+static char* build_identity_key(const char *title, const char *artist, gint64 size, guint32 mediatype) {
+    // An audiobook and a song may share title, artist and size; databases
+    // too old to store a media type only hold audio
+    if (mediatype == 0) mediatype = ITDB_MEDIATYPE_AUDIO;
+    return g_strdup_printf("%" G_GINT64_FORMAT "\x1f%u\x1f%s\x1f%s", size, mediatype,
+                           title ? title : "Unknown Title",
+                           artist ? artist : "Unknown Artist");
+}
+
+char* rb_ipod_device_cache_path(Itdb_iTunesDB *itdb, const char *mount_point, const char *prefix) {
+    // Key the sidecar on the device GUID when available so the same iPod
+    // mounted elsewhere keeps its history; fall back to the mount point
+    gchar *device_key = NULL;
+    if (itdb && itdb->device) {
+        device_key = itdb_device_get_sysinfo(itdb->device, "FirewireGuid");
+    }
+    if (!device_key) {
+        device_key = g_strdup(mount_point);
+    }
+
+    gchar *digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, device_key, -1);
+    gchar *filename = g_strdup_printf("%s-%.16s.tsv", prefix, digest);
+    char *path = g_build_filename(g_get_user_cache_dir(), PROGRAM_NAME, filename, NULL);
+
+    g_free(filename);
+    g_free(digest);
+    g_free(device_key);
+    return path;
+}
+
+static void load_sidecar(RbIpodContentIndex *index) {
+    gchar *contents = NULL;
+    gsize length = 0;
+
+    if (!g_file_get_contents(index->sidecar_path, &contents, &length, NULL)) {
+        log_message(LOG_DEBUG, "No content index sidecar at %s", index->sidecar_path);
+        return;
+    }
+
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    if (!lines[0] || strcmp(lines[0], CONTENT_INDEX_HEADER) != 0) {
+        log_message(LOG_WARNING, "Ignoring content index with unknown format: %s", index->sidecar_path);
+        g_strfreev(lines);
+        return;
+    }
+
+    for (int i = 1; lines[i]; i++) {
+        // Format: size \t mtime \t dbid \t ipod_path \t source_path
+        gchar **fields = g_strsplit(lines[i], "\t", 5);
+        if (g_strv_length(fields) == 5) {
+            RbIpodSourceRecord *record = g_malloc0(sizeof(RbIpodSourceRecord));
+            record->size = g_ascii_strtoll(fields[0], NULL, 10);
+            record->mtime = g_ascii_strtoll(fields[1], NULL, 10);
+            record->dbid = g_ascii_strtoull(fields[2], NULL, 10);
+            record->ipod_path = g_strdup(fields[3]);
+            g_hash_table_replace(index->sources, g_strdup(fields[4]), record);
+        }
+        g_strfreev(fields);
+    }
+    g_strfreev(lines);
+
+    log_message(LOG_INFO, "Loaded %u source entries from content index %s",
+               g_hash_table_size(index->sources), index->sidecar_path);
+}
+
+RbIpodContentIndex* rb_ipod_content_index_new(Itdb_iTunesDB *itdb, const char *mount_point) {
+    if (!itdb || !mount_point) return NULL;
+
+    RbIpodContentIndex *index = g_malloc0(sizeof(RbIpodContentIndex));
+    index->tracks_by_path = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    index->tracks_by_identity = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    index->sources = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_source_record);
+    index->sidecar_path = rb_ipod_device_cache_path(itdb, mount_point, "content-index");
+
+    for (GList *item = itdb->tracks; item; item = item->next) {
+        rb_ipod_content_index_add_track(index, (Itdb_Track*)item->data);
+    }
+
+    load_sidecar(index);
+
+    log_message(LOG_INFO, "Content index built: %u tracks on device",
+               g_hash_table_size(index->tracks_by_path));
+    return index;
+}
+
+void rb_ipod_content_index_free(RbIpodContentIndex *index) {
+    if (!index) return;
+
+    g_hash_table_destroy(index->tracks_by_path);
+    g_hash_table_destroy(index->tracks_by_identity);
+    g_hash_table_destroy(index->sources);
+    g_free(index->sidecar_path);
+    g_free(index);
+}
+
+void rb_ipod_content_index_add_track(RbIpodContentIndex *index, Itdb_Track *track) {
+    if (!index || !track) return;
+
+    if (track->ipod_path) {
+        g_hash_table_replace(index->tracks_by_path, rb_ipod_normalize_ipod_path(track->ipod_path), track);
+    }
+    g_hash_table_replace(index->tracks_by_identity,
+                         build_identity_key(track->title, track->artist, track->size, track->mediatype), track);
+}
+
+void rb_ipod_content_index_remove_track(RbIpodContentIndex *index, Itdb_Track *track) {
+    if (!index || !track) return;
+
+    // Only drop keys that still resolve to this track (a later track may
+    // have replaced them)
+    if (track->ipod_path) {
+        char *path_key = rb_ipod_normalize_ipod_path(track->ipod_path);
+        if (g_hash_table_lookup(index->tracks_by_path, path_key) == track) {
+            g_hash_table_remove(index->tracks_by_path, path_key);
+        }
+        g_free(path_key);
+    }
+
+    char *identity_key = build_identity_key(track->title, track->artist, track->size, track->mediatype);
+    if (g_hash_table_lookup(index->tracks_by_identity, identity_key) == track) {
+        g_hash_table_remove(index->tracks_by_identity, identity_key);
+    }
+    g_free(identity_key);
+}
+
+Itdb_Track* rb_ipod_content_index_lookup_source(RbIpodContentIndex *index, const char *source_path,
+                                                gint64 size, gint64 mtime) {
+    if (!index || !source_path) return NULL;
+
+    RbIpodSourceRecord *record = g_hash_table_lookup(index->sources, source_path);
+    if (!record || record->size != size || record->mtime != mtime) {
+        return NULL;
+    }
+
+    // The sidecar is only a hint: the track must still be in the iTunesDB
+    Itdb_Track *track = g_hash_table_lookup(index->tracks_by_path, record->ipod_path);
+    if (!track) return NULL;
+    if (record->dbid != 0 && track->dbid != 0 && record->dbid != track->dbid) {
+        return NULL;
+    }
+
+    return track;
+}
+
+Itdb_Track* rb_ipod_content_index_lookup_identity(RbIpodContentIndex *index, const char *title,
+                                                  const char *artist, gint64 size, guint32 mediatype) {
+    if (!index || size <= 0) return NULL;
+
+    char *key = build_identity_key(title, artist, size, mediatype);
+    Itdb_Track *track = g_hash_table_lookup(index->tracks_by_identity, key);
+    g_free(key);
+    return track;
+}
+
+void rb_ipod_content_index_record_source(RbIpodContentIndex *index, const char *source_path,
+                                         gint64 size, gint64 mtime, Itdb_Track *track) {
+    if (!index || !source_path || !track || !track->ipod_path) return;
+
+    RbIpodSourceRecord *record = g_malloc0(sizeof(RbIpodSourceRecord));
+    record->size = size;
+    record->mtime = mtime;
+    record->dbid = track->dbid;
+    record->ipod_path = rb_ipod_normalize_ipod_path(track->ipod_path);
+    g_hash_table_replace(index->sources, g_strdup(source_path), record);
+}
+
+gboolean rb_ipod_content_index_save(RbIpodContentIndex *index, Itdb_iTunesDB *itdb) {
+    if (!index || !itdb) return FALSE;
+
+    // Resolve against the tracks actually written: dbids are only final after
+    // itdb_write, and removed tracks must drop out of the sidecar
+    GHashTable *current = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (GList *item = itdb->tracks; item; item = item->next) {
+        Itdb_Track *track = (Itdb_Track*)item->data;
+        if (track->ipod_path) {
+            g_hash_table_replace(current, rb_ipod_normalize_ipod_path(track->ipod_path), track);
+        }
+    }
+
+    GString *out = g_string_new(CONTENT_INDEX_HEADER "\n");
+    guint written = 0;
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, index->sources);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const char *source_path = key;
+        RbIpodSourceRecord *record = value;
+
+        Itdb_Track *track = g_hash_table_lookup(current, record->ipod_path);
+        if (!track) {
+            // Committed while a background save ran: not in this iTunesDB
+            // yet, kept for the next save
+            Itdb_Track *pending = g_hash_table_lookup(index->tracks_by_path, record->ipod_path);
+            if (pending && !pending->itdb) continue;
+        }
+        if (!track || strchr(source_path, '\n')) {
+            g_hash_table_iter_remove(&iter);
+            continue;
+        }
+        record->dbid = track->dbid;
+
+        g_string_append_printf(out, "%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%" G_GUINT64_FORMAT "\t%s\t%s\n",
+                               record->size, record->mtime, record->dbid,
+                               record->ipod_path, source_path);
+        written++;
+    }
+    g_hash_table_destroy(current);
+
+    char *dir = g_path_get_dirname(index->sidecar_path);
+    g_mkdir_with_parents(dir, 0755);
+    g_free(dir);
+
+    GError *error = NULL;
+    gboolean result = g_file_set_contents(index->sidecar_path, out->str, out->len, &error);
+    if (!result) {
+        log_message(LOG_WARNING, "Failed to write content index %s: %s",
+                   index->sidecar_path, error ? error->message : "unknown error");
+        if (error) g_error_free(error);
+    } else {
+        log_message(LOG_INFO, "Content index saved: %u entries -> %s", written, index->sidecar_path);
+    }
+
+    g_string_free(out, TRUE);
+    return result;
+}
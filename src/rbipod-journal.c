@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gpod/itdb.h>
+
+#include "../include/rbipod-journal.h"
+#include "../include/rbipod-database.h"
+#include "../include/rbipod-files.h"
+#include "../include/rbipod-index.h"
+#include "../include/rbipod-metadata.h"
+#include "../include/rbipod-logging.h"
+#include "../include/rbipod-utils.h"
+
+// =============================================================================
+// SYNC JOURNAL (CRASH RECOVERY)
+// =============================================================================
+
+#define SYNC_JOURNAL_HEADER "# rbipod-sync-journal 1"
+
+typedef struct {
+    gint64 size;
+    gint64 mtime;
+    guint32 mediatype;
+    char *source_path;
+} JournalEntry;
+
+struct _RbIpodSyncJournal {
+    char *path;
+    char *mount_point;
+    FILE *file;                // Append handle, opened by the first record
+    GHashTable *entries;       // Normalized ipod_path -> JournalEntry*
+};
+
+static void free_journal_entry(gpointer data) {
+    JournalEntry *entry = data;
+    if (!entry) return;
+    g_free(entry->source_path);
+    g_free(entry);
+}
+
+// Same keys as the content index: '/' separated, from /iPod_Control/ on
+static char* journal_key(const char *ipod_path) {
+    const char *relative = strstr(ipod_path, "/iPod_Control/");
+    return rb_ipod_normalize_ipod_path(relative ? relative : ipod_path);
+}
+
+static void format_entry(GString *out, const char *key, const JournalEntry *entry) {
+    // Format: size \t mtime \t mediatype \t ipod_path \t source_path
+    g_string_append_printf(out, "%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%u\t%s\t%s\n",
+                           entry->size, entry->mtime, entry->mediatype, key, entry->source_path);
+}
+
+static void load_journal(RbIpodSyncJournal *journal) {
+    gchar *contents = NULL;
+    gsize length = 0;
+
+    if (!g_file_get_contents(journal->path, &contents, &length, NULL)) {
+        return;
+    }
+
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    if (!lines[0] || strcmp(lines[0], SYNC_JOURNAL_HEADER) != 0) {
+        log_message(LOG_WARNING, "Ignoring sync journal with unknown format: %s", journal->path);
+        g_strfreev(lines);
+        return;
+    }
+
+    // A line cut short by the crash has fewer fields and is skipped
+    for (int i = 1; lines[i]; i++) {
+        gchar **fields = g_strsplit(lines[i], "\t", 5);
+        if (g_strv_length(fields) == 5) {
+            JournalEntry *entry = g_malloc0(sizeof(JournalEntry));
+            entry->size = g_ascii_strtoll(fields[0], NULL, 10);
+            entry->mtime = g_ascii_strtoll(fields[1], NULL, 10);
+            entry->mediatype = (guint32)g_ascii_strtoull(fields[2], NULL, 10);
+            entry->source_path = g_strdup(fields[4]);
+            g_hash_table_replace(journal->entries, g_strdup(fields[3]), entry);
+        }
+        g_strfreev(fields);
+    }
+    g_strfreev(lines);
+
+    if (g_hash_table_size(journal->entries) > 0) {
+        log_message(LOG_INFO, "Sync journal %s: %u files from an interrupted sync",
+                   journal->path, g_hash_table_size(journal->entries));
+    }
+}
+
+RbIpodSyncJournal* rb_ipod_sync_journal_open(Itdb_iTunesDB *itdb, const char *mount_point) {
+    if (!itdb || !mount_point) return NULL;
+
+    RbIpodSyncJournal *journal = g_malloc0(sizeof(RbIpodSyncJournal));
+    journal->path = rb_ipod_device_cache_path(itdb, mount_point, "sync-journal");
+    journal->mount_point = g_strdup(mount_point);
+    journal->entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_journal_entry);
+
+    load_journal(journal);
+    return journal;
+}
+
+void rb_ipod_sync_journal_free(RbIpodSyncJournal *journal) {
+    if (!journal) return;
+
+    if (journal->file) {
+        fclose(journal->file);
+    }
+    g_hash_table_destroy(journal->entries);
+    g_free(journal->mount_point);
+    g_free(journal->path);
+    g_free(journal);
+}
+
+// Replaces the file with the entries still pending; none left removes it
+static void rewrite_journal(RbIpodSyncJournal *journal) {
+    if (journal->file) {
+        fclose(journal->file);
+        journal->file = NULL;
+    }
+
+    if (g_hash_table_size(journal->entries) == 0) {
+        g_unlink(journal->path);
+        return;
+    }
+
+    GString *out = g_string_new(SYNC_JOURNAL_HEADER "\n");
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, journal->entries);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        format_entry(out, key, value);
+    }
+
+    GError *error = NULL;
+    if (!g_file_set_contents(journal->path, out->str, out->len, &error)) {
+        log_message(LOG_WARNING, "Failed to rewrite sync journal %s: %s",
+                   journal->path, error ? error->message : "unknown error");
+        g_clear_error(&error);
+    }
+    g_string_free(out, TRUE);
+}
+
+void rb_ipod_sync_journal_record(RbIpodSyncJournal *journal, const char *ipod_path,
+                                 const char *source_path, gint64 size, gint64 mtime,
+                                 guint32 mediatype) {
+    if (!journal || !ipod_path || !source_path || strchr(source_path, '\n')) return;
+
+    if (!journal->file) {
+        char *dir = g_path_get_dirname(journal->path);
+        g_mkdir_with_parents(dir, 0755);
+        g_free(dir);
+
+        gboolean fresh = !g_file_test(journal->path, G_FILE_TEST_EXISTS);
+        journal->file = fopen(journal->path, "a");
+        if (!journal->file) {
+            log_message(LOG_WARNING, "Sync journal disabled, cannot open %s: %s",
+                       journal->path, strerror(errno));
+            return;
+        }
+        if (fresh) {
+            fputs(SYNC_JOURNAL_HEADER "\n", journal->file);
+        }
+    }
+
+    JournalEntry *entry = g_malloc0(sizeof(JournalEntry));
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->mediatype = mediatype;
+    entry->source_path = g_strdup(source_path);
+    char *key = journal_key(ipod_path);
+
+    // Written before the copy starts: a crash mid-copy still names the file
+    GString *line = g_string_new(NULL);
+    format_entry(line, key, entry);
+    fputs(line->str, journal->file);
+    fflush(journal->file);
+    g_string_free(line, TRUE);
+
+    g_hash_table_replace(journal->entries, key, entry);
+}
+
+void rb_ipod_sync_journal_forget(RbIpodSyncJournal *journal, const char *ipod_path) {
+    if (!journal || !ipod_path) return;
+
+    // The line stays in the file until the next rewrite; recovery finds no
+    // file to adopt for it
+    char *key = journal_key(ipod_path);
+    g_hash_table_remove(journal->entries, key);
+    g_free(key);
+}
+
+static GHashTable* written_track_paths(Itdb_iTunesDB *itdb) {
+    GHashTable *paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (GList *item = itdb->tracks; item; item = item->next) {
+        Itdb_Track *track = (Itdb_Track*)item->data;
+        if (track->ipod_path) {
+            g_hash_table_add(paths, rb_ipod_normalize_ipod_path(track->ipod_path));
+        }
+    }
+    return paths;
+}
+
+void rb_ipod_sync_journal_commit(RbIpodSyncJournal *journal, Itdb_iTunesDB *itdb) {
+    if (!journal || !itdb || g_hash_table_size(journal->entries) == 0) return;
+
+    GHashTable *written = written_track_paths(itdb);
+    guint before = g_hash_table_size(journal->entries);
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, journal->entries);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        if (g_hash_table_contains(written, key)) {
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+    g_hash_table_destroy(written);
+
+    if (g_hash_table_size(journal->entries) != before) {
+        rewrite_journal(journal);
+    }
+}
+
+// A complete copy of an unchanged source becomes a track again
+static gboolean adopt_file(RbIpodDb *db, const char *device_path, const JournalEntry *entry) {
+    struct stat device_stat, source_stat;
+
+    // Shorter than its source: the copy was cut off
+    if (stat(device_path, &device_stat) != 0 || device_stat.st_size != entry->size) {
+        return FALSE;
+    }
+    if (stat(entry->source_path, &source_stat) != 0 || source_stat.st_size != entry->size ||
+        (gint64)source_stat.st_mtime != entry->mtime) {
+        return FALSE;
+    }
+
+    AudioMetadata *meta = probe_source_file(entry->source_path, entry->size, entry->mediatype);
+    if (!meta) return FALSE;
+
+    // Synced again under another name since the interrupted run
+    if (rb_ipod_content_index_lookup_identity(db->content_index, meta->title,
+                                              meta->artist, meta->file_size, meta->mediatype)) {
+        free_metadata(meta);
+        return FALSE;
+    }
+
+    Itdb_Track *track = create_ipod_track_from_metadata(meta, device_path, strrchr(entry->source_path, '.'));
+    if (!track) {
+        free_metadata(meta);
+        return FALSE;
+    }
+
+    rb_ipod_db_add_track(db, track);
+    rb_ipod_content_index_add_track(db->content_index, track);
+    rb_ipod_content_index_record_source(db->content_index, entry->source_path, entry->size,
+                                        entry->mtime, track);
+    log_message(LOG_DEBUG, "Adopted file from interrupted sync: %s -> %s", entry->source_path, device_path);
+
+    free_metadata(meta);
+    return TRUE;
+}
+
+guint rb_ipod_sync_journal_recover(RbIpodDb *db) {
+    RbIpodSyncJournal *journal = db ? db->journal : NULL;
+    if (!journal || g_hash_table_size(journal->entries) == 0) return 0;
+
+    GHashTable *written = written_track_paths(db->itdb);
+    guint adopted = 0;
+    guint removed = 0;
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, journal->entries);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        // Saved by a checkpoint after it was journaled
+        if (g_hash_table_contains(written, key)) {
+            g_hash_table_iter_remove(&iter);
+            continue;
+        }
+
+        char *device_path = g_build_filename(journal->mount_point, (const char*)key, NULL);
+        if (adopt_file(db, device_path, value)) {
+            adopted++;      // Dropped from the journal once a save writes it
+        } else {
+            if (g_unlink(device_path) == 0) {
+                removed++;
+            }
+            g_hash_table_iter_remove(&iter);
+        }
+        g_free(device_path);
+    }
+    g_hash_table_destroy(written);
+    rewrite_journal(journal);
+    rb_ipod_db_wait_for_save(db);     // Adopted tracks join the itdb now
+
+    g_sync_ctx.stats.files_adopted += adopted;
+    g_sync_ctx.stats.orphans_removed += removed;
+    log_message(LOG_INFO, "Interrupted sync recovered: %u files adopted, %u removed", adopted, removed);
+    return adopted;
+}
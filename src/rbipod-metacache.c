@@ -0,0 +1,602 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <glib.h>
+
+#include "../include/rbipod-metacache.h"
+#include "../include/rbipod-logging.h"
+#include "../include/rbipod-utils.h"
+
+// =============================================================================
+// HOST METADATA CACHE
+// =============================================================================
+
+// File layout (host byte order, the byte-order mark rejects foreign files):
+//   header   magic[8] version(4) bom(4) entry_count(4) blob_count(4) reserved(8)
+//   entries  record_length(4) + record body, entry_count times
+//   blobs    hash(8) length(4) data, blob_count times
+// A record body starts with the stat key, the artwork reference and the
+// source path, then the numeric AudioMetadata fields, the string fields
+// (length(4) + bytes + NUL, G_MAXUINT32 for NULL) and the chapter list.
+// Loading reads only that prefix; the rest is decoded on lookup.
+
+#define METADATA_CACHE_MAGIC "RBMDCACH"
+#define METADATA_CACHE_BOM 0x01020304u
+#define METADATA_CACHE_HEADER_SIZE 32
+#define NULL_STRING_LENGTH G_MAXUINT32
+
+typedef struct {
+    const guchar *data;     // Into the mapping, or owned
+    gsize length;
+    guchar *owned;
+} CacheRecord;
+
+typedef struct {
+    guint64 hash;
+    const guchar *data;
+    gsize length;
+    guchar *owned;
+} CacheBlob;
+
+struct _RbIpodMetadataCache {
+    char *path;
+    GMutex mutex;
+    const guchar *map;
+    gsize map_size;
+    GHashTable *entries;    // source path -> CacheRecord*
+    GHashTable *blobs;      // &hash -> CacheBlob*
+    gboolean dirty;
+};
+
+// Strings stored after the path, in this order
+static const size_t cached_string_fields[] = {
+    offsetof(AudioMetadata, title),
+    offsetof(AudioMetadata, artist),
+    offsetof(AudioMetadata, album),
+    offsetof(AudioMetadata, genre),
+    offsetof(AudioMetadata, composer),
+    offsetof(AudioMetadata, albumartist),
+    offsetof(AudioMetadata, sort_artist),
+    offsetof(AudioMetadata, sort_album),
+    offsetof(AudioMetadata, sort_albumartist),
+    offsetof(AudioMetadata, podcasturl),
+    offsetof(AudioMetadata, podcastrss),
+    offsetof(AudioMetadata, description),
+    offsetof(AudioMetadata, subtitle),
+    offsetof(AudioMetadata, category),
+    offsetof(AudioMetadata, episode_id),
+    offsetof(AudioMetadata, podcast_name),
+    offsetof(AudioMetadata, episode_summary),
+    offsetof(AudioMetadata, artwork_format),
+    offsetof(AudioMetadata, tvshow),
+    offsetof(AudioMetadata, tvepisode),
+    offsetof(AudioMetadata, tvnetwork),
+};
+
+#define META_STRING(meta, i) ((char**)((guchar*)(meta) + cached_string_fields[i]))
+
+static void free_record(gpointer data) {
+    CacheRecord *record = data;
+    g_free(record->owned);
+    g_free(record);
+}
+
+static void free_blob(gpointer data) {
+    CacheBlob *blob = data;
+    g_free(blob->owned);
+    g_free(blob);
+}
+
+static gint64 stat_mtime_ns(const struct stat *source_stat) {
+    return (gint64)source_stat->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + source_stat->st_mtim.tv_nsec;
+}
+
+// =============================================================================
+// RECORD ENCODING
+// =============================================================================
+
+typedef struct {
+    guint64 dev;
+    guint64 ino;
+    gint64 size;
+    gint64 mtime_ns;
+    guint32 mediatype;
+    guint32 external_tools;     // Results with --external-tools may differ
+} CacheKey;
+
+static void put_u32(GByteArray *out, guint32 value) {
+    g_byte_array_append(out, (const guint8*)&value, sizeof(value));
+}
+
+static void put_u64(GByteArray *out, guint64 value) {
+    g_byte_array_append(out, (const guint8*)&value, sizeof(value));
+}
+
+static void put_string(GByteArray *out, const char *value) {
+    if (!value) {
+        put_u32(out, NULL_STRING_LENGTH);
+        return;
+    }
+    guint32 length = (guint32)strlen(value);
+    put_u32(out, length);
+    g_byte_array_append(out, (const guint8*)value, length + 1);
+}
+
+typedef struct {
+    const guchar *p;
+    const guchar *end;
+    gboolean ok;
+} Reader;
+
+static gboolean take(Reader *reader, void *value, gsize length) {
+    if (!reader->ok || (gsize)(reader->end - reader->p) < length) {
+        reader->ok = FALSE;
+        return FALSE;
+    }
+    memcpy(value, reader->p, length);
+    reader->p += length;
+    return TRUE;
+}
+
+static guint32 take_u32(Reader *reader) {
+    guint32 value = 0;
+    take(reader, &value, sizeof(value));
+    return value;
+}
+
+static guint64 take_u64(Reader *reader) {
+    guint64 value = 0;
+    take(reader, &value, sizeof(value));
+    return value;
+}
+
+// Returns a pointer to the NUL-terminated string inside the record
+static const char* take_string(Reader *reader) {
+    guint32 length = take_u32(reader);
+    if (!reader->ok || length == NULL_STRING_LENGTH) return NULL;
+    if ((gsize)(reader->end - reader->p) <= length || reader->p[length] != '\0') {
+        reader->ok = FALSE;
+        return NULL;
+    }
+    const char *value = (const char*)reader->p;
+    reader->p += length + 1;
+    return value;
+}
+
+typedef struct {
+    CacheKey key;
+    guint64 artwork_hash;
+    gsize artwork_size;
+    const char *source_path;
+} RecordPrefix;
+
+static gboolean read_prefix(Reader *reader, RecordPrefix *prefix) {
+    prefix->key.dev = take_u64(reader);
+    prefix->key.ino = take_u64(reader);
+    prefix->key.size = (gint64)take_u64(reader);
+    prefix->key.mtime_ns = (gint64)take_u64(reader);
+    prefix->key.mediatype = take_u32(reader);
+    prefix->key.external_tools = take_u32(reader);
+    prefix->artwork_hash = take_u64(reader);
+    prefix->artwork_size = take_u32(reader);
+    prefix->source_path = take_string(reader);
+    return reader->ok && prefix->source_path != NULL;
+}
+
+static guchar* encode_record(const char *source_path, const CacheKey *key, const AudioMetadata *meta,
+                             guint64 artwork_hash, gsize *length) {
+    GByteArray *out = g_byte_array_new();
+
+    put_u64(out, key->dev);
+    put_u64(out, key->ino);
+    put_u64(out, (guint64)key->size);
+    put_u64(out, (guint64)key->mtime_ns);
+    put_u32(out, key->mediatype);
+    put_u32(out, key->external_tools);
+    put_u64(out, artwork_hash);
+    put_u32(out, (guint32)meta->artwork_size);
+    put_string(out, source_path);
+
+    put_u32(out, (guint32)meta->year);
+    put_u32(out, (guint32)meta->track_number);
+    put_u32(out, (guint32)meta->disc_number);
+    put_u32(out, (guint32)meta->duration);
+    put_u32(out, (guint32)meta->bitrate);
+    put_u32(out, (guint32)meta->season_number);
+    put_u32(out, (guint32)meta->episode_number);
+    put_u64(out, (guint64)meta->time_released);
+    put_u32(out, meta->duration_ms);
+    put_u32(out, meta->pregap);
+    put_u32(out, meta->postgap);
+    put_u64(out, meta->samplecount);
+    put_u32(out, meta->gapless_data);
+    put_u32(out, meta->has_gapless ? 1 : 0);
+    put_u32(out, meta->detected_mediatype);
+    put_u32(out, meta->has_video ? 1 : 0);
+
+    // Podcast playback defaults, set only on a full probe
+    guint64 rating_bits;
+    memcpy(&rating_bits, &meta->rating, sizeof(rating_bits));
+    put_u64(out, rating_bits);
+    put_u32(out, meta->mark_unplayed ? 1 : 0);
+    put_u32(out, meta->remember_playback_position ? 1 : 0);
+    put_u32(out, meta->skip_when_shuffling ? 1 : 0);
+    put_u32(out, meta->bookmark_time);
+
+    for (gsize i = 0; i < G_N_ELEMENTS(cached_string_fields); i++) {
+        put_string(out, *META_STRING(meta, i));
+    }
+
+    guint32 chapter_count = meta->chapters ? meta->chapters->len : 0;
+    put_u32(out, chapter_count);
+    for (guint32 i = 0; i < chapter_count; i++) {
+        const RbIpodChapter *chapter = g_ptr_array_index(meta->chapters, i);
+        put_u32(out, chapter->start_ms);
+        put_string(out, chapter->title);
+    }
+
+    *length = out->len;
+    return g_byte_array_free(out, FALSE);
+}
+
+static void read_numbers(Reader *reader, AudioMetadata *meta) {
+    meta->year = (int)take_u32(reader);
+    meta->track_number = (int)take_u32(reader);
+    meta->disc_number = (int)take_u32(reader);
+    meta->duration = (int)take_u32(reader);
+    meta->bitrate = (int)take_u32(reader);
+    meta->season_number = (int)take_u32(reader);
+    meta->episode_number = (int)take_u32(reader);
+    meta->time_released = (time_t)take_u64(reader);
+    meta->duration_ms = take_u32(reader);
+    meta->pregap = take_u32(reader);
+    meta->postgap = take_u32(reader);
+    meta->samplecount = take_u64(reader);
+    meta->gapless_data = take_u32(reader);
+    meta->has_gapless = take_u32(reader) != 0;
+    meta->detected_mediatype = take_u32(reader);
+    meta->has_video = take_u32(reader) != 0;
+
+    guint64 rating_bits = take_u64(reader);
+    memcpy(&meta->rating, &rating_bits, sizeof(meta->rating));
+    meta->mark_unplayed = take_u32(reader) != 0;
+    meta->remember_playback_position = take_u32(reader) != 0;
+    meta->skip_when_shuffling = take_u32(reader) != 0;
+    meta->bookmark_time = take_u32(reader);
+}
+
+// Walks the rest of a record without decoding it
+static gboolean record_is_complete(Reader reader) {
+    AudioMetadata scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    read_numbers(&reader, &scratch);
+    for (gsize i = 0; i < G_N_ELEMENTS(cached_string_fields); i++) {
+        take_string(&reader);
+    }
+    guint32 chapter_count = take_u32(&reader);
+    for (guint32 i = 0; i < chapter_count && reader.ok; i++) {
+        take_u32(&reader);
+        take_string(&reader);
+    }
+    return reader.ok;
+}
+
+// Fills meta from a record whose key has already been checked; meta is
+// left untouched when the record cannot be used
+static gboolean decode_record(RbIpodMetadataCache *cache, const CacheRecord *record, AudioMetadata *meta) {
+    Reader reader = {record->data, record->data + record->length, TRUE};
+    RecordPrefix prefix;
+    if (!read_prefix(&reader, &prefix) || !record_is_complete(reader)) return FALSE;
+
+    // A result without its artwork is a miss
+    const CacheBlob *blob = NULL;
+    if (prefix.artwork_size > 0) {
+        blob = g_hash_table_lookup(cache->blobs, &prefix.artwork_hash);
+        if (!blob || blob->length != prefix.artwork_size) return FALSE;
+    }
+
+    read_numbers(&reader, meta);
+    for (gsize i = 0; i < G_N_ELEMENTS(cached_string_fields); i++) {
+        *META_STRING(meta, i) = g_strdup(take_string(&reader));
+    }
+
+    guint32 chapter_count = take_u32(&reader);
+    if (chapter_count > 0) {
+        meta->chapters = g_ptr_array_sized_new(chapter_count);
+        for (guint32 i = 0; i < chapter_count; i++) {
+            RbIpodChapter *chapter = g_new0(RbIpodChapter, 1);
+            chapter->start_ms = take_u32(&reader);
+            chapter->title = g_strdup(take_string(&reader));
+            g_ptr_array_add(meta->chapters, chapter);
+        }
+    }
+
+    if (blob) {
+        meta->artwork_data = g_malloc(blob->length);
+        memcpy(meta->artwork_data, blob->data, blob->length);
+        meta->artwork_size = blob->length;
+    }
+    return TRUE;
+}
+
+// =============================================================================
+// OPEN / LOOKUP / STORE
+// =============================================================================
+
+static void load_mapping(RbIpodMetadataCache *cache) {
+    int fd = open(cache->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_message(LOG_DEBUG, "No metadata cache at %s", cache->path);
+        return;
+    }
+
+    struct stat cache_stat;
+    if (fstat(fd, &cache_stat) != 0 || cache_stat.st_size < METADATA_CACHE_HEADER_SIZE) {
+        close(fd);
+        return;
+    }
+
+    gsize size = (gsize)cache_stat.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_message(LOG_WARNING, "Cannot map metadata cache %s: %s", cache->path, strerror(errno));
+        return;
+    }
+
+    Reader reader = {map, (const guchar*)map + size, TRUE};
+    char magic[8];
+    take(&reader, magic, sizeof(magic));
+    guint32 version = take_u32(&reader);
+    guint32 bom = take_u32(&reader);
+    guint32 entry_count = take_u32(&reader);
+    guint32 blob_count = take_u32(&reader);
+    take_u64(&reader);
+
+    if (memcmp(magic, METADATA_CACHE_MAGIC, sizeof(magic)) != 0 ||
+        version != METADATA_CACHE_VERSION || bom != METADATA_CACHE_BOM) {
+        log_message(LOG_WARNING, "Ignoring metadata cache with unknown format: %s", cache->path);
+        munmap(map, size);
+        return;
+    }
+
+    cache->map = map;
+    cache->map_size = size;
+
+    // Only the path of each record is read here
+    for (guint32 i = 0; i < entry_count && reader.ok; i++) {
+        guint32 record_length = take_u32(&reader);
+        if (!reader.ok || (gsize)(reader.end - reader.p) < record_length) break;
+
+        CacheRecord *record = g_new0(CacheRecord, 1);
+        record->data = reader.p;
+        record->length = record_length;
+        reader.p += record_length;
+
+        Reader body = {record->data, record->data + record->length, TRUE};
+        RecordPrefix prefix;
+        if (!read_prefix(&body, &prefix)) {
+            g_free(record);
+            break;
+        }
+        g_hash_table_replace(cache->entries, g_strdup(prefix.source_path), record);
+    }
+
+    for (guint32 i = 0; i < blob_count && reader.ok; i++) {
+        CacheBlob *blob = g_new0(CacheBlob, 1);
+        blob->hash = take_u64(&reader);
+        blob->length = take_u32(&reader);
+        if (!reader.ok || (gsize)(reader.end - reader.p) < blob->length) {
+            g_free(blob);
+            break;
+        }
+        blob->data = reader.p;
+        reader.p += blob->length;
+        g_hash_table_replace(cache->blobs, &blob->hash, blob);
+    }
+
+    log_message(LOG_INFO, "Metadata cache loaded: %u entries, %u artwork blobs (%s)",
+               g_hash_table_size(cache->entries), g_hash_table_size(cache->blobs), cache->path);
+}
+
+RbIpodMetadataCache* rb_ipod_metadata_cache_open(const char *path) {
+    RbIpodMetadataCache *cache = g_new0(RbIpodMetadataCache, 1);
+    cache->path = path ? g_strdup(path)
+                       : g_build_filename(g_get_user_cache_dir(), PROGRAM_NAME, METADATA_CACHE_FILENAME, NULL);
+    g_mutex_init(&cache->mutex);
+    cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_record);
+    cache->blobs = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, free_blob);
+
+    load_mapping(cache);
+    return cache;
+}
+
+void rb_ipod_metadata_cache_free(RbIpodMetadataCache *cache) {
+    if (!cache) return;
+
+    g_hash_table_destroy(cache->entries);
+    g_hash_table_destroy(cache->blobs);
+    if (cache->map) munmap((void*)cache->map, cache->map_size);
+    g_mutex_clear(&cache->mutex);
+    g_free(cache->path);
+    g_free(cache);
+}
+
+static void fill_key(CacheKey *key, const struct stat *source_stat, guint32 mediatype) {
+    key->dev = (guint64)source_stat->st_dev;
+    key->ino = (guint64)source_stat->st_ino;
+    key->size = (gint64)source_stat->st_size;
+    key->mtime_ns = stat_mtime_ns(source_stat);
+    key->mediatype = mediatype;
+    key->external_tools = g_sync_ctx.allow_external_tools ? 1 : 0;
+}
+
+gboolean rb_ipod_metadata_cache_lookup(RbIpodMetadataCache *cache, const char *source_path,
+                                       const struct stat *source_stat, guint32 mediatype,
+                                       AudioMetadata *meta) {
+    if (!cache || !source_path || !source_stat || !meta) return FALSE;
+
+    CacheKey expected;
+    fill_key(&expected, source_stat, mediatype);
+
+    g_mutex_lock(&cache->mutex);
+    gboolean hit = FALSE;
+    CacheRecord *record = g_hash_table_lookup(cache->entries, source_path);
+    if (record) {
+        Reader reader = {record->data, record->data + record->length, TRUE};
+        RecordPrefix prefix;
+        hit = read_prefix(&reader, &prefix) &&
+              prefix.key.dev == expected.dev && prefix.key.ino == expected.ino &&
+              prefix.key.size == expected.size && prefix.key.mtime_ns == expected.mtime_ns &&
+              prefix.key.mediatype == expected.mediatype &&
+              prefix.key.external_tools == expected.external_tools &&
+              decode_record(cache, record, meta);
+    }
+    g_mutex_unlock(&cache->mutex);
+
+    return hit;
+}
+
+void rb_ipod_metadata_cache_store(RbIpodMetadataCache *cache, const char *source_path,
+                                  const struct stat *source_stat, guint32 mediatype,
+                                  const AudioMetadata *meta) {
+    if (!cache || !source_path || !source_stat || !meta) return;
+
+    // A result without its artwork would come back incomplete
+    if (meta->artwork_size > PROBE_MAX_PICTURE_SIZE) return;
+
+    CacheKey key;
+    fill_key(&key, source_stat, mediatype);
+
+    // Hash outside the lock: workers store concurrently
+    guint64 artwork_hash = 0;
+    if (meta->artwork_data && meta->artwork_size > 0) {
+        artwork_hash = rb_ipod_hash_bytes(meta->artwork_data, meta->artwork_size);
+    }
+
+    CacheRecord *record = g_new0(CacheRecord, 1);
+    record->owned = encode_record(source_path, &key, meta, artwork_hash, &record->length);
+    record->data = record->owned;
+
+    g_mutex_lock(&cache->mutex);
+    if (artwork_hash != 0 && !g_hash_table_contains(cache->blobs, &artwork_hash)) {
+        // Episodes of a feed share their cover: stored once
+        CacheBlob *blob = g_new0(CacheBlob, 1);
+        blob->hash = artwork_hash;
+        blob->owned = g_malloc(meta->artwork_size);
+        memcpy(blob->owned, meta->artwork_data, meta->artwork_size);
+        blob->data = blob->owned;
+        blob->length = meta->artwork_size;
+        g_hash_table_replace(cache->blobs, &blob->hash, blob);
+    }
+    g_hash_table_replace(cache->entries, g_strdup(source_path), record);
+    cache->dirty = TRUE;
+    g_mutex_unlock(&cache->mutex);
+}
+
+guint rb_ipod_metadata_cache_size(RbIpodMetadataCache *cache) {
+    if (!cache) return 0;
+
+    g_mutex_lock(&cache->mutex);
+    guint size = g_hash_table_size(cache->entries);
+    g_mutex_unlock(&cache->mutex);
+    return size;
+}
+
+// =============================================================================
+// SAVE
+// =============================================================================
+
+static gboolean write_all(FILE *out, const void *data, gsize length) {
+    return fwrite(data, 1, length, out) == length;
+}
+
+gboolean rb_ipod_metadata_cache_save(RbIpodMetadataCache *cache) {
+    if (!cache) return FALSE;
+
+    g_mutex_lock(&cache->mutex);
+    if (!cache->dirty) {
+        g_mutex_unlock(&cache->mutex);
+        return TRUE;
+    }
+
+    // Keep entries whose source still exists, and the artwork they use
+    GPtrArray *kept = g_ptr_array_new();
+    GHashTable *used_blobs = g_hash_table_new(g_int64_hash, g_int64_equal);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, cache->entries);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        CacheRecord *record = value;
+        struct stat source_stat;
+        if (stat((const char*)key, &source_stat) != 0) continue;
+
+        Reader reader = {record->data, record->data + record->length, TRUE};
+        RecordPrefix prefix;
+        if (!read_prefix(&reader, &prefix)) continue;
+
+        if (prefix.artwork_size > 0) {
+            CacheBlob *blob = g_hash_table_lookup(cache->blobs, &prefix.artwork_hash);
+            if (!blob) continue;
+            g_hash_table_add(used_blobs, &blob->hash);
+        }
+        g_ptr_array_add(kept, record);
+    }
+
+    char *dir = g_path_get_dirname(cache->path);
+    g_mkdir_with_parents(dir, 0755);
+    g_free(dir);
+
+    char *temp_path = g_strdup_printf("%s.tmp.%d", cache->path, (int)getpid());
+    FILE *out = fopen(temp_path, "wb");
+    gboolean ok = (out != NULL);
+
+    if (ok) {
+        guint32 header[4] = {METADATA_CACHE_VERSION, METADATA_CACHE_BOM, kept->len,
+                             g_hash_table_size(used_blobs)};
+        guint64 reserved = 0;
+        ok = write_all(out, METADATA_CACHE_MAGIC, 8) && write_all(out, header, sizeof(header)) &&
+             write_all(out, &reserved, sizeof(reserved));
+
+        for (guint i = 0; ok && i < kept->len; i++) {
+            const CacheRecord *record = g_ptr_array_index(kept, i);
+            guint32 length = (guint32)record->length;
+            ok = write_all(out, &length, sizeof(length)) && write_all(out, record->data, record->length);
+        }
+
+        g_hash_table_iter_init(&iter, used_blobs);
+        while (ok && g_hash_table_iter_next(&iter, &key, NULL)) {
+            const CacheBlob *blob = g_hash_table_lookup(cache->blobs, key);
+            guint32 length = (guint32)blob->length;
+            ok = write_all(out, &blob->hash, sizeof(blob->hash)) && write_all(out, &length, sizeof(length)) &&
+                 write_all(out, blob->data, blob->length);
+        }
+
+        if (fclose(out) != 0) ok = FALSE;
+    }
+
+    // The old mapping stays valid after the rename (it keeps the old inode)
+    if (ok && rename(temp_path, cache->path) != 0) ok = FALSE;
+    if (ok) {
+        log_message(LOG_INFO, "Metadata cache saved: %u entries, %u artwork blobs -> %s",
+                   kept->len, g_hash_table_size(used_blobs), cache->path);
+        cache->dirty = FALSE;
+    } else {
+        log_message(LOG_WARNING, "Failed to write metadata cache %s: %s", cache->path, strerror(errno));
+        unlink(temp_path);
+    }
+
+    g_free(temp_path);
+    g_hash_table_destroy(used_blobs);
+    g_ptr_array_free(kept, TRUE);
+    g_mutex_unlock(&cache->mutex);
+    return ok;
+}
@@ -76,6 +76,35 @@ void parse_mediatype_arg(int argc, char *argv[], int start_index, char **mediaty
     }
 }
 
+void parse_jobs_arg(int argc, char *argv[], int start_index, guint *num_jobs) {
+    for (int i = start_index; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+            long value = strtol(argv[i + 1], NULL, 10);
+            *num_jobs = value > 0 ? (guint)value : 0;
+            break;
+        }
+    }
+}
+
+void parse_uint_arg(int argc, char *argv[], int start_index, const char *option, guint *value) {
+    for (int i = start_index; i < argc - 1; i++) {
+        if (strcmp(argv[i], option) == 0) {
+            long parsed = strtol(argv[i + 1], NULL, 10);
+            *value = parsed > 0 ? (guint)parsed : 0;
+            break;
+        }
+    }
+}
+
+gboolean parse_flag_arg(int argc, char *argv[], int start_index, const char *flag) {
+    for (int i = start_index; i < argc; i++) {
+        if (strcmp(argv[i], flag) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 AudioMetadata* extract_metadata_from_filename(const char *filename) {
     if (!filename) return NULL;
     
@@ -212,6 +241,18 @@ void free_metadata(AudioMetadata *meta) {
     // Free artwork data
     g_free(meta->artwork_data);
     g_free(meta->artwork_format);
+    // Free video fields and chapters
+    g_free(meta->tvshow);
+    g_free(meta->tvepisode);
+    g_free(meta->tvnetwork);
+    if (meta->chapters) {
+        for (guint i = 0; i < meta->chapters->len; i++) {
+            RbIpodChapter *chapter = g_ptr_array_index(meta->chapters, i);
+            g_free(chapter->title);
+            g_free(chapter);
+        }
+        g_ptr_array_free(meta->chapters, TRUE);
+    }
     g_free(meta);
 }
 
@@ -0,0 +1,513 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <glib.h>
+#include <gpod/itdb.h>
+
+#include "../include/rbipod-mp4.h"
+#include "../include/rbipod-logging.h"
+
+// =============================================================================
+// NATIVE MP4 / M4A ATOM PARSER
+// =============================================================================
+
+// The whole file is mapped, but only the atoms on the path to the metadata
+// are read: on a 2 GB video the pages touched are the top-level atom
+// headers plus moov, whatever the order of moov and mdat.
+
+#define FOURCC(a, b, c, d) (((guint32)(guchar)(a) << 24) | ((guint32)(guchar)(b) << 16) | \
+                            ((guint32)(guchar)(c) << 8) | (guint32)(guchar)(d))
+
+typedef struct {
+    guint32 type;
+    const guchar *body;
+    gsize body_length;
+} Mp4Atom;
+
+// "data" well-known types
+#define MP4_DATA_UTF8 1
+#define MP4_DATA_JPEG 13
+#define MP4_DATA_PNG 14
+#define MP4_DATA_BE_INT 21
+
+static guint16 read_be16(const guchar *p) {
+    return ((guint16)p[0] << 8) | p[1];
+}
+
+static guint32 read_be32(const guchar *p) {
+    return ((guint32)p[0] << 24) | ((guint32)p[1] << 16) | ((guint32)p[2] << 8) | p[3];
+}
+
+static guint64 read_be64(const guchar *p) {
+    return ((guint64)read_be32(p) << 32) | read_be32(p + 4);
+}
+
+// Reads the atom at *cursor (bounded by end) and advances the cursor past it
+static gboolean next_atom(const guchar **cursor, const guchar *end, Mp4Atom *atom) {
+    const guchar *p = *cursor;
+    if (end - p < 8) return FALSE;
+
+    guint64 size = read_be32(p);
+    gsize header = 8;
+    if (size == 1) {
+        if (end - p < 16) return FALSE;
+        size = read_be64(p + 8);
+        header = 16;
+    } else if (size == 0) {
+        size = (guint64)(end - p); // Extends to the end of the parent
+    }
+    if (size < header || size > (guint64)(end - p)) return FALSE;
+
+    atom->type = read_be32(p + 4);
+    atom->body = p + header;
+    atom->body_length = (gsize)size - header;
+    *cursor = p + size;
+    return TRUE;
+}
+
+static gboolean find_child(const guchar *start, gsize length, guint32 type, Mp4Atom *atom) {
+    const guchar *cursor = start;
+    while (next_atom(&cursor, start + length, atom)) {
+        if (atom->type == type) return TRUE;
+    }
+    return FALSE;
+}
+
+// =============================================================================
+// moov/trak and moov/mvhd
+// =============================================================================
+
+static void parse_mvhd(RbIpodMp4File *mp4, const Mp4Atom *mvhd) {
+    const guchar *p = mvhd->body;
+    guint32 timescale;
+    guint64 duration;
+
+    if (mvhd->body_length >= 32 && p[0] == 1) {
+        timescale = read_be32(p + 20);
+        duration = read_be64(p + 24);
+    } else if (mvhd->body_length >= 20) {
+        timescale = read_be32(p + 12);
+        duration = read_be32(p + 16);
+    } else {
+        return;
+    }
+
+    if (timescale > 0 && duration != G_MAXUINT32 && duration != G_MAXUINT64) {
+        mp4->duration_ms = (guint32)MIN(duration * 1000 / timescale, (guint64)G_MAXUINT32);
+    }
+}
+
+static void parse_trak(RbIpodMp4File *mp4, const Mp4Atom *trak) {
+    Mp4Atom mdia, hdlr, mdhd;
+    if (!find_child(trak->body, trak->body_length, FOURCC('m','d','i','a'), &mdia)) return;
+    if (!find_child(mdia.body, mdia.body_length, FOURCC('h','d','l','r'), &hdlr) ||
+        hdlr.body_length < 12) {
+        return;
+    }
+
+    guint32 handler = read_be32(hdlr.body + 8);
+    if (handler == FOURCC('v','i','d','e')) {
+        mp4->has_video = TRUE;
+    } else if (handler == FOURCC('s','o','u','n')) {
+        mp4->has_audio = TRUE;
+        // The sound track's timescale is its sample rate
+        if (mp4->sample_rate == 0 && find_child(mdia.body, mdia.body_length, FOURCC('m','d','h','d'), &mdhd)) {
+            if (mdhd.body_length >= 24 && mdhd.body[0] == 1) {
+                mp4->sample_rate = (int)read_be32(mdhd.body + 20);
+            } else if (mdhd.body_length >= 16) {
+                mp4->sample_rate = (int)read_be32(mdhd.body + 12);
+            }
+        }
+    }
+}
+
+// Nero chapters: version(1) flags(3) [reserved(4) if v1] count(1)
+// then count x { start(8, 100 ns units), title_length(1), title }
+static void parse_chpl(RbIpodMp4File *mp4, const Mp4Atom *chpl) {
+    const guchar *p = chpl->body;
+    const guchar *end = p + chpl->body_length;
+    if (end - p < 5) return;
+
+    p += (p[0] != 0) ? 8 : 4;
+    if (p >= end) return;
+    guint count = *p++;
+
+    for (guint i = 0; i < count && end - p >= 9; i++) {
+        RbIpodMp4Chapter chapter;
+        chapter.start = read_be64(p);
+        gsize title_length = p[8];
+        p += 9;
+        if ((gsize)(end - p) < title_length) break;
+        chapter.title.data = p;
+        chapter.title.length = title_length;
+        p += title_length;
+
+        if (!mp4->chapters) {
+            mp4->chapters = g_array_sized_new(FALSE, FALSE, sizeof(RbIpodMp4Chapter), count);
+        }
+        g_array_append_val(mp4->chapters, chapter);
+    }
+}
+
+// =============================================================================
+// udta/meta/ilst
+// =============================================================================
+
+typedef struct {
+    guint32 type;
+    size_t offset;
+} IlstTextField;
+
+static const IlstTextField ilst_text_fields[] = {
+    { FOURCC(0xA9,'n','a','m'), offsetof(RbIpodMp4File, title) },
+    { FOURCC(0xA9,'A','R','T'), offsetof(RbIpodMp4File, artist) },
+    { FOURCC(0xA9,'a','l','b'), offsetof(RbIpodMp4File, album) },
+    { FOURCC('a','A','R','T'), offsetof(RbIpodMp4File, album_artist) },
+    { FOURCC(0xA9,'g','e','n'), offsetof(RbIpodMp4File, genre) },
+    { FOURCC(0xA9,'w','r','t'), offsetof(RbIpodMp4File, composer) },
+    { FOURCC(0xA9,'d','a','y'), offsetof(RbIpodMp4File, year) },
+    { FOURCC(0xA9,'g','r','p'), offsetof(RbIpodMp4File, grouping) },
+    { FOURCC('c','a','t','g'), offsetof(RbIpodMp4File, category) },
+    { FOURCC('d','e','s','c'), offsetof(RbIpodMp4File, description) },
+    { FOURCC('l','d','e','s'), offsetof(RbIpodMp4File, long_description) },
+    { FOURCC('t','v','s','h'), offsetof(RbIpodMp4File, tvshow) },
+    { FOURCC('t','v','e','n'), offsetof(RbIpodMp4File, tvepisode) },
+    { FOURCC('t','v','n','n'), offsetof(RbIpodMp4File, tvnetwork) },
+    { FOURCC('p','u','r','l'), offsetof(RbIpodMp4File, podcast_url) },
+    { FOURCC('s','o','n','m'), offsetof(RbIpodMp4File, sort_title) },
+    { FOURCC('s','o','a','r'), offsetof(RbIpodMp4File, sort_artist) },
+    { FOURCC('s','o','a','l'), offsetof(RbIpodMp4File, sort_album) },
+    { FOURCC('s','o','a','a'), offsetof(RbIpodMp4File, sort_album_artist) },
+};
+
+// Big-endian integer of 1, 2, 4 or 8 bytes ("stik", "tvsn", "pcst", ...)
+static gint64 read_data_int(const guchar *p, gsize length) {
+    switch (length) {
+        case 1: return p[0];
+        case 2: return read_be16(p);
+        case 4: return read_be32(p);
+        case 8: return (gint64)read_be64(p);
+        default: return 0;
+    }
+}
+
+static void parse_ilst_item(RbIpodMp4File *mp4, const Mp4Atom *item) {
+    // First "data" child: type(4) locale(4) payload
+    Mp4Atom data;
+    if (!find_child(item->body, item->body_length, FOURCC('d','a','t','a'), &data) ||
+        data.body_length < 8) {
+        return;
+    }
+    guint32 data_type = read_be32(data.body) & 0x00FFFFFF;
+    const guchar *payload = data.body + 8;
+    gsize length = data.body_length - 8;
+
+    for (gsize i = 0; i < G_N_ELEMENTS(ilst_text_fields); i++) {
+        if (ilst_text_fields[i].type == item->type) {
+            if (data_type == MP4_DATA_UTF8 && length > 0) {
+                RbIpodMp4Slice *slice = (RbIpodMp4Slice*)((guchar*)mp4 + ilst_text_fields[i].offset);
+                slice->data = payload;
+                slice->length = length;
+            }
+            return;
+        }
+    }
+
+    switch (item->type) {
+        case FOURCC('c','o','v','r'):
+            // Several covers may be stored: keep the first one
+            if (!mp4->cover.data && length > 0) {
+                mp4->cover.data = payload;
+                mp4->cover.length = length;
+                mp4->cover_type = (int)data_type;
+            }
+            break;
+        case FOURCC('t','r','k','n'):
+            if (length >= 6) {
+                mp4->track_number = read_be16(payload + 2);
+                mp4->track_total = read_be16(payload + 4);
+            }
+            break;
+        case FOURCC('d','i','s','k'):
+            if (length >= 6) {
+                mp4->disc_number = read_be16(payload + 2);
+                mp4->disc_total = read_be16(payload + 4);
+            }
+            break;
+        case FOURCC('g','n','r','e'):
+            mp4->genre_id = (int)read_data_int(payload, length);
+            break;
+        case FOURCC('s','t','i','k'):
+            mp4->stik = (int)read_data_int(payload, length);
+            break;
+        case FOURCC('t','v','s','n'):
+            mp4->season = (int)read_data_int(payload, length);
+            break;
+        case FOURCC('t','v','e','s'):
+            mp4->episode = (int)read_data_int(payload, length);
+            break;
+        case FOURCC('p','c','s','t'):
+            mp4->podcast = read_data_int(payload, length) != 0;
+            break;
+        default:
+            break;
+    }
+}
+
+static void parse_meta(RbIpodMp4File *mp4, const Mp4Atom *meta) {
+    const guchar *body = meta->body;
+    gsize length = meta->body_length;
+
+    // ISO "meta" is a full box (version/flags first); the QuickTime
+    // variant starts directly with its children ("hdlr")
+    if (length >= 8 && read_be32(body + 4) != FOURCC('h','d','l','r')) {
+        body += 4;
+        length -= 4;
+    }
+
+    Mp4Atom ilst, item;
+    if (!find_child(body, length, FOURCC('i','l','s','t'), &ilst)) return;
+
+    const guchar *cursor = ilst.body;
+    while (next_atom(&cursor, ilst.body + ilst.body_length, &item)) {
+        parse_ilst_item(mp4, &item);
+    }
+}
+
+static void parse_moov(RbIpodMp4File *mp4, const Mp4Atom *moov) {
+    const guchar *cursor = moov->body;
+    const guchar *end = moov->body + moov->body_length;
+    Mp4Atom child, udta_child;
+
+    while (next_atom(&cursor, end, &child)) {
+        switch (child.type) {
+            case FOURCC('m','v','h','d'):
+                parse_mvhd(mp4, &child);
+                break;
+            case FOURCC('t','r','a','k'):
+                parse_trak(mp4, &child);
+                break;
+            case FOURCC('u','d','t','a'): {
+                const guchar *udta_cursor = child.body;
+                while (next_atom(&udta_cursor, child.body + child.body_length, &udta_child)) {
+                    if (udta_child.type == FOURCC('m','e','t','a')) {
+                        parse_meta(mp4, &udta_child);
+                    } else if (udta_child.type == FOURCC('c','h','p','l')) {
+                        parse_chpl(mp4, &udta_child);
+                    }
+                }
+                break;
+            }
+            case FOURCC('m','e','t','a'):
+                parse_meta(mp4, &child);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// =============================================================================
+// PUBLIC API
+// =============================================================================
+
+RbIpodMp4File* rb_ipod_mp4_open(const char *file_path) {
+    if (!file_path) return NULL;
+
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_message(LOG_DEBUG, "Cannot open %s for MP4 parsing: %s", file_path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < 8) {
+        close(fd);
+        return NULL;
+    }
+
+    gsize size = (gsize)file_stat.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_message(LOG_DEBUG, "Cannot map %s: %s", file_path, strerror(errno));
+        return NULL;
+    }
+    // Atom headers are scattered: no readahead into mdat
+    madvise(map, size, MADV_RANDOM);
+
+    RbIpodMp4File *mp4 = g_new0(RbIpodMp4File, 1);
+    mp4->map = map;
+    mp4->map_size = size;
+    mp4->stik = -1;
+
+    const guchar *cursor = mp4->map;
+    const guchar *end = mp4->map + size;
+    Mp4Atom atom;
+    gboolean has_ftyp = FALSE;
+    gboolean has_moov = FALSE;
+
+    while (next_atom(&cursor, end, &atom)) {
+        switch (atom.type) {
+            case FOURCC('f','t','y','p'):
+                has_ftyp = TRUE;
+                break;
+            case FOURCC('m','o','o','v'):
+                parse_moov(mp4, &atom);
+                has_moov = TRUE;
+                break;
+            case FOURCC('m','d','a','t'):
+                mp4->mdat_bytes += atom.body_length;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (!has_moov || (!has_ftyp && mp4->duration_ms == 0)) {
+        rb_ipod_mp4_close(mp4);
+        return NULL;
+    }
+    return mp4;
+}
+
+void rb_ipod_mp4_close(RbIpodMp4File *mp4) {
+    if (!mp4) return;
+    if (mp4->chapters) g_array_free(mp4->chapters, TRUE);
+    munmap((void*)mp4->map, mp4->map_size);
+    g_free(mp4);
+}
+
+guint32 rb_ipod_mp4_mediatype(const RbIpodMp4File *mp4) {
+    if (!mp4) return 0;
+    if (mp4->podcast) return ITDB_MEDIATYPE_PODCAST;
+
+    switch (mp4->stik) {
+        case 1: return ITDB_MEDIATYPE_AUDIO;
+        case 2: return ITDB_MEDIATYPE_AUDIOBOOK;
+        case 6: return ITDB_MEDIATYPE_MUSICVIDEO;
+        case 0:
+        case 9: return ITDB_MEDIATYPE_MOVIE;
+        case 10: return ITDB_MEDIATYPE_TVSHOW;
+        case 14: return ITDB_MEDIATYPE_RINGTONE;
+        case 21: return ITDB_MEDIATYPE_PODCAST;
+        default: break;
+    }
+
+    // Untagged: episode fields or a video track decide
+    if (mp4->has_video) {
+        return (mp4->tvshow.length > 0 || mp4->episode > 0) ? ITDB_MEDIATYPE_TVSHOW : ITDB_MEDIATYPE_MOVIE;
+    }
+    return 0;
+}
+
+// ID3v1 genres, as referenced (index + 1) by "gnre"
+static const char *const id3v1_genres[] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop",
+    "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B", "Rap", "Reggae", "Rock",
+    "Techno", "Industrial", "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack",
+    "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance",
+    "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+    "AlternRock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop",
+    "Instrumental Rock", "Ethnic", "Gothic", "Darkwave", "Techno-Industrial", "Electronic",
+    "Pop-Folk", "Eurodance", "Dream", "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40",
+    "Christian Rap", "Pop/Funk", "Jungle", "Native American", "Cabaret", "New Wave",
+    "Psychadelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal", "Acid Punk",
+    "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock"
+};
+
+static void fill_string(char **field, const RbIpodMp4Slice *slice) {
+    if (*field || slice->length == 0) return;
+    *field = g_strndup((const char*)slice->data, slice->length);
+}
+
+gboolean rb_ipod_mp4_fill_metadata(const RbIpodMp4File *mp4, AudioMetadata *meta) {
+    if (!mp4 || !meta) return FALSE;
+
+    if (mp4->duration_ms > 0) {
+        meta->duration_ms = mp4->duration_ms;
+        meta->duration = (mp4->duration_ms + 500) / 1000;
+        if (mp4->mdat_bytes > 0) {
+            meta->bitrate = (int)(mp4->mdat_bytes * 8 / mp4->duration_ms);
+        }
+    }
+
+    fill_string(&meta->title, &mp4->title);
+    fill_string(&meta->artist, &mp4->artist);
+    fill_string(&meta->album, &mp4->album);
+    fill_string(&meta->albumartist, &mp4->album_artist);
+    fill_string(&meta->genre, &mp4->genre);
+    fill_string(&meta->composer, &mp4->composer);
+    fill_string(&meta->sort_artist, &mp4->sort_artist);
+    fill_string(&meta->sort_album, &mp4->sort_album);
+    fill_string(&meta->sort_albumartist, &mp4->sort_album_artist);
+    fill_string(&meta->description, &mp4->description);
+    fill_string(&meta->episode_summary, &mp4->long_description);
+    fill_string(&meta->category, &mp4->category);
+    fill_string(&meta->episode_id, &mp4->grouping);
+    fill_string(&meta->podcasturl, &mp4->podcast_url);
+    fill_string(&meta->tvshow, &mp4->tvshow);
+    fill_string(&meta->tvepisode, &mp4->tvepisode);
+    fill_string(&meta->tvnetwork, &mp4->tvnetwork);
+
+    if (!meta->genre && mp4->genre_id > 0 && mp4->genre_id <= (int)G_N_ELEMENTS(id3v1_genres)) {
+        meta->genre = g_strdup(id3v1_genres[mp4->genre_id - 1]);
+    }
+
+    // "©day" is a year or an ISO 8601 date (release date of an episode)
+    if (mp4->year.length >= 4) {
+        char date[32];
+        gsize length = MIN(mp4->year.length, sizeof(date) - 1);
+        memcpy(date, mp4->year.data, length);
+        date[length] = '\0';
+
+        int year = 0, month = 0, day = 0;
+        int fields = sscanf(date, "%d-%d-%d", &year, &month, &day);
+        if (meta->year == 0 && fields >= 1) meta->year = year;
+        if (meta->time_released == 0 && fields == 3 && g_date_valid_dmy(day, month, year)) {
+            GDateTime *released = g_date_time_new_utc(year, month, day, 0, 0, 0);
+            if (released) {
+                meta->time_released = (time_t)g_date_time_to_unix(released);
+                g_date_time_unref(released);
+            }
+        }
+    }
+
+    if (meta->track_number == 0) meta->track_number = mp4->track_number;
+    if (meta->disc_number == 0) meta->disc_number = mp4->disc_number;
+    if (meta->season_number == 0) meta->season_number = mp4->season;
+    if (meta->episode_number == 0) meta->episode_number = mp4->episode;
+
+    meta->has_video = mp4->has_video;
+    meta->detected_mediatype = rb_ipod_mp4_mediatype(mp4);
+
+    // The only payload copy: straight from the mapping
+    if (!meta->artwork_data && mp4->cover.length > 0 && mp4->cover.length <= PROBE_MAX_PICTURE_SIZE) {
+        meta->artwork_data = g_malloc(mp4->cover.length);
+        memcpy(meta->artwork_data, mp4->cover.data, mp4->cover.length);
+        meta->artwork_size = mp4->cover.length;
+        g_free(meta->artwork_format);
+        meta->artwork_format = g_strdup(mp4->cover_type == MP4_DATA_PNG ? "png" : "jpeg");
+    }
+
+    if (mp4->chapters && !meta->chapters) {
+        meta->chapters = g_ptr_array_new();
+        for (guint i = 0; i < mp4->chapters->len; i++) {
+            const RbIpodMp4Chapter *source = &g_array_index(mp4->chapters, RbIpodMp4Chapter, i);
+            RbIpodChapter *chapter = g_new0(RbIpodChapter, 1);
+            chapter->start_ms = (guint32)MIN(source->start / 10000, (guint64)G_MAXUINT32);
+            chapter->title = g_strndup((const char*)source->title.data, source->title.length);
+            g_ptr_array_add(meta->chapters, chapter);
+        }
+    }
+
+    return mp4->duration_ms > 0 || mp4->title.length > 0 || mp4->cover.length > 0;
+}
@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <gpod/itdb.h>
+
+#include "../include/rbipod-pipeline.h"
+#include "../include/rbipod-files.h"
+#include "../include/rbipod-database.h"
+#include "../include/rbipod-index.h"
+#include "../include/rbipod-journal.h"
+#include "../include/rbipod-allocator.h"
+#include "../include/rbipod-metadata.h"
+#include "../include/rbipod-logging.h"
+#include "../include/rbipod-utils.h"
+
+// =============================================================================
+// SYNC PIPELINE (PROBE -> COPY -> DATABASE COMMIT)
+// =============================================================================
+
+// Stages:
+//   owner (calling thread)  source lookup, feeds the probe queue
+//   probe workers (N)       tags, artwork, filename allocation, track build
+//   owner                   identity dedup, hands new tracks to the writer
+//   writer (1)              device copy - USB mass storage gains nothing
+//                           from concurrent writers
+//   owner                   itdb_track_add, playlists, index, statistics
+//   save thread             periodic itdb_write checkpoint; commits queue
+//                           as delayed actions until it completes
+// Every file handed to the writer is journaled on the host first, so an
+// interrupted run loses at most the work since the last checkpoint.
+// Only the owner touches the itdb, the content index and g_sync_ctx.stats.
+
+typedef enum {
+    PIPELINE_JOB_PROBED,
+    PIPELINE_JOB_COPIED
+} PipelineJobState;
+
+typedef struct {
+    const RbIpodManifestEntry *entry;
+    guint32 mediatype;
+    PipelineJobState state;
+    gboolean ok;
+    AudioMetadata *meta;
+    Itdb_Track *track;
+    char *ipod_path;    // Absolute destination path
+} PipelineJob;
+
+// Bounded blocking queue: keeps probed jobs (and their artwork) from piling
+// up in memory when the device is the bottleneck
+typedef struct {
+    GMutex mutex;
+    GCond not_empty;
+    GCond not_full;
+    GQueue *items;
+    guint capacity;
+    gboolean closed;
+} BoundedQueue;
+
+typedef struct {
+    RbIpodDb *db;
+    BoundedQueue probe_queue;
+    BoundedQueue write_queue;
+    GAsyncQueue *events;    // Unbounded so workers never block on the owner
+    guint since_checkpoint; // Tracks committed since the last background save
+    gint64 last_checkpoint_us;
+} PipelineState;
+
+static void bounded_queue_init(BoundedQueue *queue, guint capacity) {
+    g_mutex_init(&queue->mutex);
+    g_cond_init(&queue->not_empty);
+    g_cond_init(&queue->not_full);
+    queue->items = g_queue_new();
+    queue->capacity = MAX(capacity, 1);
+    queue->closed = FALSE;
+}
+
+static void bounded_queue_clear(BoundedQueue *queue) {
+    g_queue_free(queue->items);
+    g_cond_clear(&queue->not_full);
+    g_cond_clear(&queue->not_empty);
+    g_mutex_clear(&queue->mutex);
+}
+
+static void bounded_queue_push(BoundedQueue *queue, gpointer item) {
+    g_mutex_lock(&queue->mutex);
+    while (g_queue_get_length(queue->items) >= queue->capacity) {
+        g_cond_wait(&queue->not_full, &queue->mutex);
+    }
+    g_queue_push_tail(queue->items, item);
+    g_cond_signal(&queue->not_empty);
+    g_mutex_unlock(&queue->mutex);
+}
+
+static gboolean bounded_queue_try_push(BoundedQueue *queue, gpointer item) {
+    g_mutex_lock(&queue->mutex);
+    gboolean pushed = g_queue_get_length(queue->items) < queue->capacity;
+    if (pushed) {
+        g_queue_push_tail(queue->items, item);
+        g_cond_signal(&queue->not_empty);
+    }
+    g_mutex_unlock(&queue->mutex);
+    return pushed;
+}
+
+// Returns NULL once the queue is closed and drained
+static gpointer bounded_queue_pop(BoundedQueue *queue) {
+    g_mutex_lock(&queue->mutex);
+    while (g_queue_is_empty(queue->items) && !queue->closed) {
+        g_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    gpointer item = g_queue_pop_head(queue->items);
+    if (item) {
+        g_cond_signal(&queue->not_full);
+    }
+    g_mutex_unlock(&queue->mutex);
+    return item;
+}
+
+static void bounded_queue_close(BoundedQueue *queue) {
+    g_mutex_lock(&queue->mutex);
+    queue->closed = TRUE;
+    g_cond_broadcast(&queue->not_empty);
+    g_mutex_unlock(&queue->mutex);
+}
+
+static void free_pipeline_job(PipelineJob *job) {
+    if (!job) return;
+    if (job->track) itdb_track_free(job->track);
+    if (job->meta) free_metadata(job->meta);
+    g_free(job->ipod_path);
+    g_free(job);
+}
+
+static gpointer probe_worker_thread(gpointer data) {
+    PipelineState *state = data;
+    PipelineJob *job;
+
+    while ((job = bounded_queue_pop(&state->probe_queue)) != NULL) {
+        const char *file_path = job->entry->path;
+
+        job->meta = probe_source_file(file_path, job->entry->size, job->mediatype);
+        if (job->meta) {
+            // Allocator is thread-safe; unused names are released by the owner
+            job->ipod_path = rb_ipod_file_allocator_next(state->db->file_allocator, file_path);
+        }
+        if (job->ipod_path) {
+            job->track = create_ipod_track_from_metadata(job->meta, job->ipod_path, strrchr(file_path, '.'));
+        }
+        if (job->meta && job->meta->artwork_data) {
+            // The track holds the prepared cover now; jobs waiting in the
+            // write queue should not also keep the full-size source image
+            g_free(job->meta->artwork_data);
+            job->meta->artwork_data = NULL;
+            job->meta->artwork_size = 0;
+        }
+
+        job->ok = (job->track != NULL);
+        job->state = PIPELINE_JOB_PROBED;
+        g_async_queue_push(state->events, job);
+    }
+
+    return NULL;
+}
+
+static gpointer writer_thread(gpointer data) {
+    PipelineState *state = data;
+    PipelineJob *job;
+
+    while ((job = bounded_queue_pop(&state->write_queue)) != NULL) {
+        job->ok = copy_file_to_ipod(job->entry->path, job->ipod_path);
+        job->state = PIPELINE_JOB_COPIED;
+        g_async_queue_push(state->events, job);
+    }
+
+    return NULL;
+}
+
+// Owner side: returns TRUE when the job is finished (skipped, failed or committed)
+static gboolean handle_probed_job(PipelineState *state, PipelineJob *job) {
+    RbIpodDb *db = state->db;
+    const RbIpodManifestEntry *entry = job->entry;
+
+    if (!job->ok) {
+        log_message(LOG_ERROR, "Failed to prepare track for %s", entry->path);
+        if (job->ipod_path) {
+            rb_ipod_file_allocator_release(db->file_allocator, job->ipod_path);
+        }
+        g_sync_ctx.stats.files_failed++;
+        return TRUE;
+    }
+
+    // Same track already on the device or earlier in this run
+    Itdb_Track *existing = rb_ipod_content_index_lookup_identity(db->content_index, job->meta->title,
+                                                                 job->meta->artist, job->meta->file_size,
+                                                                 job->meta->mediatype);
+    if (existing) {
+        log_message(LOG_DEBUG, "Track already on iPod (%s), skipping: %s", existing->ipod_path, entry->path);
+        rb_ipod_content_index_record_source(db->content_index, entry->path, entry->size,
+                                            entry->mtime, existing);
+        rb_ipod_file_allocator_release(db->file_allocator, job->ipod_path);
+        g_sync_ctx.stats.files_skipped++;
+        return TRUE;
+    }
+
+    // Claim the identity now so duplicates still in flight are caught
+    rb_ipod_content_index_add_track(db->content_index, job->track);
+    rb_ipod_sync_journal_record(db->journal, job->ipod_path, entry->path, entry->size,
+                                entry->mtime, job->mediatype);
+    bounded_queue_push(&state->write_queue, job);
+    return FALSE;
+}
+
+static void handle_copied_job(PipelineState *state, PipelineJob *job) {
+    RbIpodDb *db = state->db;
+    const RbIpodManifestEntry *entry = job->entry;
+
+    if (!job->ok) {
+        log_message(LOG_ERROR, "Failed to copy file to iPod: %s", entry->path);
+        rb_ipod_content_index_remove_track(db->content_index, job->track);
+        rb_ipod_sync_journal_forget(db->journal, job->ipod_path);
+        rb_ipod_file_allocator_release(db->file_allocator, job->ipod_path);
+        g_sync_ctx.stats.files_failed++;
+        return;
+    }
+
+    rb_ipod_db_add_track(db, job->track);
+    rb_ipod_content_index_record_source(db->content_index, entry->path, entry->size,
+                                        entry->mtime, job->track);
+    job->track = NULL; // Owned by the action log, then the itdb
+
+    g_sync_ctx.stats.files_added++;
+    g_sync_ctx.stats.bytes_transferred += entry->size;
+    state->since_checkpoint++;
+}
+
+// Every checkpoint_tracks tracks or checkpoint_seconds, but never so often
+// that itdb_write (as last measured) exceeds its share of the sync time
+static gboolean checkpoint_due(PipelineState *state) {
+    if (state->since_checkpoint == 0) return FALSE;
+
+    gint64 elapsed_us = g_get_monotonic_time() - state->last_checkpoint_us;
+    if (elapsed_us < (gint64)(state->db->last_save_us / PIPELINE_CHECKPOINT_MAX_OVERHEAD)) {
+        return FALSE;
+    }
+
+    return (g_sync_ctx.checkpoint_tracks > 0 && state->since_checkpoint >= g_sync_ctx.checkpoint_tracks) ||
+           (g_sync_ctx.checkpoint_seconds > 0 &&
+            elapsed_us >= (gint64)g_sync_ctx.checkpoint_seconds * G_USEC_PER_SEC);
+}
+
+static void finish_checkpoint(RbIpodDb *db, gboolean wait) {
+    if (!db->is_saving) return;
+
+    // A failed checkpoint is logged; the final save reports the sync result
+    if (wait) {
+        rb_ipod_db_wait_for_save(db);
+    } else {
+        rb_ipod_db_poll_save(db);
+    }
+    if (!db->is_saving) {
+        g_sync_ctx.stats.checkpoint_write_us += db->last_save_us;
+    }
+}
+
+// Saves what is committed so far without pausing the probe/copy stages
+static void checkpoint_database(PipelineState *state, gboolean more_to_come) {
+    RbIpodDb *db = state->db;
+
+    finish_checkpoint(db, FALSE);
+
+    if (more_to_come && !db->is_saving && checkpoint_due(state)) {
+        if (rb_ipod_db_save_async(db)) {
+            g_sync_ctx.stats.db_checkpoints++;
+        }
+        state->since_checkpoint = 0;
+        state->last_checkpoint_us = g_get_monotonic_time();
+    }
+}
+
+gboolean rb_ipod_sync_pipeline_run(RbIpodDb *db, const RbIpodManifest *manifest,
+                                   guint32 mediatype, guint num_jobs) {
+    if (!db || !manifest) {
+        log_message(LOG_ERROR, "rb_ipod_sync_pipeline_run called with NULL parameters");
+        return FALSE;
+    }
+
+    if (num_jobs == 0) {
+        num_jobs = g_get_num_processors();
+    }
+    num_jobs = CLAMP(num_jobs, 1, PIPELINE_MAX_JOBS);
+
+    PipelineState state = {0};
+    state.db = db;
+    bounded_queue_init(&state.probe_queue, num_jobs * 2);
+    bounded_queue_init(&state.write_queue, PIPELINE_WRITE_QUEUE_DEPTH);
+    state.events = g_async_queue_new();
+    state.last_checkpoint_us = g_get_monotonic_time();
+
+    log_message(LOG_INFO, "Sync pipeline: %u files, %u probe workers", manifest->entries->len, num_jobs);
+
+    GThread **workers = g_new0(GThread*, num_jobs);
+    for (guint i = 0; i < num_jobs; i++) {
+        workers[i] = g_thread_new("rbipod-probe", probe_worker_thread, &state);
+    }
+    GThread *writer = g_thread_new("rbipod-writer", writer_thread, &state);
+
+    guint total_files = manifest->entries->len;
+    guint next_entry = 0;
+    guint completed = 0;
+    guint in_flight = 0;
+    gboolean cancelled = FALSE;
+
+    while (next_entry < total_files || in_flight > 0) {
+        // Feed as much as the probe queue accepts without blocking
+        while (next_entry < total_files && !cancelled) {
+            if (g_sync_ctx.cancellation_requested) {
+                printf("\nSync cancelled by user\n");
+                cancelled = TRUE;
+                break;
+            }
+
+            const RbIpodManifestEntry *entry = g_ptr_array_index(manifest->entries, next_entry);
+
+            // Unchanged since the last sync: never reaches a worker
+            if (rb_ipod_content_index_lookup_source(db->content_index, entry->path,
+                                                    entry->size, entry->mtime)) {
+                log_message(LOG_DEBUG, "Unchanged since last sync, skipping: %s", entry->path);
+                g_sync_ctx.stats.files_skipped++;
+                next_entry++;
+                completed++;
+                continue;
+            }
+
+            PipelineJob *job = g_malloc0(sizeof(PipelineJob));
+            job->entry = entry;
+            job->mediatype = mediatype;
+            if (!bounded_queue_try_push(&state.probe_queue, job)) {
+                g_free(job);
+                break;
+            }
+            next_entry++;
+            in_flight++;
+        }
+        if (cancelled) {
+            next_entry = total_files; // Drain what is already in flight
+        }
+
+        if (in_flight > 0) {
+            PipelineJob *job = g_async_queue_pop(state.events);
+            gboolean finished = TRUE;
+
+            if (job->state == PIPELINE_JOB_PROBED) {
+                finished = handle_probed_job(&state, job);
+            } else {
+                handle_copied_job(&state, job);
+            }
+
+            if (finished) {
+                free_pipeline_job(job);
+                in_flight--;
+                completed++;
+            }
+        }
+
+        checkpoint_database(&state, next_entry < total_files);
+
+        if (total_files > 0) {
+            printf("\rProgress: %d%% (%u/%u)", (int)(((guint64)completed * 100) / total_files),
+                   completed, total_files);
+            fflush(stdout);
+        }
+    }
+
+    bounded_queue_close(&state.probe_queue);
+    for (guint i = 0; i < num_jobs; i++) {
+        g_thread_join(workers[i]);
+    }
+    bounded_queue_close(&state.write_queue);
+    g_thread_join(writer);
+    g_free(workers);
+
+    // Queued commits join the itdb before the caller counts or saves it
+    finish_checkpoint(db, TRUE);
+
+    g_async_queue_unref(state.events);
+    bounded_queue_clear(&state.write_queue);
+    bounded_queue_clear(&state.probe_queue);
+
+    log_message(LOG_INFO, "Sync pipeline finished: %u/%u files processed%s",
+               completed, total_files, cancelled ? " (cancelled)" : "");
+    return !cancelled;
+}
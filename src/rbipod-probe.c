@@ -0,0 +1,729 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <glib.h>
+
+#include "../include/rbipod-probe.h"
+#include "../include/rbipod-walker.h"
+#include "../include/rbipod-mp4.h"
+#include "../include/rbipod-logging.h"
+
+// =============================================================================
+// NATIVE CONTAINER PROBING
+// =============================================================================
+
+// Everything here reads a handful of header bytes with pread() (the MP3
+// scanner maps the file instead, since it may walk every frame header):
+// these probes replace per-file mediainfo/ffprobe/ffmpeg spawns on the sync
+// path and must stay safe to call from several pipeline workers at once.
+
+typedef struct {
+    int fd;
+    gint64 size;
+} ProbeFile;
+
+static gboolean probe_open(ProbeFile *file, const char *file_path) {
+    file->fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (file->fd < 0) return FALSE;
+
+    struct stat file_stat;
+    if (fstat(file->fd, &file_stat) != 0) {
+        close(file->fd);
+        return FALSE;
+    }
+    file->size = file_stat.st_size;
+    return TRUE;
+}
+
+static gboolean read_at(const ProbeFile *file, gint64 offset, void *buffer, gsize length) {
+    if (offset < 0 || offset + (gint64)length > file->size) return FALSE;
+
+    gsize done = 0;
+    while (done < length) {
+        ssize_t bytes_read = pread(file->fd, (guchar*)buffer + done, length - done, offset + done);
+        if (bytes_read < 0) {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        if (bytes_read == 0) return FALSE;
+        done += bytes_read;
+    }
+    return TRUE;
+}
+
+static guint32 read_be32(const guchar *p) {
+    return ((guint32)p[0] << 24) | ((guint32)p[1] << 16) | ((guint32)p[2] << 8) | p[3];
+}
+
+static guint64 read_be64(const guchar *p) {
+    return ((guint64)read_be32(p) << 32) | read_be32(p + 4);
+}
+
+static guint32 read_le32(const guchar *p) {
+    return ((guint32)p[3] << 24) | ((guint32)p[2] << 16) | ((guint32)p[1] << 8) | p[0];
+}
+
+static guint32 read_syncsafe32(const guchar *p) {
+    return ((guint32)(p[0] & 0x7F) << 21) | ((guint32)(p[1] & 0x7F) << 14) |
+           ((guint32)(p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+// Offset of the first byte after a leading ID3v2 tag (0 if there is none)
+static gint64 skip_id3v2(const ProbeFile *file) {
+    guchar header[10];
+    if (!read_at(file, 0, header, sizeof(header))) return 0;
+    if (memcmp(header, "ID3", 3) != 0) return 0;
+
+    gint64 end = 10 + (gint64)read_syncsafe32(header + 6);
+    if (header[5] & 0x10) end += 10; // Footer present
+    return MIN(end, file->size);
+}
+
+static gboolean set_properties(int *duration, int *bitrate, double seconds, gint64 audio_bytes) {
+    if (seconds <= 0) return FALSE;
+
+    *duration = (int)(seconds + 0.5);
+    if (*duration == 0) *duration = 1;
+    if (audio_bytes > 0) {
+        *bitrate = (int)(audio_bytes * 8 / seconds / 1000);
+    }
+    return TRUE;
+}
+
+// =============================================================================
+// RIFF/WAVE AND AIFF
+// =============================================================================
+
+static gboolean probe_wav(const ProbeFile *file, int *duration, int *bitrate) {
+    guchar header[12];
+    if (!read_at(file, 0, header, sizeof(header))) return FALSE;
+    if (memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) return FALSE;
+
+    guint32 byte_rate = 0;
+    gint64 data_size = -1;
+    gint64 offset = 12;
+
+    while (offset + 8 <= file->size && (byte_rate == 0 || data_size < 0)) {
+        guchar chunk[8];
+        if (!read_at(file, offset, chunk, sizeof(chunk))) break;
+        gint64 chunk_size = read_le32(chunk + 4);
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            guchar fmt[12];
+            if (!read_at(file, offset + 8, fmt, sizeof(fmt))) return FALSE;
+            byte_rate = read_le32(fmt + 8);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            // Streamed WAVs leave the size at 0 or 0xFFFFFFFF: trust the file
+            data_size = MIN(chunk_size, file->size - offset - 8);
+            if (chunk_size == 0) data_size = file->size - offset - 8;
+        }
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    if (byte_rate == 0 || data_size <= 0) return FALSE;
+    return set_properties(duration, bitrate, (double)data_size / byte_rate, data_size);
+}
+
+// 80-bit IEEE 754 extended sample rate, as stored in the COMM chunk
+static guint32 read_extended_rate(const guchar *p) {
+    int exponent = ((p[0] & 0x7F) << 8 | p[1]) - 16383;
+    guint64 mantissa = read_be64(p + 2);
+    if (exponent < 0 || exponent > 63) return 0;
+    return (guint32)(mantissa >> (63 - exponent));
+}
+
+static gboolean probe_aiff(const ProbeFile *file, int *duration, int *bitrate) {
+    guchar header[12];
+    if (!read_at(file, 0, header, sizeof(header))) return FALSE;
+    if (memcmp(header, "FORM", 4) != 0 ||
+        (memcmp(header + 8, "AIFF", 4) != 0 && memcmp(header + 8, "AIFC", 4) != 0)) {
+        return FALSE;
+    }
+
+    gint64 offset = 12;
+    gint64 sound_size = 0;
+    guint32 frames = 0;
+    guint32 sample_rate = 0;
+
+    while (offset + 8 <= file->size) {
+        guchar chunk[8];
+        if (!read_at(file, offset, chunk, sizeof(chunk))) break;
+        gint64 chunk_size = read_be32(chunk + 4);
+
+        if (memcmp(chunk, "COMM", 4) == 0) {
+            guchar comm[18];
+            if (!read_at(file, offset + 8, comm, sizeof(comm))) return FALSE;
+            frames = read_be32(comm + 2);
+            sample_rate = read_extended_rate(comm + 8);
+        } else if (memcmp(chunk, "SSND", 4) == 0) {
+            sound_size = MIN(chunk_size, file->size - offset - 8);
+        }
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    if (sample_rate == 0 || frames == 0) return FALSE;
+    return set_properties(duration, bitrate, (double)frames / sample_rate, sound_size);
+}
+
+// =============================================================================
+// MPEG AUDIO
+// =============================================================================
+
+typedef struct {
+    int version;            // 1, 2, or 25 for MPEG 2.5
+    int layer;
+    int bitrate;            // kbps
+    int sample_rate;
+    gboolean mono;
+    int frame_length;
+    int samples_per_frame;
+} MpegFrameHeader;
+
+static const int mpeg_bitrates[5][16] = {
+    {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},  // V1 L1
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},     // V1 L2
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},      // V1 L3
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},     // V2 L1
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}           // V2 L2/L3
+};
+
+static const int mpeg_sample_rates[3][3] = {
+    {44100, 48000, 32000},  // V1
+    {22050, 24000, 16000},  // V2
+    {11025, 12000, 8000}    // V2.5
+};
+
+static gboolean parse_mpeg_header(const guchar *p, MpegFrameHeader *header) {
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) return FALSE;
+
+    int version_bits = (p[1] >> 3) & 0x03;
+    int layer_bits = (p[1] >> 1) & 0x03;
+    int bitrate_index = p[2] >> 4;
+    int rate_index = (p[2] >> 2) & 0x03;
+    int padding = (p[2] >> 1) & 0x01;
+
+    if (version_bits == 1 || layer_bits == 0 || bitrate_index == 0 ||
+        bitrate_index == 15 || rate_index == 3) {
+        return FALSE;
+    }
+
+    header->version = version_bits == 3 ? 1 : (version_bits == 2 ? 2 : 25);
+    header->layer = 4 - layer_bits;
+    header->mono = (p[3] >> 6) == 3;
+
+    int table = header->version == 1 ? header->layer - 1 : (header->layer == 1 ? 3 : 4);
+    header->bitrate = mpeg_bitrates[table][bitrate_index];
+    header->sample_rate = mpeg_sample_rates[header->version == 1 ? 0 : (header->version == 2 ? 1 : 2)][rate_index];
+
+    if (header->layer == 1) {
+        header->samples_per_frame = 384;
+        header->frame_length = (12 * header->bitrate * 1000 / header->sample_rate + padding) * 4;
+    } else if (header->layer == 3 && header->version != 1) {
+        header->samples_per_frame = 576;
+        header->frame_length = 72 * header->bitrate * 1000 / header->sample_rate + padding;
+    } else {
+        header->samples_per_frame = 1152;
+        header->frame_length = 144 * header->bitrate * 1000 / header->sample_rate + padding;
+    }
+    return header->frame_length > 4;
+}
+
+// Header fields that must stay constant across the frames of one stream
+static gboolean same_stream(const MpegFrameHeader *a, const MpegFrameHeader *b) {
+    return a->version == b->version && a->layer == b->layer && a->sample_rate == b->sample_rate;
+}
+
+// First offset in [start, end) holding a frame whose successor is also a
+// valid frame of the same stream (or which ends exactly at end)
+static gsize find_first_frame(const guchar *data, gsize start, gsize end, gsize limit,
+                              MpegFrameHeader *header) {
+    gsize stop = MIN(end, start + limit);
+    for (gsize i = start; i + 4 <= stop; i++) {
+        if (!parse_mpeg_header(data + i, header)) continue;
+
+        gsize next_pos = i + header->frame_length;
+        if (next_pos == end) return i;
+
+        MpegFrameHeader next;
+        if (next_pos + 4 <= end && parse_mpeg_header(data + next_pos, &next) && same_stream(header, &next)) {
+            return i;
+        }
+    }
+    return end;
+}
+
+// Keeps the offsets of the last frames seen for the gapless byte count
+#define MP3_TAIL_FRAMES 9
+
+typedef struct {
+    gsize offsets[MP3_TAIL_FRAMES];
+    guint count;
+} FrameTail;
+
+static void frame_tail_push(FrameTail *tail, gsize offset) {
+    tail->offsets[tail->count % MP3_TAIL_FRAMES] = offset;
+    tail->count++;
+}
+
+// Offset of the 8th frame before the last one (iTunes' gapless_data end)
+static gboolean frame_tail_gapless_end(const FrameTail *tail, gsize *offset) {
+    if (tail->count < MP3_TAIL_FRAMES) return FALSE;
+    *offset = tail->offsets[tail->count % MP3_TAIL_FRAMES];
+    return TRUE;
+}
+
+// Walks frame headers from start to end; resynchronises over junk
+static void walk_frames(const guchar *data, gsize start, gsize end, const MpegFrameHeader *reference,
+                        guint32 *frames, gint64 *audio_bytes, gboolean *vbr, FrameTail *tail) {
+    gsize pos = start;
+    while (pos + 4 <= end) {
+        MpegFrameHeader header;
+        if (!parse_mpeg_header(data + pos, &header) || !same_stream(&header, reference)) {
+            gsize next = find_first_frame(data, pos + 1, end, PROBE_SYNC_SEARCH_LIMIT, &header);
+            if (next >= end || !same_stream(&header, reference)) break;
+            pos = next;
+            continue;
+        }
+        if (pos + header.frame_length > end) break; // Truncated last frame
+
+        if (header.bitrate != reference->bitrate) *vbr = TRUE;
+        frame_tail_push(tail, pos);
+        (*frames)++;
+        *audio_bytes += header.frame_length;
+        pos += header.frame_length;
+    }
+}
+
+// With a Xing/VBRI header nothing is walked, but gapless_data still needs
+// the frame boundaries at the end: find the chain of frames that ends
+// exactly where the audio does
+static gboolean find_tail_frames(const guchar *data, gsize first_frame, gsize end,
+                                 const MpegFrameHeader *reference, FrameTail *tail) {
+    gsize span = (gsize)reference->frame_length * MP3_TAIL_FRAMES * 4;
+    gsize start = end > first_frame + span ? end - span : first_frame;
+
+    for (gsize i = start; i + 4 <= end; i++) {
+        MpegFrameHeader header;
+        if (!parse_mpeg_header(data + i, &header) || !same_stream(&header, reference)) continue;
+
+        FrameTail candidate = {{0}, 0};
+        gsize pos = i;
+        while (pos + 4 <= end && parse_mpeg_header(data + pos, &header) && same_stream(&header, reference)) {
+            frame_tail_push(&candidate, pos);
+            pos += header.frame_length;
+        }
+        if (pos == end && candidate.count >= MP3_TAIL_FRAMES) {
+            *tail = candidate;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// LAME/Lavc extension of the Xing/Info header: encoder delay and padding
+static void read_lame_tag(const guchar *lame, const guchar *limit, RbIpodMp3Info *info) {
+    if (lame + 24 > limit) return;
+    if (memcmp(lame, "LAME", 4) != 0 && memcmp(lame, "Lavc", 4) != 0 &&
+        memcmp(lame, "Lavf", 4) != 0 && memcmp(lame, "GOGO", 4) != 0) {
+        return;
+    }
+
+    const guchar *p = lame + 21;
+    info->encoder_delay = (p[0] << 4) | (p[1] >> 4);
+    info->encoder_padding = ((p[1] & 0x0F) << 8) | p[2];
+    info->has_gapless = info->encoder_delay > 0 || info->encoder_padding > 0;
+}
+
+gboolean rb_ipod_probe_mp3(const char *file_path, RbIpodMp3Info *info) {
+    if (!file_path || !info) return FALSE;
+    memset(info, 0, sizeof(RbIpodMp3Info));
+
+    ProbeFile file;
+    if (!probe_open(&file, file_path)) return FALSE;
+    if (file.size < 4) {
+        close(file.fd);
+        return FALSE;
+    }
+
+    // The tag header is read through the fd, so before it is closed
+    gsize audio_start = (gsize)skip_id3v2(&file);
+    const guchar *data = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+    close(file.fd);
+    if (data == MAP_FAILED) {
+        log_message(LOG_DEBUG, "Cannot map %s: %s", file_path, strerror(errno));
+        return FALSE;
+    }
+
+    gsize audio_end = (gsize)file.size;
+
+    // Trailing tags: ID3v1 and APEv2 (whose footer sits before ID3v1)
+    if (audio_end >= audio_start + 128 && memcmp(data + audio_end - 128, "TAG", 3) == 0) {
+        audio_end -= 128;
+    }
+    if (audio_end >= audio_start + 32 && memcmp(data + audio_end - 32, "APETAGEX", 8) == 0) {
+        const guchar *footer = data + audio_end - 32;
+        gsize ape_size = read_le32(footer + 12);
+        if (read_le32(footer + 20) & 0x80000000) ape_size += 32; // Header present
+        if (ape_size <= audio_end - audio_start) audio_end -= ape_size;
+    }
+
+    MpegFrameHeader first;
+    gsize first_frame = find_first_frame(data, audio_start, audio_end, PROBE_SYNC_SEARCH_LIMIT, &first);
+    if (first_frame >= audio_end) {
+        munmap((void*)data, file.size);
+        return FALSE;
+    }
+    info->sample_rate = first.sample_rate;
+
+    // Xing/Info header sits after the side information of the first frame
+    gsize side_info = first.version == 1 ? (first.mono ? 17 : 32) : (first.mono ? 9 : 17);
+    const guchar *frame_end = data + MIN(first_frame + first.frame_length, audio_end);
+    const guchar *xing = data + first_frame + 4 + side_info;
+    const guchar *vbri = data + first_frame + 36;
+    gboolean header_frame = FALSE;
+    gint64 stream_bytes = 0;
+
+    if (xing + 8 <= frame_end && (memcmp(xing, "Xing", 4) == 0 || memcmp(xing, "Info", 4) == 0)) {
+        header_frame = TRUE;
+        info->vbr = memcmp(xing, "Xing", 4) == 0;
+        guint32 flags = read_be32(xing + 4);
+        const guchar *field = xing + 8;
+        if ((flags & 0x01) && field + 4 <= frame_end) {
+            info->frame_count = read_be32(field);
+            field += 4;
+        }
+        if (flags & 0x02) {
+            if (field + 4 <= frame_end) stream_bytes = read_be32(field);
+            field += 4;
+        }
+        if (flags & 0x04) field += 100; // Seek table
+        if (flags & 0x08) field += 4;   // Quality indicator
+        read_lame_tag(field, frame_end, info);
+    } else if (vbri + 18 <= frame_end && memcmp(vbri, "VBRI", 4) == 0) {
+        header_frame = TRUE;
+        info->vbr = TRUE;
+        stream_bytes = read_be32(vbri + 10);
+        info->frame_count = read_be32(vbri + 14);
+    }
+
+    gsize audio_first = header_frame ? first_frame + first.frame_length : first_frame;
+    gint64 audio_bytes = 0;
+    FrameTail tail = {{0}, 0};
+    gboolean have_tail = FALSE;
+
+    if (info->frame_count > 0) {
+        audio_bytes = stream_bytes > first.frame_length ? stream_bytes - first.frame_length
+                                                        : (gint64)(audio_end - audio_first);
+        if (info->has_gapless) {
+            have_tail = find_tail_frames(data, audio_first, audio_end, &first, &tail);
+        }
+    } else {
+        // No usable header: count the frames themselves
+        madvise((void*)data, file.size, MADV_SEQUENTIAL);
+        walk_frames(data, audio_first, audio_end, &first, &info->frame_count, &audio_bytes, &info->vbr, &tail);
+        have_tail = TRUE;
+    }
+    munmap((void*)data, file.size);
+
+    if (info->frame_count == 0) return FALSE;
+
+    guint64 total_samples = (guint64)info->frame_count * first.samples_per_frame;
+    guint32 trimmed = info->encoder_delay + info->encoder_padding;
+    info->sample_count = total_samples > trimmed ? total_samples - trimmed : total_samples;
+    info->duration_ms = (guint32)(info->sample_count * 1000 / first.sample_rate);
+
+    double seconds = (double)total_samples / first.sample_rate;
+    info->bitrate = seconds > 0 ? (int)(audio_bytes * 8 / seconds / 1000 + 0.5) : first.bitrate;
+
+    gsize gapless_end;
+    if (have_tail && frame_tail_gapless_end(&tail, &gapless_end)) {
+        info->gapless_data = (guint32)(gapless_end - first_frame);
+    } else {
+        // Tail not found: assume average-sized frames at the end
+        gint64 average = audio_bytes / info->frame_count;
+        info->gapless_data = (guint32)MAX((gint64)0, (gint64)(audio_first - first_frame) + audio_bytes - 8 * average);
+    }
+
+    log_message(LOG_DEBUG, "MP3 scan: %s -> %u frames, %u ms, %d kbps%s, delay %u, padding %u",
+               file_path, info->frame_count, info->duration_ms, info->bitrate,
+               info->vbr ? " VBR" : "", info->encoder_delay, info->encoder_padding);
+    return TRUE;
+}
+
+static gboolean probe_mpeg(const char *file_path, int *duration, int *bitrate) {
+    RbIpodMp3Info info;
+    if (!rb_ipod_probe_mp3(file_path, &info)) return FALSE;
+
+    *duration = (int)((info.duration_ms + 500) / 1000);
+    if (*duration == 0) *duration = 1;
+    *bitrate = info.bitrate;
+    return TRUE;
+}
+
+// =============================================================================
+// ADTS AAC
+// =============================================================================
+
+static const int adts_sample_rates[16] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+    16000, 12000, 11025, 8000, 7350, 0, 0, 0
+};
+
+static gboolean probe_adts(const ProbeFile *file, int *duration, int *bitrate) {
+    gint64 offset = skip_id3v2(file);
+    gint64 audio_start = offset;
+    int sample_rate = 0;
+    gint64 sampled_bytes = 0;
+    int sampled_frames = 0;
+    int blocks_per_frame = 1;
+
+    // Average the first frames and extrapolate: walking every header of a
+    // long podcast would cost one read per 23 ms of audio
+    while (sampled_frames < PROBE_ADTS_SAMPLE_FRAMES && offset + 7 <= file->size) {
+        guchar p[7];
+        if (!read_at(file, offset, p, sizeof(p))) break;
+        if (p[0] != 0xFF || (p[1] & 0xF6) != 0xF0) break;
+
+        int frame_rate = adts_sample_rates[(p[2] >> 2) & 0x0F];
+        int frame_length = ((p[3] & 0x03) << 11) | (p[4] << 3) | (p[5] >> 5);
+        if (frame_rate == 0 || frame_length < 7) break;
+
+        sample_rate = frame_rate;
+        blocks_per_frame = (p[6] & 0x03) + 1;
+        sampled_bytes += frame_length;
+        sampled_frames++;
+        offset += frame_length;
+    }
+
+    if (sampled_frames == 0 || sample_rate == 0) return FALSE;
+
+    gint64 audio_bytes = file->size - audio_start;
+    double frames = (double)audio_bytes * sampled_frames / sampled_bytes;
+    double seconds = frames * 1024 * blocks_per_frame / sample_rate;
+    return set_properties(duration, bitrate, seconds, audio_bytes);
+}
+
+// =============================================================================
+// MP4 / M4A
+// =============================================================================
+
+// Atom walk lives in rbipod-mp4.c (shared with the metadata reader)
+static gboolean probe_mp4(const char *file_path, gint64 file_size, int *duration, int *bitrate) {
+    RbIpodMp4File *mp4 = rb_ipod_mp4_open(file_path);
+    if (!mp4) return FALSE;
+
+    gboolean success = set_properties(duration, bitrate, mp4->duration_ms / 1000.0,
+                                      mp4->mdat_bytes > 0 ? mp4->mdat_bytes : file_size);
+    rb_ipod_mp4_close(mp4);
+    return success;
+}
+
+gboolean rb_ipod_probe_audio_properties(const char *file_path, int *duration, int *bitrate) {
+    if (!file_path || !duration || !bitrate) return FALSE;
+
+    *duration = 0;
+    *bitrate = 0;
+
+    ProbeFile file;
+    if (!probe_open(&file, file_path)) return FALSE;
+
+    gboolean success = FALSE;
+    switch (rb_ipod_classify_extension(file_path)) {
+        case RB_IPOD_EXT_WAV:
+            success = probe_wav(&file, duration, bitrate);
+            break;
+        case RB_IPOD_EXT_AIFF:
+            success = probe_aiff(&file, duration, bitrate);
+            break;
+        case RB_IPOD_EXT_MP3:
+            success = probe_mpeg(file_path, duration, bitrate);
+            break;
+        case RB_IPOD_EXT_AAC:
+            // Raw ".aac" is usually ADTS, but some tools write MP4 containers
+            success = probe_adts(&file, duration, bitrate) ||
+                      probe_mp4(file_path, file.size, duration, bitrate);
+            break;
+        case RB_IPOD_EXT_M4A:
+        case RB_IPOD_EXT_M4P:
+        case RB_IPOD_EXT_MP4:
+            success = probe_mp4(file_path, file.size, duration, bitrate);
+            break;
+        default:
+            break;
+    }
+    close(file.fd);
+
+    if (success) {
+        log_message(LOG_DEBUG, "Native probe: %s -> duration: %d sec, bitrate: %d kbps",
+                   file_path, *duration, *bitrate);
+    }
+    return success;
+}
+
+// =============================================================================
+// ID3v2 PICTURES
+// =============================================================================
+
+// Removes ID3v2 unsynchronisation (0xFF 0x00 -> 0xFF) in place
+static gsize id3v2_resync(guchar *data, gsize length) {
+    gsize out = 0;
+    for (gsize i = 0; i < length; i++) {
+        data[out++] = data[i];
+        if (data[i] == 0xFF && i + 1 < length && data[i + 1] == 0x00) i++;
+    }
+    return out;
+}
+
+// Length of a text field terminated according to its ID3v2 encoding
+static gsize id3v2_text_length(const guchar *p, gsize length, guchar encoding) {
+    if (encoding == 1 || encoding == 2) {
+        for (gsize i = 0; i + 1 < length; i += 2) {
+            if (p[i] == 0 && p[i + 1] == 0) return i + 2;
+        }
+    } else {
+        for (gsize i = 0; i < length; i++) {
+            if (p[i] == 0) return i + 1;
+        }
+    }
+    return length;
+}
+
+static const char* picture_format(const guchar *data, gsize length) {
+    if (length >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) return "jpeg";
+    if (length >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) return "png";
+    return "unknown";
+}
+
+// Picture payload of an APIC (v2.3/2.4) or PIC (v2.2) frame body
+static const guchar* id3v2_picture_payload(const guchar *body, gsize length, int major,
+                                           gsize *payload_length, int *picture_type) {
+    if (length < 4) return NULL;
+
+    guchar encoding = body[0];
+    gsize pos = 1;
+    if (major == 2) {
+        pos += 3; // Three-letter image format
+    } else {
+        pos += id3v2_text_length(body + pos, length - pos, 0); // MIME type
+    }
+    if (pos >= length) return NULL;
+
+    *picture_type = body[pos++];
+    pos += id3v2_text_length(body + pos, length - pos, encoding); // Description
+    if (pos >= length) return NULL;
+
+    *payload_length = length - pos;
+    return body + pos;
+}
+
+gboolean rb_ipod_probe_embedded_picture(const char *file_path, AudioMetadata *meta) {
+    if (!file_path || !meta) return FALSE;
+
+    ProbeFile file;
+    if (!probe_open(&file, file_path)) return FALSE;
+
+    guchar header[10];
+    if (!read_at(&file, 0, header, sizeof(header)) || memcmp(header, "ID3", 3) != 0) {
+        close(file.fd);
+        return FALSE;
+    }
+
+    int major = header[3];
+    guchar tag_flags = header[5];
+    gsize tag_size = read_syncsafe32(header + 6);
+    if (major < 2 || major > 4 || tag_size > PROBE_MAX_PICTURE_SIZE + 65536) {
+        close(file.fd);
+        return FALSE;
+    }
+
+    guchar *tag = g_malloc(tag_size);
+    gboolean have_tag = read_at(&file, 10, tag, tag_size);
+    close(file.fd);
+    if (!have_tag) {
+        g_free(tag);
+        return FALSE;
+    }
+
+    // Whole-tag unsynchronisation (v2.2/2.3); v2.4 flags it per frame
+    if ((tag_flags & 0x80) && major < 4) {
+        tag_size = id3v2_resync(tag, tag_size);
+    }
+
+    gsize pos = 0;
+    if ((tag_flags & 0x40) && major >= 3 && tag_size >= 4) {
+        // Extended header: v2.3 size excludes its own size field
+        pos = major == 4 ? read_syncsafe32(tag) : read_be32(tag) + 4;
+    }
+
+    gsize id_length = major == 2 ? 3 : 4;
+    gsize frame_header_length = major == 2 ? 6 : 10;
+    const char *frame_id = major == 2 ? "PIC" : "APIC";
+
+    const guchar *best = NULL;
+    gsize best_length = 0;
+
+    while (pos + frame_header_length <= tag_size && tag[pos] != 0) {
+        const guchar *frame = tag + pos;
+        gsize frame_size;
+        if (major == 2) {
+            frame_size = ((gsize)frame[3] << 16) | ((gsize)frame[4] << 8) | frame[5];
+        } else if (major == 4) {
+            frame_size = read_syncsafe32(frame + 4);
+        } else {
+            frame_size = read_be32(frame + 4);
+        }
+        if (frame_size > tag_size - pos - frame_header_length) break;
+
+        if (memcmp(frame, frame_id, id_length) == 0) {
+            guchar *body = tag + pos + frame_header_length;
+            gsize body_length = frame_size;
+            gboolean usable = TRUE;
+
+            if (major == 4) {
+                guchar format_flags = frame[9];
+                if (format_flags & 0x0C) usable = FALSE;  // Compressed or encrypted
+                if (usable && (format_flags & 0x02)) body_length = id3v2_resync(body, body_length);
+                if (usable && (format_flags & 0x01) && body_length >= 4) {
+                    body += 4; // Data length indicator
+                    body_length -= 4;
+                }
+            } else if (major == 3 && (frame[9] & 0xC0)) {
+                usable = FALSE;
+            }
+
+            gsize payload_length = 0;
+            int picture_type = 0;
+            const guchar *payload = usable ? id3v2_picture_payload(body, body_length, major,
+                                                                   &payload_length, &picture_type) : NULL;
+            if (payload && payload_length > 0 && (!best || picture_type == 3)) {
+                best = payload;
+                best_length = payload_length;
+                if (picture_type == 3) break; // Front cover
+            }
+        }
+        pos += frame_header_length + frame_size;
+    }
+
+    gboolean success = FALSE;
+    if (best && best_length <= PROBE_MAX_PICTURE_SIZE) {
+        g_free(meta->artwork_data);
+        g_free(meta->artwork_format);
+        meta->artwork_data = g_malloc(best_length);
+        memcpy(meta->artwork_data, best, best_length);
+        meta->artwork_size = best_length;
+        meta->artwork_format = g_strdup(picture_format(best, best_length));
+        success = TRUE;
+        log_message(LOG_DEBUG, "Native ID3v2 picture: %s (%zu bytes, %s)",
+                   file_path, meta->artwork_size, meta->artwork_format);
+    }
+
+    g_free(tag);
+    return success;
+}
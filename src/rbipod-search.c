@@ -0,0 +1,518 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <glib.h>
+#include <gpod/itdb.h>
+
+#include "../include/rbipod-search.h"
+#include "../include/rbipod-dbreader.h"
+#include "../include/rbipod-logging.h"
+
+// =============================================================================
+// DEVICE SEARCH INDEX
+// =============================================================================
+
+// File layout (host byte order, the byte-order mark rejects foreign files):
+//   header    magic[8] version(4) bom(4) db_size(8) db_mtime_ns(8)
+//             entry_count(4) trigram_count(4) posting_count(4) strings_size(4)
+//   entries   mediatype(4) display(4) folded(4), one per track
+//   trigrams  trigram(4) first(4) count(4), sorted by trigram
+//   postings  entry ids, ascending within each trigram
+//   strings   display "title\0artist\0album\0ipod_path\0" and the folded
+//             search text (fields joined by FIELD_SEPARATOR, NUL-terminated)
+// Every section is a multiple of 4 bytes, so the mapping is used as is.
+// Trigrams are taken over the bytes of the folded UTF-8 text: a substring
+// of the folded text always contains the trigrams of the query term.
+
+#define SEARCH_INDEX_MAGIC "RBSRCHIX"
+#define SEARCH_INDEX_BOM 0x01020304u
+#define FIELD_SEPARATOR '\x1f'
+
+#define TRIGRAM(p) (((guint32)(p)[0] << 16) | ((guint32)(p)[1] << 8) | (guint32)(p)[2])
+
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 bom;
+    gint64 db_size;
+    gint64 db_mtime_ns;
+    guint32 entry_count;
+    guint32 trigram_count;
+    guint32 posting_count;
+    guint32 strings_size;
+} SearchIndexHeader;
+
+typedef struct {
+    guint32 mediatype;
+    guint32 display;           // Offsets into the strings section
+    guint32 folded;
+} SearchEntryRecord;
+
+typedef struct {
+    guint32 trigram;
+    guint32 first;             // Index into the postings section
+    guint32 count;
+} TrigramRecord;
+
+struct _RbIpodSearchIndex {
+    guchar *data;              // Mapping of the cache file, or the index just built
+    gsize size;
+    gboolean mapped;
+    const SearchIndexHeader *header;
+    const SearchEntryRecord *entries;
+    const TrigramRecord *trigrams;
+    const guint32 *postings;
+    const char *strings;
+};
+
+// Lower case, accents and control characters removed
+static char* fold_text(const char *text) {
+    if (!text) return g_strdup("");
+
+    gchar *decomposed = g_utf8_normalize(text, -1, G_NORMALIZE_ALL);
+    if (!decomposed) {
+        gchar *valid = g_utf8_make_valid(text, -1);
+        decomposed = g_utf8_normalize(valid, -1, G_NORMALIZE_ALL);
+        g_free(valid);
+        if (!decomposed) return g_strdup("");
+    }
+
+    GString *folded = g_string_sized_new(strlen(decomposed));
+    for (const gchar *p = decomposed; *p; p = g_utf8_next_char(p)) {
+        gunichar c = g_utf8_get_char(p);
+        if (g_unichar_ismark(c) || g_unichar_iscntrl(c)) continue;
+        g_string_append_unichar(folded, g_unichar_tolower(c));
+    }
+    g_free(decomposed);
+    return g_string_free(folded, FALSE);
+}
+
+// The database libgpod reads: the compressed one when present
+static gboolean database_key(const char *mount_point, gint64 *size, gint64 *mtime_ns) {
+    gchar *itunes_dir = itdb_get_itunes_dir(mount_point);
+    gchar *db_path = itunes_dir ? itdb_get_path(itunes_dir, "iTunesCDB") : NULL;
+    g_free(itunes_dir);
+    if (!db_path) {
+        db_path = itdb_get_itunesdb_path(mount_point);
+    }
+    if (!db_path) return FALSE;
+
+    struct stat db_stat;
+    gboolean found = stat(db_path, &db_stat) == 0;
+    g_free(db_path);
+    if (!found) return FALSE;
+
+    *size = (gint64)db_stat.st_size;
+    *mtime_ns = (gint64)db_stat.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + db_stat.st_mtim.tv_nsec;
+    return TRUE;
+}
+
+static char* default_cache_path(const char *mount_point) {
+    gchar *digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, mount_point, -1);
+    gchar *filename = g_strdup_printf("%s-%.16s.bin", SEARCH_INDEX_PREFIX, digest);
+    char *path = g_build_filename(g_get_user_cache_dir(), PROGRAM_NAME, filename, NULL);
+    g_free(filename);
+    g_free(digest);
+    return path;
+}
+
+// =============================================================================
+// BUILD
+// =============================================================================
+
+typedef struct {
+    GArray *entries;           // SearchEntryRecord
+    GString *strings;
+    GHashTable *postings;      // trigram -> GArray of entry ids
+} IndexBuilder;
+
+static void free_posting_list(gpointer data) {
+    g_array_free((GArray*)data, TRUE);
+}
+
+static void append_string(GString *strings, const char *text) {
+    const char *value = text ? text : "";
+    g_string_append_len(strings, value, (gssize)strlen(value) + 1);
+}
+
+static void index_trigrams(IndexBuilder *builder, guint32 id, const char *folded) {
+    gsize length = strlen(folded);
+    for (gsize i = 0; i + 3 <= length; i++) {
+        const guchar *p = (const guchar*)folded + i;
+        if (p[0] == FIELD_SEPARATOR || p[1] == FIELD_SEPARATOR || p[2] == FIELD_SEPARATOR) continue;
+
+        gpointer key = GUINT_TO_POINTER(TRIGRAM(p));
+        GArray *ids = g_hash_table_lookup(builder->postings, key);
+        if (!ids) {
+            ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+            g_hash_table_insert(builder->postings, key, ids);
+        }
+        // Entries are added in order: a repeat can only be the last id
+        if (ids->len == 0 || g_array_index(ids, guint32, ids->len - 1) != id) {
+            g_array_append_val(ids, id);
+        }
+    }
+}
+
+static void builder_add(IndexBuilder *builder, guint32 mediatype, const char *title, const char *artist,
+                        const char *album, const char *album_artist, const char *subtitle,
+                        const char *ipod_path) {
+    // Databases too old to store a media type only hold audio
+    if (mediatype == 0) mediatype = ITDB_MEDIATYPE_AUDIO;
+    SearchEntryRecord entry = { mediatype, (guint32)builder->strings->len, 0 };
+    append_string(builder->strings, title);
+    append_string(builder->strings, artist);
+    append_string(builder->strings, album);
+    append_string(builder->strings, ipod_path);
+
+    const char *fields[] = { title, artist, album, album_artist, subtitle };
+    GString *joined = g_string_new(NULL);
+    for (gsize i = 0; i < G_N_ELEMENTS(fields); i++) {
+        if (!fields[i] || !*fields[i]) continue;
+        char *folded = fold_text(fields[i]);
+        if (joined->len > 0) g_string_append_c(joined, FIELD_SEPARATOR);
+        g_string_append(joined, folded);
+        g_free(folded);
+    }
+
+    entry.folded = (guint32)builder->strings->len;
+    append_string(builder->strings, joined->str);
+    index_trigrams(builder, builder->entries->len, joined->str);
+    g_array_append_val(builder->entries, entry);
+    g_string_free(joined, TRUE);
+}
+
+static gboolean add_reader_track(const RbIpodDbTrackRecord *record, gpointer user_data) {
+    char *fields[] = {
+        rb_ipod_dbreader_track_string(record, RB_IPOD_MHOD_TITLE),
+        rb_ipod_dbreader_track_string(record, RB_IPOD_MHOD_ARTIST),
+        rb_ipod_dbreader_track_string(record, RB_IPOD_MHOD_ALBUM),
+        rb_ipod_dbreader_track_string(record, RB_IPOD_MHOD_ALBUMARTIST),
+        rb_ipod_dbreader_track_string(record, RB_IPOD_MHOD_SUBTITLE),
+        rb_ipod_dbreader_track_string(record, RB_IPOD_MHOD_PATH),
+    };
+    builder_add(user_data, record->mediatype, fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]);
+    for (gsize i = 0; i < G_N_ELEMENTS(fields); i++) g_free(fields[i]);
+    return TRUE;
+}
+
+static gint compare_guint32(gconstpointer a, gconstpointer b) {
+    guint32 x = *(const guint32*)a;
+    guint32 y = *(const guint32*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static GByteArray* serialize_index(IndexBuilder *builder, gint64 db_size, gint64 db_mtime_ns) {
+    // Keeps every section 4-byte aligned
+    while (builder->strings->len % 4 != 0) g_string_append_c(builder->strings, '\0');
+
+    GArray *keys = g_array_sized_new(FALSE, FALSE, sizeof(guint32), g_hash_table_size(builder->postings));
+    GHashTableIter iter;
+    gpointer key, value;
+    guint32 posting_count = 0;
+    g_hash_table_iter_init(&iter, builder->postings);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        guint32 trigram = GPOINTER_TO_UINT(key);
+        g_array_append_val(keys, trigram);
+        posting_count += ((GArray*)value)->len;
+    }
+    g_array_sort(keys, compare_guint32);
+
+    SearchIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SEARCH_INDEX_VERSION;
+    header.bom = SEARCH_INDEX_BOM;
+    header.db_size = db_size;
+    header.db_mtime_ns = db_mtime_ns;
+    header.entry_count = builder->entries->len;
+    header.trigram_count = keys->len;
+    header.posting_count = posting_count;
+    header.strings_size = (guint32)builder->strings->len;
+
+    GByteArray *out = g_byte_array_sized_new(sizeof(header) + builder->entries->len * sizeof(SearchEntryRecord) +
+                                              keys->len * sizeof(TrigramRecord) + posting_count * 4 +
+                                              builder->strings->len);
+    g_byte_array_append(out, (const guint8*)&header, sizeof(header));
+    g_byte_array_append(out, (const guint8*)builder->entries->data,
+                        builder->entries->len * sizeof(SearchEntryRecord));
+
+    guint32 first = 0;
+    for (guint i = 0; i < keys->len; i++) {
+        guint32 trigram = g_array_index(keys, guint32, i);
+        GArray *ids = g_hash_table_lookup(builder->postings, GUINT_TO_POINTER(trigram));
+        TrigramRecord record = { trigram, first, ids->len };
+        g_byte_array_append(out, (const guint8*)&record, sizeof(record));
+        first += ids->len;
+    }
+    for (guint i = 0; i < keys->len; i++) {
+        GArray *ids = g_hash_table_lookup(builder->postings, GUINT_TO_POINTER(g_array_index(keys, guint32, i)));
+        g_byte_array_append(out, (const guint8*)ids->data, ids->len * sizeof(guint32));
+    }
+    g_byte_array_append(out, (const guint8*)builder->strings->str, builder->strings->len);
+
+    g_array_free(keys, TRUE);
+    return out;
+}
+
+static GByteArray* build_index(const char *mount_point, gint64 db_size, gint64 db_mtime_ns) {
+    IndexBuilder builder;
+    builder.entries = g_array_new(FALSE, FALSE, sizeof(SearchEntryRecord));
+    builder.strings = g_string_new(NULL);
+    builder.postings = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_posting_list);
+    gboolean loaded = TRUE;
+
+    RbIpodDbReader *reader = rb_ipod_dbreader_open(mount_point);
+    if (reader) {
+        rb_ipod_dbreader_foreach_track(reader, add_reader_track, &builder);
+        rb_ipod_dbreader_close(reader);
+    } else {
+        // Compressed or unreadable directly: one full parse, then cached
+        Itdb_iTunesDB *itdb = itdb_parse(mount_point, NULL);
+        if (itdb) {
+            for (GList *item = itdb->tracks; item; item = item->next) {
+                Itdb_Track *track = (Itdb_Track*)item->data;
+                builder_add(&builder, track->mediatype, track->title, track->artist, track->album,
+                            track->albumartist, track->subtitle, track->ipod_path);
+            }
+            itdb_free(itdb);
+        } else {
+            log_message(LOG_ERROR, "Cannot read the iPod database at %s", mount_point);
+            loaded = FALSE;
+        }
+    }
+
+    GByteArray *out = loaded ? serialize_index(&builder, db_size, db_mtime_ns) : NULL;
+    g_array_free(builder.entries, TRUE);
+    g_string_free(builder.strings, TRUE);
+    g_hash_table_destroy(builder.postings);
+    return out;
+}
+
+// =============================================================================
+// OPEN / QUERY
+// =============================================================================
+
+// Points the section pointers into data after checking they fit
+static gboolean attach_sections(RbIpodSearchIndex *index, gint64 db_size, gint64 db_mtime_ns) {
+    if (index->size < sizeof(SearchIndexHeader)) return FALSE;
+
+    const SearchIndexHeader *header = (const SearchIndexHeader*)index->data;
+    if (memcmp(header->magic, SEARCH_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SEARCH_INDEX_VERSION || header->bom != SEARCH_INDEX_BOM) {
+        return FALSE;
+    }
+    if (header->db_size != db_size || header->db_mtime_ns != db_mtime_ns) {
+        return FALSE;   // Database written since
+    }
+
+    guint64 expected = sizeof(SearchIndexHeader) +
+                       (guint64)header->entry_count * sizeof(SearchEntryRecord) +
+                       (guint64)header->trigram_count * sizeof(TrigramRecord) +
+                       (guint64)header->posting_count * sizeof(guint32) +
+                       header->strings_size;
+    if (expected != index->size) return FALSE;
+    if (header->strings_size > 0 && index->data[index->size - 1] != '\0') return FALSE;
+
+    const guchar *cursor = index->data + sizeof(SearchIndexHeader);
+    index->header = header;
+    index->entries = (const SearchEntryRecord*)cursor;
+    cursor += header->entry_count * sizeof(SearchEntryRecord);
+    index->trigrams = (const TrigramRecord*)cursor;
+    cursor += header->trigram_count * sizeof(TrigramRecord);
+    index->postings = (const guint32*)cursor;
+    cursor += header->posting_count * sizeof(guint32);
+    index->strings = (const char*)cursor;
+    return TRUE;
+}
+
+static RbIpodSearchIndex* map_cache(const char *path, gint64 db_size, gint64 db_mtime_ns) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat cache_stat;
+    if (fstat(fd, &cache_stat) != 0 || cache_stat.st_size < (off_t)sizeof(SearchIndexHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    gsize size = (gsize)cache_stat.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_message(LOG_WARNING, "Cannot map search index %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    RbIpodSearchIndex *index = g_new0(RbIpodSearchIndex, 1);
+    index->data = map;
+    index->size = size;
+    index->mapped = TRUE;
+    if (!attach_sections(index, db_size, db_mtime_ns)) {
+        log_message(LOG_DEBUG, "Search index %s is stale, rebuilding", path);
+        rb_ipod_search_index_free(index);
+        return NULL;
+    }
+    return index;
+}
+
+RbIpodSearchIndex* rb_ipod_search_index_open(const char *mount_point, const char *cache_path) {
+    if (!mount_point) return NULL;
+
+    gint64 db_size, db_mtime_ns;
+    if (!database_key(mount_point, &db_size, &db_mtime_ns)) {
+        log_message(LOG_ERROR, "No iPod database found under %s", mount_point);
+        return NULL;
+    }
+
+    char *path = cache_path ? g_strdup(cache_path) : default_cache_path(mount_point);
+    RbIpodSearchIndex *index = map_cache(path, db_size, db_mtime_ns);
+    if (index) {
+        log_message(LOG_DEBUG, "Search index mapped from %s (%u entries)", path, index->header->entry_count);
+        g_free(path);
+        return index;
+    }
+
+    GByteArray *built = build_index(mount_point, db_size, db_mtime_ns);
+    if (!built) {
+        g_free(path);
+        return NULL;
+    }
+
+    char *dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0755);
+    g_free(dir);
+
+    // A read-only cache directory only costs the next query a rebuild
+    GError *error = NULL;
+    if (!g_file_set_contents(path, (const gchar*)built->data, built->len, &error)) {
+        log_message(LOG_WARNING, "Failed to write search index %s: %s",
+                   path, error ? error->message : "unknown error");
+        g_clear_error(&error);
+    }
+
+    index = g_new0(RbIpodSearchIndex, 1);
+    index->size = built->len;
+    index->data = g_byte_array_free(built, FALSE);
+    attach_sections(index, db_size, db_mtime_ns);
+    log_message(LOG_INFO, "Search index built: %u entries, %u trigrams -> %s",
+               index->header->entry_count, index->header->trigram_count, path);
+    g_free(path);
+    return index;
+}
+
+void rb_ipod_search_index_free(RbIpodSearchIndex *index) {
+    if (!index) return;
+
+    if (index->mapped) {
+        munmap(index->data, index->size);
+    } else {
+        g_free(index->data);
+    }
+    g_free(index);
+}
+
+gboolean rb_ipod_search_index_from_cache(const RbIpodSearchIndex *index) {
+    return index && index->mapped;
+}
+
+guint rb_ipod_search_index_size(const RbIpodSearchIndex *index) {
+    return index ? index->header->entry_count : 0;
+}
+
+static const TrigramRecord* find_trigram(const RbIpodSearchIndex *index, guint32 trigram) {
+    guint32 low = 0;
+    guint32 high = index->header->trigram_count;
+    while (low < high) {
+        guint32 middle = low + (high - low) / 2;
+        const TrigramRecord *record = &index->trigrams[middle];
+        if (record->trigram == trigram) {
+            if ((guint64)record->first + record->count > index->header->posting_count) return NULL;
+            return record;
+        }
+        if (record->trigram < trigram) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NULL;
+}
+
+static const char* entry_string(const RbIpodSearchIndex *index, guint32 offset) {
+    return offset < index->header->strings_size ? index->strings + offset : "";
+}
+
+guint rb_ipod_search_index_query(const RbIpodSearchIndex *index, const char *query,
+                                 guint32 mediatype, guint limit, GArray *hits) {
+    if (!index || !hits) return 0;
+
+    char *folded = fold_text(query);
+    gchar **terms = g_strsplit_set(folded, " \t\r\n", -1);
+    g_free(folded);
+
+    // Candidates come from the rarest trigram of all the terms; a trigram
+    // missing from the index means nothing can match
+    const guint32 *candidates = NULL;
+    guint32 candidate_count = 0;
+    gboolean impossible = FALSE;
+    for (gchar **term = terms; *term && !impossible; term++) {
+        gsize length = strlen(*term);
+        for (gsize i = 0; i + 3 <= length; i++) {
+            const TrigramRecord *record = find_trigram(index, TRIGRAM((const guchar*)*term + i));
+            if (!record) {
+                impossible = TRUE;
+                break;
+            }
+            if (!candidates || record->count < candidate_count) {
+                candidates = index->postings + record->first;
+                candidate_count = record->count;
+            }
+        }
+    }
+
+    guint found = 0;
+    guint32 total = candidates ? candidate_count : index->header->entry_count;
+    for (guint32 i = 0; i < total && !impossible; i++) {
+        guint32 id = candidates ? candidates[i] : i;
+        if (id >= index->header->entry_count) continue;
+
+        const SearchEntryRecord *entry = &index->entries[id];
+        if (mediatype != 0 && entry->mediatype != mediatype) continue;
+
+        // Trigrams only narrow the set: every term is checked in full
+        const char *text = entry_string(index, entry->folded);
+        gboolean match = TRUE;
+        for (gchar **term = terms; *term && match; term++) {
+            if (**term && !strstr(text, *term)) match = FALSE;
+        }
+        if (!match) continue;
+
+        g_array_append_val(hits, id);
+        if (++found == limit) break;
+    }
+
+    g_strfreev(terms);
+    return found;
+}
+
+gboolean rb_ipod_search_index_entry(const RbIpodSearchIndex *index, guint32 id, RbIpodSearchEntry *entry) {
+    if (!index || !entry || id >= index->header->entry_count) return FALSE;
+
+    const SearchEntryRecord *record = &index->entries[id];
+    entry->mediatype = record->mediatype;
+    guint32 offset = record->display;
+    const char **fields[] = { &entry->title, &entry->artist, &entry->album, &entry->ipod_path };
+    for (gsize i = 0; i < G_N_ELEMENTS(fields); i++) {
+        *fields[i] = entry_string(index, offset);
+        offset += (guint32)strlen(*fields[i]) + 1;
+    }
+    return TRUE;
+}
@@ -0,0 +1,221 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "../include/rbipod-thumbcache.h"
+#include "../include/rbipod-logging.h"
+
+// =============================================================================
+// HOST THUMBNAIL CACHE
+// =============================================================================
+
+// File layout (host byte order, the cache never leaves the machine):
+//   magic[8] width height rowstride n_channels has_alpha reserved   (u32 each)
+//   pixels   rowstride * height bytes
+#define THUMBNAIL_MAGIC "RBTHUMB1"
+#define THUMBNAIL_HEADER_SIZE 32
+#define THUMBNAIL_EXTENSION ".thumb"
+
+typedef struct {
+    char magic[8];
+    guint32 width;
+    guint32 height;
+    guint32 rowstride;
+    guint32 n_channels;
+    guint32 has_alpha;
+    guint32 reserved;
+} ThumbnailHeader;
+
+struct _RbIpodThumbnailCache {
+    char *dir;
+    gint64 max_bytes;
+    gint stored;               // Files written during this run
+};
+
+RbIpodThumbnailCache* rb_ipod_thumbnail_cache_open(const char *base_dir, const char *format_key) {
+    if (!format_key) return NULL;
+
+    char *dir = base_dir ? g_build_filename(base_dir, format_key, NULL)
+                         : g_build_filename(g_get_user_cache_dir(), PROGRAM_NAME,
+                                            THUMBNAIL_CACHE_DIRNAME, format_key, NULL);
+    if (g_mkdir_with_parents(dir, 0755) != 0) {
+        log_message(LOG_WARNING, "Thumbnail cache disabled, cannot create %s: %s", dir, strerror(errno));
+        g_free(dir);
+        return NULL;
+    }
+
+    RbIpodThumbnailCache *cache = g_malloc0(sizeof(RbIpodThumbnailCache));
+    cache->dir = dir;
+    cache->max_bytes = THUMBNAIL_CACHE_MAX_BYTES;
+    log_message(LOG_DEBUG, "Thumbnail cache: %s", dir);
+    return cache;
+}
+
+static char* entry_path(RbIpodThumbnailCache *cache, guint64 hash, gsize source_size) {
+    char name[64];
+    snprintf(name, sizeof(name), "%016" G_GINT64_MODIFIER "x-%" G_GSIZE_MODIFIER "x" THUMBNAIL_EXTENSION,
+             hash, source_size);
+    return g_build_filename(cache->dir, name, NULL);
+}
+
+static void free_pixels(guchar *pixels, gpointer data) {
+    (void)pixels;
+    g_free(data);
+}
+
+GdkPixbuf* rb_ipod_thumbnail_cache_lookup(RbIpodThumbnailCache *cache, guint64 hash, gsize source_size) {
+    if (!cache) return NULL;
+
+    char *path = entry_path(cache, hash, source_size);
+    gchar *contents = NULL;
+    gsize length = 0;
+    if (!g_file_get_contents(path, &contents, &length, NULL)) {
+        g_free(path);
+        return NULL;
+    }
+
+    ThumbnailHeader header;
+    gboolean valid = length >= THUMBNAIL_HEADER_SIZE;
+    if (valid) {
+        memcpy(&header, contents, sizeof(header));
+        valid = memcmp(header.magic, THUMBNAIL_MAGIC, 8) == 0 &&
+                header.width > 0 && header.height > 0 &&
+                (header.n_channels == 3 || header.n_channels == 4) &&
+                header.rowstride >= header.width * header.n_channels &&
+                length == THUMBNAIL_HEADER_SIZE + (gsize)header.rowstride * header.height;
+    }
+    if (!valid) {
+        log_message(LOG_WARNING, "Discarding corrupt thumbnail cache entry: %s", path);
+        g_unlink(path);
+        g_free(contents);
+        g_free(path);
+        return NULL;
+    }
+
+    // Recently used entries survive eviction
+    utime(path, NULL);
+    g_free(path);
+
+    return gdk_pixbuf_new_from_data((const guchar*)contents + THUMBNAIL_HEADER_SIZE, GDK_COLORSPACE_RGB,
+                                    header.has_alpha != 0, 8, header.width, header.height,
+                                    header.rowstride, free_pixels, contents);
+}
+
+void rb_ipod_thumbnail_cache_store(RbIpodThumbnailCache *cache, guint64 hash, gsize source_size,
+                                   GdkPixbuf *pixbuf) {
+    if (!cache || !pixbuf) return;
+    if (gdk_pixbuf_get_bits_per_sample(pixbuf) != 8 || gdk_pixbuf_get_colorspace(pixbuf) != GDK_COLORSPACE_RGB) {
+        return;
+    }
+
+    ThumbnailHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, THUMBNAIL_MAGIC, 8);
+    header.width = gdk_pixbuf_get_width(pixbuf);
+    header.height = gdk_pixbuf_get_height(pixbuf);
+    header.rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    header.n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+    header.has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+
+    // The last row of a pixbuf may be shorter than rowstride
+    gsize pixel_bytes = (gsize)header.rowstride * header.height;
+    gsize last_row = (gsize)header.width * header.n_channels;
+    gchar *contents = g_malloc0(THUMBNAIL_HEADER_SIZE + pixel_bytes);
+    memcpy(contents, &header, sizeof(header));
+    memcpy(contents + THUMBNAIL_HEADER_SIZE, gdk_pixbuf_read_pixels(pixbuf),
+           pixel_bytes - header.rowstride + last_row);
+
+    // g_file_set_contents() writes a temporary file and renames it
+    char *path = entry_path(cache, hash, source_size);
+    GError *error = NULL;
+    if (g_file_set_contents(path, contents, THUMBNAIL_HEADER_SIZE + pixel_bytes, &error)) {
+        g_atomic_int_inc(&cache->stored);
+    } else {
+        log_message(LOG_WARNING, "Failed to store thumbnail %s: %s", path, error ? error->message : "unknown error");
+        g_clear_error(&error);
+    }
+    g_free(path);
+    g_free(contents);
+}
+
+void rb_ipod_thumbnail_cache_set_max_bytes(RbIpodThumbnailCache *cache, gint64 max_bytes) {
+    if (cache) cache->max_bytes = max_bytes;
+}
+
+typedef struct {
+    char *path;
+    gint64 size;
+    gint64 mtime_ns;
+} CachedFile;
+
+static gint compare_oldest_first(gconstpointer a, gconstpointer b) {
+    const CachedFile *fa = *(CachedFile* const*)a;
+    const CachedFile *fb = *(CachedFile* const*)b;
+    return (fa->mtime_ns > fb->mtime_ns) - (fa->mtime_ns < fb->mtime_ns);
+}
+
+static void free_cached_file(gpointer data) {
+    CachedFile *file = data;
+    g_free(file->path);
+    g_free(file);
+}
+
+// Least recently used first (lookups refresh mtime) down to 90% of the limit
+static void evict(RbIpodThumbnailCache *cache) {
+    GDir *dir = g_dir_open(cache->dir, 0, NULL);
+    if (!dir) return;
+
+    GPtrArray *files = g_ptr_array_new_with_free_func(free_cached_file);
+    gint64 total = 0;
+    const char *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (!g_str_has_suffix(name, THUMBNAIL_EXTENSION)) continue;
+
+        CachedFile *file = g_malloc0(sizeof(CachedFile));
+        file->path = g_build_filename(cache->dir, name, NULL);
+        struct stat st;
+        if (stat(file->path, &st) != 0) {
+            free_cached_file(file);
+            continue;
+        }
+        file->size = st.st_size;
+        file->mtime_ns = (gint64)st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+        total += file->size;
+        g_ptr_array_add(files, file);
+    }
+    g_dir_close(dir);
+
+    if (total > cache->max_bytes) {
+        g_ptr_array_sort(files, compare_oldest_first);
+        gint64 target = cache->max_bytes / 10 * 9;
+        guint removed = 0;
+        for (guint i = 0; i < files->len && total > target; i++) {
+            CachedFile *file = g_ptr_array_index(files, i);
+            if (g_unlink(file->path) == 0) {
+                total -= file->size;
+                removed++;
+            }
+        }
+        log_message(LOG_INFO, "Thumbnail cache: evicted %u entries, %.1f MB kept", removed, total / (1024.0 * 1024.0));
+    }
+    g_ptr_array_free(files, TRUE);
+}
+
+void rb_ipod_thumbnail_cache_free(RbIpodThumbnailCache *cache) {
+    if (!cache) return;
+
+    if (cache->stored > 0) {
+        evict(cache);
+    }
+    g_free(cache->dir);
+    g_free(cache);
+}
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <gpod/itdb.h>
+
+#include "../include/rbipod-trackindex.h"
+#include "../include/rbipod-index.h"
+#include "../include/rbipod-logging.h"
+
+// =============================================================================
+// IN-MEMORY TRACK INDICES (LOADED ITUNESDB)
+// =============================================================================
+
+struct _RbIpodTrackIndex {
+    GHashTable *by_path;        // normalized ipod_path -> Itdb_Track*
+    GHashTable *by_dbid;        // guint64* dbid -> Itdb_Track*
+    GHashTable *by_tags;        // artist/album/title/track_nr key -> Itdb_Track*
+    GHashTable *by_episode;     // podcast grouping (episode id) -> Itdb_Track*
+    GHashTable *memberships;    // Itdb_Track* -> GList* of Itdb_Playlist*
+    GHashTable *pending_dbids;  // Tracks added with dbid 0 (set by itdb_write)
+    GHashTable *mediatypes;     // mediatype -> track count
+    guint track_count;
+};
+
+static char* build_tags_key(const char *artist, const char *album, const char *title, gint track_nr) {
+    return g_strdup_printf("%s\x1f%s\x1f%s\x1f%d",
+                           artist ? artist : "", album ? album : "", title ? title : "", track_nr);
+}
+
+static gboolean is_episode(const Itdb_Track *track) {
+    return (track->mediatype & ITDB_MEDIATYPE_PODCAST) && track->grouping && *track->grouping;
+}
+
+static void free_membership(gpointer data) {
+    g_list_free(data);
+}
+
+// Removes key only while it still resolves to track (a later track with
+// the same key may have replaced it)
+static void remove_if_owner(GHashTable *table, gconstpointer key, Itdb_Track *track) {
+    if (g_hash_table_lookup(table, key) == track) {
+        g_hash_table_remove(table, key);
+    }
+}
+
+static void index_dbid(RbIpodTrackIndex *index, Itdb_Track *track) {
+    guint64 *key = g_malloc(sizeof(guint64));
+    *key = track->dbid;
+    g_hash_table_replace(index->by_dbid, key, track);
+}
+
+static void adjust_mediatype(RbIpodTrackIndex *index, guint32 mediatype, gint delta) {
+    gpointer key = GUINT_TO_POINTER(mediatype);
+    gint count = GPOINTER_TO_INT(g_hash_table_lookup(index->mediatypes, key)) + delta;
+    if (count > 0) {
+        g_hash_table_replace(index->mediatypes, key, GINT_TO_POINTER(count));
+    } else {
+        g_hash_table_remove(index->mediatypes, key);
+    }
+}
+
+RbIpodTrackIndex* rb_ipod_track_index_new(Itdb_iTunesDB *itdb) {
+    if (!itdb) return NULL;
+
+    RbIpodTrackIndex *index = g_malloc0(sizeof(RbIpodTrackIndex));
+    index->by_path = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    index->by_dbid = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    index->by_tags = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    index->by_episode = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    index->memberships = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_membership);
+    index->pending_dbids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    index->mediatypes = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    for (GList *item = itdb->tracks; item; item = item->next) {
+        rb_ipod_track_index_add_track(index, (Itdb_Track*)item->data);
+    }
+    for (GList *pl_item = itdb->playlists; pl_item; pl_item = pl_item->next) {
+        Itdb_Playlist *playlist = (Itdb_Playlist*)pl_item->data;
+        for (GList *member = playlist->members; member; member = member->next) {
+            rb_ipod_track_index_add_member(index, playlist, (Itdb_Track*)member->data);
+        }
+    }
+
+    log_message(LOG_DEBUG, "Track index built: %u tracks, %u with playlists",
+               index->track_count, g_hash_table_size(index->memberships));
+    return index;
+}
+
+void rb_ipod_track_index_free(RbIpodTrackIndex *index) {
+    if (!index) return;
+
+    g_hash_table_destroy(index->by_path);
+    g_hash_table_destroy(index->by_dbid);
+    g_hash_table_destroy(index->by_tags);
+    g_hash_table_destroy(index->by_episode);
+    g_hash_table_destroy(index->memberships);
+    g_hash_table_destroy(index->pending_dbids);
+    g_hash_table_destroy(index->mediatypes);
+    g_free(index);
+}
+
+void rb_ipod_track_index_add_track(RbIpodTrackIndex *index, Itdb_Track *track) {
+    if (!index || !track) return;
+
+    if (track->ipod_path) {
+        g_hash_table_replace(index->by_path, rb_ipod_normalize_ipod_path(track->ipod_path), track);
+    }
+    if (track->dbid != 0) {
+        index_dbid(index, track);
+    } else {
+        g_hash_table_add(index->pending_dbids, track);
+    }
+    g_hash_table_replace(index->by_tags,
+                         build_tags_key(track->artist, track->album, track->title, track->track_nr), track);
+    if (is_episode(track)) {
+        g_hash_table_replace(index->by_episode, g_strdup(track->grouping), track);
+    }
+
+    adjust_mediatype(index, track->mediatype, 1);
+    index->track_count++;
+}
+
+void rb_ipod_track_index_remove_track(RbIpodTrackIndex *index, Itdb_Track *track) {
+    if (!index || !track) return;
+
+    if (track->ipod_path) {
+        char *path_key = rb_ipod_normalize_ipod_path(track->ipod_path);
+        remove_if_owner(index->by_path, path_key, track);
+        g_free(path_key);
+    }
+    if (!g_hash_table_remove(index->pending_dbids, track)) {
+        remove_if_owner(index->by_dbid, &track->dbid, track);
+    }
+    char *tags_key = build_tags_key(track->artist, track->album, track->title, track->track_nr);
+    remove_if_owner(index->by_tags, tags_key, track);
+    g_free(tags_key);
+    if (is_episode(track)) {
+        remove_if_owner(index->by_episode, track->grouping, track);
+    }
+    g_hash_table_remove(index->memberships, track);
+
+    adjust_mediatype(index, track->mediatype, -1);
+    if (index->track_count > 0) index->track_count--;
+}
+
+void rb_ipod_track_index_add_member(RbIpodTrackIndex *index, Itdb_Playlist *playlist, Itdb_Track *track) {
+    if (!index || !playlist || !track) return;
+
+    GList *playlists = g_hash_table_lookup(index->memberships, track);
+    if (g_list_find(playlists, playlist)) return;
+
+    // The list head changes: steal the old one so it is not freed
+    g_hash_table_steal(index->memberships, track);
+    g_hash_table_insert(index->memberships, track, g_list_prepend(playlists, playlist));
+}
+
+void rb_ipod_track_index_remove_playlist(RbIpodTrackIndex *index, Itdb_Playlist *playlist) {
+    if (!index || !playlist) return;
+
+    for (GList *member = playlist->members; member; member = member->next) {
+        Itdb_Track *track = (Itdb_Track*)member->data;
+        GList *playlists = g_hash_table_lookup(index->memberships, track);
+        if (!playlists) continue;
+
+        g_hash_table_steal(index->memberships, track);
+        playlists = g_list_remove(playlists, playlist);
+        if (playlists) {
+            g_hash_table_insert(index->memberships, track, playlists);
+        }
+    }
+}
+
+void rb_ipod_track_index_commit(RbIpodTrackIndex *index) {
+    if (!index || g_hash_table_size(index->pending_dbids) == 0) return;
+
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, index->pending_dbids);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        Itdb_Track *track = key;
+        if (track->dbid != 0) {
+            index_dbid(index, track);
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+}
+
+Itdb_Track* rb_ipod_track_index_lookup_path(RbIpodTrackIndex *index, const char *ipod_path) {
+    if (!index || !ipod_path) return NULL;
+
+    char *key = rb_ipod_normalize_ipod_path(ipod_path);
+    Itdb_Track *track = g_hash_table_lookup(index->by_path, key);
+    g_free(key);
+    return track;
+}
+
+Itdb_Track* rb_ipod_track_index_lookup_dbid(RbIpodTrackIndex *index, guint64 dbid) {
+    if (!index || dbid == 0) return NULL;
+
+    return g_hash_table_lookup(index->by_dbid, &dbid);
+}
+
+Itdb_Track* rb_ipod_track_index_lookup_tags(RbIpodTrackIndex *index, const char *artist,
+                                            const char *album, const char *title, gint track_nr) {
+    if (!index) return NULL;
+
+    char *key = build_tags_key(artist, album, title, track_nr);
+    Itdb_Track *track = g_hash_table_lookup(index->by_tags, key);
+    g_free(key);
+    return track;
+}
+
+Itdb_Track* rb_ipod_track_index_lookup_episode(RbIpodTrackIndex *index, const char *episode_id) {
+    if (!index || !episode_id || !*episode_id) return NULL;
+
+    return g_hash_table_lookup(index->by_episode, episode_id);
+}
+
+GList* rb_ipod_track_index_playlists(RbIpodTrackIndex *index, Itdb_Track *track) {
+    if (!index || !track) return NULL;
+
+    return g_hash_table_lookup(index->memberships, track);
+}
+
+guint rb_ipod_track_index_count(RbIpodTrackIndex *index) {
+    return index ? index->track_count : 0;
+}
+
+guint rb_ipod_track_index_count_mediatype(RbIpodTrackIndex *index, guint32 mediatype) {
+    if (!index) return 0;
+
+    return GPOINTER_TO_UINT(g_hash_table_lookup(index->mediatypes, GUINT_TO_POINTER(mediatype)));
+}
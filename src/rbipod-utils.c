@@ -26,6 +26,9 @@ gboolean init_application(const char *mount_point) {
     // Initialize mutex
     pthread_mutex_init(&g_sync_ctx.log_mutex, NULL);
     
+    g_sync_ctx.checkpoint_tracks = PIPELINE_CHECKPOINT_TRACKS;
+    g_sync_ctx.checkpoint_seconds = PIPELINE_CHECKPOINT_SECONDS;
+    
     // Initialize logging
     if (!init_logging(LOG_FILE)) {
         fprintf(stderr, "Warning: Could not initialize logging\n");
@@ -56,6 +59,79 @@ void cleanup_application(void) {
     pthread_mutex_destroy(&g_sync_ctx.log_mutex);
 }
 
+// =============================================================================
+// CONTENT HASHING
+// =============================================================================
+
+guint64 rb_ipod_hash_bytes(const void *data, gsize length) {
+    // FNV-1a over 64-bit words (memcpy keeps unaligned input safe), with a
+    // final avalanche so inputs differing in a single byte spread out
+    const guchar *p = data;
+    guint64 hash = 0xcbf29ce484222325ULL ^ length;
+
+    while (length >= 8) {
+        guint64 word;
+        memcpy(&word, p, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+        p += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        hash = (hash ^ *p++) * 0x100000001b3ULL;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// =============================================================================
+// MEMORY REPORTING
+// =============================================================================
+
+// Value in KB of a "Field:   1234 kB" line of /proc/self/status, -1 if absent
+static gint64 read_status_kb(const char *field) {
+    FILE *status = fopen("/proc/self/status", "r");
+    if (!status) return -1;
+
+    gint64 value = -1;
+    size_t field_len = strlen(field);
+    char line[256];
+    while (fgets(line, sizeof(line), status)) {
+        if (strncmp(line, field, field_len) == 0 && line[field_len] == ':') {
+            value = g_ascii_strtoll(line + field_len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return value;
+}
+
+gint64 rb_ipod_get_peak_rss_kb(void) {
+    return read_status_kb("VmHWM");
+}
+
+void rb_ipod_phase_begin(void) {
+    // "5" resets VmHWM to the current RSS (Linux 4.0+); without it the
+    // reported peaks are cumulative since process start
+    FILE *clear_refs = fopen("/proc/self/clear_refs", "w");
+    if (clear_refs) {
+        fputs("5", clear_refs);
+        fclose(clear_refs);
+    }
+}
+
+void rb_ipod_phase_end(RbIpodPhase phase) {
+    gint64 peak = rb_ipod_get_peak_rss_kb();
+    if (peak > 0) {
+        g_sync_ctx.stats.peak_rss_kb[phase] = peak;
+        log_message(LOG_DEBUG, "Peak RSS during phase %d: %" G_GINT64_FORMAT " kB", phase, peak);
+    }
+    rb_ipod_phase_begin();
+}
+
 void print_version(void) {
     printf("%s version %s\n", PROGRAM_NAME, PROGRAM_VERSION);
     printf("Built with libgpod and GLib support\n");
@@ -72,13 +148,27 @@ void print_usage(const char *program_name) {
     
     printf("SYNC COMMANDS:\n");
     printf("  sync <mount_point> <directory>             Synchronize directory with iPod\n");
-    printf("  sync-file <mount_point> <file> [--mediatype type]   Synchronize single file with iPod\n");
+    printf("  sync-file <mount_point> <file>... [--mediatype type]   Synchronize one or more files with iPod\n");
     printf("  sync-folder-filtered <mount_point> <folder> <mediatype>  Synchronize folder with specific media type\n");
     printf("  list <mount_point>                         List all tracks on iPod\n");
     printf("  info <mount_point>                         Show detailed iPod information\n");
+    printf("  search <mount_point> <query...>            Find tracks by title, artist, album or podcast\n");
     printf("  reset <mount_point> <mediatype>           Remove all tracks of specified media type\n");
     printf("  reset <mount_point> all                   Remove ALL tracks and clean iPod completely\n\n");
     
+    printf("SYNC OPTIONS:\n");
+    printf("  --jobs N, -j N                 Metadata/artwork worker threads (default: one per CPU)\n");
+    printf("  --external-tools               Fall back to mediainfo/ffprobe/ffmpeg when native probing fails\n");
+    printf("  --no-metadata-cache            Probe every file again instead of reusing ~/.cache results\n");
+    printf("  --checkpoint-tracks N          Save the database in background every N tracks (default: %d, 0 = off)\n",
+           PIPELINE_CHECKPOINT_TRACKS);
+    printf("  --checkpoint-seconds N         ... or every N seconds (default: %d, 0 = off)\n\n",
+           PIPELINE_CHECKPOINT_SECONDS);
+    
+    printf("SEARCH OPTIONS:\n");
+    printf("  --mediatype type               Only tracks of this media type\n");
+    printf("  --limit N                      Results shown (default: %d, 0 = all)\n\n", SEARCH_DEFAULT_LIMIT);
+    
     printf("OTHER COMMANDS:\n");
     printf("  version                        Show version information\n");
     printf("  help                          Show this help message\n\n");
@@ -93,9 +183,11 @@ void print_usage(const char *program_name) {
     printf("  %s sync /media/ipod /home/user/Music                     # Sync music directory\n", program_name);
     printf("  %s sync-file /media/ipod /home/user/podcast.mp3 --mediatype podcast  # Sync single file as podcast\n", program_name);
     printf("  %s sync-folder-filtered /media/ipod /home/user/Podcasts podcast      # Sync folder as podcasts\n", program_name);
+    printf("  %s sync /media/ipod /home/user/Music --jobs 8            # Sync with 8 probe workers\n", program_name);
     printf("  %s sync-folder-filtered /media/ipod /home/user/Audiobooks audiobook  # Sync folder as audiobooks\n", program_name);
     printf("  %s list /media/ipod                                      # List tracks\n", program_name);
     printf("  %s info /media/ipod                                      # Show device info\n", program_name);
+    printf("  %s search /media/ipod radiohead --mediatype audio        # Find tracks\n", program_name);
     printf("  %s reset /media/ipod podcast                             # Remove all podcasts\n", program_name);
     printf("  %s reset /media/ipod all                                 # Clean iPod completely\n\n", program_name);
     
@@ -0,0 +1,317 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "../include/rbipod-walker.h"
+#include "../include/rbipod-covers.h"
+#include "../include/rbipod-logging.h"
+#include "../include/rbipod-utils.h"
+
+// =============================================================================
+// SOURCE TREE WALKER
+// =============================================================================
+
+// Shared state between walker threads. Directories are the unit of work:
+// each thread lists one directory, stats only the files it will keep and
+// pushes subdirectories back on the queue for whichever thread is idle.
+typedef struct {
+    GMutex mutex;
+    GCond cond;
+    GQueue *pending;        // char* directory paths not listed yet
+    guint active;           // directories currently being listed
+    GHashTable *visited;    // "dev:ino" of directories already queued
+    RbIpodManifest *manifest;
+    gint aborted;           // Atomic: read while listing, outside the mutex
+} WalkerState;
+
+RbIpodExtClass rb_ipod_classify_extension(const char *filename) {
+    if (!filename) return RB_IPOD_EXT_UNSUPPORTED;
+
+    const char *ext = strrchr(filename, '.');
+    if (!ext) return RB_IPOD_EXT_UNSUPPORTED;
+    ext++; // Skip the dot
+
+    if (g_ascii_strcasecmp(ext, "mp3") == 0) return RB_IPOD_EXT_MP3;
+    if (g_ascii_strcasecmp(ext, "m4a") == 0) return RB_IPOD_EXT_M4A;
+    if (g_ascii_strcasecmp(ext, "aac") == 0) return RB_IPOD_EXT_AAC;
+    if (g_ascii_strcasecmp(ext, "wav") == 0) return RB_IPOD_EXT_WAV;
+    if (g_ascii_strcasecmp(ext, "aiff") == 0) return RB_IPOD_EXT_AIFF;
+    if (g_ascii_strcasecmp(ext, "m4p") == 0) return RB_IPOD_EXT_M4P;
+    if (g_ascii_strcasecmp(ext, "mp4") == 0) return RB_IPOD_EXT_MP4;
+    return RB_IPOD_EXT_UNSUPPORTED;
+}
+
+static void free_manifest_entry(gpointer data) {
+    RbIpodManifestEntry *entry = data;
+    if (!entry) return;
+    g_free(entry->path);
+    g_free(entry);
+}
+
+static gint compare_manifest_entries(gconstpointer a, gconstpointer b) {
+    const RbIpodManifestEntry *entry_a = *(RbIpodManifestEntry* const*)a;
+    const RbIpodManifestEntry *entry_b = *(RbIpodManifestEntry* const*)b;
+    return strcmp(entry_a->path, entry_b->path);
+}
+
+// Returns TRUE the first time a directory is seen (guards against symlink loops)
+static gboolean mark_directory_visited(WalkerState *state, dev_t dev, ino_t ino) {
+    char *key = g_strdup_printf("%llu:%llu", (unsigned long long)dev, (unsigned long long)ino);
+    gboolean first = g_hash_table_add(state->visited, key);
+    return first;
+}
+
+static void note_cover_candidate(const char *name, char **best_name, int *best_rank) {
+    int rank = rb_ipod_folder_cover_rank(name);
+    if (rank > 0 && (*best_rank == 0 || rank < *best_rank)) {
+        g_free(*best_name);
+        *best_name = g_strdup(name);
+        *best_rank = rank;
+    }
+}
+
+static void list_directory(WalkerState *state, const char *dir_path,
+                           GPtrArray *files, GPtrArray *subdirs, guint *errors) {
+    int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        log_message(LOG_WARNING, "Cannot open directory %s: %s", dir_path, strerror(errno));
+        (*errors)++;
+        return;
+    }
+
+    DIR *dir = fdopendir(dir_fd);
+    if (!dir) {
+        log_message(LOG_WARNING, "Cannot read directory %s: %s", dir_path, strerror(errno));
+        close(dir_fd);
+        (*errors)++;
+        return;
+    }
+
+    // Best folder cover candidate among the skipped image files
+    char *cover_name = NULL;
+    int cover_rank = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        if (g_atomic_int_get(&state->aborted) || g_sync_ctx.cancellation_requested) break;
+
+        unsigned char type = entry->d_type;
+        RbIpodExtClass ext_class = RB_IPOD_EXT_UNSUPPORTED;
+
+        // d_type lets us drop unsupported files without touching their inode
+        if (type == DT_REG) {
+            ext_class = rb_ipod_classify_extension(entry->d_name);
+            if (ext_class == RB_IPOD_EXT_UNSUPPORTED) {
+                note_cover_candidate(entry->d_name, &cover_name, &cover_rank);
+                continue;
+            }
+        } else if (type != DT_DIR && type != DT_LNK && type != DT_UNKNOWN) {
+            continue;
+        }
+
+        // Symlinks and filesystems without d_type still need an fstatat
+        struct stat file_stat;
+        if (fstatat(dir_fd, entry->d_name, &file_stat, 0) != 0) {
+            (*errors)++;
+            continue;
+        }
+
+        if (S_ISDIR(file_stat.st_mode)) {
+            g_mutex_lock(&state->mutex);
+            gboolean first = mark_directory_visited(state, file_stat.st_dev, file_stat.st_ino);
+            g_mutex_unlock(&state->mutex);
+            if (first) {
+                g_ptr_array_add(subdirs, g_build_filename(dir_path, entry->d_name, NULL));
+            }
+        } else if (S_ISREG(file_stat.st_mode)) {
+            if (ext_class == RB_IPOD_EXT_UNSUPPORTED) {
+                ext_class = rb_ipod_classify_extension(entry->d_name);
+                if (ext_class == RB_IPOD_EXT_UNSUPPORTED) {
+                    note_cover_candidate(entry->d_name, &cover_name, &cover_rank);
+                    continue;
+                }
+            }
+
+            RbIpodManifestEntry *item = g_malloc0(sizeof(RbIpodManifestEntry));
+            item->path = g_build_filename(dir_path, entry->d_name, NULL);
+            item->size = file_stat.st_size;
+            item->mtime = file_stat.st_mtime;
+            item->inode = file_stat.st_ino;
+            item->device = file_stat.st_dev;
+            item->ext_class = ext_class;
+            g_ptr_array_add(files, item);
+        }
+    }
+
+    closedir(dir); // Also closes dir_fd
+
+    // Files of this directory get its cover without listing it again
+    rb_ipod_folder_covers_record(g_sync_ctx.folder_covers, dir_path, cover_name);
+    g_free(cover_name);
+}
+
+static gpointer walker_thread(gpointer data) {
+    WalkerState *state = data;
+
+    GPtrArray *files = g_ptr_array_new();
+    GPtrArray *subdirs = g_ptr_array_new();
+
+    g_mutex_lock(&state->mutex);
+    for (;;) {
+        while (g_queue_is_empty(state->pending) && state->active > 0 && !g_atomic_int_get(&state->aborted)) {
+            g_cond_wait(&state->cond, &state->mutex);
+        }
+        if (g_atomic_int_get(&state->aborted) || g_queue_is_empty(state->pending)) {
+            // Nothing queued and nobody left to produce more work
+            break;
+        }
+
+        char *dir_path = g_queue_pop_head(state->pending);
+        state->active++;
+        g_mutex_unlock(&state->mutex);
+
+        guint errors = 0;
+        list_directory(state, dir_path, files, subdirs, &errors);
+        g_free(dir_path);
+
+        g_mutex_lock(&state->mutex);
+        for (guint i = 0; i < subdirs->len; i++) {
+            g_queue_push_tail(state->pending, g_ptr_array_index(subdirs, i));
+        }
+        for (guint i = 0; i < files->len; i++) {
+            RbIpodManifestEntry *item = g_ptr_array_index(files, i);
+            state->manifest->total_bytes += item->size;
+            g_ptr_array_add(state->manifest->entries, item);
+        }
+        state->manifest->directories_scanned++;
+        state->manifest->errors += errors;
+        if (g_sync_ctx.cancellation_requested) {
+            g_atomic_int_set(&state->aborted, TRUE);
+        }
+        state->active--;
+        g_cond_broadcast(&state->cond);
+
+        g_ptr_array_set_size(subdirs, 0);
+        g_ptr_array_set_size(files, 0);
+    }
+    g_cond_broadcast(&state->cond);
+    g_mutex_unlock(&state->mutex);
+
+    g_ptr_array_free(subdirs, TRUE);
+    g_ptr_array_free(files, TRUE);
+    return NULL;
+}
+
+RbIpodManifest* rb_ipod_walk_directory(const char *root_path, guint num_threads, RbIpodWalkStatus *status) {
+    if (status) *status = RB_IPOD_WALK_NOT_A_DIRECTORY;
+    if (!root_path) return NULL;
+
+    struct stat root_stat;
+    if (stat(root_path, &root_stat) != 0 || !S_ISDIR(root_stat.st_mode)) {
+        log_message(LOG_ERROR, "Cannot walk %s: not a directory", root_path);
+        return NULL;
+    }
+
+    if (num_threads == 0) {
+        // Listing is I/O-bound (network shares especially), so oversubscribe
+        num_threads = MIN(g_get_num_processors() * 2, WALKER_MAX_THREADS);
+    }
+    num_threads = CLAMP(num_threads, 1, WALKER_MAX_THREADS);
+
+    RbIpodManifest *manifest = g_malloc0(sizeof(RbIpodManifest));
+    manifest->entries = g_ptr_array_new_with_free_func(free_manifest_entry);
+
+    WalkerState state = {0};
+    g_mutex_init(&state.mutex);
+    g_cond_init(&state.cond);
+    state.pending = g_queue_new();
+    state.visited = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    state.manifest = manifest;
+
+    mark_directory_visited(&state, root_stat.st_dev, root_stat.st_ino);
+    g_queue_push_tail(state.pending, g_strdup(root_path));
+
+    log_message(LOG_DEBUG, "Walking %s with %u threads", root_path, num_threads);
+
+    GThread **threads = g_new0(GThread*, num_threads);
+    for (guint i = 0; i < num_threads; i++) {
+        threads[i] = g_thread_new("rbipod-walker", walker_thread, &state);
+    }
+    for (guint i = 0; i < num_threads; i++) {
+        g_thread_join(threads[i]);
+    }
+    g_free(threads);
+
+    gboolean aborted = g_atomic_int_get(&state.aborted);
+    g_queue_free_full(state.pending, g_free);
+    g_hash_table_destroy(state.visited);
+    g_cond_clear(&state.cond);
+    g_mutex_clear(&state.mutex);
+
+    if (aborted) {
+        log_message(LOG_WARNING, "Walk of %s cancelled", root_path);
+        rb_ipod_manifest_free(manifest);
+        if (status) *status = RB_IPOD_WALK_CANCELLED;
+        return NULL;
+    }
+    if (status) *status = RB_IPOD_WALK_OK;
+
+    // Threads finish in arbitrary order; sort so syncs are reproducible
+    g_ptr_array_sort(manifest->entries, compare_manifest_entries);
+
+    log_message(LOG_INFO, "Walked %s: %u files (%" G_GINT64_FORMAT " bytes) in %u directories, %u errors",
+               root_path, manifest->entries->len, manifest->total_bytes,
+               manifest->directories_scanned, manifest->errors);
+    return manifest;
+}
+
+RbIpodManifest* rb_ipod_manifest_new_from_files(const char *const *file_paths, guint num_files) {
+    RbIpodManifest *manifest = g_malloc0(sizeof(RbIpodManifest));
+    manifest->entries = g_ptr_array_new_with_free_func(free_manifest_entry);
+
+    for (guint i = 0; i < num_files; i++) {
+        const char *file_path = file_paths[i];
+
+        struct stat file_stat;
+        if (stat(file_path, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+            log_message(LOG_ERROR, "Cannot access file: %s", file_path);
+            manifest->errors++;
+            continue;
+        }
+
+        RbIpodExtClass ext_class = rb_ipod_classify_extension(file_path);
+        if (ext_class == RB_IPOD_EXT_UNSUPPORTED) {
+            log_message(LOG_ERROR, "Unsupported file type: %s", file_path);
+            manifest->errors++;
+            continue;
+        }
+
+        RbIpodManifestEntry *item = g_malloc0(sizeof(RbIpodManifestEntry));
+        item->path = g_strdup(file_path);
+        item->size = file_stat.st_size;
+        item->mtime = file_stat.st_mtime;
+        item->inode = file_stat.st_ino;
+        item->device = file_stat.st_dev;
+        item->ext_class = ext_class;
+        g_ptr_array_add(manifest->entries, item);
+        manifest->total_bytes += item->size;
+    }
+
+    return manifest;
+}
+
+void rb_ipod_manifest_free(RbIpodManifest *manifest) {
+    if (!manifest) return;
+
+    g_ptr_array_free(manifest->entries, TRUE);
+    g_free(manifest);
+}
@@ -0,0 +1,97 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_helpers.h"
+
+int check(const char *label, gboolean condition) {
+    printf("   %s %s\n", condition ? "✅" : "❌", label);
+    return condition ? 1 : 0;
+}
+
+void remove_tree(const char *path) {
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        GDir *dir = g_dir_open(path, 0, NULL);
+        if (dir) {
+            const char *name;
+            while ((name = g_dir_read_name(dir)) != NULL) {
+                char *child = g_build_filename(path, name, NULL);
+                remove_tree(child);
+                g_free(child);
+            }
+            g_dir_close(dir);
+        }
+        g_rmdir(path);
+    } else {
+        g_unlink(path);
+    }
+}
+
+void put_be32(GByteArray *out, guint32 v) {
+    guint8 b[4] = {v >> 24, v >> 16, v >> 8, v};
+    g_byte_array_append(out, b, 4);
+}
+
+void put_be64(GByteArray *out, guint64 v) {
+    put_be32(out, v >> 32);
+    put_be32(out, (guint32)v);
+}
+
+void put_le16(GByteArray *out, guint16 v) {
+    guint8 b[2] = {v, v >> 8};
+    g_byte_array_append(out, b, 2);
+}
+
+void put_le32(GByteArray *out, guint32 v) {
+    guint8 b[4] = {v, v >> 8, v >> 16, v >> 24};
+    g_byte_array_append(out, b, 4);
+}
+
+void put_zeros(GByteArray *out, gsize count) {
+    gsize start = out->len;
+    g_byte_array_set_size(out, start + count);
+    memset(out->data + start, 0, count);
+}
+
+void put_atom(GByteArray *out, const char *type, GByteArray *body) {
+    put_be32(out, 8 + body->len);
+    g_byte_array_append(out, (const guint8*)type, 4);
+    g_byte_array_append(out, body->data, body->len);
+    g_byte_array_free(body, TRUE);
+}
+
+void put_item(GByteArray *ilst, const char *type, guint32 data_type,
+              const void *payload, gsize length) {
+    GByteArray *data = g_byte_array_new();
+    put_be32(data, data_type);
+    put_zeros(data, 4);
+    g_byte_array_append(data, payload, length);
+    GByteArray *item = g_byte_array_new();
+    put_atom(item, "data", data);
+    put_atom(ilst, type, item);
+}
+
+void put_syncsafe(GByteArray *out, guint32 v) {
+    guint8 b[4] = {(v >> 21) & 0x7F, (v >> 14) & 0x7F, (v >> 7) & 0x7F, v & 0x7F};
+    g_byte_array_append(out, b, 4);
+}
+
+void put_id3_frame(GByteArray *tag, const char *id, const guint8 *body, gsize length) {
+    g_byte_array_append(tag, (const guint8*)id, 4);
+    put_be32(tag, length);
+    put_zeros(tag, 2);
+    g_byte_array_append(tag, body, length);
+}
+
+void put_id3_text(GByteArray *tag, const char *id, const char *text) {
+    GByteArray *body = g_byte_array_new();
+    put_zeros(body, 1);
+    g_byte_array_append(body, (const guint8*)text, strlen(text));
+    put_id3_frame(tag, id, body->data, body->len);
+    g_byte_array_free(body, TRUE);
+}
@@ -0,0 +1,39 @@
+#ifndef RBIPOD_TEST_HELPERS_H
+#define RBIPOD_TEST_HELPERS_H
+
+#include <glib.h>
+
+// =============================================================================
+// SHARED TEST HELPERS
+// =============================================================================
+
+// Prints "✅ label" or "❌ label"; returns 1 when condition holds, for
+// passed += check(...)
+int check(const char *label, gboolean condition);
+
+// Deletes path and, for a directory, everything under it. Symlinks are
+// removed, never followed.
+void remove_tree(const char *path);
+
+// =============================================================================
+// SYNTHETIC MEDIA BUILDERS
+// =============================================================================
+
+// Integer encodings appended to out
+void put_be32(GByteArray *out, guint32 v);
+void put_be64(GByteArray *out, guint64 v);
+void put_le16(GByteArray *out, guint16 v);
+void put_le32(GByteArray *out, guint32 v);
+void put_zeros(GByteArray *out, gsize count);
+
+// MP4 atom wrapping body (freed); ilst item holding a single "data" atom
+void put_atom(GByteArray *out, const char *type, GByteArray *body);
+void put_item(GByteArray *ilst, const char *type, guint32 data_type,
+              const void *payload, gsize length);
+
+// ID3v2.3: 28-bit tag size, frame (id, size, flags, body), ISO-8859-1 text frame
+void put_syncsafe(GByteArray *out, guint32 v);
+void put_id3_frame(GByteArray *tag, const char *id, const guint8 *body, gsize length);
+void put_id3_text(GByteArray *tag, const char *id, const char *text);
+
+#endif // RBIPOD_TEST_HELPERS_H
@@ -0,0 +1,217 @@
+/* Test du journal d'actions groupées sur la base
+ * Plusieurs threads producteurs mettent en file des ajouts de pistes (avec
+ * listes de lecture) pendant que le propriétaire de la base applique le
+ * journal par lots: vérifie qu'aucune action n'est perdue, que les paires
+ * ajout/retrait s'annulent, que les mises à jour ré-indexent la piste, que
+ * le dernier nom l'emporte, que l'ordre d'ajout est conservé et qu'un
+ * ajout retiré du journal quitte aussi l'index de contenu.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-database.h"
+#include "rbipod-actions.h"
+#include "rbipod-trackindex.h"
+#include "rbipod-index.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define SIMULATED_MODEL "MA147"
+#define PRODUCERS 4
+#define TRACKS_PER_PRODUCER 2500
+#define CANCELLED_EVERY 10
+
+static gint producers_done = 0;
+
+typedef struct {
+    RbIpodDb *db;
+    Itdb_Playlist *playlist;
+    int producer;
+    guint cancelled;
+} Producer;
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static Itdb_Track* new_track(int producer, int n) {
+    Itdb_Track *track = itdb_track_new();
+    track->title = g_strdup_printf("Track %d-%05d", producer, n);
+    track->artist = g_strdup_printf("Artist %d", producer);
+    track->album = g_strdup_printf("Album %d", n % 100);
+    track->track_nr = n % 12 + 1;
+    track->ipod_path = g_strdup_printf(":iPod_Control:Music:F%02d:P%d%05d.mp3", n % 50, producer, n);
+    track->filetype = g_strdup("MPEG audio file");
+    track->size = 4000000 + n;
+    track->mediatype = ITDB_MEDIATYPE_AUDIO;
+    return track;
+}
+
+// Thread d'extraction: ne touche jamais db->itdb, seulement le journal
+static gpointer producer_thread(gpointer data) {
+    Producer *producer = data;
+    GList *playlists = g_list_prepend(NULL, producer->playlist);
+
+    for (int n = 0; n < TRACKS_PER_PRODUCER; n++) {
+        Itdb_Track *track = new_track(producer->producer, n);
+        rb_ipod_add_track_delayed_action(producer->db, track, n % 2 == 0 ? playlists : NULL);
+        if (n % CANCELLED_EVERY == CANCELLED_EVERY - 1) {
+            // Copie échouée après la mise en file: la paire doit s'annuler
+            rb_ipod_remove_track_delayed_action(producer->db, track);
+            producer->cancelled++;
+        }
+    }
+    g_list_free(playlists);
+    g_atomic_int_inc(&producers_done);
+    return NULL;
+}
+
+int main(void) {
+    printf("=== Batched Action Log Test ===\n\n");
+
+    char *root = g_dir_make_tmp("rbipod-actions-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    char *ipod_dir = g_build_filename(root, "ipod", NULL);
+    char *cache_dir = g_build_filename(root, "cache", NULL);
+    g_mkdir_with_parents(ipod_dir, 0755);
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    GError *error = NULL;
+    if (!itdb_init_ipod(ipod_dir, SIMULATED_MODEL, "Actions", &error)) {
+        printf("❌ Cannot initialize simulated iPod: %s\n", error ? error->message : "unknown error");
+        return 1;
+    }
+    RbIpodDb *db = rb_ipod_db_new(ipod_dir);
+    if (!db) {
+        printf("❌ Cannot open simulated iPod database\n");
+        return 1;
+    }
+    Itdb_Playlist *even = itdb_playlist_new("Even", FALSE);
+    itdb_playlist_add(db->itdb, even, -1);
+
+    int passed = 0;
+    int total = 7;
+    struct timespec start, end;
+
+    // Producteurs concurrents, le propriétaire applique au fil de l'eau
+    Producer producers[PRODUCERS];
+    GThread *threads[PRODUCERS];
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers[p] = (Producer){ db, even, p, 0 };
+        threads[p] = g_thread_new("producer", producer_thread, &producers[p]);
+    }
+    guint batches = 0;
+    while (g_atomic_int_get(&producers_done) < PRODUCERS) {
+        rb_ipod_db_process_delayed_actions(db);
+        batches++;
+        g_usleep(1000);
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        g_thread_join(threads[p]);
+    }
+    rb_ipod_db_process_delayed_actions(db);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double apply_time = get_time_diff(start, end);
+
+    guint cancelled = 0;
+    for (int p = 0; p < PRODUCERS; p++) cancelled += producers[p].cancelled;
+    guint expected = PRODUCERS * TRACKS_PER_PRODUCER - cancelled;
+    Itdb_Playlist *master = itdb_playlist_mpl(db->itdb);
+
+    printf("📝 %d producers x %d tracks, %u cancelled\n", PRODUCERS, TRACKS_PER_PRODUCER, cancelled);
+    printf("   Queue and apply: %8.3f ms (%u batches)\n\n", apply_time * 1000, batches);
+
+    passed += check("every queued add applied, add/remove pairs coalesced",
+                    g_queue_is_empty(db->delayed_actions) && itdb_tracks_number(db->itdb) == expected &&
+                    itdb_playlist_tracks_number(master) == expected &&
+                    rb_ipod_track_index_count(db->track_index) == expected);
+
+    char *cancelled_path = g_strdup_printf("/iPod_Control/Music/F%02d/P0%05d.mp3",
+                                           (CANCELLED_EVERY - 1) % 50, CANCELLED_EVERY - 1);
+    passed += check("cancelled tracks never reach the database",
+                    rb_ipod_track_index_lookup_path(db->track_index, cancelled_path) == NULL);
+    g_free(cancelled_path);
+
+    guint even_expected = PRODUCERS * (TRACKS_PER_PRODUCER / 2);
+    passed += check("playlist memberships carried by the add actions",
+                    itdb_playlist_tracks_number(even) == even_expected);
+
+    // Mise à jour puis renommage, appliqués au prochain lot
+    Itdb_Track *target = rb_ipod_track_index_lookup_tags(db->track_index, "Artist 1", "Album 0", "Track 1-00000", 1);
+    RbIpodTrackUpdate *update = rb_ipod_track_update_new();
+    update->title = g_strdup("Renamed Track");
+    update->rating = 80;
+    rb_ipod_db_update_track(db, target, update);
+    rb_ipod_track_update_free(update);
+    rb_ipod_db_set_name(db, "First Name");
+    rb_ipod_db_set_name(db, "Final Name");
+
+    // Ajouts séquentiels: doivent arriver en fin de liste, dans l'ordre
+    Itdb_Track *tail[3];
+    for (int i = 0; i < 3; i++) {
+        tail[i] = new_track(PRODUCERS, i);
+        rb_ipod_db_add_track(db, tail[i]);
+    }
+    rb_ipod_db_wait_for_save(db);
+
+    passed += check("update re-indexes the track, memberships kept",
+                    target && rb_ipod_track_index_lookup_tags(db->track_index, "Artist 1", "Album 0",
+                                                              "Renamed Track", 1) == target &&
+                    target->rating == 80 &&
+                    g_list_find(rb_ipod_track_index_playlists(db->track_index, target), even) &&
+                    !rb_ipod_track_index_lookup_tags(db->track_index, "Artist 1", "Album 0", "Track 1-00000", 1));
+    passed += check("last queued name wins", master->name && strcmp(master->name, "Final Name") == 0);
+
+    GList *last = g_list_last(db->itdb->tracks);
+    GList *last_member = g_list_last(master->members);
+    passed += check("batched adds keep their order at the end of the lists",
+                    last && last->data == tail[2] && last->prev->data == tail[1] &&
+                    last->prev->prev->data == tail[0] && last_member && last_member->data == tail[2] &&
+                    rb_ipod_db_save_sync(db));
+
+    // Ajout annulé avant d'être appliqué: la piste et sa mise à jour disparaissent
+    Itdb_Track *dropped = new_track(PRODUCERS, 99);
+    rb_ipod_add_track_delayed_action(db, dropped, NULL);
+    rb_ipod_content_index_add_track(db->content_index, dropped);
+    RbIpodTrackUpdate *late_update = rb_ipod_track_update_new();
+    late_update->rating = 20;
+    rb_ipod_update_track_delayed_action(db, dropped, late_update);
+    rb_ipod_track_update_free(late_update);
+    guint tracks_before = itdb_tracks_number(db->itdb);
+    guint removed_actions = rb_ipod_remove_delayed_action(db, RB_IPOD_ACTION_ADD_TRACK, dropped);
+    rb_ipod_db_process_delayed_actions(db);
+    passed += check("dropped add leaves the content index with its later actions",
+                    removed_actions == 2 && g_queue_is_empty(db->delayed_actions) &&
+                    itdb_tracks_number(db->itdb) == tracks_before &&
+                    !rb_ipod_content_index_lookup_identity(db->content_index, "Track 4-00099", "Artist 4",
+                                                           4000099, ITDB_MEDIATYPE_AUDIO));
+
+    rb_ipod_db_free(db);
+    remove_tree(root);
+    g_free(ipod_dir);
+    g_free(cache_dir);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
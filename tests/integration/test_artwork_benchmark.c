@@ -0,0 +1,509 @@
+/* Banc d'essai des pochettes (extraction, conversion, vignettes, ArtworkDB)
+ * Génère un corpus synthétique: MP3 avec APIC, M4A avec covr et MP3 sans
+ * image avec cover.jpg dans le dossier, pour des pochettes JPEG et PNG de
+ * tailles variées. Chaque variante est un album de N pistes partageant sa
+ * pochette. Mesure par piste l'extraction (probe complet), la conversion
+ * (décodage réduit au format de l'appareil), l'attribution de la vignette
+ * (cache de pochettes) puis le temps d'itdb_write et la part ArtworkDB sur un
+ * iPod simulé (itdb_init_ipod dans un répertoire temporaire).
+ * Résultats en percentiles, écrits aussi en JSON pour comparer les versions.
+ *
+ * Usage: test_artwork_benchmark [pistes_par_variante] [--json fichier]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-files.h"
+#include "rbipod-metadata.h"
+#include "rbipod-database.h"
+#include "rbipod-artcache.h"
+#include "rbipod-covers.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define DEFAULT_TRACKS_PER_VARIANT 8
+#define MP3_FRAMES 200                  // ~5 s à 128 kbps
+#define MP3_FRAME_LENGTH 417
+#define SIMULATED_MODEL "MA147"         // iPod Video 5G: trois formats de pochette
+#define DEFAULT_JSON_PATH "artwork_benchmark.json"
+
+typedef enum {
+    CONTAINER_MP3_APIC,
+    CONTAINER_M4A_COVR,
+    CONTAINER_MP3_FOLDER,
+    CONTAINER_COUNT
+} Container;
+
+static const char *const container_names[CONTAINER_COUNT] = {"mp3-apic", "m4a-covr", "mp3-folder"};
+
+typedef struct {
+    const char *format;     // Format d'enregistrement gdk-pixbuf
+    int dimension;
+} CoverSpec;
+
+static const CoverSpec cover_specs[] = {
+    {"jpeg", 300}, {"jpeg", 1000}, {"jpeg", 3000}, {"png", 600}, {"png", 1500},
+};
+
+typedef enum {
+    STAGE_EXTRACT,          // probe_source_file (tags + image)
+    STAGE_CONVERT,          // rb_ipod_artwork_decode_scaled, sans cache
+    STAGE_THUMBNAIL,        // rb_ipod_artwork_cache_apply (chemin de synchro)
+    STAGE_COUNT
+} Stage;
+
+static const char *const stage_names[STAGE_COUNT] = {"extract", "convert", "thumbnail"};
+
+typedef struct {
+    char *name;
+    GArray *samples[STAGE_COUNT];   // double, millisecondes par piste
+} Variant;
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return get_time_diff(*start, end) * 1000;
+}
+
+// =============================================================================
+// CORPUS
+// =============================================================================
+
+// Pochette synthétique (dégradé + bruit, pour un encodage réaliste)
+static gchar* create_cover(const CoverSpec *spec, int seed, gsize *size) {
+    GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, spec->dimension, spec->dimension);
+    guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    guint32 noise = 2463534242u + seed;
+    for (int y = 0; y < spec->dimension; y++) {
+        for (int x = 0; x < spec->dimension; x++) {
+            noise ^= noise << 13; noise ^= noise >> 17; noise ^= noise << 5;
+            guchar *p = pixels + y * rowstride + x * 3;
+            p[0] = (x * 255 / spec->dimension + seed) & 0xFF;
+            p[1] = (y * 255 / spec->dimension) & 0xFF;
+            p[2] = noise & 0x3F;
+        }
+    }
+
+    gchar *data = NULL;
+    gboolean ok = strcmp(spec->format, "jpeg") == 0 ?
+        gdk_pixbuf_save_to_buffer(pixbuf, &data, size, "jpeg", NULL, "quality", "90", NULL) :
+        gdk_pixbuf_save_to_buffer(pixbuf, &data, size, "png", NULL, NULL);
+    g_object_unref(pixbuf);
+    return ok ? data : NULL;
+}
+
+static void append_mp3_frames(GByteArray *out) {
+    // MPEG-1 Layer III, 128 kbps, 44.1 kHz
+    guint8 frame[MP3_FRAME_LENGTH];
+    memset(frame, 0, sizeof(frame));
+    frame[0] = 0xFF; frame[1] = 0xFB; frame[2] = 0x90; frame[3] = 0x00;
+    for (int i = 0; i < MP3_FRAMES; i++) {
+        g_byte_array_append(out, frame, sizeof(frame));
+    }
+}
+
+static GByteArray* build_mp3(const char *album, int track, const CoverSpec *spec,
+                             const gchar *cover, gsize cover_size) {
+    GByteArray *tag = g_byte_array_new();
+    char text[64];
+    snprintf(text, sizeof(text), "Track %d", track);
+    put_id3_text(tag, "TIT2", text);
+    put_id3_text(tag, "TPE1", "Benchmark Artist");
+    put_id3_text(tag, "TALB", album);
+    snprintf(text, sizeof(text), "%d", track);
+    put_id3_text(tag, "TRCK", text);
+
+    if (cover) {
+        GByteArray *apic = g_byte_array_new();
+        put_zeros(apic, 1);
+        const char *mime = strcmp(spec->format, "jpeg") == 0 ? "image/jpeg" : "image/png";
+        g_byte_array_append(apic, (const guint8*)mime, strlen(mime) + 1);
+        g_byte_array_append(apic, (const guint8*)"\x03\0", 2);  // Front cover, sans description
+        g_byte_array_append(apic, (const guint8*)cover, cover_size);
+        put_id3_frame(tag, "APIC", apic->data, apic->len);
+        g_byte_array_free(apic, TRUE);
+    }
+
+    GByteArray *out = g_byte_array_new();
+    g_byte_array_append(out, (const guint8*)"ID3\x03\x00\x00", 6);
+    put_syncsafe(out, tag->len);
+    g_byte_array_append(out, tag->data, tag->len);
+    g_byte_array_free(tag, TRUE);
+    append_mp3_frames(out);
+    return out;
+}
+
+static GByteArray* build_m4a(const char *album, int track, const CoverSpec *spec,
+                             const gchar *cover, gsize cover_size) {
+    GByteArray *ftyp = g_byte_array_new();
+    g_byte_array_append(ftyp, (const guint8*)"M4A \0\0\0\0M4A mp42isom", 20);
+
+    GByteArray *mvhd = g_byte_array_new();
+    put_zeros(mvhd, 12);
+    put_be32(mvhd, 600);
+    put_be32(mvhd, 5 * 600);
+    put_zeros(mvhd, 80);
+
+    GByteArray *mdhd = g_byte_array_new();
+    put_zeros(mdhd, 12);
+    put_be32(mdhd, 44100);
+    put_be32(mdhd, 5 * 44100);
+    put_zeros(mdhd, 4);
+    GByteArray *hdlr = g_byte_array_new();
+    put_zeros(hdlr, 8);
+    g_byte_array_append(hdlr, (const guint8*)"soun", 4);
+    put_zeros(hdlr, 13);
+    GByteArray *mdia = g_byte_array_new();
+    put_atom(mdia, "mdhd", mdhd);
+    put_atom(mdia, "hdlr", hdlr);
+    GByteArray *trak = g_byte_array_new();
+    put_atom(trak, "mdia", mdia);
+
+    GByteArray *ilst = g_byte_array_new();
+    char text[64];
+    snprintf(text, sizeof(text), "Track %d", track);
+    put_item(ilst, "\xA9nam", 1, text, strlen(text));
+    put_item(ilst, "\xA9" "ART", 1, "Benchmark Artist", 16);
+    put_item(ilst, "\xA9" "alb", 1, album, strlen(album));
+    guint8 trkn[8] = {0, 0, 0, track, 0, 0, 0, 0};
+    put_item(ilst, "trkn", 0, trkn, sizeof(trkn));
+    put_item(ilst, "covr", strcmp(spec->format, "jpeg") == 0 ? 13 : 14, cover, cover_size);
+
+    GByteArray *meta = g_byte_array_new();
+    put_zeros(meta, 4);
+    GByteArray *meta_hdlr = g_byte_array_new();
+    put_zeros(meta_hdlr, 8);
+    g_byte_array_append(meta_hdlr, (const guint8*)"mdirappl", 8);
+    put_zeros(meta_hdlr, 9);
+    put_atom(meta, "hdlr", meta_hdlr);
+    put_atom(meta, "ilst", ilst);
+    GByteArray *udta = g_byte_array_new();
+    put_atom(udta, "meta", meta);
+
+    GByteArray *moov = g_byte_array_new();
+    put_atom(moov, "mvhd", mvhd);
+    put_atom(moov, "trak", trak);
+    put_atom(moov, "udta", udta);
+
+    GByteArray *mdat = g_byte_array_new();
+    put_zeros(mdat, 64 * 1024);
+
+    GByteArray *out = g_byte_array_new();
+    put_atom(out, "ftyp", ftyp);
+    put_atom(out, "moov", moov);
+    put_atom(out, "mdat", mdat);
+    return out;
+}
+
+// Crée l'album d'une variante; retourne les chemins des pistes
+static GPtrArray* create_album(const char *root, Container container, const CoverSpec *spec,
+                               int seed, int tracks, gsize *cover_size) {
+    char *album = g_strdup_printf("%s %s %dpx", container_names[container], spec->format, spec->dimension);
+    char *dir = g_build_filename(root, album, NULL);
+    g_mkdir_with_parents(dir, 0755);
+
+    gchar *cover = create_cover(spec, seed, cover_size);
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    if (!cover) {
+        g_free(album);
+        g_free(dir);
+        return paths;
+    }
+
+    if (container == CONTAINER_MP3_FOLDER) {
+        char *name = g_strdup_printf("cover.%s", strcmp(spec->format, "jpeg") == 0 ? "jpg" : "png");
+        char *cover_path = g_build_filename(dir, name, NULL);
+        g_file_set_contents(cover_path, cover, *cover_size, NULL);
+        g_free(cover_path);
+        g_free(name);
+    }
+
+    for (int i = 1; i <= tracks; i++) {
+        GByteArray *data = container == CONTAINER_M4A_COVR ?
+            build_m4a(album, i, spec, cover, *cover_size) :
+            build_mp3(album, i, spec, container == CONTAINER_MP3_APIC ? cover : NULL, *cover_size);
+        char *name = g_strdup_printf("%02d - Track.%s", i, container == CONTAINER_M4A_COVR ? "m4a" : "mp3");
+        char *path = g_build_filename(dir, name, NULL);
+        if (g_file_set_contents(path, (const gchar*)data->data, data->len, NULL)) {
+            g_ptr_array_add(paths, path);
+        } else {
+            g_free(path);
+        }
+        g_free(name);
+        g_byte_array_free(data, TRUE);
+    }
+
+    g_free(cover);
+    g_free(album);
+    g_free(dir);
+    return paths;
+}
+
+// =============================================================================
+// STATISTICS
+// =============================================================================
+
+static gint compare_doubles(gconstpointer a, gconstpointer b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+typedef struct {
+    double mean, p50, p90, p99, max;
+    guint count;
+} Summary;
+
+// Percentiles au rang le plus proche
+static Summary summarize(GArray *samples) {
+    Summary summary = {0};
+    summary.count = samples->len;
+    if (samples->len == 0) return summary;
+
+    GArray *sorted = g_array_sized_new(FALSE, FALSE, sizeof(double), samples->len);
+    g_array_append_vals(sorted, samples->data, samples->len);
+    g_array_sort(sorted, compare_doubles);
+
+    double sum = 0;
+    for (guint i = 0; i < sorted->len; i++) sum += g_array_index(sorted, double, i);
+    summary.mean = sum / sorted->len;
+    const double ranks[] = {0.50, 0.90, 0.99};
+    double *targets[] = {&summary.p50, &summary.p90, &summary.p99};
+    for (int i = 0; i < 3; i++) {
+        guint index = (guint)(ranks[i] * sorted->len + 0.999999);
+        *targets[i] = g_array_index(sorted, double, CLAMP(index, 1, sorted->len) - 1);
+    }
+    summary.max = g_array_index(sorted, double, sorted->len - 1);
+    g_array_free(sorted, TRUE);
+    return summary;
+}
+
+static void print_summary_row(const char *name, const char *stage, GArray *samples) {
+    Summary s = summarize(samples);
+    printf("   %-22s %-10s %8.3f %8.3f %8.3f %8.3f %8.3f\n", name, stage, s.mean, s.p50, s.p90, s.p99, s.max);
+}
+
+static void write_summary_json(FILE *out, GArray *samples) {
+    Summary s = summarize(samples);
+    fprintf(out, "{\"count\": %u, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}",
+            s.count, s.mean, s.p50, s.p90, s.p99, s.max);
+}
+
+// =============================================================================
+// MAIN
+// =============================================================================
+
+int main(int argc, char *argv[]) {
+    int tracks = DEFAULT_TRACKS_PER_VARIANT;
+    const char *json_path = DEFAULT_JSON_PATH;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            tracks = MAX(1, atoi(argv[i]));
+        }
+    }
+
+    printf("=== Artwork Benchmark ===\n\n");
+
+    char *root = g_dir_make_tmp("rbipod-artbench-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    char *corpus_dir = g_build_filename(root, "corpus", NULL);
+    char *ipod_dir = g_build_filename(root, "ipod", NULL);
+    char *cache_dir = g_build_filename(root, "cache", NULL);
+    g_mkdir_with_parents(ipod_dir, 0755);
+
+    // Caches d'une exécution précédente exclus: mesures à froid
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    GError *error = NULL;
+    if (!itdb_init_ipod(ipod_dir, SIMULATED_MODEL, "Benchmark", &error)) {
+        printf("❌ Cannot initialize simulated iPod: %s\n", error ? error->message : "unknown error");
+        return 1;
+    }
+    RbIpodDb *db = rb_ipod_db_new(ipod_dir);
+    if (!db) {
+        printf("❌ Cannot open simulated iPod database\n");
+        return 1;
+    }
+    g_sync_ctx.ipod_db = db;
+    g_sync_ctx.folder_covers = rb_ipod_folder_covers_new();
+
+    // Même cible de conversion que le cache de pochettes
+    int max_width = 0, max_height = 0;
+    rb_ipod_artwork_target_size(db->itdb->device, &max_width, &max_height);
+    printf("📱 Simulated %s, covers prepared at %dx%d\n", SIMULATED_MODEL, max_width, max_height);
+
+    guint num_variants = CONTAINER_COUNT * G_N_ELEMENTS(cover_specs);
+    Variant *variants = g_new0(Variant, num_variants);
+    GArray *overall[STAGE_COUNT];
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        overall[s] = g_array_new(FALSE, FALSE, sizeof(double));
+    }
+
+    int total_tracks = 0, tracks_with_artwork = 0;
+    for (int c = 0; c < CONTAINER_COUNT; c++) {
+        for (guint k = 0; k < G_N_ELEMENTS(cover_specs); k++) {
+            const CoverSpec *spec = &cover_specs[k];
+            Variant *variant = &variants[c * G_N_ELEMENTS(cover_specs) + k];
+            variant->name = g_strdup_printf("%s/%s-%d", container_names[c], spec->format, spec->dimension);
+            for (int s = 0; s < STAGE_COUNT; s++) {
+                variant->samples[s] = g_array_new(FALSE, FALSE, sizeof(double));
+            }
+
+            gsize cover_size = 0;
+            GPtrArray *paths = create_album(corpus_dir, c, spec, c * 16 + k, tracks, &cover_size);
+            printf("   %-22s %zu-byte cover, %u tracks\n", variant->name, cover_size, paths->len);
+
+            for (guint i = 0; i < paths->len; i++) {
+                const char *path = g_ptr_array_index(paths, i);
+                struct stat file_stat;
+                stat(path, &file_stat);
+                struct timespec start;
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                AudioMetadata *meta = probe_source_file(path, file_stat.st_size, ITDB_MEDIATYPE_AUDIO);
+                double extract_ms = elapsed_ms(&start);
+                if (!meta) continue;
+
+                double convert_ms = 0;
+                if (meta->artwork_data) {
+                    clock_gettime(CLOCK_MONOTONIC, &start);
+                    GdkPixbuf *pixbuf = rb_ipod_artwork_decode_scaled(meta->artwork_data, meta->artwork_size,
+                                                                      max_width, max_height);
+                    convert_ms = elapsed_ms(&start);
+                    if (pixbuf) g_object_unref(pixbuf);
+                }
+
+                // Piste sans pochette, puis attribution mesurée séparément
+                g_sync_ctx.ipod_db = NULL;
+                char *ipod_path = g_strdup_printf(":iPod_Control:Music:F00:BENCH%04d.%s", total_tracks,
+                                                  c == CONTAINER_M4A_COVR ? "m4a" : "mp3");
+                Itdb_Track *track = create_ipod_track_from_metadata(meta, ipod_path, strrchr(path, '.'));
+                g_sync_ctx.ipod_db = db;
+                g_free(ipod_path);
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                gboolean has_artwork = track && rb_ipod_artwork_cache_apply(db->artwork_cache, track, meta);
+                double thumbnail_ms = elapsed_ms(&start);
+
+                double values[STAGE_COUNT] = {extract_ms, convert_ms, thumbnail_ms};
+                for (int s = 0; s < STAGE_COUNT; s++) {
+                    g_array_append_val(variant->samples[s], values[s]);
+                    g_array_append_val(overall[s], values[s]);
+                }
+                if (track) rb_ipod_db_add_track(db, track);
+                total_tracks++;
+                tracks_with_artwork += has_artwork ? 1 : 0;
+                free_metadata(meta);
+            }
+            g_ptr_array_free(paths, TRUE);
+        }
+    }
+
+    // itdb_write avec pochettes, puis sans: la différence est la part ArtworkDB
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gboolean written = rb_ipod_db_save_sync(db);
+    double write_ms = elapsed_ms(&start);
+
+    for (GList *l = db->itdb->tracks; l != NULL; l = l->next) {
+        itdb_track_remove_thumbnails(l->data);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gboolean written_plain = rb_ipod_db_save_sync(db);
+    double plain_write_ms = elapsed_ms(&start);
+    double artworkdb_ms = MAX(0.0, write_ms - plain_write_ms);
+
+    printf("\n⏱️  Per track (ms):\n");
+    printf("   %-22s %-10s %8s %8s %8s %8s %8s\n", "variant", "stage", "mean", "p50", "p90", "p99", "max");
+    for (guint v = 0; v < num_variants; v++) {
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            print_summary_row(variants[v].name, stage_names[s], variants[v].samples[s]);
+        }
+    }
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        print_summary_row("all", stage_names[s], overall[s]);
+    }
+    printf("\n💾 itdb_write: %.1f ms total, %.3f ms per track (ArtworkDB %.3f ms per track)\n",
+           write_ms, total_tracks ? write_ms / total_tracks : 0.0,
+           total_tracks ? artworkdb_ms / total_tracks : 0.0);
+
+    FILE *json = fopen(json_path, "w");
+    if (json) {
+        fprintf(json, "{\n  \"model\": \"%s\",\n  \"target\": [%d, %d],\n  \"tracks\": %d,\n",
+                SIMULATED_MODEL, max_width, max_height, total_tracks);
+        fprintf(json, "  \"write\": {\"total_ms\": %.3f, \"per_track_ms\": %.4f, \"artworkdb_per_track_ms\": %.4f},\n",
+                write_ms, total_tracks ? write_ms / total_tracks : 0.0,
+                total_tracks ? artworkdb_ms / total_tracks : 0.0);
+        fprintf(json, "  \"stages\": {");
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            fprintf(json, "%s\n    \"%s\": ", s ? "," : "", stage_names[s]);
+            write_summary_json(json, overall[s]);
+        }
+        fprintf(json, "\n  },\n  \"variants\": [");
+        for (guint v = 0; v < num_variants; v++) {
+            fprintf(json, "%s\n    {\"name\": \"%s\"", v ? "," : "", variants[v].name);
+            for (int s = 0; s < STAGE_COUNT; s++) {
+                fprintf(json, ",\n     \"%s\": ", stage_names[s]);
+                write_summary_json(json, variants[v].samples[s]);
+            }
+            fprintf(json, "}");
+        }
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+        printf("📄 JSON results: %s\n", json_path);
+    }
+
+    printf("\n");
+    int passed = 0;
+    int total = 3;
+    passed += check("every track received its cover", total_tracks > 0 && tracks_with_artwork == total_tracks);
+    passed += check("database written with and without artwork", written && written_plain);
+    passed += check("JSON results written", json != NULL);
+
+    for (guint v = 0; v < num_variants; v++) {
+        for (int s = 0; s < STAGE_COUNT; s++) g_array_free(variants[v].samples[s], TRUE);
+        g_free(variants[v].name);
+    }
+    for (int s = 0; s < STAGE_COUNT; s++) g_array_free(overall[s], TRUE);
+    g_free(variants);
+    g_sync_ctx.ipod_db = NULL;
+    rb_ipod_db_free(db);
+    rb_ipod_folder_covers_free(g_sync_ctx.folder_covers);
+    g_sync_ctx.folder_covers = NULL;
+    remove_tree(root);
+    g_free(corpus_dir);
+    g_free(ipod_dir);
+    g_free(cache_dir);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
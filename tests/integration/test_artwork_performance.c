@@ -1,5 +1,7 @@
 /* Test de performance pour l'artwork
- * Compare les différentes méthodes d'extraction et d'ajout d'artwork
+ * Compare les différentes méthodes d'extraction et d'ajout d'artwork, ainsi
+ * que la préparation des pochettes (décodage complet + réduction contre
+ * décodage réduit, sur un ou plusieurs threads)
  */
 
 #include <stdio.h>
@@ -7,9 +9,19 @@
 #include <string.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <glib.h>
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
 #include <gpod/itdb.h>
 
+extern "C" {
+#include "rbipod-artcache.h"
+}
+
+#define PREP_ITERATIONS 32
+#define PREP_TARGET_SIZE 320    // Plus grand format de pochette (iPod classic)
+
 // Simulation de notre structure AudioMetadata
 typedef struct {
     char *title;
@@ -23,7 +35,7 @@ typedef struct {
 } TestAudioMetadata;
 
 // Déclarations des fonctions TagLib (externes)
-extern gboolean extract_artwork_taglib_native(const char *file_path, TestAudioMetadata *meta);
+extern "C" gboolean extract_artwork_taglib_native(const char *file_path, TestAudioMetadata *meta);
 
 double get_time_diff(struct timespec start, struct timespec end) {
     return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
@@ -111,6 +123,105 @@ int test_artwork_extraction_performance(const char *test_file) {
     return 1;
 }
 
+// Chemin précédent: décodage pleine résolution puis réduction
+static GdkPixbuf* decode_full_then_scale(const guchar *data, gsize size) {
+    GInputStream *stream = g_memory_input_stream_new_from_data(data, size, NULL);
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_stream(stream, NULL, NULL);
+    g_object_unref(stream);
+    if (!pixbuf) return NULL;
+
+    int width = gdk_pixbuf_get_width(pixbuf);
+    int height = gdk_pixbuf_get_height(pixbuf);
+    if (width <= PREP_TARGET_SIZE && height <= PREP_TARGET_SIZE) return pixbuf;
+
+    double scale = MIN((double)PREP_TARGET_SIZE / width, (double)PREP_TARGET_SIZE / height);
+    GdkPixbuf *scaled = gdk_pixbuf_scale_simple(pixbuf, MAX(1, (int)(width * scale + 0.5)),
+                                                MAX(1, (int)(height * scale + 0.5)), GDK_INTERP_BILINEAR);
+    g_object_unref(pixbuf);
+    return scaled;
+}
+
+typedef struct {
+    const guchar *data;
+    gsize size;
+    gint decoded;
+} PrepContext;
+
+static void prep_worker(gpointer job, gpointer user_data) {
+    (void)job;
+    PrepContext *context = (PrepContext*)user_data;
+    GdkPixbuf *pixbuf = rb_ipod_artwork_decode_scaled(context->data, context->size,
+                                                      PREP_TARGET_SIZE, PREP_TARGET_SIZE);
+    if (pixbuf) {
+        g_atomic_int_inc(&context->decoded);
+        g_object_unref(pixbuf);
+    }
+}
+
+// Décodages réduits répartis sur un pool de threads; retourne la durée
+static double run_prep_pool(PrepContext *context, guint threads) {
+    struct timespec start, end;
+    context->decoded = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    GThreadPool *pool = g_thread_pool_new(prep_worker, context, threads, TRUE, NULL);
+    for (int i = 0; i < PREP_ITERATIONS; i++) {
+        g_thread_pool_push(pool, GINT_TO_POINTER(i + 1), NULL);
+    }
+    g_thread_pool_free(pool, FALSE, TRUE);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return get_time_diff(start, end);
+}
+
+int test_artwork_preparation_performance(const char *artwork_file) {
+    printf("\n🧵 Testing artwork preparation (decode + scale to %dx%d)\n", PREP_TARGET_SIZE, PREP_TARGET_SIZE);
+    printf("Artwork file: %s\n\n", artwork_file);
+
+    gchar *data = NULL;
+    gsize size = 0;
+    if (!g_file_get_contents(artwork_file, &data, &size, NULL)) {
+        printf("❌ Artwork file not found: %s\n", artwork_file);
+        return 0;
+    }
+
+    int width = 0, height = 0;
+    gdk_pixbuf_get_file_info(artwork_file, &width, &height);
+    printf("   Source: %dx%d, %zu bytes\n", width, height, size);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int full_ok = 0;
+    for (int i = 0; i < PREP_ITERATIONS; i++) {
+        GdkPixbuf *pixbuf = decode_full_then_scale((const guchar*)data, size);
+        if (pixbuf) {
+            full_ok++;
+            g_object_unref(pixbuf);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double full_time = get_time_diff(start, end);
+
+    PrepContext context = {(const guchar*)data, size, 0};
+    guint threads = g_get_num_processors();
+    double scaled_time = run_prep_pool(&context, 1);
+    int scaled_ok = context.decoded;
+    double pool_time = run_prep_pool(&context, threads);
+    int pool_ok = context.decoded;
+
+    printf("   Full decode + scale (1 thread):  %8.3f ms/image\n", full_time * 1000 / PREP_ITERATIONS);
+    printf("   Scaled decode (1 thread):        %8.3f ms/image (%.1fx)\n",
+           scaled_time * 1000 / PREP_ITERATIONS, full_time / scaled_time);
+    printf("   Scaled decode (%2u threads):      %8.3f ms/image (%.1fx), %.0f images/s\n",
+           threads, pool_time * 1000 / PREP_ITERATIONS, full_time / pool_time, PREP_ITERATIONS / pool_time);
+
+    g_free(data);
+
+    if (full_ok != PREP_ITERATIONS || scaled_ok != PREP_ITERATIONS || pool_ok != PREP_ITERATIONS) {
+        printf("   ❌ Decoding failed (%d/%d/%d of %d)\n", full_ok, scaled_ok, pool_ok, PREP_ITERATIONS);
+        return 0;
+    }
+    return 1;
+}
+
 int test_libgpod_artwork_performance(const char *mount_point, const char *artwork_file, int num_tracks) {
     printf("\n🎯 Testing libgpod artwork assignment performance\n");
     printf("Mount point: %s\n", mount_point);
@@ -238,10 +349,11 @@ int test_libgpod_artwork_performance(const char *mount_point, const char *artwor
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        printf("Usage: %s <test_audio_file> [ipod_mount_point] [artwork_file] [num_test_tracks]\n");
+        printf("Usage: %s <test_audio_file> [ipod_mount_point] [artwork_file] [num_test_tracks]\n", argv[0]);
         printf("\nExamples:\n");
         printf("  %s /path/to/test.mp3\n", argv[0]);
         printf("  %s /path/to/test.mp3 /media/ipod /path/to/artwork.jpg 10\n", argv[0]);
+        printf("  %s /path/to/test.mp3 - /path/to/artwork.jpg\n", argv[0]);
         return 1;
     }
     
@@ -258,8 +370,13 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    // Test 2: libgpod performance (si iPod disponible)
-    if (mount_point && artwork_file) {
+    // Test 2: préparation des pochettes (aucun iPod requis)
+    if (artwork_file && !test_artwork_preparation_performance(artwork_file)) {
+        return 1;
+    }
+    
+    // Test 3: libgpod performance (si iPod disponible, "-" pour l'ignorer)
+    if (mount_point && artwork_file && strcmp(mount_point, "-") != 0) {
         if (!test_libgpod_artwork_performance(mount_point, artwork_file, num_tracks)) {
             printf("⚠️  libgpod performance test skipped (iPod not available)\n");
         }
@@ -0,0 +1,169 @@
+/* Test de la sauvegarde asynchrone de la base
+ * Sur un iPod simulé (itdb_init_ipod dans un répertoire temporaire), ajoute
+ * un premier lot de pistes, lance rb_ipod_db_save_async() puis ajoute un
+ * second lot pendant l'écriture: ces pistes attendent dans delayed_actions.
+ * Vérifie que la base écrite contient exactement l'instantané, que l'index
+ * de contenu ne référence que les pistes écrites, puis que la sauvegarde
+ * finale contient tout.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-database.h"
+#include "rbipod-index.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define SIMULATED_MODEL "MA147"
+#define SNAPSHOT_TRACKS 2000
+#define QUEUED_TRACKS 200
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static char* source_path(int n) {
+    return g_strdup_printf("/music/Artist %d/Track %04d.mp3", n % 50, n);
+}
+
+static void add_tracks(RbIpodDb *db, int first, int count) {
+    for (int n = first; n < first + count; n++) {
+        Itdb_Track *track = itdb_track_new();
+        track->title = g_strdup_printf("Track %04d", n);
+        track->artist = g_strdup_printf("Artist %d", n % 50);
+        track->album = g_strdup_printf("Album %d", n % 50);
+        track->ipod_path = g_strdup_printf(":iPod_Control:Music:F%02d:T%05d.mp3", n % 50, n);
+        track->filetype = g_strdup("MPEG audio file");
+        track->size = 4000000 + n;
+        track->tracklen = 180000;
+        track->mediatype = ITDB_MEDIATYPE_AUDIO;
+
+        rb_ipod_db_add_track(db, track);
+        rb_ipod_content_index_add_track(db->content_index, track);
+        char *source = source_path(n);
+        rb_ipod_content_index_record_source(db->content_index, source, track->size, 1000 + n, track);
+        g_free(source);
+    }
+}
+
+static gboolean source_known(RbIpodDb *db, int n) {
+    char *source = source_path(n);
+    gboolean known = rb_ipod_content_index_lookup_source(db->content_index, source,
+                                                         4000000 + n, 1000 + n) != NULL;
+    g_free(source);
+    return known;
+}
+
+static guint written_tracks(const char *ipod_dir) {
+    Itdb_iTunesDB *itdb = itdb_parse(ipod_dir, NULL);
+    guint count = itdb ? itdb_tracks_number(itdb) : 0;
+    if (itdb) itdb_free(itdb);
+    return count;
+}
+
+int main(void) {
+    printf("=== Asynchronous Database Save Test ===\n\n");
+
+    char *root = g_dir_make_tmp("rbipod-save-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    char *ipod_dir = g_build_filename(root, "ipod", NULL);
+    char *cache_dir = g_build_filename(root, "cache", NULL);
+    g_mkdir_with_parents(ipod_dir, 0755);
+
+    // Index de contenu d'une exécution précédente exclu
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    GError *error = NULL;
+    if (!itdb_init_ipod(ipod_dir, SIMULATED_MODEL, "Async Save", &error)) {
+        printf("❌ Cannot initialize simulated iPod: %s\n", error ? error->message : "unknown error");
+        return 1;
+    }
+    RbIpodDb *db = rb_ipod_db_new(ipod_dir);
+    if (!db) {
+        printf("❌ Cannot open simulated iPod database\n");
+        return 1;
+    }
+
+    int passed = 0;
+    int total = 6;
+    struct timespec start, end;
+
+    add_tracks(db, 0, SNAPSHOT_TRACKS);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gboolean started = rb_ipod_db_save_async(db);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double start_time = get_time_diff(start, end);
+
+    // Ajouts pendant l'écriture: mis en file, la base en cours d'écriture ne bouge pas
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    add_tracks(db, SNAPSHOT_TRACKS, QUEUED_TRACKS);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double queue_time = get_time_diff(start, end);
+    gboolean queued = db->is_saving &&
+                      itdb_tracks_number(db->itdb) == SNAPSHOT_TRACKS &&
+                      g_queue_get_length(db->delayed_actions) == QUEUED_TRACKS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gboolean saved = rb_ipod_db_wait_for_save(db);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double wait_time = get_time_diff(start, end);
+
+    Itdb_Playlist *master = itdb_playlist_mpl(db->itdb);
+    gboolean applied = !db->is_saving && g_queue_is_empty(db->delayed_actions) &&
+                       itdb_tracks_number(db->itdb) == SNAPSHOT_TRACKS + QUEUED_TRACKS &&
+                       master && itdb_playlist_tracks_number(master) == SNAPSHOT_TRACKS + QUEUED_TRACKS;
+
+    printf("💾 %d tracks in the snapshot, %d committed during the save\n", SNAPSHOT_TRACKS, QUEUED_TRACKS);
+    printf("   save_async returned in: %8.3f ms\n", start_time * 1000);
+    printf("   %d commits queued in:  %8.3f ms\n", QUEUED_TRACKS, queue_time * 1000);
+    printf("   Remaining write wait:   %8.3f ms\n\n", wait_time * 1000);
+
+    passed += check("background save started and commits queued meanwhile", started && queued);
+    passed += check("queued tracks applied with their playlists once the save completed", saved && applied);
+    passed += check("written database holds exactly the snapshot", written_tracks(ipod_dir) == SNAPSHOT_TRACKS);
+
+    // Index relu depuis le disque: seules les pistes écrites sont connues
+    RbIpodDb *reopened = rb_ipod_db_new(ipod_dir);
+    passed += check("content index maps only sources of written tracks",
+                    reopened && source_known(reopened, 0) && source_known(reopened, SNAPSHOT_TRACKS - 1) &&
+                    !source_known(reopened, SNAPSHOT_TRACKS));
+    rb_ipod_db_free(reopened);
+
+    gboolean final_saved = rb_ipod_db_save_sync(db);
+    reopened = rb_ipod_db_new(ipod_dir);
+    passed += check("final save writes the queued tracks",
+                    final_saved && written_tracks(ipod_dir) == SNAPSHOT_TRACKS + QUEUED_TRACKS);
+    passed += check("pending index records kept for the final save",
+                    reopened && source_known(reopened, SNAPSHOT_TRACKS) &&
+                    source_known(reopened, SNAPSHOT_TRACKS + QUEUED_TRACKS - 1));
+    rb_ipod_db_free(reopened);
+
+    rb_ipod_db_free(db);
+    remove_tree(root);
+    g_free(ipod_dir);
+    g_free(cache_dir);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
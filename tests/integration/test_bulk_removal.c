@@ -0,0 +1,171 @@
+/* Test du retrait en masse (reset)
+ * Sur un iPod simulé, crée des pistes audio et podcast réparties dans trois
+ * listes de lecture avec leurs fichiers, retire tous les podcasts en une
+ * passe (listes reconstruites, fichiers supprimés en parallèle), puis vide
+ * tout l'iPod en repartant d'une base neuve.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-database.h"
+#include "rbipod-files.h"
+#include "rbipod-filesystem.h"
+#include "rbipod-index.h"
+#include "rbipod-trackindex.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define SIMULATED_MODEL "MA147"
+#define TRACK_COUNT 5000
+#define PODCAST_EVERY 4
+#define USER_PLAYLIST_EVERY 3
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static char* device_file(const char *ipod_dir, int n) {
+    return g_strdup_printf("%s/iPod_Control/Music/F%02d/B%05d.mp3", ipod_dir, n % IPOD_MUSIC_DIR_COUNT, n);
+}
+
+static void populate(RbIpodDb *db, const char *ipod_dir, Itdb_Playlist *user_pl) {
+    for (int n = 0; n < TRACK_COUNT; n++) {
+        char *path = device_file(ipod_dir, n);
+        g_file_set_contents(path, "data", 4, NULL);
+
+        Itdb_Track *track = itdb_track_new();
+        track->title = g_strdup_printf("Track %05d", n);
+        track->artist = g_strdup_printf("Artist %d", n % 50);
+        track->ipod_path = g_strdup_printf(":iPod_Control:Music:F%02d:B%05d.mp3", n % IPOD_MUSIC_DIR_COUNT, n);
+        track->filetype = g_strdup("MPEG audio file");
+        track->size = 4;
+        track->mediatype = n % PODCAST_EVERY == 0 ? ITDB_MEDIATYPE_PODCAST : ITDB_MEDIATYPE_AUDIO;
+        GList *playlists = n % USER_PLAYLIST_EVERY == 0 ? g_list_prepend(NULL, user_pl) : NULL;
+        rb_ipod_db_add_track_with_playlists(db, track, playlists);
+        g_list_free(playlists);
+        g_free(path);
+    }
+    rb_ipod_db_wait_for_save(db);
+}
+
+static gboolean playlist_has_mediatype(Itdb_Playlist *playlist, guint32 mediatype) {
+    for (GList *item = playlist ? playlist->members : NULL; item; item = item->next) {
+        if (((Itdb_Track*)item->data)->mediatype == mediatype) return TRUE;
+    }
+    return FALSE;
+}
+
+int main(void) {
+    printf("=== Bulk Removal Test ===\n\n");
+
+    char *root = g_dir_make_tmp("rbipod-bulk-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    char *ipod_dir = g_build_filename(root, "ipod", NULL);
+    char *cache_dir = g_build_filename(root, "cache", NULL);
+    g_mkdir_with_parents(ipod_dir, 0755);
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    GError *error = NULL;
+    if (!itdb_init_ipod(ipod_dir, SIMULATED_MODEL, "Bulk", &error)) {
+        printf("❌ Cannot initialize simulated iPod: %s\n", error ? error->message : "unknown error");
+        return 1;
+    }
+    ensure_ipod_directory_structure(ipod_dir);
+
+    RbIpodDb *db = rb_ipod_db_new(ipod_dir);
+    if (!db) {
+        printf("❌ Cannot open simulated iPod database\n");
+        return 1;
+    }
+    Itdb_Playlist *user_pl = itdb_playlist_new("Favorites", FALSE);
+    itdb_playlist_add(db->itdb, user_pl, -1);
+    populate(db, ipod_dir, user_pl);
+
+    int passed = 0;
+    int total = 5;
+    struct timespec start, end;
+
+    // Partition comme command_reset_media_type()
+    GHashTable *podcasts = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+    for (GList *item = db->itdb->tracks; item; item = item->next) {
+        Itdb_Track *track = (Itdb_Track*)item->data;
+        if (track->mediatype != ITDB_MEDIATYPE_PODCAST) continue;
+        g_hash_table_add(podcasts, track);
+        char *relative = rb_ipod_normalize_ipod_path(track->ipod_path);
+        g_ptr_array_add(files, g_build_filename(ipod_dir, relative, NULL));
+        g_free(relative);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    guint deleted = rb_ipod_unlink_files(files, 0);
+    guint removed = rb_ipod_db_remove_tracks(db, podcasts);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double remove_time = get_time_diff(start, end);
+
+    guint expected = TRACK_COUNT / PODCAST_EVERY;
+    char *kept_file = device_file(ipod_dir, 1);
+    passed += check("every podcast removed with its file, other files kept",
+                    removed == expected && deleted == expected && g_file_test(kept_file, G_FILE_TEST_EXISTS) &&
+                    itdb_tracks_number(db->itdb) == TRACK_COUNT - expected &&
+                    rb_ipod_track_index_count(db->track_index) == TRACK_COUNT - expected);
+    passed += check("no playlist still references a removed track",
+                    !playlist_has_mediatype(itdb_playlist_mpl(db->itdb), ITDB_MEDIATYPE_PODCAST) &&
+                    !playlist_has_mediatype(itdb_playlist_podcasts(db->itdb), ITDB_MEDIATYPE_PODCAST) &&
+                    !playlist_has_mediatype(user_pl, ITDB_MEDIATYPE_PODCAST) &&
+                    itdb_playlist_tracks_number(itdb_playlist_mpl(db->itdb)) == TRACK_COUNT - expected);
+    passed += check("database with the survivors saved", rb_ipod_db_save_sync(db));
+    g_hash_table_destroy(podcasts);
+    g_ptr_array_free(files, TRUE);
+
+    // Remise à zéro complète comme command_reset_all()
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    guint cleared = rb_ipod_clear_music_dirs(ipod_dir, 0);
+    gboolean reset = rb_ipod_db_reset(db);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double reset_time = get_time_diff(start, end);
+
+    printf("🧹 %d tracks, 3 playlists\n", TRACK_COUNT);
+    printf("   Remove %u podcasts: %8.3f ms\n", expected, remove_time * 1000);
+    printf("   Reset all:          %8.3f ms\n\n", reset_time * 1000);
+
+    passed += check("reset removes every file and starts from an empty database",
+                    reset && cleared == TRACK_COUNT - expected && !g_file_test(kept_file, G_FILE_TEST_EXISTS) &&
+                    itdb_tracks_number(db->itdb) == 0 && g_list_length(db->itdb->playlists) == 1 &&
+                    itdb_playlist_mpl(db->itdb) != NULL);
+
+    gboolean saved = rb_ipod_db_save_sync(db);
+    rb_ipod_db_free(db);
+    Itdb_iTunesDB *written = itdb_parse(ipod_dir, NULL);
+    passed += check("empty database written and readable",
+                    saved && written && itdb_tracks_number(written) == 0);
+    if (written) itdb_free(written);
+
+    remove_tree(root);
+    g_free(kept_file);
+    g_free(ipod_dir);
+    g_free(cache_dir);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
@@ -0,0 +1,192 @@
+/* Benchmark du moteur de copie vers l'iPod
+ * Mesure le débit (MB/s) de chaque stratégie de copie pour des petits
+ * fichiers (podcasts) et des gros fichiers (vidéos), et le compare à
+ * l'ancienne copie stdio avec tampon de 8 KB.
+ *
+ * Usage: test_copy_performance [dossier_destination] [taille_petit_MB] [taille_gros_MB]
+ * Le dossier de destination peut être un iPod monté pour mesurer le vrai débit USB.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "rbipod-copy.h"
+
+#define SMALL_FILE_COUNT 8
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static gboolean create_source_file(const char *path, gint64 size) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) return FALSE;
+
+    // Contenu pseudo-aléatoire: évite les raccourcis des systèmes de fichiers compressés
+    guchar *block = g_malloc(1024 * 1024);
+    guint32 state = 0x12345678;
+    for (int i = 0; i < 1024 * 1024; i++) {
+        state = state * 1103515245 + 12345;
+        block[i] = (guchar)(state >> 16);
+    }
+
+    gboolean ok = TRUE;
+    for (gint64 written = 0; written < size && ok;) {
+        gsize chunk = (gsize)MIN((gint64)(1024 * 1024), size - written);
+        ok = write(fd, block, chunk) == (ssize_t)chunk;
+        written += chunk;
+    }
+
+    g_free(block);
+    close(fd);
+    return ok;
+}
+
+// Ancienne implémentation de copy_file_to_ipod (référence)
+static gboolean legacy_stdio_copy(const char *source_path, const char *dest_path) {
+    FILE *source = fopen(source_path, "rb");
+    if (!source) return FALSE;
+    FILE *dest = fopen(dest_path, "wb");
+    if (!dest) {
+        fclose(source);
+        return FALSE;
+    }
+
+    char buffer[8192];
+    size_t bytes_read;
+    gboolean success = TRUE;
+    while ((bytes_read = fread(buffer, 1, sizeof(buffer), source)) > 0) {
+        if (fwrite(buffer, 1, bytes_read, dest) != bytes_read) {
+            success = FALSE;
+            break;
+        }
+    }
+
+    fclose(source);
+    fclose(dest);
+    return success;
+}
+
+// Copie count fichiers et retourne le débit en MB/s (0 si échec)
+static double run_copy(const char *label, char **sources, int count, gint64 size,
+                       const char *dest_dir, int strategy) {
+    struct timespec start, end;
+    gboolean ok = TRUE;
+    RbIpodCopyStrategy used = RB_IPOD_COPY_AUTO;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count && ok; i++) {
+        char *dest = g_strdup_printf("%s/copy_bench_%d.bin", dest_dir, i);
+        if (strategy < 0) {
+            ok = legacy_stdio_copy(sources[i], dest);
+        } else {
+            ok = rb_ipod_copy_file(sources[i], dest, (RbIpodCopyStrategy)strategy, &used);
+        }
+        g_free(dest);
+    }
+    // Inclut le temps d'écriture réel sur le périphérique
+    sync();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int i = 0; i < count; i++) {
+        char *dest = g_strdup_printf("%s/copy_bench_%d.bin", dest_dir, i);
+        unlink(dest);
+        g_free(dest);
+    }
+
+    if (!ok) {
+        printf("   %-18s ⚠️  not supported here\n", label);
+        return 0;
+    }
+
+    double elapsed = get_time_diff(start, end);
+    double mb_per_s = (double)(size * count) / (1024.0 * 1024.0) / elapsed;
+    printf("   %-18s %8.1f MB/s  (%.3f s%s%s)\n", label, mb_per_s, elapsed,
+           strategy == RB_IPOD_COPY_AUTO ? ", used " : "",
+           strategy == RB_IPOD_COPY_AUTO ? rb_ipod_copy_strategy_name(used) : "");
+    return mb_per_s;
+}
+
+static int benchmark_size(const char *title, gint64 size, int count, const char *dest_dir) {
+    printf("%s: %d x %.0f MB\n", title, count, size / (1024.0 * 1024.0));
+
+    char *src_dir = g_dir_make_tmp("rbipod-copy-src-XXXXXX", NULL);
+    if (!src_dir) {
+        printf("❌ Cannot create source directory\n");
+        return 0;
+    }
+
+    char **sources = g_new0(char*, count);
+    for (int i = 0; i < count; i++) {
+        sources[i] = g_strdup_printf("%s/source_%d.bin", src_dir, i);
+        if (!create_source_file(sources[i], size)) {
+            printf("❌ Cannot create source file %s\n", sources[i]);
+            return 0;
+        }
+    }
+
+    double legacy = run_copy("stdio 8 KB (old)", sources, count, size, dest_dir, -1);
+    run_copy("buffered", sources, count, size, dest_dir, RB_IPOD_COPY_BUFFERED);
+    run_copy("sendfile", sources, count, size, dest_dir, RB_IPOD_COPY_SENDFILE);
+    run_copy("copy_file_range", sources, count, size, dest_dir, RB_IPOD_COPY_FILE_RANGE);
+    double automatic = run_copy("auto", sources, count, size, dest_dir, RB_IPOD_COPY_AUTO);
+
+    if (legacy > 0 && automatic > 0) {
+        printf("   Speedup auto vs old: %.2fx\n", automatic / legacy);
+    }
+    printf("\n");
+
+    for (int i = 0; i < count; i++) {
+        unlink(sources[i]);
+        g_free(sources[i]);
+    }
+    g_free(sources);
+    rmdir(src_dir);
+    g_free(src_dir);
+
+    return automatic > 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dest_dir = argc > 1 ? argv[1] : NULL;
+    gint64 small_mb = argc > 2 ? atoi(argv[2]) : 16;
+    gint64 large_mb = argc > 3 ? atoi(argv[3]) : 256;
+
+    printf("=== Copy Engine Performance Test ===\n\n");
+
+    char *tmp_dest = NULL;
+    if (!dest_dir) {
+        tmp_dest = g_dir_make_tmp("rbipod-copy-dst-XXXXXX", NULL);
+        dest_dir = tmp_dest;
+    }
+    printf("Destination: %s\n\n", dest_dir);
+
+    int passed = 0;
+    int total = 2;
+    passed += benchmark_size("🎙️  Small files (podcast)", small_mb * 1024 * 1024, SMALL_FILE_COUNT, dest_dir);
+    passed += benchmark_size("🎬 Large file (video)", large_mb * 1024 * 1024, 1, dest_dir);
+
+    if (tmp_dest) {
+        rmdir(tmp_dest);
+        g_free(tmp_dest);
+    }
+
+    printf("=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
@@ -0,0 +1,137 @@
+/* Test de la sauvegarde de secours de la base iTunesDB
+ * Sur un iPod simulé, enregistre un lot de pistes puis vérifie que la copie
+ * de secours suit chaque écriture validée, qu'un iTunesDB corrompu est
+ * remplacé par la copie de secours à l'ouverture suivante, et que la copie
+ * disparaît à la libération de la base.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-database.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define SIMULATED_MODEL "MA147"
+#define FIRST_TRACKS 2000
+#define SECOND_TRACKS 500
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void add_tracks(RbIpodDb *db, int first, int count) {
+    for (int n = first; n < first + count; n++) {
+        Itdb_Track *track = itdb_track_new();
+        track->title = g_strdup_printf("Track %04d", n);
+        track->artist = g_strdup_printf("Artist %d", n % 50);
+        track->album = g_strdup_printf("Album %d", n % 50);
+        track->ipod_path = g_strdup_printf(":iPod_Control:Music:F%02d:T%05d.mp3", n % 50, n);
+        track->filetype = g_strdup("MPEG audio file");
+        track->size = 4000000 + n;
+        track->tracklen = 180000;
+        track->mediatype = ITDB_MEDIATYPE_AUDIO;
+        rb_ipod_db_add_track(db, track);
+    }
+}
+
+static gboolean same_contents(const char *a, const char *b) {
+    gchar *data_a = NULL, *data_b = NULL;
+    gsize len_a = 0, len_b = 0;
+    gboolean same = g_file_get_contents(a, &data_a, &len_a, NULL) &&
+                    g_file_get_contents(b, &data_b, &len_b, NULL) &&
+                    len_a == len_b && memcmp(data_a, data_b, len_a) == 0;
+    g_free(data_a);
+    g_free(data_b);
+    return same;
+}
+
+int main(void) {
+    printf("=== Database Backup Test ===\n\n");
+
+    char *root = g_dir_make_tmp("rbipod-backup-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    char *ipod_dir = g_build_filename(root, "ipod", NULL);
+    char *cache_dir = g_build_filename(root, "cache", NULL);
+    g_mkdir_with_parents(ipod_dir, 0755);
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    GError *error = NULL;
+    if (!itdb_init_ipod(ipod_dir, SIMULATED_MODEL, "Backup", &error)) {
+        printf("❌ Cannot initialize simulated iPod: %s\n", error ? error->message : "unknown error");
+        return 1;
+    }
+    RbIpodDb *db = rb_ipod_db_new(ipod_dir);
+    if (!db) {
+        printf("❌ Cannot open simulated iPod database\n");
+        return 1;
+    }
+
+    int passed = 0;
+    int total = 5;
+    struct timespec start, end;
+
+    add_tracks(db, 0, FIRST_TRACKS);
+    gboolean saved = rb_ipod_db_save_sync(db);
+    passed += check("validated save refreshes the backup",
+                    saved && validate_ipod_database(db) && same_contents(db->database_path, db->backup_path));
+
+    // Copie de secours prise au lancement d'une commande
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gboolean backed_up = create_database_backup(db);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double backup_time = get_time_diff(start, end);
+
+    add_tracks(db, FIRST_TRACKS, SECOND_TRACKS);
+    saved = rb_ipod_db_save_sync(db);
+    passed += check("backup survives the next save and follows it",
+                    backed_up && saved && same_contents(db->database_path, db->backup_path) &&
+                    !g_file_test(db->working_path, G_FILE_TEST_EXISTS));
+
+    // iTunesDB corrompu (écriture interrompue): restauré à l'ouverture
+    g_file_set_contents(db->database_path, "mhbd", 4, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    RbIpodDb *reopened = rb_ipod_db_new(ipod_dir);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double restore_time = get_time_diff(start, end);
+
+    printf("🛡️  %d tracks in iTunesDB\n", FIRST_TRACKS + SECOND_TRACKS);
+    printf("   Backup:            %8.3f ms\n", backup_time * 1000);
+    printf("   Open with restore: %8.3f ms\n\n", restore_time * 1000);
+
+    passed += check("corrupted database restored from the backup on open",
+                    reopened && itdb_tracks_number(reopened->itdb) == FIRST_TRACKS + SECOND_TRACKS);
+    passed += check("restored database passes validation", reopened && validate_ipod_database(reopened));
+
+    char *backup_path = g_strdup(db->backup_path);
+    rb_ipod_db_free(reopened);
+    rb_ipod_db_free(db);
+    passed += check("backup removed when the database is freed", !g_file_test(backup_path, G_FILE_TEST_EXISTS));
+
+    remove_tree(root);
+    g_free(backup_path);
+    g_free(ipod_dir);
+    g_free(cache_dir);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
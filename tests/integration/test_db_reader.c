@@ -0,0 +1,201 @@
+/* Test du lecteur iTunesDB en lecture seule
+ * Écrit une base sur un iPod simulé avec libgpod (musique, podcasts, vidéos,
+ * listes de lecture), puis la relit par le lecteur mmap: les nombres de
+ * pistes, les totaux par type, les listes et les chaînes doivent être ceux
+ * que donne itdb_parse(), en une fraction du temps.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-database.h"
+#include "rbipod-dbreader.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define SIMULATED_MODEL "MA147"
+#define TRACK_COUNT 5000
+
+typedef struct {
+    guint tracks;
+    guint podcasts;
+    guint videos;
+    gint64 total_size;
+    gint64 total_duration;
+    guint mp3_count;
+    const RbIpodDbTrackRecord *last;
+    RbIpodDbTrackRecord last_copy;
+} ReaderTotals;
+
+typedef struct {
+    guint playlists;
+    guint master_items;
+    guint podcast_items;
+    char *master_name;
+} PlaylistTotals;
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static guint32 mediatype_for(int n) {
+    if (n % 10 == 0) return ITDB_MEDIATYPE_PODCAST;
+    if (n % 25 == 1) return ITDB_MEDIATYPE_MOVIE;
+    return ITDB_MEDIATYPE_AUDIO;
+}
+
+static gboolean add_reader_track(const RbIpodDbTrackRecord *record, gpointer user_data) {
+    ReaderTotals *totals = user_data;
+    totals->tracks++;
+    if (record->mediatype == ITDB_MEDIATYPE_PODCAST) totals->podcasts++;
+    if (record->mediatype == ITDB_MEDIATYPE_MOVIE) totals->videos++;
+    totals->total_size += record->size;
+    totals->total_duration += record->tracklen;
+    if (rb_ipod_dbreader_track_string_is(record, RB_IPOD_MHOD_FILETYPE, "MP3")) totals->mp3_count++;
+    totals->last_copy = *record;
+    totals->last = &totals->last_copy;
+    return TRUE;
+}
+
+static gboolean add_reader_playlist(const RbIpodDbPlaylistRecord *record, gpointer user_data) {
+    PlaylistTotals *totals = user_data;
+    totals->playlists++;
+    if (record->master) {
+        totals->master_items = record->items;
+        totals->master_name = rb_ipod_dbreader_playlist_name(record);
+    }
+    if (record->podcasts) totals->podcast_items = record->items;
+    return TRUE;
+}
+
+int main(void) {
+    printf("=== Read-only iTunesDB Reader Test ===\n\n");
+
+    char *root = g_dir_make_tmp("rbipod-reader-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    char *ipod_dir = g_build_filename(root, "ipod", NULL);
+    char *cache_dir = g_build_filename(root, "cache", NULL);
+    g_mkdir_with_parents(ipod_dir, 0755);
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    GError *error = NULL;
+    if (!itdb_init_ipod(ipod_dir, SIMULATED_MODEL, "Reader Test", &error)) {
+        printf("❌ Cannot initialize simulated iPod: %s\n", error ? error->message : "unknown error");
+        return 1;
+    }
+    RbIpodDb *db = rb_ipod_db_new(ipod_dir);
+    if (!db) {
+        printf("❌ Cannot open simulated iPod database\n");
+        return 1;
+    }
+    Itdb_Playlist *favourites = itdb_playlist_new("Favoris", FALSE);
+    itdb_playlist_add(db->itdb, favourites, -1);
+    GList *favourite_list = g_list_prepend(NULL, favourites);
+
+    gint64 expected_size = 0;
+    guint expected_mp3 = 0;
+    for (int n = 0; n < TRACK_COUNT; n++) {
+        Itdb_Track *track = itdb_track_new();
+        track->title = g_strdup_printf("Titre %04d é", n);
+        track->artist = g_strdup_printf("Artiste %d", n % 40);
+        track->album = g_strdup_printf("Album %d", n % 80);
+        track->ipod_path = g_strdup_printf(":iPod_Control:Music:F%02d:R%05d.mp3", n % 50, n);
+        track->filetype = g_strdup(n % 4 == 0 ? "m4a" : "mp3");
+        track->size = 3000000 + n;
+        track->tracklen = 200000 + n;
+        track->mediatype = mediatype_for(n);
+        expected_size += track->size;
+        if (n % 4 != 0) expected_mp3++;
+        rb_ipod_db_add_track_with_playlists(db, track, n % 3 == 0 ? favourite_list : NULL);
+    }
+    g_list_free(favourite_list);
+    gboolean saved = rb_ipod_db_save_sync(db);
+    rb_ipod_db_free(db);
+
+    int passed = 0;
+    int total = 5;
+    struct timespec start, end;
+
+    // Référence: l'analyse complète par libgpod
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Itdb_iTunesDB *itdb = itdb_parse(ipod_dir, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double parse_time = get_time_diff(start, end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    RbIpodDbReader *reader = rb_ipod_dbreader_open(ipod_dir);
+    ReaderTotals tracks = {0};
+    PlaylistTotals playlists = {0};
+    rb_ipod_dbreader_foreach_track(reader, add_reader_track, &tracks);
+    rb_ipod_dbreader_foreach_playlist(reader, add_reader_playlist, &playlists);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double reader_time = get_time_diff(start, end);
+
+    printf("📖 %d tracks written by libgpod\n", TRACK_COUNT);
+    printf("   itdb_parse:       %8.3f ms\n", parse_time * 1000);
+    printf("   Mapped reader:    %8.3f ms (%.1fx)\n\n", reader_time * 1000,
+           reader_time > 0 ? parse_time / reader_time : 0.0);
+
+    guint expected_podcasts = 0, expected_videos = 0;
+    gint64 expected_duration = 0;
+    for (GList *item = itdb ? itdb->tracks : NULL; item; item = item->next) {
+        Itdb_Track *track = (Itdb_Track*)item->data;
+        if (track->mediatype == ITDB_MEDIATYPE_PODCAST) expected_podcasts++;
+        if (track->mediatype == ITDB_MEDIATYPE_MOVIE) expected_videos++;
+        expected_duration += track->tracklen;
+    }
+
+    passed += check("database written and mapped",
+                    saved && itdb && reader && rb_ipod_dbreader_track_count(reader) == TRACK_COUNT);
+    passed += check("track totals match itdb_parse",
+                    tracks.tracks == itdb_tracks_number(itdb) && tracks.podcasts == expected_podcasts &&
+                    tracks.videos == expected_videos && tracks.total_size == expected_size &&
+                    tracks.total_duration == expected_duration);
+
+    Itdb_Playlist *master = itdb ? itdb_playlist_mpl(itdb) : NULL;
+    Itdb_Playlist *podcasts = itdb ? itdb_playlist_podcasts(itdb) : NULL;
+    passed += check("playlist summaries match itdb_parse",
+                    master && podcasts && playlists.playlists == g_list_length(itdb->playlists) &&
+                    playlists.master_items == itdb_playlist_tracks_number(master) &&
+                    playlists.podcast_items == itdb_playlist_tracks_number(podcasts) &&
+                    g_strcmp0(playlists.master_name, master->name) == 0);
+
+    Itdb_Track *last = itdb ? (Itdb_Track*)g_list_last(itdb->tracks)->data : NULL;
+    char *title = rb_ipod_dbreader_track_string(tracks.last, RB_IPOD_MHOD_TITLE);
+    char *artist = rb_ipod_dbreader_track_string(tracks.last, RB_IPOD_MHOD_ARTIST);
+    passed += check("strings decoded only for the record asked",
+                    last && g_strcmp0(title, last->title) == 0 && g_strcmp0(artist, last->artist) == 0 &&
+                    tracks.mp3_count == expected_mp3);
+    passed += check("reader faster than a full parse", reader_time < parse_time);
+
+    g_free(title);
+    g_free(artist);
+    g_free(playlists.master_name);
+    rb_ipod_dbreader_close(reader);
+    if (itdb) itdb_free(itdb);
+    remove_tree(root);
+    g_free(ipod_dir);
+    g_free(cache_dir);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
@@ -0,0 +1,241 @@
+/* Benchmark du cache de métadonnées côté hôte
+ * Génère un flux de podcast synthétique (épisodes MP3 avec tags ID3v2 et une
+ * pochette commune), puis mesure l'analyse à froid (TagLib + analyse native)
+ * et à chaud (cache projeté en mémoire rouvert comme au lancement suivant).
+ * Vérifie que les résultats sont identiques, qu'un fichier modifié est
+ * réanalysé, qu'un épisode servi par le cache reste marqué non lu, que
+ * --external-tools invalide les entrées et que la pochette partagée n'est
+ * stockée qu'une fois.
+ *
+ * Usage: test_metadata_cache [nombre_episodes]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <glib.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-files.h"
+#include "rbipod-metadata.h"
+#include "rbipod-metacache.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define DEFAULT_EPISODES 500
+#define EPISODE_FRAMES 400              // ~10 s à 128 kbps
+#define MP3_FRAME_LENGTH 417
+#define COVER_SIZE (60 * 1024)
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static gboolean create_episode(const char *path, int number, const guint8 *cover) {
+    GByteArray *tag = g_byte_array_new();
+    char text[64];
+    snprintf(text, sizeof(text), "Episode %d", number);
+    put_id3_text(tag, "TIT2", text);
+    put_id3_text(tag, "TPE1", "Host Name");
+    put_id3_text(tag, "TALB", "Nightly Show");
+    put_id3_text(tag, "TCON", "Podcast");
+    snprintf(text, sizeof(text), "%d", number);
+    put_id3_text(tag, "TRCK", text);
+
+    GByteArray *apic = g_byte_array_new();
+    g_byte_array_append(apic, (const guint8*)"\0image/jpeg\0\x03\0", 14);
+    g_byte_array_append(apic, cover, COVER_SIZE);
+    put_id3_frame(tag, "APIC", apic->data, apic->len);
+    g_byte_array_free(apic, TRUE);
+
+    GByteArray *out = g_byte_array_new();
+    g_byte_array_append(out, (const guint8*)"ID3\x03\x00\x00", 6);
+    put_syncsafe(out, tag->len);
+    g_byte_array_append(out, tag->data, tag->len);
+    g_byte_array_free(tag, TRUE);
+
+    // MPEG-1 Layer III, 128 kbps, 44.1 kHz
+    guint8 frame[MP3_FRAME_LENGTH];
+    memset(frame, 0, sizeof(frame));
+    frame[0] = 0xFF; frame[1] = 0xFB; frame[2] = 0x90; frame[3] = 0x00;
+    for (int i = 0; i < EPISODE_FRAMES; i++) {
+        g_byte_array_append(out, frame, sizeof(frame));
+    }
+
+    gboolean ok = g_file_set_contents(path, (const gchar*)out->data, out->len, NULL);
+    g_byte_array_free(out, TRUE);
+    return ok;
+}
+
+// Analyse tous les épisodes; retourne la durée et garde les résultats
+static double probe_all(char **paths, int count, AudioMetadata **results) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++) {
+        struct stat file_stat;
+        stat(paths[i], &file_stat);
+        results[i] = probe_source_file(paths[i], file_stat.st_size, ITDB_MEDIATYPE_PODCAST);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return get_time_diff(start, end);
+}
+
+static gboolean same_metadata(const AudioMetadata *a, const AudioMetadata *b) {
+    return a && b && g_strcmp0(a->title, b->title) == 0 && g_strcmp0(a->artist, b->artist) == 0 &&
+           g_strcmp0(a->album, b->album) == 0 && a->track_number == b->track_number &&
+           a->duration == b->duration && a->duration_ms == b->duration_ms && a->bitrate == b->bitrate &&
+           a->artwork_size == b->artwork_size &&
+           (a->artwork_size == 0 || memcmp(a->artwork_data, b->artwork_data, a->artwork_size) == 0) &&
+           g_strcmp0(a->artwork_format, b->artwork_format) == 0 && a->time_released == b->time_released &&
+           a->rating == b->rating && a->mark_unplayed == b->mark_unplayed &&
+           a->remember_playback_position == b->remember_playback_position &&
+           a->skip_when_shuffling == b->skip_when_shuffling && a->bookmark_time == b->bookmark_time;
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_EPISODES;
+    if (count < 2) count = 2;
+
+    printf("=== Host Metadata Cache Test ===\n\n");
+
+    char *dir = g_dir_make_tmp("rbipod-metacache-XXXXXX", NULL);
+    if (!dir) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    char *cache_path = g_build_filename(dir, "metadata-cache.bin", NULL);
+
+    guint8 *cover = g_malloc(COVER_SIZE);
+    cover[0] = 0xFF; cover[1] = 0xD8; cover[2] = 0xFF; cover[3] = 0xE0;
+    for (int i = 4; i < COVER_SIZE; i++) cover[i] = (guint8)(i * 31);
+
+    char **paths = g_new0(char*, count);
+    for (int i = 0; i < count; i++) {
+        char *name = g_strdup_printf("episode-%04d.mp3", i + 1);
+        paths[i] = g_build_filename(dir, name, NULL);
+        g_free(name);
+        if (!create_episode(paths[i], i + 1, cover)) {
+            printf("❌ Cannot create %s\n", paths[i]);
+            return 1;
+        }
+    }
+    g_free(cover);
+    printf("🎙️  %d episodes, %d KB shared cover\n\n", count, COVER_SIZE / 1024);
+
+    int passed = 0;
+    int total = 7;
+    AudioMetadata **cold = g_new0(AudioMetadata*, count);
+    AudioMetadata **warm = g_new0(AudioMetadata*, count);
+
+    // Première exécution: cache vide
+    g_sync_ctx.metadata_cache = rb_ipod_metadata_cache_open(cache_path);
+    double cold_time = probe_all(paths, count, cold);
+    gboolean saved = rb_ipod_metadata_cache_save(g_sync_ctx.metadata_cache);
+    rb_ipod_metadata_cache_free(g_sync_ctx.metadata_cache);
+    int cold_misses = g_sync_ctx.stats.metadata_cache_misses;
+
+    // Exécution suivante: ouverture (mmap) comprise dans la mesure
+    memset(&g_sync_ctx.stats, 0, sizeof(g_sync_ctx.stats));
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    g_sync_ctx.metadata_cache = rb_ipod_metadata_cache_open(cache_path);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double open_time = get_time_diff(start, end);
+    double warm_time = probe_all(paths, count, warm) + open_time;
+    int warm_hits = g_sync_ctx.stats.metadata_cache_hits;
+
+    printf("⏱️  Probe %d files:\n", count);
+    printf("   Cold (TagLib + native): %8.2f ms (%.3f ms/file)\n", cold_time * 1000, cold_time * 1000 / count);
+    printf("   Warm (cache):           %8.2f ms (%.3f ms/file, open %.2f ms)\n",
+           warm_time * 1000, warm_time * 1000 / count, open_time * 1000);
+    printf("   Speedup: %.1fx\n\n", cold_time / warm_time);
+
+    int identical = 0;
+    for (int i = 0; i < count; i++) {
+        identical += same_metadata(cold[i], warm[i]);
+    }
+
+    struct stat cache_stat;
+    gint64 cache_size = stat(cache_path, &cache_stat) == 0 ? cache_stat.st_size : 0;
+    printf("🗄️  Cache file: %.1f KB for %d entries\n", cache_size / 1024.0, count);
+
+    passed += saved && cold_misses == count && warm_hits == count;
+    printf("   %s All warm probes answered by the cache (%d/%d)\n", warm_hits == count ? "✅" : "❌", warm_hits, count);
+    passed += identical == count;
+    printf("   %s Cached metadata identical to a full probe (%d/%d)\n", identical == count ? "✅" : "❌", identical, count);
+    passed += cache_size > 0 && cache_size < 2 * COVER_SIZE + (gint64)count * 1024;
+    printf("   %s Shared cover stored once\n", cache_size < 2 * COVER_SIZE + (gint64)count * 1024 ? "✅" : "❌");
+    passed += warm_time < cold_time;
+    printf("   %s Warm run faster than cold run\n", warm_time < cold_time ? "✅" : "❌");
+
+    // Un nouvel épisode servi par le cache doit arriver non lu sur l'iPod
+    Itdb_Track *track = create_ipod_track_from_metadata(warm[1], "/tmp/episode.mp3", ".mp3");
+    gboolean unplayed = warm[1]->mark_unplayed && track && track->mark_unplayed == 0x02;
+    passed += unplayed;
+    printf("   %s Cached episode still marked unplayed\n", unplayed ? "✅" : "❌");
+    if (track) itdb_track_free(track);
+
+    // Avec --external-tools, les résultats sans outils externes ne servent plus
+    memset(&g_sync_ctx.stats, 0, sizeof(g_sync_ctx.stats));
+    g_sync_ctx.allow_external_tools = TRUE;
+    AudioMetadata *scratch = g_new0(AudioMetadata, 1);
+    struct stat episode_stat;
+    stat(paths[1], &episode_stat);
+    gboolean tools_miss = !rb_ipod_metadata_cache_lookup(g_sync_ctx.metadata_cache, paths[1], &episode_stat,
+                                                          ITDB_MEDIATYPE_PODCAST, scratch);
+    g_sync_ctx.allow_external_tools = FALSE;
+    tools_miss = tools_miss && rb_ipod_metadata_cache_lookup(g_sync_ctx.metadata_cache, paths[1], &episode_stat,
+                                                             ITDB_MEDIATYPE_PODCAST, scratch);
+    free_metadata(scratch);
+    passed += tools_miss;
+    printf("   %s Cache keyed on --external-tools\n", tools_miss ? "✅" : "❌");
+
+    // Un épisode réécrit (mtime différent) doit être réanalysé
+    struct timeval times[2];
+    gettimeofday(&times[0], NULL);
+    times[1] = times[0];
+    times[1].tv_sec += 60;
+    utimes(paths[0], times);
+    memset(&g_sync_ctx.stats, 0, sizeof(g_sync_ctx.stats));
+    struct stat file_stat;
+    stat(paths[0], &file_stat);
+    AudioMetadata *changed = probe_source_file(paths[0], file_stat.st_size, ITDB_MEDIATYPE_PODCAST);
+    gboolean invalidated = g_sync_ctx.stats.metadata_cache_misses == 1 && same_metadata(changed, cold[0]);
+    passed += invalidated;
+    printf("   %s Modified file probed again\n", invalidated ? "✅" : "❌");
+    free_metadata(changed);
+
+    rb_ipod_metadata_cache_free(g_sync_ctx.metadata_cache);
+    g_sync_ctx.metadata_cache = NULL;
+
+    for (int i = 0; i < count; i++) {
+        free_metadata(cold[i]);
+        free_metadata(warm[i]);
+        unlink(paths[i]);
+        g_free(paths[i]);
+    }
+    g_free(cold);
+    g_free(warm);
+    g_free(paths);
+    unlink(cache_path);
+    g_free(cache_path);
+    rmdir(dir);
+    g_free(dir);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
@@ -0,0 +1,211 @@
+/* Test et banc d'essai de l'index de recherche
+ * Écrit 100 000 pistes (musique et podcasts) sur un iPod simulé, construit
+ * l'index de trigrammes puis le rouvre depuis le cache: les résultats
+ * doivent être ceux d'un parcours complet des pistes, le filtre par type
+ * de média respecté (une piste sans type comptant comme audio), les accents
+ * ignorés, et une nouvelle écriture de la base doit invalider le cache.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-database.h"
+#include "rbipod-search.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define SIMULATED_MODEL "MA147"
+#define TRACK_COUNT 100000
+#define QUERY_ROUNDS 100
+
+static const char *words[] = { "night", "river", "golden", "shadow", "summer", "ocean", "fire", "dream" };
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static Itdb_Track* new_track(int n) {
+    Itdb_Track *track = itdb_track_new();
+    track->title = g_strdup_printf("%s %s %d", words[n % 8], words[(n / 8) % 8], n);
+    track->artist = g_strdup_printf("Artist %d", n % 997);
+    track->album = g_strdup_printf("Album %d", n % 4001);
+    track->ipod_path = g_strdup_printf(":iPod_Control:Music:F%02d:S%06d.mp3", n % 50, n);
+    track->filetype = g_strdup("mp3");
+    track->size = 3000000 + n;
+    track->mediatype = n % 9 == 0 ? ITDB_MEDIATYPE_PODCAST : ITDB_MEDIATYPE_AUDIO;
+    return track;
+}
+
+static gboolean field_contains(const Itdb_Track *track, const char *term) {
+    return (track->title && strcasestr(track->title, term)) ||
+           (track->artist && strcasestr(track->artist, term)) ||
+           (track->album && strcasestr(track->album, term));
+}
+
+// Référence: parcours complet, chaque terme dans l'un des champs
+static guint brute_force(Itdb_iTunesDB *itdb, const char *query, guint32 mediatype) {
+    gchar **terms = g_strsplit(query, " ", -1);
+    guint count = 0;
+    for (GList *item = itdb->tracks; item; item = item->next) {
+        Itdb_Track *track = (Itdb_Track*)item->data;
+        if (mediatype != 0 && track->mediatype != mediatype) continue;
+        gboolean all = TRUE;
+        for (int i = 0; terms[i] && all; i++) {
+            all = field_contains(track, terms[i]);
+        }
+        if (all) count++;
+    }
+    g_strfreev(terms);
+    return count;
+}
+
+static guint search(RbIpodSearchIndex *index, const char *query, guint32 mediatype) {
+    GArray *hits = g_array_new(FALSE, FALSE, sizeof(guint32));
+    guint found = rb_ipod_search_index_query(index, query, mediatype, 0, hits);
+    g_array_free(hits, TRUE);
+    return found;
+}
+
+int main(void) {
+    printf("=== Device Search Index Test ===\n\n");
+
+    char *root = g_dir_make_tmp("rbipod-search-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    char *ipod_dir = g_build_filename(root, "ipod", NULL);
+    char *cache_dir = g_build_filename(root, "cache", NULL);
+    char *index_path = g_build_filename(cache_dir, "search-index.bin", NULL);
+    g_mkdir_with_parents(ipod_dir, 0755);
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    GError *error = NULL;
+    if (!itdb_init_ipod(ipod_dir, SIMULATED_MODEL, "Search", &error)) {
+        printf("❌ Cannot initialize simulated iPod: %s\n", error ? error->message : "unknown error");
+        return 1;
+    }
+    RbIpodDb *db = rb_ipod_db_new(ipod_dir);
+    if (!db) {
+        printf("❌ Cannot open simulated iPod database\n");
+        return 1;
+    }
+    for (int n = 0; n < TRACK_COUNT; n++) {
+        rb_ipod_db_add_track(db, new_track(n));
+    }
+    Itdb_Track *accented = new_track(TRACK_COUNT);
+    g_free(accented->artist);
+    accented->artist = g_strdup("Beyoncé Knowles");
+    rb_ipod_db_add_track(db, accented);
+    gboolean saved = rb_ipod_db_save_sync(db);
+
+    int passed = 0;
+    int total = 7;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    RbIpodSearchIndex *index = rb_ipod_search_index_open(ipod_dir, index_path);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double build_time = get_time_diff(start, end);
+    gboolean built = saved && index && !rb_ipod_search_index_from_cache(index) &&
+                     rb_ipod_search_index_size(index) == TRACK_COUNT + 1;
+    rb_ipod_search_index_free(index);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    index = rb_ipod_search_index_open(ipod_dir, index_path);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double open_time = get_time_diff(start, end);
+
+    const char *queries[] = { "river", "artist 42", "golden shadow 77", "album 4000", "zzz" };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < QUERY_ROUNDS; round++) {
+        search(index, queries[round % G_N_ELEMENTS(queries)], 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double query_time = get_time_diff(start, end) / QUERY_ROUNDS;
+
+    printf("🔎 %d tracks indexed\n", TRACK_COUNT + 1);
+    printf("   Build from iTunesDB:  %8.3f ms\n", build_time * 1000);
+    printf("   Open cached index:    %8.3f ms\n", open_time * 1000);
+    printf("   Average query:        %8.3f ms\n\n", query_time * 1000);
+
+    passed += check("index built from the database and cached", built);
+    passed += check("cached index mapped instead of rebuilt",
+                    index && rb_ipod_search_index_from_cache(index) && open_time < build_time);
+
+    gboolean same = TRUE;
+    const char *needles[] = { "river", "Artist 42", "Album 4000", "night 1234" };
+    for (gsize i = 0; i < G_N_ELEMENTS(needles); i++) {
+        if (search(index, needles[i], 0) != brute_force(db->itdb, needles[i], 0)) same = FALSE;
+    }
+    passed += check("results match a scan of every track", same);
+
+    GArray *hits = g_array_new(FALSE, FALSE, sizeof(guint32));
+    guint podcasts = rb_ipod_search_index_query(index, "golden", ITDB_MEDIATYPE_PODCAST, 0, hits);
+    gboolean only_podcasts = podcasts == brute_force(db->itdb, "golden", ITDB_MEDIATYPE_PODCAST);
+    for (guint i = 0; i < hits->len; i++) {
+        RbIpodSearchEntry entry;
+        if (!rb_ipod_search_index_entry(index, g_array_index(hits, guint32, i), &entry) ||
+            entry.mediatype != ITDB_MEDIATYPE_PODCAST) {
+            only_podcasts = FALSE;
+        }
+    }
+    g_array_set_size(hits, 0);
+    guint limited = rb_ipod_search_index_query(index, "river", 0, 10, hits);
+    passed += check("media type filter and limit", podcasts > 0 && only_podcasts && limited == 10);
+
+    g_array_set_size(hits, 0);
+    RbIpodSearchEntry entry = {0};
+    gboolean accent_found = rb_ipod_search_index_query(index, "BEYONCE", 0, 0, hits) == 1 &&
+                            rb_ipod_search_index_entry(index, g_array_index(hits, guint32, 0), &entry) &&
+                            strcmp(entry.artist, "Beyoncé Knowles") == 0;
+    passed += check("case and accents ignored", accent_found);
+    g_array_free(hits, TRUE);
+    rb_ipod_search_index_free(index);
+
+    // Base réécrite: le cache est périmé
+    g_usleep(10000);
+    Itdb_Track *late = new_track(TRACK_COUNT + 1);
+    g_free(late->title);
+    late->title = g_strdup("Unmistakable Newcomer");
+    rb_ipod_db_add_track(db, late);
+    // Piste d'une base ancienne, sans type de média: comptée comme audio
+    Itdb_Track *untyped = new_track(TRACK_COUNT + 2);
+    g_free(untyped->title);
+    untyped->title = g_strdup("Untyped Oldtimer");
+    untyped->mediatype = 0;
+    rb_ipod_db_add_track(db, untyped);
+    rb_ipod_db_save_sync(db);
+    index = rb_ipod_search_index_open(ipod_dir, index_path);
+    passed += check("rewritten database invalidates the cached index",
+                    index && !rb_ipod_search_index_from_cache(index) &&
+                    search(index, "newcomer", 0) == 1);
+    passed += check("track without a media type found as audio",
+                    index && search(index, "oldtimer", ITDB_MEDIATYPE_AUDIO) == 1);
+    rb_ipod_search_index_free(index);
+
+    rb_ipod_db_free(db);
+    remove_tree(root);
+    g_free(index_path);
+    g_free(ipod_dir);
+    g_free(cache_dir);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
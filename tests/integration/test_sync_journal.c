@@ -0,0 +1,161 @@
+/* Test de la reprise après une synchronisation interrompue
+ * Sur un iPod simulé, journalise des copies comme le pipeline puis libère la
+ * base sans l'enregistrer (câble débranché). À l'ouverture suivante, les
+ * copies complètes doivent être adoptées sans nouvelle copie, la copie
+ * tronquée et le fichier jamais écrit supprimés, et le journal vidé par la
+ * sauvegarde.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-database.h"
+#include "rbipod-journal.h"
+#include "rbipod-index.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define SIMULATED_MODEL "MA147"
+#define COMPLETE_COPIES 50
+#define SOURCE_SIZE 65536
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void write_bytes(const char *path, gsize size) {
+    gchar *data = g_malloc(size);
+    for (gsize i = 0; i < size; i++) data[i] = (gchar)(i * 31);
+    g_file_set_contents(path, data, size, NULL);
+    g_free(data);
+}
+
+static gint64 source_mtime(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (gint64)st.st_mtime : 0;
+}
+
+int main(void) {
+    printf("=== Interrupted Sync Recovery Test ===\n\n");
+
+    char *root = g_dir_make_tmp("rbipod-journal-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    char *ipod_dir = g_build_filename(root, "ipod", NULL);
+    char *source_dir = g_build_filename(root, "music", NULL);
+    char *cache_dir = g_build_filename(root, "cache", NULL);
+    char *music_dir = g_build_filename(ipod_dir, "iPod_Control", "Music", "F07", NULL);
+    g_mkdir_with_parents(source_dir, 0755);
+
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    GError *error = NULL;
+    if (!itdb_init_ipod(ipod_dir, SIMULATED_MODEL, "Journal", &error)) {
+        printf("❌ Cannot initialize simulated iPod: %s\n", error ? error->message : "unknown error");
+        return 1;
+    }
+    g_mkdir_with_parents(music_dir, 0755);
+
+    // Première exécution: copies journalisées, puis arrêt avant toute sauvegarde
+    RbIpodDb *db = rb_ipod_db_new(ipod_dir);
+    if (!db) {
+        printf("❌ Cannot open simulated iPod database\n");
+        return 1;
+    }
+    char *partial = NULL;
+    char *never_written = NULL;
+    for (int i = 0; i < COMPLETE_COPIES + 2; i++) {
+        char *name = g_strdup_printf("%02d - Track %d.mp3", i + 1, i);
+        char *source = g_build_filename(source_dir, name, NULL);
+        char *file = g_strdup_printf("RBJ%04d.mp3", i);
+        char *device = g_build_filename(music_dir, file, NULL);
+        write_bytes(source, SOURCE_SIZE);
+
+        rb_ipod_sync_journal_record(db->journal, device, source, SOURCE_SIZE, source_mtime(source),
+                                    ITDB_MEDIATYPE_AUDIO);
+        if (i < COMPLETE_COPIES) {
+            write_bytes(device, SOURCE_SIZE);
+        } else if (i == COMPLETE_COPIES) {
+            write_bytes(device, SOURCE_SIZE / 3);     // Copie interrompue
+            partial = g_strdup(device);
+        } else {
+            never_written = g_strdup(device);           // Jamais commencée
+        }
+        g_free(name);
+        g_free(source);
+        g_free(file);
+        g_free(device);
+    }
+    rb_ipod_db_free(db);
+
+    int passed = 0;
+    int total = 4;
+    struct timespec start, end;
+
+    // Exécution suivante
+    memset(&g_sync_ctx.stats, 0, sizeof(g_sync_ctx.stats));
+    db = rb_ipod_db_new(ipod_dir);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    guint adopted = rb_ipod_sync_journal_recover(db);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double recover_time = get_time_diff(start, end);
+
+    printf("🔌 %d complete copies, 1 partial, 1 never written\n", COMPLETE_COPIES);
+    printf("   Recovery: %8.3f ms (%u adopted, %d removed)\n\n", recover_time * 1000,
+           adopted, g_sync_ctx.stats.orphans_removed);
+
+    char *first_source = g_build_filename(source_dir, "01 - Track 0.mp3", NULL);
+    gboolean indexed = rb_ipod_content_index_lookup_source(db->content_index, first_source, SOURCE_SIZE,
+                                                           source_mtime(first_source)) != NULL;
+    passed += check("complete copies adopted and their sources indexed",
+                    adopted == COMPLETE_COPIES && itdb_tracks_number(db->itdb) == COMPLETE_COPIES && indexed);
+    passed += check("partial copy removed",
+                    g_sync_ctx.stats.orphans_removed == 1 && !g_file_test(partial, G_FILE_TEST_EXISTS) &&
+                    !g_file_test(never_written, G_FILE_TEST_EXISTS));
+
+    gboolean saved = rb_ipod_db_save_sync(db);
+    char *journal_path = rb_ipod_device_cache_path(db->itdb, ipod_dir, "sync-journal");
+    passed += check("journal emptied once the adopted tracks are saved",
+                    saved && !g_file_test(journal_path, G_FILE_TEST_EXISTS));
+    rb_ipod_db_free(db);
+
+    // Rien à reprendre une fois la base écrite
+    memset(&g_sync_ctx.stats, 0, sizeof(g_sync_ctx.stats));
+    db = rb_ipod_db_new(ipod_dir);
+    passed += check("adopted tracks written, nothing left to recover",
+                    db && itdb_tracks_number(db->itdb) == COMPLETE_COPIES &&
+                    rb_ipod_sync_journal_recover(db) == 0 && g_sync_ctx.stats.orphans_removed == 0);
+    rb_ipod_db_free(db);
+
+    remove_tree(root);
+    g_free(journal_path);
+    g_free(first_source);
+    g_free(partial);
+    g_free(never_written);
+    g_free(music_dir);
+    g_free(cache_dir);
+    g_free(source_dir);
+    g_free(ipod_dir);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
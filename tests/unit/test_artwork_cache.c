@@ -0,0 +1,179 @@
+/* Test du cache de déduplication des pochettes
+ * Simule un album de 20 pistes partageant une pochette PNG: compare la
+ * conversion JPEG par piste (ancien comportement) au cache par empreinte
+ * (décodage unique en GdkPixbuf), vérifie que chaque piste reçoit sa
+ * pochette, que l'image n'est décodée qu'une fois, que la LRU borne la
+ * mémoire des images décodées et qu'au-delà du budget mémoire les pochettes
+ * sont déportées sur disque.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-artcache.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define ALBUM_TRACKS 20
+#define COVER_DIMENSION 600
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Pochette PNG synthétique (dégradé, pour un encodage non trivial)
+static gboolean create_cover(AudioMetadata *meta, int seed) {
+    GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, COVER_DIMENSION, COVER_DIMENSION);
+    if (!pixbuf) return FALSE;
+
+    guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    for (int y = 0; y < COVER_DIMENSION; y++) {
+        for (int x = 0; x < COVER_DIMENSION; x++) {
+            guchar *p = pixels + y * rowstride + x * 3;
+            p[0] = (x + seed) & 0xFF;
+            p[1] = (y * 2) & 0xFF;
+            p[2] = (x ^ y) & 0xFF;
+        }
+    }
+
+    gchar *data = NULL;
+    gsize size = 0;
+    gboolean ok = gdk_pixbuf_save_to_buffer(pixbuf, &data, &size, "png", NULL, NULL);
+    g_object_unref(pixbuf);
+
+    memset(meta, 0, sizeof(*meta));
+    meta->artwork_data = (guchar*)data;
+    meta->artwork_size = size;
+    meta->artwork_format = "png";
+    return ok;
+}
+
+// Ancien chemin: décodage + réencodage JPEG puis vignettes pour chaque piste
+static gboolean apply_uncached(Itdb_Track *track, const AudioMetadata *meta) {
+    GInputStream *stream = g_memory_input_stream_new_from_data(meta->artwork_data, meta->artwork_size, NULL);
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_stream(stream, NULL, NULL);
+    g_object_unref(stream);
+    if (!pixbuf) return FALSE;
+
+    gchar *jpeg = NULL;
+    gsize jpeg_size = 0;
+    gboolean ok = gdk_pixbuf_save_to_buffer(pixbuf, &jpeg, &jpeg_size, "jpeg", NULL, "quality", "90", NULL);
+    g_object_unref(pixbuf);
+    ok = ok && itdb_track_set_thumbnails_from_data(track, (guchar*)jpeg, jpeg_size);
+    g_free(jpeg);
+    return ok;
+}
+
+int main(void) {
+    printf("=== Artwork Deduplication Cache Test ===\n\n");
+
+    AudioMetadata cover, other_cover;
+    AudioMetadata third_cover, spilled_cover;
+    if (!create_cover(&cover, 0) || !create_cover(&other_cover, 7) || !create_cover(&third_cover, 13) ||
+        !create_cover(&spilled_cover, 21)) {
+        printf("❌ Cannot create test covers\n");
+        return 1;
+    }
+    printf("🖼️  %d-track album, %dx%d PNG cover (%zu bytes)\n\n",
+           ALBUM_TRACKS, COVER_DIMENSION, COVER_DIMENSION, cover.artwork_size);
+
+    int passed = 0;
+    int total = 7;
+    struct timespec start, end;
+
+    Itdb_Track *uncached[ALBUM_TRACKS];
+    int uncached_ok = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ALBUM_TRACKS; i++) {
+        uncached[i] = itdb_track_new();
+        uncached_ok += apply_uncached(uncached[i], &cover);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double uncached_time = get_time_diff(start, end);
+
+    RbIpodArtworkCache *cache = rb_ipod_artwork_cache_new(NULL);
+    Itdb_Track *cached[ALBUM_TRACKS];
+    int cached_ok = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ALBUM_TRACKS; i++) {
+        cached[i] = itdb_track_new();
+        cached_ok += rb_ipod_artwork_cache_apply(cache, cached[i], &cover);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double cached_time = get_time_diff(start, end);
+
+    printf("⏱️  Artwork setup for %d tracks:\n", ALBUM_TRACKS);
+    printf("   Per track conversion: %8.2f ms\n", uncached_time * 1000);
+    printf("   Decode-once cache:    %8.2f ms (%.1fx)\n\n", cached_time * 1000, uncached_time / cached_time);
+
+    gboolean all_have_artwork = cached_ok == ALBUM_TRACKS && uncached_ok == ALBUM_TRACKS;
+    for (int i = 0; i < ALBUM_TRACKS; i++) {
+        if (!itdb_track_has_thumbnails(cached[i])) all_have_artwork = FALSE;
+        if (i > 0 && cached[i]->artwork == cached[0]->artwork) all_have_artwork = FALSE;
+    }
+    passed += check("every track has its own artwork", all_have_artwork);
+    passed += check("cover decoded once (1 miss, 19 hits)",
+                    g_sync_ctx.stats.artwork_cache_misses == 1 &&
+                    g_sync_ctx.stats.artwork_cache_hits == ALBUM_TRACKS - 1);
+    passed += check("bytes saved reported",
+                    g_sync_ctx.stats.artwork_bytes_saved == (gint64)(ALBUM_TRACKS - 1) * (gint64)cover.artwork_size);
+
+    Itdb_Track *other = itdb_track_new();
+    rb_ipod_artwork_cache_apply(cache, other, &other_cover);
+    passed += check("distinct cover gets its own entry", rb_ipod_artwork_cache_get_image_count(cache) == 2);
+    passed += check("cached path faster than per-track conversion", cached_time < uncached_time);
+
+    // Budget for two decoded covers: the album cover (least recently used)
+    // is evicted, tracks that already have it keep their reference
+    gsize image_bytes = rb_ipod_artwork_cache_get_pixel_bytes(cache) / 2;
+    rb_ipod_artwork_cache_set_max_bytes(cache, image_bytes * 5 / 2);
+    Itdb_Track *third = itdb_track_new();
+    rb_ipod_artwork_cache_apply(cache, third, &third_cover);
+    passed += check("LRU keeps decoded images within budget",
+                    rb_ipod_artwork_cache_get_image_count(cache) == 2 &&
+                    rb_ipod_artwork_cache_get_pixel_bytes(cache) <= image_bytes * 5 / 2 &&
+                    itdb_track_has_thumbnails(cached[0]));
+
+    // Budget already used by the covers handed out: the next one goes to disk
+    gsize retained = rb_ipod_artwork_cache_get_retained_bytes(cache);
+    rb_ipod_artwork_cache_set_memory_budget(cache, retained);
+    Itdb_Track *spilled = itdb_track_new();
+    rb_ipod_artwork_cache_apply(cache, spilled, &spilled_cover);
+    passed += check("covers beyond the memory budget spilled to disk",
+                    itdb_track_has_thumbnails(spilled) && g_sync_ctx.stats.artwork_spilled == 1 &&
+                    rb_ipod_artwork_cache_get_retained_bytes(cache) == retained);
+    printf("   Peak RSS: %.1f MB\n", rb_ipod_get_peak_rss_kb() / 1024.0);
+
+    itdb_track_free(spilled);
+    itdb_track_free(third);
+    itdb_track_free(other);
+    for (int i = 0; i < ALBUM_TRACKS; i++) {
+        itdb_track_free(uncached[i]);
+        itdb_track_free(cached[i]);
+    }
+    rb_ipod_artwork_cache_free(cache);
+    g_free(cover.artwork_data);
+    g_free(other_cover.artwork_data);
+    g_free(third_cover.artwork_data);
+    g_free(spilled_cover.artwork_data);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
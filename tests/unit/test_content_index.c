@@ -0,0 +1,107 @@
+/* Test de l'index de contenu utilisé par la synchronisation incrémentale
+ * Vérifie la déduplication par identité (titre, artiste, taille et type de
+ * média: un livre audio et un morceau identiques restent distincts), la
+ * correspondance fichier source -> piste, sa persistance dans le fichier
+ * annexe et le retrait d'une piste.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-index.h"
+#include "test_helpers.h"
+
+#define MOUNT_POINT "/media/test-ipod"
+#define SHARED_SIZE 5242880
+
+static Itdb_Track* add_track(Itdb_iTunesDB *itdb, const char *name, guint32 mediatype, guint64 dbid) {
+    Itdb_Track *track = itdb_track_new();
+    track->title = g_strdup("Chapter 1");
+    track->artist = g_strdup("Narrator");
+    track->size = SHARED_SIZE;
+    track->mediatype = mediatype;
+    track->dbid = dbid;
+    track->ipod_path = g_strdup_printf(":iPod_Control:Music:F00:%s", name);
+    itdb_track_add(itdb, track, -1);
+    return track;
+}
+
+int main(void) {
+    printf("=== Content Index Test ===\n\n");
+
+    char *root = g_dir_make_tmp("rbipod-index-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    g_setenv("XDG_CACHE_HOME", root, TRUE);
+
+    int passed = 0;
+    int total = 5;
+
+    Itdb_iTunesDB *itdb = itdb_new();
+    Itdb_Track *song = add_track(itdb, "SONG.mp3", ITDB_MEDIATYPE_AUDIO, 0x1001);
+    Itdb_Track *book = add_track(itdb, "BOOK.m4b", ITDB_MEDIATYPE_AUDIOBOOK, 0x1002);
+    RbIpodContentIndex *index = rb_ipod_content_index_new(itdb, MOUNT_POINT);
+
+    passed += check("audiobook and song with the same tags stay distinct",
+                    index &&
+                    rb_ipod_content_index_lookup_identity(index, "Chapter 1", "Narrator", SHARED_SIZE,
+                                                          ITDB_MEDIATYPE_AUDIO) == song &&
+                    rb_ipod_content_index_lookup_identity(index, "Chapter 1", "Narrator", SHARED_SIZE,
+                                                          ITDB_MEDIATYPE_AUDIOBOOK) == book &&
+                    !rb_ipod_content_index_lookup_identity(index, "Chapter 1", "Narrator", SHARED_SIZE,
+                                                           ITDB_MEDIATYPE_PODCAST));
+
+    // Base trop ancienne pour stocker le type: la piste compte comme audio
+    Itdb_Track *legacy = itdb_track_new();
+    legacy->title = g_strdup("Old Song");
+    legacy->artist = g_strdup("Narrator");
+    legacy->size = SHARED_SIZE;
+    legacy->ipod_path = g_strdup(":iPod_Control:Music:F01:OLD.mp3");
+    itdb_track_add(itdb, legacy, -1);
+    rb_ipod_content_index_add_track(index, legacy);
+    passed += check("track without a media type matches an audio file",
+                    rb_ipod_content_index_lookup_identity(index, "Old Song", "Narrator", SHARED_SIZE,
+                                                          ITDB_MEDIATYPE_AUDIO) == legacy);
+
+    rb_ipod_content_index_record_source(index, "/music/book.m4b", SHARED_SIZE, 1000, book);
+    passed += check("source lookup requires unchanged size and mtime",
+                    rb_ipod_content_index_lookup_source(index, "/music/book.m4b", SHARED_SIZE, 1000) == book &&
+                    !rb_ipod_content_index_lookup_source(index, "/music/book.m4b", SHARED_SIZE, 2000) &&
+                    !rb_ipod_content_index_lookup_source(index, "/music/song.mp3", SHARED_SIZE, 1000));
+
+    gboolean saved = rb_ipod_content_index_save(index, itdb);
+    rb_ipod_content_index_free(index);
+    index = rb_ipod_content_index_new(itdb, MOUNT_POINT);
+    passed += check("source mapping survives a save and reload",
+                    saved && rb_ipod_content_index_lookup_source(index, "/music/book.m4b",
+                                                                 SHARED_SIZE, 1000) == book);
+
+    rb_ipod_content_index_remove_track(index, book);
+    passed += check("removed track leaves the song in place",
+                    !rb_ipod_content_index_lookup_identity(index, "Chapter 1", "Narrator", SHARED_SIZE,
+                                                           ITDB_MEDIATYPE_AUDIOBOOK) &&
+                    !rb_ipod_content_index_lookup_source(index, "/music/book.m4b", SHARED_SIZE, 1000) &&
+                    rb_ipod_content_index_lookup_identity(index, "Chapter 1", "Narrator", SHARED_SIZE,
+                                                          ITDB_MEDIATYPE_AUDIO) == song);
+
+    rb_ipod_content_index_free(index);
+    itdb_free(itdb);
+    remove_tree(root);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
@@ -0,0 +1,201 @@
+/* Micro-benchmark de l'allocateur de noms de fichiers iPod
+ * Vérifie que le coût d'une allocation reste constant quel que soit
+ * le nombre de fichiers déjà présents dans iPod_Control/Music/Fxx,
+ * et qu'aucun nom alloué n'entre en collision avec un fichier existant.
+ * Mesure aussi l'ancien chemin, qui relisait tous les répertoires Fxx à
+ * chaque fichier.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "rbipod-allocator.h"
+
+#define ALLOCATIONS_PER_RUN 20000
+#define LEGACY_ALLOCATIONS 20
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Crée un faux iPod contenant num_files fichiers répartis sur F00-F49
+static char* create_fake_ipod(int num_files) {
+    char *root = g_dir_make_tmp("rbipod-alloc-XXXXXX", NULL);
+    if (!root) return NULL;
+
+    for (int dir_num = 0; dir_num < IPOD_MUSIC_DIR_COUNT; dir_num++) {
+        char f_dir[MAX_PATH_LEN];
+        snprintf(f_dir, sizeof(f_dir), "%s/iPod_Control/Music/F%02d", root, dir_num);
+        g_mkdir_with_parents(f_dir, 0755);
+    }
+
+    for (int i = 0; i < num_files; i++) {
+        guint32 value = (guint32)i;
+        char path[MAX_PATH_LEN];
+        snprintf(path, sizeof(path), "%s/iPod_Control/Music/F%02d/%c%c%c%c.mp3", root,
+                 i % IPOD_MUSIC_DIR_COUNT,
+                 'A' + (value / (26 * 26 * 26)) % 26, 'A' + (value / (26 * 26)) % 26,
+                 'A' + (value / 26) % 26, 'A' + value % 26);
+        int fd = open(path, O_CREAT | O_WRONLY, 0644);
+        if (fd >= 0) close(fd);
+    }
+
+    return root;
+}
+
+static void remove_fake_ipod(const char *root) {
+    for (int dir_num = 0; dir_num < IPOD_MUSIC_DIR_COUNT; dir_num++) {
+        char f_dir[MAX_PATH_LEN];
+        snprintf(f_dir, sizeof(f_dir), "%s/iPod_Control/Music/F%02d", root, dir_num);
+
+        GDir *dir = g_dir_open(f_dir, 0, NULL);
+        if (!dir) continue;
+        const char *name;
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            char *path = g_build_filename(f_dir, name, NULL);
+            unlink(path);
+            g_free(path);
+        }
+        g_dir_close(dir);
+        rmdir(f_dir);
+    }
+
+    char *music = g_build_filename(root, "iPod_Control", "Music", NULL);
+    char *control = g_build_filename(root, "iPod_Control", NULL);
+    rmdir(music);
+    rmdir(control);
+    rmdir(root);
+    g_free(music);
+    g_free(control);
+}
+
+// Ancien comportement: relecture des 50 répertoires Fxx avant chaque nom
+static char* legacy_allocate(const char *root) {
+    guint32 max_counter = 0;
+    for (int dir_num = 0; dir_num < IPOD_MUSIC_DIR_COUNT; dir_num++) {
+        char f_dir[MAX_PATH_LEN];
+        snprintf(f_dir, sizeof(f_dir), "%s/iPod_Control/Music/F%02d", root, dir_num);
+
+        GDir *dir = g_dir_open(f_dir, 0, NULL);
+        if (!dir) continue;
+        const char *name;
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            if (strlen(name) < 5) continue;
+            guint32 value = 0;
+            gboolean letters = TRUE;
+            for (int i = 0; i < 4 && letters; i++) {
+                letters = name[i] >= 'A' && name[i] <= 'Z';
+                value = value * 26 + (guint32)(name[i] - 'A');
+            }
+            guint32 counter = dir_num * 100 + value;
+            if (letters && counter > max_counter) max_counter = counter;
+        }
+        g_dir_close(dir);
+    }
+
+    guint32 counter = max_counter + 1;
+    guint32 name_id = counter % (26 * 26 * 26 * 26);
+    return g_strdup_printf("%s/iPod_Control/Music/F%02d/%c%c%c%c.mp3", root, (counter / 100) % 50,
+                           'A' + (name_id / (26 * 26 * 26)) % 26, 'A' + (name_id / (26 * 26)) % 26,
+                           'A' + (name_id / 26) % 26, 'A' + name_id % 26);
+}
+
+static int run_benchmark(int existing_files, double *ns_per_alloc) {
+    printf("📁 %6d existing files: ", existing_files);
+    fflush(stdout);
+
+    char *root = create_fake_ipod(existing_files);
+    if (!root) {
+        printf("❌ Cannot create temporary iPod tree\n");
+        return 0;
+    }
+
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    RbIpodFileAllocator *allocator = rb_ipod_file_allocator_new(root);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double scan_time = get_time_diff(start, end);
+
+    char **paths = g_new0(char*, ALLOCATIONS_PER_RUN);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ALLOCATIONS_PER_RUN; i++) {
+        paths[i] = rb_ipod_file_allocator_next(allocator, "track.mp3");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double alloc_time = get_time_diff(start, end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < LEGACY_ALLOCATIONS; i++) {
+        g_free(legacy_allocate(root));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double legacy_time = get_time_diff(start, end) / LEGACY_ALLOCATIONS;
+
+    // Vérification: noms uniques et jamais déjà présents sur le disque
+    int collisions = 0;
+    GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+    for (int i = 0; i < ALLOCATIONS_PER_RUN; i++) {
+        if (!paths[i] || g_hash_table_contains(seen, paths[i]) ||
+            g_file_test(paths[i], G_FILE_TEST_EXISTS)) {
+            collisions++;
+        } else {
+            g_hash_table_add(seen, paths[i]);
+        }
+    }
+    g_hash_table_destroy(seen);
+
+    *ns_per_alloc = alloc_time * 1e9 / ALLOCATIONS_PER_RUN;
+    printf("scan %.2f ms once, %.0f ns/allocation (legacy rescanned every file: %.2f ms/file)%s\n",
+           scan_time * 1000, *ns_per_alloc, legacy_time * 1000,
+           collisions ? " ❌" : " ✓");
+    if (collisions) {
+        printf("   ❌ %d colliding names\n", collisions);
+    }
+
+    for (int i = 0; i < ALLOCATIONS_PER_RUN; i++) g_free(paths[i]);
+    g_free(paths);
+    rb_ipod_file_allocator_free(allocator);
+    remove_fake_ipod(root);
+    g_free(root);
+
+    return collisions == 0;
+}
+
+int main(void) {
+    printf("=== iPod Filename Allocator Benchmark ===\n\n");
+
+    int sizes[] = { 1000, 10000, 100000 };
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    double costs[3] = { 0 };
+    int passed = 0;
+
+    for (int i = 0; i < num_sizes; i++) {
+        if (run_benchmark(sizes[i], &costs[i])) {
+            passed++;
+        }
+    }
+
+    printf("\n=== Results ===\n");
+    printf("Collision-free runs: %d/%d\n", passed, num_sizes);
+    if (costs[0] > 0) {
+        printf("Allocation cost 100k vs 1k existing files: %.2fx\n", costs[num_sizes - 1] / costs[0]);
+    }
+
+    if (passed == num_sizes) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
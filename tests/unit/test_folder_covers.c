@@ -0,0 +1,149 @@
+/* Test de la découverte des pochettes de dossier
+ * Construit une arborescence (album avec cover.jpg + folder.png, album avec
+ * front.png, album sans image), la parcourt avec le walker puis vérifie la
+ * priorité des noms, la résolution unique par dossier et l'application des
+ * pochettes aux pistes sans image intégrée.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "rbipod-covers.h"
+#include "rbipod-walker.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define ALBUM_TRACKS 12
+#define APPLY_ROUNDS 100
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static char* write_file(const char *dir, const char *name, const char *contents) {
+    char *path = g_build_filename(dir, name, NULL);
+    g_file_set_contents(path, contents, -1, NULL);
+    return path;
+}
+
+static char* make_album(const char *root, const char *name, int tracks) {
+    char *dir = g_build_filename(root, name, NULL);
+    g_mkdir_with_parents(dir, 0755);
+    for (int i = 0; i < tracks; i++) {
+        char track[32];
+        snprintf(track, sizeof(track), "%02d - Track.mp3", i + 1);
+        g_free(write_file(dir, track, "ID3"));
+    }
+    return dir;
+}
+
+static gboolean applied(RbIpodFolderCovers *covers, const char *dir, const char *expected,
+                        const char *format) {
+    char *track = g_build_filename(dir, "01 - Track.mp3", NULL);
+    AudioMetadata meta;
+    memset(&meta, 0, sizeof(meta));
+    gboolean ok = rb_ipod_folder_covers_apply(covers, track, &meta);
+    if (expected) {
+        ok = ok && meta.artwork_size == strlen(expected) &&
+             memcmp(meta.artwork_data, expected, meta.artwork_size) == 0 &&
+             strcmp(meta.artwork_format, format) == 0;
+    } else {
+        ok = !ok && meta.artwork_data == NULL;
+    }
+    g_free(meta.artwork_data);
+    g_free(meta.artwork_format);
+    g_free(track);
+    return ok;
+}
+
+int main(void) {
+    printf("=== Folder Cover Discovery Test ===\n\n");
+
+    char *root = g_dir_make_tmp("rbipod-covers-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create test tree\n");
+        return 1;
+    }
+    char *tagged = make_album(root, "Tagged Album", ALBUM_TRACKS);
+    char *png_only = make_album(root, "PNG Album", 1);
+    char *bare = make_album(root, "Bare Album", 1);
+    char *cover_jpg = write_file(tagged, "Cover.JPG", "jpeg cover bytes");
+    g_free(write_file(tagged, "folder.png", "png folder bytes"));
+    g_free(write_file(tagged, "back.jpg", "back bytes"));
+    g_free(write_file(png_only, "front.png", "png front bytes"));
+    g_free(write_file(bare, "notes.txt", "not an image"));
+
+    int passed = 0;
+    int total = 6;
+    struct timespec start, end;
+
+    passed += check("cover name priority (cover < folder < front, JPEG before PNG)",
+                    rb_ipod_folder_cover_rank("cover.jpg") < rb_ipod_folder_cover_rank("Cover.png") &&
+                    rb_ipod_folder_cover_rank("Cover.png") < rb_ipod_folder_cover_rank("FOLDER.jpeg") &&
+                    rb_ipod_folder_cover_rank("folder.jpg") < rb_ipod_folder_cover_rank("front.png") &&
+                    rb_ipod_folder_cover_rank("back.jpg") == 0 &&
+                    rb_ipod_folder_cover_rank("cover.gif") == 0 &&
+                    rb_ipod_folder_cover_rank(".png") == 0);
+
+    g_sync_ctx.folder_covers = rb_ipod_folder_covers_new();
+    RbIpodManifest *manifest = rb_ipod_walk_directory(root, 2, NULL);
+
+    // Listed by the walker as coverless: an image added afterwards is not seen
+    g_free(write_file(bare, "cover.jpg", "late cover"));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gboolean tagged_ok = TRUE;
+    for (int i = 0; i < APPLY_ROUNDS; i++) {
+        tagged_ok = applied(g_sync_ctx.folder_covers, tagged, "jpeg cover bytes", "jpeg") && tagged_ok;
+        if (i == 0) g_unlink(cover_jpg);  // Loaded once: later tracks need no read
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double apply_time = get_time_diff(start, end) / APPLY_ROUNDS;
+
+    printf("📁 %u files walked, folder cover per track: %.3f ms\n\n",
+           manifest ? manifest->entries->len : 0, apply_time * 1000);
+
+    passed += check("walker found the album files", manifest && manifest->entries->len == ALBUM_TRACKS + 2);
+    passed += check("best cover applied, image read once per directory", tagged_ok);
+    passed += check("PNG cover applied with its format",
+                    applied(g_sync_ctx.folder_covers, png_only, "png front bytes", "png"));
+    passed += check("directory resolved during the walk is not listed again",
+                    applied(g_sync_ctx.folder_covers, bare, NULL, NULL) &&
+                    g_sync_ctx.stats.folder_covers_used == APPLY_ROUNDS + 1);
+
+    // Files synced without a walk (sync-file): the directory is listed lazily
+    RbIpodFolderCovers *lazy = rb_ipod_folder_covers_new();
+    char *bare_track = g_build_filename(bare, "01 - Track.mp3", NULL);
+    passed += check("unwalked directory resolved on first use",
+                    rb_ipod_folder_covers_has(lazy, bare_track) &&
+                    applied(lazy, bare, "late cover", "jpeg"));
+    g_free(bare_track);
+    rb_ipod_folder_covers_free(lazy);
+
+    rb_ipod_manifest_free(manifest);
+    rb_ipod_folder_covers_free(g_sync_ctx.folder_covers);
+    g_sync_ctx.folder_covers = NULL;
+    remove_tree(root);
+    g_free(cover_jpg);
+    g_free(tagged);
+    g_free(png_only);
+    g_free(bare);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
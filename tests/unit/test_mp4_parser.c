@@ -0,0 +1,230 @@
+/* Test du parseur natif d'atomes MP4
+ * Génère un épisode de série M4V synthétique (mdat creux de 2 GB placé avant
+ * moov) avec tags iTunes, pochette PNG et chapitres Nero, vérifie les champs
+ * extraits et le temps d'analyse (mdat ne doit jamais être lu).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-mp4.h"
+#include "test_helpers.h"
+
+#define SPARSE_MDAT_SIZE (2000LL * 1024 * 1024)
+#define PARSE_ITERATIONS 1000
+#define COVER_SIZE 5000
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void put_text(GByteArray *ilst, const char *type, const char *text) {
+    put_item(ilst, type, 1, text, strlen(text));
+}
+
+static void put_int(GByteArray *ilst, const char *type, guint32 value, gsize length) {
+    guint8 b[4] = {value >> 24, value >> 16, value >> 8, value};
+    put_item(ilst, type, 21, b + 4 - length, length);
+}
+
+static GByteArray* build_trak(const char *handler, guint32 timescale) {
+    GByteArray *mdhd = g_byte_array_new();
+    put_zeros(mdhd, 12);            // version/flags, creation, modification
+    put_be32(mdhd, timescale);
+    put_be32(mdhd, timescale * 100);
+    put_zeros(mdhd, 4);
+    GByteArray *hdlr = g_byte_array_new();
+    put_zeros(hdlr, 8);
+    g_byte_array_append(hdlr, (const guint8*)handler, 4);
+    put_zeros(hdlr, 13);
+
+    GByteArray *mdia = g_byte_array_new();
+    put_atom(mdia, "mdhd", mdhd);
+    put_atom(mdia, "hdlr", hdlr);
+    GByteArray *trak = g_byte_array_new();
+    put_atom(trak, "mdia", mdia);
+    return trak;
+}
+
+static GByteArray* build_moov(int seconds) {
+    GByteArray *mvhd = g_byte_array_new();
+    put_zeros(mvhd, 12);
+    put_be32(mvhd, 600);
+    put_be32(mvhd, seconds * 600);
+    put_zeros(mvhd, 80);
+
+    GByteArray *ilst = g_byte_array_new();
+    put_text(ilst, "\xA9nam", "Épisode 3");
+    put_text(ilst, "\xA9" "ART", "Artist");
+    put_text(ilst, "tvsh", "My Show");
+    put_text(ilst, "tven", "S02E03");
+    put_text(ilst, "\xA9" "day", "2021-06-15T00:00:00Z");
+    guint8 trkn[8] = {0, 0, 0, 3, 0, 10, 0, 0};
+    put_item(ilst, "trkn", 0, trkn, sizeof(trkn));
+    put_int(ilst, "stik", 10, 1);
+    put_int(ilst, "tvsn", 2, 4);
+    put_int(ilst, "tves", 3, 4);
+    guint8 gnre[2] = {0, 18};
+    put_item(ilst, "gnre", 0, gnre, sizeof(gnre));
+    guint8 *cover = g_malloc0(COVER_SIZE);
+    memcpy(cover, "\x89PNG\r\n\x1a\n", 8);
+    put_item(ilst, "covr", 14, cover, COVER_SIZE);
+    g_free(cover);
+
+    GByteArray *meta = g_byte_array_new();
+    put_zeros(meta, 4);             // version/flags (meta ISO)
+    GByteArray *meta_hdlr = g_byte_array_new();
+    put_zeros(meta_hdlr, 8);
+    g_byte_array_append(meta_hdlr, (const guint8*)"mdirappl", 8);
+    put_zeros(meta_hdlr, 9);
+    put_atom(meta, "hdlr", meta_hdlr);
+    put_atom(meta, "ilst", ilst);
+
+    GByteArray *chpl = g_byte_array_new();
+    put_be32(chpl, 0x01000000);     // version 1
+    put_zeros(chpl, 4);
+    guint8 count = 2;
+    g_byte_array_append(chpl, &count, 1);
+    const char *titles[] = {"Intro", "Main"};
+    for (int i = 0; i < 2; i++) {
+        put_be64(chpl, (guint64)i * 60 * 10000000);  // Unités de 100 ns
+        guint8 length = strlen(titles[i]);
+        g_byte_array_append(chpl, &length, 1);
+        g_byte_array_append(chpl, (const guint8*)titles[i], length);
+    }
+
+    GByteArray *udta = g_byte_array_new();
+    put_atom(udta, "chpl", chpl);
+    put_atom(udta, "meta", meta);
+
+    GByteArray *moov = g_byte_array_new();
+    put_atom(moov, "mvhd", mvhd);
+    put_atom(moov, "trak", build_trak("vide", 600));
+    put_atom(moov, "trak", build_trak("soun", 48000));
+    put_atom(moov, "udta", udta);
+    return moov;
+}
+
+// mdat 64 bits creux en premier, moov à la fin du fichier
+static gboolean create_episode(const char *path, int seconds) {
+    FILE *out = fopen(path, "wb");
+    if (!out) return FALSE;
+
+    GByteArray *head = g_byte_array_new();
+    GByteArray *ftyp = g_byte_array_new();
+    g_byte_array_append(ftyp, (const guint8*)"M4V ", 4);
+    put_zeros(ftyp, 4);
+    g_byte_array_append(ftyp, (const guint8*)"isom", 4);
+    put_atom(head, "ftyp", ftyp);
+    put_be32(head, 1);
+    g_byte_array_append(head, (const guint8*)"mdat", 4);
+    put_be64(head, 16 + SPARSE_MDAT_SIZE);
+    fwrite(head->data, 1, head->len, out);
+    g_byte_array_free(head, TRUE);
+
+    fseeko(out, SPARSE_MDAT_SIZE, SEEK_CUR);
+    GByteArray *moov = g_byte_array_new();
+    put_atom(moov, "moov", build_moov(seconds));
+    gboolean ok = fwrite(moov->data, 1, moov->len, out) == moov->len;
+    g_byte_array_free(moov, TRUE);
+    return fclose(out) == 0 && ok;
+}
+
+int main(void) {
+    printf("=== Native MP4 Atom Parser Test ===\n\n");
+
+    char *dir = g_dir_make_tmp("rbipod-mp4-XXXXXX", NULL);
+    if (!dir) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+    char *path = g_build_filename(dir, "episode.m4v", NULL);
+    if (!create_episode(path, 2712)) {
+        printf("❌ Cannot create %s\n", path);
+        return 1;
+    }
+
+    int passed = 0;
+    int total = 8;
+
+    printf("📼 TV episode (2 GB mdat before moov):\n");
+    RbIpodMp4File *mp4 = rb_ipod_mp4_open(path);
+    AudioMetadata meta;
+    memset(&meta, 0, sizeof(meta));
+    gboolean filled = mp4 && rb_ipod_mp4_fill_metadata(mp4, &meta);
+    guint32 mediatype = rb_ipod_mp4_mediatype(mp4);
+    gboolean cover_in_mapping = mp4 && mp4->cover.data > mp4->map &&
+                                mp4->cover.data < mp4->map + mp4->map_size;
+    rb_ipod_mp4_close(mp4);
+
+    passed += check("duration and bitrate", filled && meta.duration_ms == 2712000 && meta.bitrate > 0);
+    passed += check("title, artist, track, genre",
+                    g_strcmp0(meta.title, "Épisode 3") == 0 && g_strcmp0(meta.artist, "Artist") == 0 &&
+                    meta.track_number == 3 && g_strcmp0(meta.genre, "Rock") == 0);
+    passed += check("TV show, season and episode",
+                    g_strcmp0(meta.tvshow, "My Show") == 0 && g_strcmp0(meta.tvepisode, "S02E03") == 0 &&
+                    meta.season_number == 2 && meta.episode_number == 3);
+    passed += check("media type TV show with video", mediatype == ITDB_MEDIATYPE_TVSHOW && meta.has_video);
+    passed += check("release date", meta.year == 2021 && meta.time_released == 1623715200);
+    passed += check("PNG cover referenced in the mapping, copied once",
+                    cover_in_mapping && meta.artwork_size == COVER_SIZE &&
+                    g_strcmp0(meta.artwork_format, "png") == 0);
+
+    gboolean chapters_ok = meta.chapters && meta.chapters->len == 2;
+    if (chapters_ok) {
+        RbIpodChapter *second = g_ptr_array_index(meta.chapters, 1);
+        chapters_ok = second->start_ms == 60000 && g_strcmp0(second->title, "Main") == 0;
+    }
+    passed += check("Nero chapters", chapters_ok);
+
+    printf("\n⏱️  Parse cost:\n");
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < PARSE_ITERATIONS; i++) {
+        AudioMetadata bench;
+        memset(&bench, 0, sizeof(bench));
+        RbIpodMp4File *file = rb_ipod_mp4_open(path);
+        rb_ipod_mp4_fill_metadata(file, &bench);
+        rb_ipod_mp4_close(file);
+        g_free(bench.title);
+        g_free(bench.artist);
+        g_free(bench.genre);
+        g_free(bench.tvshow);
+        g_free(bench.tvepisode);
+        g_free(bench.artwork_data);
+        g_free(bench.artwork_format);
+        for (guint j = 0; bench.chapters && j < bench.chapters->len; j++) {
+            RbIpodChapter *chapter = g_ptr_array_index(bench.chapters, j);
+            g_free(chapter->title);
+            g_free(chapter);
+        }
+        if (bench.chapters) g_ptr_array_free(bench.chapters, TRUE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double parse_ms = get_time_diff(start, end) * 1000 / PARSE_ITERATIONS;
+    printf("   %.3f ms/file\n", parse_ms);
+    passed += check("under 1 ms per file", parse_ms < 1.0);
+
+    unlink(path);
+    g_free(path);
+    rmdir(dir);
+    g_free(dir);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
@@ -0,0 +1,331 @@
+/* Test de l'analyse native des conteneurs audio
+ * Génère des fichiers WAV, AIFF, MP3 (CBR et Xing), AAC (ADTS) et M4A
+ * synthétiques, vérifie la durée lue dans les en-têtes et l'extraction de la
+ * pochette ID3v2 (dont un tag de 300 KB, plus grand que la fenêtre de
+ * recherche de la première trame), puis compare le coût par fichier à un
+ * lancement de ffprobe.
+ * Mesure aussi l'analyse d'un livre audio MP3 de 100 MB (parcours de toutes
+ * les trames, puis en-tête Xing + LAME avec les données gapless).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "rbipod-probe.h"
+#include "test_helpers.h"
+
+#define PROBE_ITERATIONS 2000
+#define FFPROBE_ITERATIONS 20
+#define AUDIOBOOK_SIZE (100 * 1024 * 1024)
+#define MP3_FRAME_LENGTH 417
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static gboolean write_file(const char *path, GByteArray *data) {
+    gboolean ok = g_file_set_contents(path, (const gchar*)data->data, data->len, NULL);
+    g_byte_array_free(data, TRUE);
+    return ok;
+}
+
+// Tag ID3v2.3 avec une image APIC (JPEG factice de picture_size octets)
+static void put_id3v2_picture(GByteArray *out, gsize picture_size) {
+    static const guint8 jpeg[] = {0xFF, 0xD8, 0xFF, 0xE0, 'J', 'F', 'I', 'F'};
+    GByteArray *apic = g_byte_array_new();
+    guint8 encoding = 0, type = 3;
+    g_byte_array_append(apic, &encoding, 1);
+    g_byte_array_append(apic, (const guint8*)"image/jpeg", 11);
+    g_byte_array_append(apic, &type, 1);
+    g_byte_array_append(apic, (const guint8*)"cover", 6);
+    g_byte_array_append(apic, jpeg, sizeof(jpeg));
+    put_zeros(apic, picture_size);
+
+    guint32 tag_size = 10 + apic->len + 64;
+    guint8 header[10] = {'I', 'D', '3', 3, 0, 0,
+                         (tag_size >> 21) & 0x7F, (tag_size >> 14) & 0x7F,
+                         (tag_size >> 7) & 0x7F, tag_size & 0x7F};
+    g_byte_array_append(out, header, sizeof(header));
+    g_byte_array_append(out, (const guint8*)"APIC", 4);
+    put_be32(out, apic->len);
+    put_zeros(out, 2);
+    g_byte_array_append(out, apic->data, apic->len);
+    put_zeros(out, 64); // Padding
+    g_byte_array_free(apic, TRUE);
+}
+
+static gboolean create_wav(const char *path, int seconds) {
+    GByteArray *out = g_byte_array_new();
+    guint32 byte_rate = 44100 * 4;
+    guint32 data_size = byte_rate * seconds;
+    g_byte_array_append(out, (const guint8*)"RIFF", 4);
+    put_le32(out, 36 + data_size);
+    g_byte_array_append(out, (const guint8*)"WAVEfmt ", 8);
+    put_le32(out, 16);
+    put_le16(out, 1);
+    put_le16(out, 2);
+    put_le32(out, 44100);
+    put_le32(out, byte_rate);
+    put_le16(out, 4);
+    put_le16(out, 16);
+    g_byte_array_append(out, (const guint8*)"data", 4);
+    put_le32(out, data_size);
+    put_zeros(out, data_size);
+    return write_file(path, out);
+}
+
+static gboolean create_aiff(const char *path, int seconds) {
+    GByteArray *out = g_byte_array_new();
+    guint32 frames = 44100 * seconds;
+    guint32 ssnd_size = 8 + frames * 4;
+    static const guint8 rate_44100[10] = {0x40, 0x0E, 0xAC, 0x44, 0, 0, 0, 0, 0, 0};
+    g_byte_array_append(out, (const guint8*)"FORM", 4);
+    put_be32(out, 4 + 8 + 18 + 8 + ssnd_size);
+    g_byte_array_append(out, (const guint8*)"AIFFCOMM", 8);
+    put_be32(out, 18);
+    guint8 channels[2] = {0, 2};
+    g_byte_array_append(out, channels, 2);
+    put_be32(out, frames);
+    guint8 bits[2] = {0, 16};
+    g_byte_array_append(out, bits, 2);
+    g_byte_array_append(out, rate_44100, sizeof(rate_44100));
+    g_byte_array_append(out, (const guint8*)"SSND", 4);
+    put_be32(out, ssnd_size);
+    put_zeros(out, ssnd_size);
+    return write_file(path, out);
+}
+
+// MPEG-1 Layer III, 128 kbps, 44.1 kHz: trames de 417 octets
+static gboolean create_mp3(const char *path, int seconds, gboolean xing, gsize picture_size) {
+    static const guint8 frame_header[4] = {0xFF, 0xFB, 0x90, 0x00};
+    GByteArray *out = g_byte_array_new();
+    guint32 frames = (guint32)(seconds * 44100.0 / 1152);
+    put_id3v2_picture(out, picture_size);
+
+    if (xing) {
+        // Trame Xing annonçant la durée réelle, suivie de quelques trames
+        g_byte_array_append(out, frame_header, 4);
+        put_zeros(out, 32);
+        g_byte_array_append(out, (const guint8*)"Xing", 4);
+        put_be32(out, 0x01);
+        put_be32(out, frames);
+        put_zeros(out, 417 - 4 - 32 - 12);
+        frames = 20;
+    }
+    for (guint32 i = 0; i < frames; i++) {
+        g_byte_array_append(out, frame_header, 4);
+        put_zeros(out, 417 - 4);
+    }
+    return write_file(path, out);
+}
+
+static gboolean create_adts(const char *path, int seconds) {
+    GByteArray *out = g_byte_array_new();
+    const guint32 length = 300;
+    guint32 frames = (guint32)(seconds * 44100.0 / 1024);
+    guint8 header[7] = {0xFF, 0xF1, (1 << 6) | (4 << 2), (2 << 6) | ((length >> 11) & 3),
+                        (length >> 3) & 0xFF, ((length & 7) << 5) | 0x1F, 0xFC};
+    put_id3v2_picture(out, 500);
+    for (guint32 i = 0; i < frames; i++) {
+        g_byte_array_append(out, header, sizeof(header));
+        put_zeros(out, length - sizeof(header));
+    }
+    return write_file(path, out);
+}
+
+static gboolean create_m4a(const char *path, int seconds) {
+    GByteArray *out = g_byte_array_new();
+    put_be32(out, 16);
+    g_byte_array_append(out, (const guint8*)"ftypM4A ", 8);
+    put_zeros(out, 4);
+    put_be32(out, 8 + 100000);
+    g_byte_array_append(out, (const guint8*)"mdat", 4);
+    put_zeros(out, 100000);
+    put_be32(out, 8 + 8 + 100);
+    g_byte_array_append(out, (const guint8*)"moov", 4);
+    put_be32(out, 8 + 100);
+    g_byte_array_append(out, (const guint8*)"mvhd", 4);
+    put_zeros(out, 12);                 // version/flags, creation, modification
+    put_be32(out, 600);                 // timescale
+    put_be32(out, seconds * 600);       // duration
+    put_zeros(out, 100 - 20);
+    return write_file(path, out);
+}
+
+// Livre audio MP3 de 100 MB écrit trame par trame (128 kbps, 44.1 kHz)
+static guint32 create_audiobook(const char *path, gboolean lame_header) {
+    static const guint8 frame_header[4] = {0xFF, 0xFB, 0x90, 0x00};
+    guint32 frames = AUDIOBOOK_SIZE / MP3_FRAME_LENGTH;
+    FILE *out = fopen(path, "wb");
+    if (!out) return 0;
+
+    guint8 frame[MP3_FRAME_LENGTH];
+    memset(frame, 0, sizeof(frame));
+    memcpy(frame, frame_header, sizeof(frame_header));
+
+    if (lame_header) {
+        // Trame Info: nombre de trames, octets, délai 576 et remplissage 1200
+        guint8 info[MP3_FRAME_LENGTH];
+        memcpy(info, frame, sizeof(info));
+        GByteArray *fields = g_byte_array_new();
+        g_byte_array_append(fields, (const guint8*)"Info", 4);
+        put_be32(fields, 0x03);
+        put_be32(fields, frames);
+        put_be32(fields, (frames + 1) * MP3_FRAME_LENGTH);
+        g_byte_array_append(fields, (const guint8*)"LAME3.100", 9);
+        put_zeros(fields, 12);
+        guint8 gapless[3] = {576 >> 4, ((576 & 0x0F) << 4) | (1200 >> 8), 1200 & 0xFF};
+        g_byte_array_append(fields, gapless, sizeof(gapless));
+        memcpy(info + 4 + 32, fields->data, fields->len);
+        g_byte_array_free(fields, TRUE);
+        fwrite(info, 1, sizeof(info), out);
+    }
+
+    for (guint32 i = 0; i < frames; i++) {
+        fwrite(frame, 1, sizeof(frame), out);
+    }
+    fclose(out);
+    return frames;
+}
+
+static int benchmark_audiobook(const char *dir, gboolean lame_header) {
+    char *path = g_build_filename(dir, lame_header ? "audiobook_lame.mp3" : "audiobook.mp3", NULL);
+    guint32 frames = create_audiobook(path, lame_header);
+
+    RbIpodMp3Info info;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gboolean ok = rb_ipod_probe_mp3(path, &info);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = get_time_diff(start, end) * 1000;
+
+    guint64 expected_samples = (guint64)frames * 1152 - (lame_header ? 576 + 1200 : 0);
+    guint32 expected_gapless = (frames + (lame_header ? 1 : 0) - 9) * MP3_FRAME_LENGTH;
+    gboolean passed = ok && info.frame_count == frames && info.sample_count == expected_samples &&
+                      info.bitrate == 128 && elapsed_ms < 100.0 &&
+                      (!lame_header || (info.has_gapless && info.gapless_data == expected_gapless));
+
+    printf("   %s %-16s %u frames, %u ms, %d kbps, delay %u, padding %u, gapless_data %u: %.2f ms\n",
+           passed ? "✅" : "❌", lame_header ? "Info + LAME" : "frame walk",
+           info.frame_count, info.duration_ms, info.bitrate,
+           info.encoder_delay, info.encoder_padding, info.gapless_data, elapsed_ms);
+
+    unlink(path);
+    g_free(path);
+    return passed;
+}
+
+static int check_file(const char *label, const char *path, int expected, gboolean expect_picture) {
+    int duration = 0, bitrate = 0;
+    gboolean ok = rb_ipod_probe_audio_properties(path, &duration, &bitrate);
+
+    AudioMetadata meta;
+    memset(&meta, 0, sizeof(meta));
+    gboolean picture = rb_ipod_probe_embedded_picture(path, &meta);
+    gboolean picture_ok = picture == expect_picture &&
+                          (!picture || g_strcmp0(meta.artwork_format, "jpeg") == 0);
+    g_free(meta.artwork_data);
+    g_free(meta.artwork_format);
+
+    gboolean passed = ok && ABS(duration - expected) <= 1 && picture_ok;
+    printf("   %s %-10s %4d s (expected %d), %4d kbps, picture: %s\n",
+           passed ? "✅" : "❌", label, duration, expected, bitrate, picture ? "yes" : "no");
+    return passed;
+}
+
+int main(void) {
+    printf("=== Native Container Probe Test ===\n\n");
+
+    char *dir = g_dir_make_tmp("rbipod-probe-XXXXXX", NULL);
+    if (!dir) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+
+    char *wav = g_build_filename(dir, "tone.wav", NULL);
+    char *aiff = g_build_filename(dir, "tone.aiff", NULL);
+    char *cbr = g_build_filename(dir, "cbr.mp3", NULL);
+    char *vbr = g_build_filename(dir, "vbr.mp3", NULL);
+    char *big_tag = g_build_filename(dir, "cover.mp3", NULL);
+    char *aac = g_build_filename(dir, "episode.aac", NULL);
+    char *m4a = g_build_filename(dir, "track.m4a", NULL);
+
+    create_wav(wav, 10);
+    create_aiff(aiff, 7);
+    create_mp3(cbr, 60, FALSE, 500);
+    create_mp3(vbr, 240, TRUE, 500);
+    create_mp3(big_tag, 90, FALSE, 300 * 1024);   // Tag plus grand que la fenêtre de synchro
+    create_adts(aac, 30);
+    create_m4a(m4a, 185);
+
+    int passed = 0;
+    int total = 10;
+
+    printf("🔍 Durations and pictures:\n");
+    passed += check_file("WAV", wav, 10, FALSE);
+    passed += check_file("AIFF", aiff, 7, FALSE);
+    passed += check_file("MP3 CBR", cbr, 60, TRUE);
+    passed += check_file("MP3 Xing", vbr, 240, TRUE);
+    passed += check_file("MP3 300KB", big_tag, 90, TRUE);
+    passed += check_file("AAC ADTS", aac, 30, TRUE);
+    passed += check_file("M4A", m4a, 185, FALSE);
+
+    printf("\n📚 100 MB audiobook MP3:\n");
+    passed += benchmark_audiobook(dir, FALSE);
+    passed += benchmark_audiobook(dir, TRUE);
+
+    // Coût par fichier: analyse native contre un processus ffprobe
+    printf("\n⏱️  Cost per file:\n");
+    struct timespec start, end;
+    int duration, bitrate;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < PROBE_ITERATIONS; i++) {
+        rb_ipod_probe_audio_properties(i % 2 ? cbr : m4a, &duration, &bitrate);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double native_ms = get_time_diff(start, end) * 1000 / PROBE_ITERATIONS;
+    printf("   Native probe: %.3f ms/file\n", native_ms);
+    passed += native_ms < 5.0;
+
+    char *ffprobe = g_find_program_in_path("ffprobe");
+    if (ffprobe) {
+        char *command = g_strdup_printf("%s -v quiet -show_entries format=duration -of csv=p=0 \"%s\" > /dev/null",
+                                        ffprobe, cbr);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < FFPROBE_ITERATIONS; i++) {
+            if (system(command) != 0) break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double spawn_ms = get_time_diff(start, end) * 1000 / FFPROBE_ITERATIONS;
+        printf("   ffprobe spawn: %.3f ms/file (%.0fx slower)\n", spawn_ms, spawn_ms / native_ms);
+        g_free(command);
+        g_free(ffprobe);
+    } else {
+        printf("   ffprobe not installed, spawn cost not measured\n");
+    }
+
+    const char *files[] = {wav, aiff, cbr, vbr, big_tag, aac, m4a};
+    for (gsize i = 0; i < G_N_ELEMENTS(files); i++) {
+        unlink(files[i]);
+        g_free((char*)files[i]);
+    }
+    rmdir(dir);
+    g_free(dir);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
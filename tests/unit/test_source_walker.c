@@ -0,0 +1,197 @@
+/* Test du parcours de l'arborescence source
+ * Vérifie que le manifeste produit en une seule passe contient exactement
+ * les fichiers audio supportés (tailles, tri, boucles de liens symboliques),
+ * qu'une interruption est signalée comme telle, et compare son coût à
+ * l'ancien double parcours compter-puis-synchroniser.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "rbipod-walker.h"
+#include "rbipod-utils.h"
+#include "test_helpers.h"
+
+#define NUM_ARTISTS 40
+#define ALBUMS_PER_ARTIST 5
+#define TRACKS_PER_ALBUM 12
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void create_file(const char *path, size_t size) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) return;
+    if (size > 0 && ftruncate(fd, (off_t)size) != 0) {
+        perror("ftruncate");
+    }
+    close(fd);
+}
+
+// Bibliothèque factice: Artist/Album/NN.mp3 + fichiers non audio
+static int create_fake_library(const char *root) {
+    int expected = 0;
+
+    for (int a = 0; a < NUM_ARTISTS; a++) {
+        for (int b = 0; b < ALBUMS_PER_ARTIST; b++) {
+            char album[1024];
+            snprintf(album, sizeof(album), "%s/Artist %02d/Album %d", root, a, b);
+            g_mkdir_with_parents(album, 0755);
+
+            for (int t = 0; t < TRACKS_PER_ALBUM; t++) {
+                char path[1200];
+                snprintf(path, sizeof(path), "%s/%02d.%s", album, t + 1, (t % 3 == 0) ? "M4A" : "mp3");
+                create_file(path, 1000 + t);
+                expected++;
+            }
+
+            char path[1200];
+            snprintf(path, sizeof(path), "%s/cover.jpg", album);
+            create_file(path, 10);
+            snprintf(path, sizeof(path), "%s/.hidden.mp3", album);
+            create_file(path, 10);
+        }
+    }
+
+    // Boucle de liens symboliques: ne doit pas être suivie indéfiniment
+    char link_path[1024];
+    snprintf(link_path, sizeof(link_path), "%s/Artist 00/loop", root);
+    if (symlink("..", link_path) != 0) {
+        perror("symlink");
+    }
+
+    return expected;
+}
+
+// Ancien comportement: stat() sur chaque entrée, deux fois
+static int legacy_count(const char *dir_path) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) return 0;
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || strcmp(entry->d_name, "loop") == 0) continue;
+
+        char full_path[1024];
+        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
+
+        struct stat file_stat;
+        if (stat(full_path, &file_stat) != 0) continue;
+
+        if (S_ISDIR(file_stat.st_mode)) {
+            count += legacy_count(full_path);
+        } else if (S_ISREG(file_stat.st_mode) &&
+                   rb_ipod_classify_extension(entry->d_name) != RB_IPOD_EXT_UNSUPPORTED) {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+int main(void) {
+    printf("=== Source Walker Tests ===\n\n");
+
+    int passed = 0;
+    int total = 0;
+
+    char *root = g_dir_make_tmp("rbipod-walk-XXXXXX", NULL);
+    if (!root) {
+        printf("❌ Cannot create temporary directory\n");
+        return 1;
+    }
+
+    int expected = create_fake_library(root);
+    printf("📁 Fake library: %d audio files\n\n", expected);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    RbIpodWalkStatus status;
+    RbIpodManifest *manifest = rb_ipod_walk_directory(root, 0, &status);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double walk_time = get_time_diff(start, end);
+
+    // Test 1: nombre de fichiers
+    total++;
+    if (manifest && status == RB_IPOD_WALK_OK && (int)manifest->entries->len == expected) {
+        printf("✓ Manifest contains %u files\n", manifest->entries->len);
+        passed++;
+    } else {
+        printf("❌ Expected %d files, got %u\n", expected, manifest ? manifest->entries->len : 0);
+    }
+
+    // Test 2: tri par chemin, tailles et classes d'extension
+    total++;
+    gboolean consistent = manifest != NULL;
+    for (guint i = 0; manifest && i < manifest->entries->len; i++) {
+        RbIpodManifestEntry *entry = g_ptr_array_index(manifest->entries, i);
+        struct stat st;
+        if (stat(entry->path, &st) != 0 || st.st_size != entry->size ||
+            (guint64)st.st_ino != entry->inode || entry->ext_class == RB_IPOD_EXT_UNSUPPORTED) {
+            consistent = FALSE;
+        }
+        if (i > 0) {
+            RbIpodManifestEntry *prev = g_ptr_array_index(manifest->entries, i - 1);
+            if (strcmp(prev->path, entry->path) >= 0) consistent = FALSE;
+        }
+    }
+    if (consistent) {
+        printf("✓ Entries sorted, sizes and inodes match\n");
+        passed++;
+    } else {
+        printf("❌ Manifest entries inconsistent with filesystem\n");
+    }
+
+    // Test 3: une interruption (Ctrl+C) se distingue d'un dossier vide
+    total++;
+    g_sync_ctx.cancellation_requested = TRUE;
+    RbIpodManifest *cancelled = rb_ipod_walk_directory(root, 0, &status);
+    g_sync_ctx.cancellation_requested = FALSE;
+    RbIpodWalkStatus missing_status;
+    char *missing = g_build_filename(root, "missing", NULL);
+    RbIpodManifest *not_found = rb_ipod_walk_directory(missing, 0, &missing_status);
+    g_free(missing);
+    if (!cancelled && status == RB_IPOD_WALK_CANCELLED &&
+        !not_found && missing_status == RB_IPOD_WALK_NOT_A_DIRECTORY) {
+        printf("✓ Cancelled walk reported as cancelled\n");
+        passed++;
+    } else {
+        printf("❌ Cancelled walk not reported as cancelled (status %d)\n", status);
+    }
+
+    // Comparaison avec l'ancien double parcours (comptage + synchronisation)
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int legacy = legacy_count(root);
+    legacy += legacy_count(root);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double legacy_time = get_time_diff(start, end);
+
+    printf("\n⏱️  Single parallel walk: %.2f ms\n", walk_time * 1000);
+    printf("⏱️  Legacy count + sync traversal: %.2f ms (%d entries visited)\n", legacy_time * 1000, legacy);
+
+    rb_ipod_manifest_free(manifest);
+    remove_tree(root);
+    g_free(root);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
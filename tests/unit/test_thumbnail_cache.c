@@ -0,0 +1,181 @@
+/* Test du cache de vignettes côté hôte
+ * Prépare une grande pochette JPEG (décodage réduit), la stocke dans un
+ * répertoire de cache temporaire puis vérifie la relecture sans décodage,
+ * le rejet d'une entrée corrompue et l'éviction LRU sous la limite de taille.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "rbipod-thumbcache.h"
+#include "rbipod-artcache.h"
+#include "test_helpers.h"
+
+#define SOURCE_DIMENSION 3000
+#define TARGET_DIMENSION 320
+#define ITERATIONS 20
+#define EVICTION_ENTRIES 10
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static gchar* create_jpeg_cover(gsize *size) {
+    GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, SOURCE_DIMENSION, SOURCE_DIMENSION);
+    guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    for (int y = 0; y < SOURCE_DIMENSION; y++) {
+        for (int x = 0; x < SOURCE_DIMENSION; x++) {
+            guchar *p = pixels + y * rowstride + x * 3;
+            p[0] = x & 0xFF;
+            p[1] = y & 0xFF;
+            p[2] = (x + y) & 0xFF;
+        }
+    }
+
+    gchar *data = NULL;
+    gdk_pixbuf_save_to_buffer(pixbuf, &data, size, "jpeg", NULL, "quality", "90", NULL);
+    g_object_unref(pixbuf);
+    return data;
+}
+
+static gboolean same_pixels(GdkPixbuf *a, GdkPixbuf *b) {
+    if (!a || !b) return FALSE;
+    int width = gdk_pixbuf_get_width(a);
+    int height = gdk_pixbuf_get_height(a);
+    if (width != gdk_pixbuf_get_width(b) || height != gdk_pixbuf_get_height(b) ||
+        gdk_pixbuf_get_n_channels(a) != gdk_pixbuf_get_n_channels(b)) {
+        return FALSE;
+    }
+    gsize row = (gsize)width * gdk_pixbuf_get_n_channels(a);
+    for (int y = 0; y < height; y++) {
+        if (memcmp(gdk_pixbuf_read_pixels(a) + y * gdk_pixbuf_get_rowstride(a),
+                   gdk_pixbuf_read_pixels(b) + y * gdk_pixbuf_get_rowstride(b), row) != 0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static int count_entries(const char *dir) {
+    GDir *handle = g_dir_open(dir, 0, NULL);
+    if (!handle) return 0;
+    int count = 0;
+    while (g_dir_read_name(handle)) count++;
+    g_dir_close(handle);
+    return count;
+}
+
+int main(void) {
+    printf("=== Host Thumbnail Cache Test ===\n\n");
+
+    char *base_dir = g_dir_make_tmp("rbipod-thumbs-XXXXXX", NULL);
+    char *format_dir = g_build_filename(base_dir, "gen11-320x320", NULL);
+    gsize cover_size = 0;
+    gchar *cover = create_jpeg_cover(&cover_size);
+    if (!base_dir || !cover) {
+        printf("❌ Cannot prepare test data\n");
+        return 1;
+    }
+    printf("🖼️  %dx%d JPEG cover (%zu bytes) -> %dx%d\n\n",
+           SOURCE_DIMENSION, SOURCE_DIMENSION, cover_size, TARGET_DIMENSION, TARGET_DIMENSION);
+
+    int passed = 0;
+    int total = 4;
+    struct timespec start, end;
+
+    RbIpodThumbnailCache *cache = rb_ipod_thumbnail_cache_open(base_dir, "gen11-320x320");
+    GdkPixbuf *prepared = rb_ipod_artwork_decode_scaled((const guchar*)cover, cover_size,
+                                                        TARGET_DIMENSION, TARGET_DIMENSION);
+    rb_ipod_thumbnail_cache_store(cache, 1, cover_size, prepared);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ITERATIONS; i++) {
+        GdkPixbuf *pixbuf = rb_ipod_artwork_decode_scaled((const guchar*)cover, cover_size,
+                                                          TARGET_DIMENSION, TARGET_DIMENSION);
+        if (pixbuf) g_object_unref(pixbuf);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double decode_time = get_time_diff(start, end) / ITERATIONS;
+
+    GdkPixbuf *loaded = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (loaded) g_object_unref(loaded);
+        loaded = rb_ipod_thumbnail_cache_lookup(cache, 1, cover_size);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double load_time = get_time_diff(start, end) / ITERATIONS;
+
+    printf("⏱️  Per cover:\n");
+    printf("   Scaled decode: %8.3f ms\n", decode_time * 1000);
+    printf("   Cache load:    %8.3f ms (%.1fx)\n\n", load_time * 1000, decode_time / load_time);
+
+    passed += check("cached pixels identical to the prepared cover", same_pixels(prepared, loaded));
+    passed += check("warm load faster than decoding", load_time < decode_time);
+
+    // Entrée tronquée: rejetée et supprimée
+    GDir *handle = g_dir_open(format_dir, 0, NULL);
+    char *entry = g_build_filename(format_dir, g_dir_read_name(handle), NULL);
+    g_dir_close(handle);
+    truncate(entry, 100);
+    GdkPixbuf *corrupt = rb_ipod_thumbnail_cache_lookup(cache, 1, cover_size);
+    passed += check("corrupt entry rejected and removed", !corrupt && !g_file_test(entry, G_FILE_TEST_EXISTS));
+    g_free(entry);
+
+    // Limite pour 3 entrées: la plus ancienne part, l'entrée relue reste
+    for (int i = 0; i < EVICTION_ENTRIES; i++) {
+        rb_ipod_thumbnail_cache_store(cache, 100 + i, cover_size, prepared);
+        g_usleep(2000);
+    }
+    GdkPixbuf *touched = rb_ipod_thumbnail_cache_lookup(cache, 100, cover_size);
+    gint64 entry_bytes = 32 + (gint64)gdk_pixbuf_get_rowstride(prepared) * gdk_pixbuf_get_height(prepared);
+    rb_ipod_thumbnail_cache_set_max_bytes(cache, entry_bytes * 3 + entry_bytes / 2);
+    rb_ipod_thumbnail_cache_free(cache);
+
+    cache = rb_ipod_thumbnail_cache_open(base_dir, "gen11-320x320");
+    GdkPixbuf *kept = rb_ipod_thumbnail_cache_lookup(cache, 100, cover_size);
+    GdkPixbuf *evicted = rb_ipod_thumbnail_cache_lookup(cache, 101, cover_size);
+    int remaining = count_entries(format_dir);
+    passed += check("LRU eviction within the size limit keeps recently used entries",
+                    touched && kept && !evicted && remaining == 3);
+    rb_ipod_thumbnail_cache_free(cache);
+
+    if (touched) g_object_unref(touched);
+    if (kept) g_object_unref(kept);
+    if (loaded) g_object_unref(loaded);
+    g_object_unref(prepared);
+    g_free(cover);
+
+    handle = g_dir_open(format_dir, 0, NULL);
+    const char *name;
+    while (handle && (name = g_dir_read_name(handle)) != NULL) {
+        char *path = g_build_filename(format_dir, name, NULL);
+        g_unlink(path);
+        g_free(path);
+    }
+    if (handle) g_dir_close(handle);
+    g_rmdir(format_dir);
+    g_rmdir(base_dir);
+    g_free(format_dir);
+    g_free(base_dir);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}
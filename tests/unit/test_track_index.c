@@ -0,0 +1,168 @@
+/* Test des index en mémoire sur la base iTunesDB chargée
+ * Construit une base de 60 000 pistes (liste principale, liste Podcasts et
+ * une liste utilisateur) sans iPod, puis vérifie que chaque recherche (chemin,
+ * dbid, étiquettes, épisode) trouve la bonne piste, que l'appartenance aux
+ * listes de lecture est exacte et que les index suivent les retraits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <gpod/itdb.h>
+
+#include "rbipod-trackindex.h"
+#include "test_helpers.h"
+
+#define TRACK_COUNT 60000
+#define PODCAST_EVERY 10
+#define USER_PLAYLIST_EVERY 3
+
+double get_time_diff(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static char* track_path(int n) {
+    return g_strdup_printf(":iPod_Control:Music:F%02d:T%05d.mp3", n % 50, n);
+}
+
+static char* episode_id(int n) {
+    return g_strdup_printf("episode-%05d", n);
+}
+
+// Insertion en tête: la construction reste linéaire, l'ordre n'importe pas ici
+static Itdb_iTunesDB* build_database(Itdb_Playlist **user_pl) {
+    Itdb_iTunesDB *itdb = itdb_new();
+    Itdb_Playlist *master = itdb_playlist_new("iPod", FALSE);
+    itdb_playlist_set_mpl(master);
+    itdb_playlist_add(itdb, master, -1);
+    Itdb_Playlist *podcasts = itdb_playlist_new("Podcasts", FALSE);
+    itdb_playlist_set_podcasts(podcasts);
+    itdb_playlist_add(itdb, podcasts, -1);
+    *user_pl = itdb_playlist_new("Favorites", FALSE);
+    itdb_playlist_add(itdb, *user_pl, -1);
+
+    for (int n = 0; n < TRACK_COUNT; n++) {
+        Itdb_Track *track = itdb_track_new();
+        track->title = g_strdup_printf("Track %05d", n);
+        track->artist = g_strdup_printf("Artist %d", n % 500);
+        track->album = g_strdup_printf("Album %d", n % 5000);
+        track->track_nr = n % 12 + 1;
+        track->ipod_path = track_path(n);
+        track->dbid = 0x1000000ULL + n;
+        track->size = 4000000 + n;
+        track->mediatype = ITDB_MEDIATYPE_AUDIO;
+        if (n % PODCAST_EVERY == 0) {
+            track->mediatype = ITDB_MEDIATYPE_PODCAST;
+            track->grouping = episode_id(n);
+        }
+        itdb_track_add(itdb, track, 0);
+        itdb_playlist_add_track(master, track, 0);
+        if (track->mediatype == ITDB_MEDIATYPE_PODCAST) itdb_playlist_add_track(podcasts, track, 0);
+        if (n % USER_PLAYLIST_EVERY == 0) itdb_playlist_add_track(*user_pl, track, 0);
+    }
+    return itdb;
+}
+
+int main(void) {
+    printf("=== Track Index Test ===\n\n");
+
+    Itdb_Playlist *user_pl = NULL;
+    Itdb_iTunesDB *itdb = build_database(&user_pl);
+
+    int passed = 0;
+    int total = 6;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    RbIpodTrackIndex *index = rb_ipod_track_index_new(itdb);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double build_time = get_time_diff(start, end);
+
+    // Une recherche de chaque sorte par piste
+    gboolean all_found = TRUE;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int n = 0; n < TRACK_COUNT && all_found; n++) {
+        char *path = g_strdup_printf("/iPod_Control/Music/F%02d/T%05d.mp3", n % 50, n);
+        char *title = g_strdup_printf("Track %05d", n);
+        char *artist = g_strdup_printf("Artist %d", n % 500);
+        char *album = g_strdup_printf("Album %d", n % 5000);
+        Itdb_Track *track = rb_ipod_track_index_lookup_path(index, path);
+        all_found = track && track->dbid == 0x1000000ULL + n &&
+                    rb_ipod_track_index_lookup_dbid(index, track->dbid) == track &&
+                    rb_ipod_track_index_lookup_tags(index, artist, album, title, n % 12 + 1) == track;
+        g_free(path);
+        g_free(title);
+        g_free(artist);
+        g_free(album);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double lookup_time = get_time_diff(start, end);
+
+    printf("📇 %d tracks, 3 playlists\n", TRACK_COUNT);
+    printf("   Index build:           %8.3f ms\n", build_time * 1000);
+    printf("   %d x 3 lookups:     %8.3f ms (%.3f µs per track)\n\n", TRACK_COUNT,
+           lookup_time * 1000, lookup_time * 1e6 / TRACK_COUNT);
+
+    passed += check("path, dbid and tag lookups resolve every track", all_found);
+
+    char *episode = episode_id(PODCAST_EVERY * USER_PLAYLIST_EVERY);
+    Itdb_Track *podcast = rb_ipod_track_index_lookup_episode(index, episode);
+    g_free(episode);
+    passed += check("podcast episode lookup and per-type counts",
+                    podcast && podcast->mediatype == ITDB_MEDIATYPE_PODCAST &&
+                    rb_ipod_track_index_count(index) == TRACK_COUNT &&
+                    rb_ipod_track_index_count_mediatype(index, ITDB_MEDIATYPE_PODCAST) == TRACK_COUNT / PODCAST_EVERY);
+
+    passed += check("podcast in the user playlist belongs to exactly three playlists",
+                    podcast && g_list_length(rb_ipod_track_index_playlists(index, podcast)) == 3 &&
+                    g_list_find(rb_ipod_track_index_playlists(index, podcast), user_pl));
+
+    // Retrait par le même chemin que remove_track_from_ipod()
+    char *removed_path = g_strdup(podcast->ipod_path);
+    guint64 removed_dbid = podcast->dbid;
+    for (GList *pl = rb_ipod_track_index_playlists(index, podcast); pl; pl = pl->next) {
+        itdb_playlist_remove_track((Itdb_Playlist*)pl->data, podcast);
+    }
+    rb_ipod_track_index_remove_track(index, podcast);
+    itdb_track_remove(podcast);
+    passed += check("removed track drops out of every index",
+                    !rb_ipod_track_index_lookup_path(index, removed_path) &&
+                    !rb_ipod_track_index_lookup_dbid(index, removed_dbid) &&
+                    rb_ipod_track_index_count(index) == TRACK_COUNT - 1 &&
+                    itdb_playlist_tracks_number(user_pl) == (TRACK_COUNT + USER_PLAYLIST_EVERY - 1) / USER_PLAYLIST_EVERY - 1);
+    g_free(removed_path);
+
+    // Piste ajoutée sans dbid: indexée une fois itdb_write() passé
+    Itdb_Track *added = itdb_track_new();
+    added->title = g_strdup("Fresh");
+    added->ipod_path = g_strdup(":iPod_Control:Music:F00:FRESH.mp3");
+    itdb_track_add(itdb, added, 0);
+    rb_ipod_track_index_add_track(index, added);
+    added->dbid = 0x7777;
+    gboolean before_commit = rb_ipod_track_index_lookup_dbid(index, 0x7777) == NULL;
+    rb_ipod_track_index_commit(index);
+    passed += check("dbid assigned by a save is indexed on commit",
+                    before_commit && rb_ipod_track_index_lookup_dbid(index, 0x7777) == added);
+
+    Itdb_Track *first = rb_ipod_track_index_lookup_path(index, "/iPod_Control/Music/F00/T00000.mp3");
+    rb_ipod_track_index_remove_playlist(index, user_pl);
+    itdb_playlist_remove(user_pl);
+    passed += check("removed playlist drops out of memberships",
+                    first && g_list_length(rb_ipod_track_index_playlists(index, first)) == 2);
+
+    rb_ipod_track_index_free(index);
+    itdb_free(itdb);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", passed, total);
+
+    if (passed == total) {
+        printf("🎉 All tests passed!\n");
+        return 0;
+    } else {
+        printf("❌ Some tests failed.\n");
+        return 1;
+    }
+}